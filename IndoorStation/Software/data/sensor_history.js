@@ -180,9 +180,11 @@ function getFromToDates()
 	return { dateFrom, dateTo };
 }
 
-var previous_response_length = 0;
-var currentSensorIndex = 0;
-function loadData()
+const GET_DATA_MULTI_BINARY_RECORD_SIZE = 9;	// timestamp (uint32), battery voltage in mV (uint16), pin state (uint8), number of send loops (uint8), sensor index (uint8), all little-endian
+const GET_DATA_MAX_RETRIES = 5;				// Number of retries if the indoor station is busy with other history requests (503)
+const GET_DATA_MAX_POINTS = 4000;			// Approximate number of points per sensor. Longer histories are downsampled by the indoor station (all pin state changes are kept).
+
+async function loadData()
 {
 	let urlPartDates = "";
 	const dates = getFromToDates();
@@ -207,80 +209,91 @@ function loadData()
 	chart_accu.showLoading("Lade...");
 	chart_pinState.showLoading("Lade...");
 
-	var xhr = new XMLHttpRequest();
-	currentSensorIndex = 0;
-	previous_response_length = 0;
-	xhr.open("GET", "/get_data?sensorIndex=" + currentSensorIndex + urlPartDates, true);
-	xhr.onprogress = function ()
+	try
+	{
+		await loadSensorData(urlPartDates);
+		console.log("completed: all sensors");
+	}
+	catch(error)
 	{
-		var chunk = xhr.responseText.slice(previous_response_length);
-		previous_response_length = xhr.responseText.length;
+		console.error("Error loading data:", error);
+	}
 
-		// Use .some() instead of .forEach() to be able to break the loop
-		chunk.split("}{").some(function(element)
-		{
-			var originalElementLength = element.length;
-			if(!element.startsWith("{")) { element = "{" + element; }
-			if(!element.endsWith("}")) { element = element + "}"; }
-			console.log("element = " + element);
+	chart_accu.hideLoading();
+	chart_pinState.hideLoading();
 
-			try
-			{
-				var obj = JSON.parse(element);
-				if(!("time" in obj) || !("batP" in obj) || !("pin" in obj))
-				{
-					// property in object is missing. Wait for the rest of the message
-					console.log("not all properties found in object.");
-					throw new Error("Not all properties found");
-				}
-				var x = obj.time * 1000;
-				// Check if timestamp is < 01.01.2000 --> skip this point
-				if (x < Date.UTC(2000, 0, 1))
-				{
-    				console.log("invalid timestamp (earlier than 01.01.2000), skip this element:", obj);
-					return false; // Return false to "continue" the "forEach" loop (.some(...))
-				}
+	// Click the "All" button (index 4 in the rangeSelector) after loading to make sure, everything is shown
+	// https://www.highcharts.com/forum/viewtopic.php?t=27631
+	chart_accu.rangeSelector.clickButton(4, { type:'all' }, true);
+	chart_pinState.rangeSelector.clickButton(4, { type:'all' }, true);
+}
 
-				chart_accu.series[currentSensorIndex].addPoint([x, obj.batP], false, false, false);
-				chart_pinState.series[currentSensorIndex].addPoint([x, obj.pin ? 1 : 0], false, false, false);
-				// Return false to "continue" the "forEach" loop (.some(...))
-				return false;
-			}
-			catch(error)
-			{
-				console.log("uncomplete element received. Rewind position and wait for the rest.")
-				// Rewind the chunk position to the beginning of this element (uncomplete parts received)
-				previous_response_length -= (originalElementLength + 1);
-				// Return true to break the "forEach" loop (.some(...))
-				return true;
-			}
-		});
-		// redraw the charts after each chunk of data
-		chart_accu.redraw();
-		chart_pinState.redraw();
+// Load the histories of all sensors with one request in the binary format (merged by time) and add the records to the charts while the chunks arrive
+async function loadSensorData(urlPartDates)
+{
+	const sensorIndices = [];
+	for(let sensorIndex = 0; sensorIndex < Num_Sensors; sensorIndex++)
+	{
+		sensorIndices.push(sensorIndex);
+	}
+	const url = "/get_data_multi?sensors=" + sensorIndices.join(",") + urlPartDates + "&format=bin&maxPoints=" + GET_DATA_MAX_POINTS;
+	let response = await fetch(url);
+	// All history streams of the indoor station are used (e.g. by other open pages) -> retry after the requested time
+	for(let retry = 0; response.status == 503 && retry < GET_DATA_MAX_RETRIES; retry++)
+	{
+		const retryAfter_s = parseInt(response.headers.get("Retry-After")) || 1;
+		await new Promise(resolve => setTimeout(resolve, retryAfter_s * 1000));
+		response = await fetch(url);
+	}
+	if(!response.ok || !(response.headers.get("Content-Type") || "").startsWith("application/octet-stream"))
+	{
+		console.log("no data: " + await response.text());
+		return;
 	}
-	xhr.addEventListener("load", function(e)
+
+	const reader = response.body.getReader();
+	let pendingBytes = new Uint8Array(0);		// Incomplete record at the end of the last chunk
+	while(true)
 	{
-		console.log("completed: sensor #" + currentSensorIndex);
-		currentSensorIndex++;
-		if (currentSensorIndex < Num_Sensors)
+		const { done, value } = await reader.read();
+		if(done)
+		{
+			break;
+		}
+
+		// Continue the incomplete record of the last chunk
+		let bytes = value;
+		if(pendingBytes.length > 0)
 		{
-			previous_response_length = 0;
-			xhr.open("GET", "/get_data?sensorIndex=" + currentSensorIndex + urlPartDates, true);
-			xhr.send();
+			bytes = new Uint8Array(pendingBytes.length + value.length);
+			bytes.set(pendingBytes);
+			bytes.set(value, pendingBytes.length);
 		}
-		else
+
+		const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+		const numberRecords = Math.floor(bytes.length / GET_DATA_MULTI_BINARY_RECORD_SIZE);
+		for(let i = 0; i < numberRecords; i++)
 		{
-			chart_accu.hideLoading();
-			chart_pinState.hideLoading();
+			const offset = i * GET_DATA_MULTI_BINARY_RECORD_SIZE;
+			const x = view.getUint32(offset, true) * 1000;
+			// Check if timestamp is < 01.01.2000 --> skip this point
+			if (x < Date.UTC(2000, 0, 1))
+			{
+				continue;
+			}
+			const batP = battery_voltageToPercent(view.getUint16(offset + 4, true));
+			const pin = view.getUint8(offset + 6);
+			const sensorIndex = view.getUint8(offset + 8);
 
-			// Click the "All" button (index 4 in the rangeSelector) after loading to make sure, everything is shown
-			// https://www.highcharts.com/forum/viewtopic.php?t=27631
-			chart_accu.rangeSelector.clickButton(4, { type:'all' }, true);
-			chart_pinState.rangeSelector.clickButton(4, { type:'all' }, true);
+			chart_accu.series[sensorIndex].addPoint([x, batP], false, false, false);
+			chart_pinState.series[sensorIndex].addPoint([x, pin ? 1 : 0], false, false, false);
 		}
-	});
-	xhr.send();
+		pendingBytes = bytes.slice(numberRecords * GET_DATA_MULTI_BINARY_RECORD_SIZE);
+
+		// redraw the charts after each chunk of data
+		chart_accu.redraw();
+		chart_pinState.redraw();
+	}
 }
 
 var style = getComputedStyle(document.body);
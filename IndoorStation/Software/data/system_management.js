@@ -61,6 +61,13 @@ function bodyLoaded()
 			const isPairedElement = templateClone.querySelector('#sensor_X_isPaired');
 			const useEncryptionElement = templateClone.querySelector('#sensor_X_useEncryption');
 			const macElement = templateClone.querySelector('#sensor_X_mac_display');
+			const retentionMaxAgeElement = templateClone.querySelector('#sensor_X_retention_max_age');
+			const retentionMaxSizeElement = templateClone.querySelector('#sensor_X_retention_max_size');
+			const historySizeElement = templateClone.querySelector('#sensor_X_history_size');
+			const samplingModeElement = templateClone.querySelector('#sensor_X_sampling_mode');
+			const samplingThresholdsElement = templateClone.querySelector('#sensor_X_sampling_thresholds');
+			const samplingVoltageDeltaElement = templateClone.querySelector('#sensor_X_sampling_voltage_delta');
+			const samplingIntervalElement = templateClone.querySelector('#sensor_X_sampling_interval');
 			
 			titleElement.id = `sensor_${sensor.index}_title`;
 			nameElement.id = `sensor_${sensor.index}_name`;
@@ -73,6 +80,17 @@ function bodyLoaded()
 			isPairedElement.id = `sensor_${sensor.index}_isPaired`;
 			useEncryptionElement.id = `sensor_${sensor.index}_useEncryption`;
 			macElement.id = `sensor_${sensor.index}_mac_display`;
+			retentionMaxAgeElement.id = `sensor_${sensor.index}_retention_max_age`;
+			retentionMaxSizeElement.id = `sensor_${sensor.index}_retention_max_size`;
+			historySizeElement.id = `sensor_${sensor.index}_history_size`;
+			templateClone.querySelector('label[for="sensor_X_retention_max_age"]').htmlFor = retentionMaxAgeElement.id;
+			templateClone.querySelector('label[for="sensor_X_retention_max_size"]').htmlFor = retentionMaxSizeElement.id;
+			samplingModeElement.id = `sensor_${sensor.index}_sampling_mode`;
+			samplingThresholdsElement.id = `sensor_${sensor.index}_sampling_thresholds`;
+			samplingVoltageDeltaElement.id = `sensor_${sensor.index}_sampling_voltage_delta`;
+			samplingIntervalElement.id = `sensor_${sensor.index}_sampling_interval`;
+			templateClone.querySelector('label[for="sensor_X_sampling_voltage_delta"]').htmlFor = samplingVoltageDeltaElement.id;
+			templateClone.querySelector('label[for="sensor_X_sampling_interval"]').htmlFor = samplingIntervalElement.id;
 			
 			// Update form action sensorIndex
 			const nameForm = templateClone.querySelector('form[action="/set_sensor_name"]');
@@ -81,6 +99,12 @@ function bodyLoaded()
 			const modeForm = templateClone.querySelector('form[action="/set_sensor_mode"]');
 			modeForm.querySelector('input[name="sensorIndex"]').value = sensor.index;
 			
+			const retentionForm = templateClone.querySelector('form[action="/set_retention_policy"]');
+			retentionForm.querySelector('input[name="sensorIndex"]').value = sensor.index;
+
+			const samplingForm = templateClone.querySelector('form[action="/set_sampling_policy"]');
+			samplingForm.querySelector('input[name="sensorIndex"]').value = sensor.index;
+
 			const removeDataForm = templateClone.querySelector('form[action="/remove_data"]');
 			removeDataForm.querySelector('input[name="sensorIndex"]').value = sensor.index;
 
@@ -91,6 +115,9 @@ function bodyLoaded()
 			const downloadForm = templateClone.querySelector('form[action="/download_data"]');
 			downloadForm.querySelector('input[name="sensorIndex"]').value = sensor.index;
 			const downloadButton = downloadForm.querySelector('button');
+
+			const exportForm = templateClone.querySelector('form[action="/export"]');
+			exportForm.querySelector('input[name="sensorIndex"]').value = sensor.index;
 			
 			// Upload form handling
 			const uploadForm = templateClone.querySelector('form[action="/upload_data"]');
@@ -120,6 +147,15 @@ function bodyLoaded()
 
 			macElement.textContent = sensor.mac;
 
+			retentionMaxAgeElement.value = sensor.retentionMaxAge;
+			retentionMaxSizeElement.value = sensor.retentionMaxSize;
+			historySizeElement.textContent = (sensor.historySize / 1024).toFixed(1);
+
+			samplingModeElement.value = sensor.samplingMode;
+			samplingVoltageDeltaElement.value = sensor.samplingVoltageDelta;
+			samplingIntervalElement.value = sensor.samplingInterval;
+			samplingThresholdsElement.style.display = (Number(sensor.samplingMode) === 2) ? 'grid' : 'none';	// The thresholds are only used by "Zustandswechsel und Änderungen"
+
 			// Disable download button if no messages
 			downloadButton.disabled = Number(sensor.numMessages) === 0;
 			
@@ -141,6 +177,14 @@ function bodyLoaded()
 		fetch('/set_battery_empty_threshold?threshold=' + batterySlider.value)
 	};
 
+	// Add events for the retention watermarks (both values are sent, the indoor station checks that high > low)
+	const highWatermarkInput = document.getElementById('retention_high_watermark');
+	const lowWatermarkInput = document.getElementById('retention_low_watermark');
+	highWatermarkInput.onchange = lowWatermarkInput.onchange = function(e)
+	{
+		fetch('/set_retention_watermarks?high=' + highWatermarkInput.value + '&low=' + lowWatermarkInput.value)
+	};
+
 	// Load indoor station info
 	fetch('/get_indoor_station_info')
 	.then(response => response.json())
@@ -153,6 +197,16 @@ function bodyLoaded()
 			batterySlider.value = data.batteryEmptyThreshold;
 			batteryValDisplay.innerText = data.batteryEmptyThreshold;
 		}
+		if(data.retentionHighWatermark !== undefined)
+		{
+			highWatermarkInput.value = data.retentionHighWatermark;
+			lowWatermarkInput.value = data.retentionLowWatermark;
+		}
+		document.getElementById("indoor_station_retention_active").style.display = data.retentionActive ? 'block' : 'none';
+		if(data.queryCacheHits !== undefined)
+		{
+			document.getElementById("indoor_station_query_cache").textContent = data.queryCacheHits + " Treffer / " + data.queryCacheMisses + " Fehlzugriffe (" + data.queryCacheEntries + " Einträge, " + data.queryCacheBytes + " Bytes)";
+		}
 	})
 	.catch(error => console.error('Error loading indoor station info:', error));
 
@@ -8,6 +8,49 @@ const SERVER_EVENT_SENSOR_MODE_CHANGED =      "sensorModeChanged"
 
 // Shared utility functions
 
+// Battery lookup table of the indoor station (battery.cpp). It must contain constantly increasing values in both columns.
+const BATTERY_LOOKUP_TABLE = [
+	{ percent: 0, voltage_mV: 3000 },
+	{ percent: 10, voltage_mV: 3200 },
+	{ percent: 20, voltage_mV: 3400 },
+	{ percent: 30, voltage_mV: 3560 },
+	{ percent: 40, voltage_mV: 3680 },
+	{ percent: 50, voltage_mV: 3800 },
+	{ percent: 60, voltage_mV: 3880 },
+	{ percent: 70, voltage_mV: 3960 },
+	{ percent: 80, voltage_mV: 4040 },
+	{ percent: 90, voltage_mV: 4120 },
+	{ percent: 100, voltage_mV: 4200 }
+];
+
+// Convert the battery voltage to a percentage the same way as battery_voltageToPercent() of the indoor station
+function battery_voltageToPercent(batteryVoltage_mV, numberFractionalDigits = 2)
+{
+	const n = BATTERY_LOOKUP_TABLE.length;
+	if(batteryVoltage_mV <= BATTERY_LOOKUP_TABLE[0].voltage_mV)
+	{
+		return BATTERY_LOOKUP_TABLE[0].percent;
+	}
+	if(batteryVoltage_mV >= BATTERY_LOOKUP_TABLE[n - 1].voltage_mV)
+	{
+		return BATTERY_LOOKUP_TABLE[n - 1].percent;
+	}
+
+	for(let i = 0; i < n - 1; i++)
+	{
+		const entry1 = BATTERY_LOOKUP_TABLE[i];
+		const entry2 = BATTERY_LOOKUP_TABLE[i + 1];
+		if(batteryVoltage_mV > entry1.voltage_mV && batteryVoltage_mV <= entry2.voltage_mV)
+		{
+			// interpolate with integers like Arduino map()
+			const multiplier = Math.pow(10, numberFractionalDigits);
+			const scaledPercent = Math.trunc((batteryVoltage_mV - entry1.voltage_mV) * (entry2.percent - entry1.percent) * multiplier / (entry2.voltage_mV - entry1.voltage_mV)) + entry1.percent * multiplier;
+			return scaledPercent / multiplier;
+		}
+	}
+	return 0;
+}
+
 function getSensorColor(sensorIndex)
 {
 	// Read sensor colors from CSS custom properties
@@ -11,6 +11,14 @@
  */
 float battery_voltageToPercent(uint16_t batteryVoltage_mV, uint8_t numberFractionalDigits = 2);
 
+/**
+ * Convert the battery voltage in mV to an level in percent without floating point operations.
+ * @param batteryVoltage_mV Measured voltage of the battery in mV.
+ * @param numberFractionalDigits Number of fractional digits of the level. E.g. numberFractionalDigits=2 --> return e.g. 314 for 3.14 %
+ * @return Battery level in percent multiplied by 10^numberFractionalDigits.
+ */
+uint32_t battery_voltageToScaledPercent(uint16_t batteryVoltage_mV, uint8_t numberFractionalDigits = 2);
+
 /**
  * Check if the battery is empty. It is regarded as empty, when the battery level in percent falls under threshold_percent
  * @param batteryVoltage_V Measured voltage of the battery in mV.
@@ -23,5 +23,12 @@
 #define ARRAY_ELEMENT_COUNT(array) (sizeof array / sizeof array[0])
 
 //#define DEBUG_OUTPUT                                      // enable this define to print debugging output on the serial. If this is disabled, no serial output is used at all (to save power)
+//#define MEMORY_UNIFIED_HISTORY_LOG                        // enable this define to save the histories of all sensors in one log instead of separate files for each sensor (see historyLog.h). Existing histories are not converted.
+//#define MEMORY_RAW_FLASH_HISTORY_LOG                      // enable this define to write the segments of the unified history log directly to a flash region outside of the file system (see rawFlash.h). This implies MEMORY_UNIFIED_HISTORY_LOG.
+//#define MEMORY_RAM_HISTORY_BACKEND                        // enable this define to keep only the newest messages of each sensor in RAM instead of saving the histories (display only mode without flash wear, see historyRam.h). The histories are lost on a restart.
+
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    #define MEMORY_UNIFIED_HISTORY_LOG
+#endif
 
 #endif
\ No newline at end of file
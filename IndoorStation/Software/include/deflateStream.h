@@ -0,0 +1,54 @@
+#ifndef DEFLATESTREAM_H
+#define DEFLATESTREAM_H
+
+#include <Arduino.h>
+
+/*
+ * Streaming compressor for the zlib format (RFC 1950 / RFC 1951), as used by HTTP "Content-Encoding: deflate".
+ * The data is LZ77 compressed with a small window and a hash table with one entry per hash (no hash chains) and encoded with the fixed Huffman codes.
+ * This needs about 2 kB of RAM and no dynamic memory, so it fits into the heap of the ESP8266. Text with repeating lines (e.g. CSV exports of the history) is typically compressed to about a third.
+ * All data passed to deflateStream_compress() is encoded immediately, so no data is kept back between the calls (except up to 7 bits).
+ */
+#define DEFLATE_STREAM_WINDOW_SIZE          1024        // Number of previous bytes that are searched for matches (maximum distance)
+#define DEFLATE_STREAM_MAX_INPUT_SIZE       512         // Maximum number of bytes passed to deflateStream_compress() at once
+#define DEFLATE_STREAM_HASH_SIZE            256         // Number of entries of the hash table (must be a power of 2)
+#define DEFLATE_STREAM_MAX_OUTPUT_SIZE(inputLength)     ((inputLength) * 9 / 8 + 8)     // Maximum number of bytes returned by deflateStream_compress() (each literal needs at most 9 bits)
+#define DEFLATE_STREAM_MAX_FINISH_SIZE      10          // Maximum number of bytes returned by deflateStream_finish()
+
+typedef struct deflate_stream
+{
+    uint8_t buffer[DEFLATE_STREAM_WINDOW_SIZE + DEFLATE_STREAM_MAX_INPUT_SIZE];   // Previous bytes (window) followed by the bytes that are compressed
+    uint16_t windowLength;          // Number of previous bytes in the buffer
+    uint16_t hashTable[DEFLATE_STREAM_HASH_SIZE];  // Position + 1 in the buffer of the last 3 bytes with this hash (0 = none)
+    uint32_t bitBuffer;             // Bits that are not written to the output yet (LSB first)
+    uint8_t bitCount;               // Number of bits in the bit buffer
+    uint32_t adler32;               // Adler-32 checksum of the uncompressed data (zlib trailer)
+} deflate_stream_t;
+
+/**
+ * Start a new compressed stream.
+ * @param stream The stream state that is initialized.
+ * @param output Buffer for the zlib header. Must have space for at least 2 bytes.
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_begin(deflate_stream_t& stream, uint8_t* output);
+
+/**
+ * Compress the next part of the data.
+ * @param stream The stream started with deflateStream_begin().
+ * @param data The uncompressed data.
+ * @param length Number of bytes of the data. Must not be larger than DEFLATE_STREAM_MAX_INPUT_SIZE.
+ * @param output Buffer for the compressed data. Must have space for at least DEFLATE_STREAM_MAX_OUTPUT_SIZE(length) bytes.
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_compress(deflate_stream_t& stream, const uint8_t* data, size_t length, uint8_t* output);
+
+/**
+ * Finish the compressed stream (end of the last block and zlib trailer).
+ * @param stream The stream started with deflateStream_begin().
+ * @param output Buffer for the end of the stream. Must have space for at least DEFLATE_STREAM_MAX_FINISH_SIZE bytes.
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_finish(deflate_stream_t& stream, uint8_t* output);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef HISTORYBACKEND_H
+#define HISTORYBACKEND_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+#include "memory.h"
+
+/*
+ * Interface of the storages of the sensor histories. The memory module (memory.h stays the interface for the rest of the software) keeps the latest messages, the rollups,
+ * the latest state snapshot and the storage catalog and uses the selected backend to append, read, count and remove the messages of the sensors.
+ * Available backends:
+ * - memory_segmentsHistoryBackend: History segment files of each sensor in LittleFS (see memory.cpp). Default.
+ * - historyLog_backend: Unified history log of all sensors in LittleFS or in a raw flash region (see historyLog.h). Default with MEMORY_UNIFIED_HISTORY_LOG.
+ * - historyRam_backend: Ring buffer of the newest messages of each sensor in RAM (see historyRam.h). Display only mode without flash wear. Default with MEMORY_RAM_HISTORY_BACKEND.
+ * - historyPosix_backend: One file with message_sensor_timestamped_t structs for each sensor in a directory of the host (see historyPosix.h). Only for Linux builds (benchmarks with real datasets).
+ * The history check, the import merge, the retention policies of each sensor and the conversion of legacy history files are only available with memory_segmentsHistoryBackend.
+ *
+ * Positions inside a history (memory_findSensorMessagePosition(), memory_openHistoryReader()) are defined by the backend. Position 0 is always the start of the history.
+ * The readers (memory_history_reader_t) are initialized and used by the backends only. The backends must keep the last returned message in reader.message (needed by memory_unreadHistoryMessage()).
+ * reader.position is used by memory_readHistory() if the backend has no own readHistory function.
+ */
+
+/**
+ * Statistics of a history backend since its initialization. Used to compare the backends.
+ */
+typedef struct history_backend_stats
+{
+    uint32_t numberAppendedMessages;    // Number of messages that were appended
+    uint32_t numberWrites;              // Number of write operations to the storage (each write of a write buffer counts once)
+    uint32_t writtenBytes;              // Number of bytes written to the storage (history data and index entries)
+    uint32_t usedBytes;                 // Number of bytes used by the histories of all sensors (including the write buffers)
+} history_backend_stats_t;
+
+/**
+ * Functions of a history backend. The sensor indexes passed to the functions are always < NUM_SUPPORTED_SENSORS.
+ */
+typedef struct history_backend
+{
+    const char* name;                   // Short name of the backend (e.g. for benchmark results)
+
+    /** Restore the state of the histories after a restart. Called by memory_init(). */
+    void (*init)();
+    /** Close all open files. The write buffers are already written when this is called by memory_end(). */
+    void (*end)();
+
+    /** Append the message to the write buffer of the sensor. Returns false if it doesn't fit into the write buffer anymore (memory.cpp writes the buffer and tries again). */
+    bool (*appendMessage)(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage);
+    /** Write the write buffer of the sensor (-1 = of all sensors) to the storage. Returns true if everything was written. */
+    bool (*writeBuffer)(int8_t sensorIndex);
+    /** Get the number of bytes in the write buffer of the sensor (0 if the backend has no write buffer). Backends with a shared write buffer return its length for all sensors. */
+    uint16_t (*getWriteBufferLength)(uint8_t sensorIndex);
+    /** Get millis() at which the oldest message in the write buffer of the sensor was added. */
+    unsigned long (*getWriteBufferFirstMillis)(uint8_t sensorIndex);
+
+    /** Remove all messages of the sensor. */
+    void (*removeSensor)(uint8_t sensorIndex);
+    /** Delete the oldest part of the histories of all sensors (used by the retention engine when the file system watermarks are exceeded). NULL if not supported. Returns true if something was deleted. */
+    bool (*removeOldestData)();
+
+    /** Get the newest message of the sensor (timestamp -1 if there is none). */
+    message_sensor_timestamped_t (*getLatestMessage)(uint8_t sensorIndex);
+    /** Get the timestamp of the oldest message of the sensor from the index (or the first record), without decoding a block. -1 if there is none or the index isn't available. */
+    time_t (*getFirstTimestamp)(uint8_t sensorIndex);
+    /** Get the number of messages of the sensor. */
+    uint32_t (*getNumberMessages)(uint8_t sensorIndex);
+    /** Get the number of bytes used by the history of the sensor. */
+    uint32_t (*getHistorySize)(uint8_t sensorIndex);
+    /** Get the statistics of the backend. */
+    void (*getStats)(history_backend_stats_t& stats);
+
+    /** Get the position from which on the messages of the sensor with a timestamp >= timeFrom can be found. All messages before the position must be older than timeFrom. */
+    uint32_t (*findMessagePosition)(uint8_t sensorIndex, time_t timeFrom);
+    /** Rebuild the index of the sensor. NULL if the backend has no index. */
+    bool (*rebuildIndex)(uint8_t sensorIndex);
+
+    /** Open a reader for the messages of the sensor from the position on. */
+    void (*openReader)(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position);
+    /** Read the next message. Returns false if the end of the history is reached. */
+    bool (*readMessage)(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+    /** Open a reader that reads the messages of the sensor backwards. The first read message can still be newer than timeTo (memory.cpp skips them). */
+    void (*openReaderReverse)(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo);
+    /** Read the previous message. Returns false if the start of the history is reached. */
+    bool (*readPreviousMessage)(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+    /** Read the raw history data for the download. NULL to send the messages in the legacy format (concatenated message_sensor_timestamped_t structs). */
+    size_t (*readHistory)(memory_history_reader_t& reader, uint8_t* buffer, size_t length);
+    /** Close the files opened by the reader. */
+    void (*closeReader)(memory_history_reader_t& reader);
+} history_backend_t;
+
+/**
+ * History segment files of each sensor in LittleFS (see memory.cpp).
+ */
+extern const history_backend_t memory_segmentsHistoryBackend;
+
+/**
+ * Select the backend that is used for the histories. This must be called before memory_init(). The histories of the previous backend are not converted.
+ * Without a call, the backend selected in config.h is used (see above).
+ * @param backend The backend that is used.
+ */
+void memory_setHistoryBackend(const history_backend_t* backend);
+
+/**
+ * Get the backend that is used for the histories.
+ */
+const history_backend_t* memory_getHistoryBackend();
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef HISTORYCODEC_H
+#define HISTORYCODEC_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+
+/*
+ * Encoding of the sensor messages in the history segments (v2 format).
+ * Each record starts with a tag byte followed by the fields given by the tag:
+ * - Keyframe (first record of each block): varint(zigzag(timestamp)), varint(batteryVoltage_mV), numberSendLoops, sensor_sw_version
+ * - Delta record: varint(|timestamp - previous timestamp|), varint(zigzag(batteryVoltage_mV - previous batteryVoltage_mV)), [numberSendLoops], [sensor_sw_version]
+ *   numberSendLoops and sensor_sw_version are only stored when they changed compared to the previous message.
+ * A typical delta record needs 4 bytes (tag, 2 bytes time difference, 1 byte voltage difference).
+ * Unused bytes at the end of a block are filled with HISTORY_CODEC_TAG_PADDING.
+ * In segments with HISTORY_SEGMENT_FLAG_BLOCK_CRC, each completed block ends with at least one padding byte followed by the CRC32 of all previous bytes of the block (HISTORY_CODEC_BLOCK_CRC_SIZE bytes).
+ * The newest block of the history isn't completed yet and has no CRC.
+ */
+#define HISTORY_CODEC_TAG_PADDING           0x00    // Tag of the unused bytes at the end of a block
+#define HISTORY_CODEC_TAG_RECORD            0x80    // This bit is set for all records (to distinguish them from padding and erased flash)
+#define HISTORY_CODEC_TAG_KEYFRAME          0x40    // The record contains absolute values and doesn't depend on the previous message
+#define HISTORY_CODEC_TAG_PIN_STATE         0x20    // State of the sensor pin
+#define HISTORY_CODEC_TAG_LOOPS             0x10    // The record contains the numberSendLoops
+#define HISTORY_CODEC_TAG_VERSION           0x08    // The record contains the sensor_sw_version
+#define HISTORY_CODEC_TAG_TIME_BACKWARDS    0x04    // The timestamp is smaller than the one of the previous message (e.g. after a time synchronization)
+#define HISTORY_CODEC_TAG_RESERVED_MASK     0x03    // These bits must be 0
+
+#define HISTORY_CODEC_MAX_RECORD_SIZE       16      // Maximum number of bytes of one encoded record (keyframe with 10 bytes timestamp)
+#define HISTORY_CODEC_BLOCK_CRC_SIZE        4       // Number of bytes of the CRC32 at the end of each completed block
+
+/**
+ * Encode the sensor message into a record.
+ * @param message Sensor message that is encoded.
+ * @param previousMessage Previous sensor message of the same sensor. Use NULL to encode a keyframe.
+ * @param buffer Buffer for the record. Must have space for at least HISTORY_CODEC_MAX_RECORD_SIZE bytes.
+ * @return Number of bytes of the encoded record.
+ */
+size_t historyCodec_encodeMessage(const message_sensor_timestamped_t& message, const message_sensor_timestamped_t* previousMessage, uint8_t* buffer);
+
+/**
+ * Decode the record at the beginning of the buffer.
+ * @param buffer Buffer that contains the record.
+ * @param length Number of bytes available in the buffer.
+ * @param message Contains the previous sensor message of the same sensor when called (used for delta records). Contains the decoded message afterwards.
+ * @return Number of bytes of the decoded record. 0 if the buffer doesn't start with a valid and complete record (e.g. padding). The message isn't changed in this case.
+ */
+size_t historyCodec_decodeMessage(const uint8_t* buffer, size_t length, message_sensor_timestamped_t& message);
+
+/**
+ * Check if the given segment header is valid for the v2 format with the given block and segment size.
+ * @param header Header that is checked.
+ * @param blockSize Expected size of the blocks in bytes.
+ * @param segmentSize Expected size of a full segment in bytes.
+ * @return True if the header is valid; otherwise false.
+ */
+bool historyCodec_isValidSegmentHeader(const history_segment_header_t& header, uint16_t blockSize, uint16_t segmentSize);
+
+/**
+ * Check the CRC32 at the end of a completed block (only for segments with HISTORY_SEGMENT_FLAG_BLOCK_CRC).
+ * @param block Buffer that contains the complete block.
+ * @param blockSize Size of the block in bytes.
+ * @return True if the CRC matches the content of the block; otherwise false.
+ */
+bool historyCodec_isValidBlock(const uint8_t* block, uint16_t blockSize);
+
+#endif
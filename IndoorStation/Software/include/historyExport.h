@@ -0,0 +1,71 @@
+#ifndef HISTORYEXPORT_H
+#define HISTORYEXPORT_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+#include "memory.h"
+#include "deflateStream.h"
+
+/*
+ * Export of the history of a sensor as text (CSV or newline delimited JSON), optionally compressed (zlib format, see deflateStream.h).
+ * The export is produced in small parts while it is sent, so only a fixed amount of RAM is needed independent of the size of the history.
+ * CSV:    time,pin,voltage_mV,batP,loops
+ *         2024-05-01T12:00:00Z,1,4012,87.5,1
+ * NDJSON: {"time":"2024-05-01T12:00:00Z","pin":1,"voltage_mV":4012,"batP":87.5,"loops":1}
+ * All times are given in UTC (ISO 8601).
+ */
+#define HISTORY_EXPORT_TEXT_BUFFER_SIZE     DEFLATE_STREAM_MAX_INPUT_SIZE   // Number of bytes of text that are produced (and compressed) at once
+#define HISTORY_EXPORT_MAX_LINE_LENGTH      128                             // Maximum number of bytes of one exported line
+
+enum HistoryExportFormats
+{
+    HISTORY_EXPORT_FORMAT_CSV = 0,          // Comma separated values with a header line
+    HISTORY_EXPORT_FORMAT_NDJSON = 1        // One JSON object per line
+};
+
+enum HistoryExportStates
+{
+    HISTORY_EXPORT_STATE_HEADER = 0,        // Nothing produced yet
+    HISTORY_EXPORT_STATE_RECORDS = 1,       // The sensor messages are exported
+    HISTORY_EXPORT_STATE_TRAILER = 2,       // All sensor messages are exported, the end of the compressed stream is missing
+    HISTORY_EXPORT_STATE_DONE = 3           // Everything produced (the pending bytes may not be sent yet)
+};
+
+typedef struct history_export
+{
+    memory_history_reader_t reader;
+    time_t timeFrom;                        // Only messages in the range timeFrom..timeTo are exported
+    time_t timeTo;
+    HistoryExportFormats format;
+    bool isCompressed;
+    HistoryExportStates state;
+    uint8_t text[HISTORY_EXPORT_TEXT_BUFFER_SIZE];      // Produced text that isn't compressed yet
+    uint8_t compressed[DEFLATE_STREAM_MAX_OUTPUT_SIZE(HISTORY_EXPORT_TEXT_BUFFER_SIZE) + DEFLATE_STREAM_MAX_FINISH_SIZE];    // Compressed text
+    const uint8_t* pendingData;             // Bytes that are produced but not returned by historyExport_read() yet (points to text or compressed)
+    size_t pendingLength;
+    size_t pendingOffset;
+    deflate_stream_t deflate;               // State of the compression (only used if isCompressed)
+} history_export_t;
+
+/**
+ * Start the export of the history of a sensor.
+ * @param exp The export state that is initialized. It is about 3.5 kB large, so it should be allocated on the heap.
+ * @param sensorIndex Index of the sensor whose history is exported.
+ * @param timeFrom Only messages with a timestamp >= timeFrom are exported.
+ * @param timeTo Only messages with a timestamp <= timeTo are exported.
+ * @param format Text format of the export.
+ * @param isCompressed Compress the export (zlib format, HTTP "Content-Encoding: deflate").
+ */
+void historyExport_begin(history_export_t& exp, uint8_t sensorIndex, time_t timeFrom, time_t timeTo, HistoryExportFormats format, bool isCompressed);
+
+/**
+ * Read the next part of the export. This can be used directly as callback for chunked web server responses.
+ * @param exp The export started with historyExport_begin().
+ * @param buffer Buffer for the data.
+ * @param length Maximum number of bytes that are written to the buffer.
+ * @return Number of bytes written to the buffer. 0 if the export is complete.
+ */
+size_t historyExport_read(history_export_t& exp, uint8_t* buffer, size_t length);
+
+#endif
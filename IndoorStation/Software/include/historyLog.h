@@ -0,0 +1,162 @@
+#ifndef HISTORYLOG_H
+#define HISTORYLOG_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+#include "memory.h"
+#include "rawFlash.h"
+#include "historyBackend.h"
+
+#ifdef MEMORY_UNIFIED_HISTORY_LOG
+
+/*
+ * Unified history log (enabled with MEMORY_UNIFIED_HISTORY_LOG in config.h). It is a history backend (historyLog_backend, see historyBackend.h) that is used by the memory module instead of the history segments of each sensor, memory.h stays the interface.
+ * The messages of all sensors are appended to one log in the order in which they are received. So the number of files doesn't grow with the number of sensors,
+ * all sensors share one write buffer (one sequential append stream) and reading the messages of all sensors in time order is one sequential scan.
+ * The log segments have the layout of the history segments (segment header, blocks with CRC, see historyCodec.h) with HISTORY_SEGMENT_FLAG_SENSOR_ID:
+ * Each record starts with the sensor id (sensor index + 1) followed by the encoded message. The message is encoded relative to the previous message of the same sensor in the same block,
+ * the first message of each sensor in a block is a keyframe.
+ * Each sensor has an index file with one entry for each block that contains messages of the sensor. The readers of a sensor only load these blocks.
+ * Positions inside the log are given as (segment number * MEMORY_HISTORY_SEGMENT_SIZE + offset inside the segment).
+ * With MEMORY_RAW_FLASH_HISTORY_LOG, the segments aren't saved as files but in the sectors of a raw flash region (see rawFlash.h). Segment n is saved in sector (n % RAW_FLASH_NUMBER_SECTORS),
+ * the newest and oldest segment are found by the segment numbers in the segment headers. The index files and the removed file stay in the file system.
+ */
+#define FILENAME_HISTORY_LOG_SEGMENT_FORMAT         "/dataLog.%03u"             // Segment of the unified history log (segment number)
+#define FILENAME_HISTORY_LOG_INDEX_SENSOR_FORMAT    "/dataLogSensor%d.idx"      // Index of the blocks of the log that contain messages of the sensor (history_index_entry_t structs)
+#define FILENAME_HISTORY_LOG_REMOVED                "/dataLog.rm"               // Position of the log from which on the messages of each sensor are valid (uint32_t for each sensor, see historyLog_removeSensor())
+
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    #define HISTORY_LOG_MAX_SEGMENTS                (RAW_FLASH_NUMBER_SECTORS)                                          // Maximum number of log segments. When reached, the oldest segment is deleted (its sector is erased for the new segment).
+#else
+    #define HISTORY_LOG_MAX_SEGMENTS                (NUM_SUPPORTED_SENSORS * MEMORY_HISTORY_MAX_SEGMENTS_PER_SENSOR)    // Maximum number of log segments. When reached, the oldest segment is deleted.
+#endif
+
+/**
+ * Find the log segments and restore the state of the log and of the sensor indexes. Incompletely written data at the end of the log (e.g. after a power loss) is removed
+ * and the index entries of the last blocks are added if they are missing.
+ */
+void historyLog_init();
+
+/**
+ * Write the buffered records and close the newest log segment.
+ */
+void historyLog_end();
+
+/**
+ * Encode the sensor message and append it to the write buffer.
+ * @return True if the message was added; false if it doesn't fit into the write buffer anymore (write the buffer with historyLog_writeBuffer() and try again).
+ */
+bool historyLog_appendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Write the write buffer to the log segments and the index entries of the started blocks to the index files.
+ * @param sensorIndex Not used. All sensors share the write buffer, so it is always written completely.
+ * @return True if the whole buffer was written; otherwise false (the bytes that couldn't be written are kept in the write buffer).
+ */
+bool historyLog_writeBuffer(int8_t sensorIndex);
+
+/**
+ * Get the number of bytes in the write buffer. All sensors share the write buffer, so this is the same for all sensors.
+ */
+uint16_t historyLog_getWriteBufferLength(uint8_t sensorIndex);
+
+/**
+ * Get millis() at which the oldest record in the write buffer was added. This is the same for all sensors.
+ */
+unsigned long historyLog_getWriteBufferFirstMillis(uint8_t sensorIndex);
+
+/**
+ * Delete the oldest log segment and remove its entries from the index files. The newest segment is never deleted.
+ * @return True if a segment was deleted; otherwise false.
+ */
+bool historyLog_removeOldestSegment();
+
+/**
+ * Remove all messages of the sensor. The current block is completed, so that all following blocks only contain new messages of the sensor.
+ * The position of the next block is saved and all older records of the sensor are skipped. The log files are deleted when no sensor has messages anymore.
+ */
+void historyLog_removeSensor(uint8_t sensorIndex);
+
+/**
+ * Get the newest message of the sensor (timestamp -1 if there is none).
+ */
+message_sensor_timestamped_t historyLog_getLatestMessage(uint8_t sensorIndex);
+
+/**
+ * Get the timestamp of the oldest message of the sensor from its first index entry (-1 if there is none).
+ */
+time_t historyLog_getFirstTimestamp(uint8_t sensorIndex);
+
+/**
+ * Get the number of messages of the sensor in the log.
+ */
+uint32_t historyLog_getNumberMessages(uint8_t sensorIndex);
+
+/**
+ * Get the number of bytes used by the sensor. This is the share of the log according to the number of messages plus the index file.
+ */
+uint32_t historyLog_getHistorySize(uint8_t sensorIndex);
+
+/**
+ * Get the statistics of the log since historyLog_init().
+ */
+void historyLog_getStats(history_backend_stats_t& stats);
+
+/**
+ * Get the position of the block from which on the messages of the sensor with a timestamp >= timeFrom can be found (binary search in the index of the sensor).
+ */
+uint32_t historyLog_findMessagePosition(uint8_t sensorIndex, time_t timeFrom);
+
+/**
+ * Rebuild the index of the sensor by reading the whole log.
+ * @return True if the index was rebuilt successfully; otherwise false.
+ */
+bool historyLog_rebuildIndex(uint8_t sensorIndex);
+
+/**
+ * Open a reader for the messages of the sensor. The reader starts with the first block of the sensor at or behind the position.
+ */
+void historyLog_openReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position);
+
+/**
+ * Read the next message of the sensor of the reader opened with historyLog_openReader().
+ * @return True if a message was read; false if the end of the log is reached.
+ */
+bool historyLog_readMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Open a reader that reads the messages of the sensor backwards with historyLog_readPreviousMessage(). The reader starts with the block of the sensor that can contain timeTo.
+ */
+void historyLog_openReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo);
+
+/**
+ * Read the previous message of the sensor of the reader opened with historyLog_openReaderReverse().
+ * @return True if a message was read; false if the start of the log is reached.
+ */
+bool historyLog_readPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Close the segment and index files opened by the reader.
+ */
+void historyLog_closeReader(memory_history_reader_t& reader);
+
+/**
+ * Open a reader for the messages of all sensors. The reader starts with the log segment that can contain timeFrom.
+ */
+void historyLog_openAllSensorsReader(memory_history_reader_t& reader, time_t timeFrom);
+
+/**
+ * Read the next message of any sensor from the reader opened with historyLog_openAllSensorsReader(). The messages are returned in the order in which they were received.
+ * @return True if a message was read; false if the end of the log is reached.
+ */
+bool historyLog_readAllSensorsMessage(memory_history_reader_t& reader, uint8_t& sensorIndex, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Unified history log as history backend. The histories are downloaded in the legacy format (see memory_readHistory()).
+ */
+extern const history_backend_t historyLog_backend;
+
+#endif
+
+#endif
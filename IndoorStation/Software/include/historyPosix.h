@@ -0,0 +1,89 @@
+#ifndef HISTORYPOSIX_H
+#define HISTORYPOSIX_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+#include "memory.h"
+#include "historyBackend.h"
+
+#ifndef ARDUINO
+
+/*
+ * History backend for Linux builds (historyPosix_backend). The history of each sensor is saved as concatenated message_sensor_timestamped_t structs (legacy history file format)
+ * in one file in a directory of the host. It is used to run the memory module with real datasets (e.g. to compare the backends with benchmarks), it isn't available on the ESP8266.
+ * Positions inside the history are byte offsets in the history file (the messages in the write buffer follow the file).
+ * Select it with historyPosix_configure() and memory_setHistoryBackend(&historyPosix_backend) before memory_init().
+ */
+#define FILENAME_HISTORY_POSIX_SENSOR_FORMAT    "%s/dataSensor%d.bin"   // History file of the sensor (directory, sensor index)
+#define HISTORY_POSIX_WRITE_BUFFER_MESSAGES     64                      // Number of messages per sensor that are buffered in RAM. When the buffer is full, it is written to the file at once.
+
+/**
+ * Set the directory of the history files. This must be called before memory_init().
+ * @param directory Existing directory in which the history files are saved.
+ * @param syncWrites Call fsync() after each write of a write buffer (to measure the durable write costs).
+ */
+void historyPosix_configure(const char* directory, bool syncWrites);
+
+/**
+ * Open the history files of all sensors. An incomplete message at the end of a file (e.g. after a crash) is removed.
+ */
+void historyPosix_init();
+
+/**
+ * Write the write buffers and close the history files.
+ */
+void historyPosix_end();
+
+/**
+ * Append the message to the write buffer of the sensor.
+ * @return True if the message was added; false if the write buffer is full (write it with historyPosix_writeBuffer() and try again).
+ */
+bool historyPosix_appendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Append the write buffer of the sensor (-1 = of all sensors) to the history file.
+ * @return True if all buffers were written; otherwise false (the messages are kept in the write buffer).
+ */
+bool historyPosix_writeBuffer(int8_t sensorIndex);
+
+/**
+ * Remove all messages of the sensor (the history file is truncated).
+ */
+void historyPosix_removeSensor(uint8_t sensorIndex);
+
+/**
+ * Get the byte offset of the first message of the sensor with a timestamp >= timeFrom (binary search in the history file).
+ */
+uint32_t historyPosix_findMessagePosition(uint8_t sensorIndex, time_t timeFrom);
+
+/**
+ * Open a reader for the messages of the sensor from the byte offset on.
+ */
+void historyPosix_openReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position);
+
+/**
+ * Read the next message of the sensor.
+ * @return True if a message was read; false if the end of the history is reached.
+ */
+bool historyPosix_readMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Open a reader that reads the messages of the sensor backwards with historyPosix_readPreviousMessage(). The reader starts with the newest message that isn't newer than timeTo.
+ */
+void historyPosix_openReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo);
+
+/**
+ * Read the previous message of the sensor.
+ * @return True if a message was read; false if the start of the history is reached.
+ */
+bool historyPosix_readPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * History files in a directory of the host as history backend.
+ */
+extern const history_backend_t historyPosix_backend;
+
+#endif
+
+#endif
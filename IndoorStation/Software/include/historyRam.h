@@ -0,0 +1,91 @@
+#ifndef HISTORYRAM_H
+#define HISTORYRAM_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+#include "memory.h"
+#include "historyBackend.h"
+
+#if defined(MEMORY_RAM_HISTORY_BACKEND) || !defined(ARDUINO)
+
+/*
+ * History backend that keeps the newest messages of each sensor in a ring buffer in RAM (historyRam_backend, enabled with MEMORY_RAM_HISTORY_BACKEND in config.h).
+ * Nothing is written to the history files, so the flash isn't worn by the histories (display only mode). The histories are lost on a restart, only the rollup buckets are still saved.
+ * When the ring buffer of a sensor is full, the oldest message is overwritten.
+ * Positions inside the history are the consecutive numbers of the messages. Position 0 is the oldest message that is still available.
+ * On Linux builds the backend is always available (see memory_setHistoryBackend()).
+ */
+#define HISTORY_RAM_MAX_MESSAGES_PER_SENSOR     128         // Number of messages of each sensor that are kept in RAM (sizeof(message_sensor_timestamped_t) bytes each)
+
+/**
+ * Delete the messages of all sensors.
+ */
+void historyRam_init();
+
+/**
+ * Append the message to the ring buffer of the sensor. The oldest message is overwritten if the ring buffer is full.
+ * @return Always true.
+ */
+bool historyRam_appendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Remove all messages of the sensor.
+ */
+void historyRam_removeSensor(uint8_t sensorIndex);
+
+/**
+ * Get the newest message of the sensor (timestamp -1 if there is none).
+ */
+message_sensor_timestamped_t historyRam_getLatestMessage(uint8_t sensorIndex);
+
+/**
+ * Get the timestamp of the oldest message of the sensor in the ring buffer (-1 if there is none).
+ */
+time_t historyRam_getFirstTimestamp(uint8_t sensorIndex);
+
+/**
+ * Get the number of messages of the sensor in the ring buffer.
+ */
+uint32_t historyRam_getNumberMessages(uint8_t sensorIndex);
+
+/**
+ * Get the number of bytes used by the messages of the sensor in the ring buffer.
+ */
+uint32_t historyRam_getHistorySize(uint8_t sensorIndex);
+
+/**
+ * Get the number of the first message of the sensor with a timestamp >= timeFrom (binary search in the ring buffer).
+ */
+uint32_t historyRam_findMessagePosition(uint8_t sensorIndex, time_t timeFrom);
+
+/**
+ * Open a reader for the messages of the sensor from the message with the number given as position on.
+ */
+void historyRam_openReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position);
+
+/**
+ * Read the next message of the sensor. Messages that were overwritten in the meantime are skipped.
+ * @return True if a message was read; false if the newest message was already read.
+ */
+bool historyRam_readMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Open a reader that reads the messages of the sensor backwards with historyRam_readPreviousMessage(). The reader starts with the newest message that isn't newer than timeTo.
+ */
+void historyRam_openReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo);
+
+/**
+ * Read the previous message of the sensor.
+ * @return True if a message was read; false if the oldest available message was already read.
+ */
+bool historyRam_readPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Ring buffers of the newest messages in RAM as history backend.
+ */
+extern const history_backend_t historyRam_backend;
+
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <Arduino.h>
+
+/*
+ * Writer for streamed JSON responses with many small records (e.g. /get_data). It formats the records directly into the buffers of a chunked response, without a JSON document and without floats.
+ * A record that doesn't fit into the rest of a buffer is formatted into the writer and continued at the start of the next buffer.
+ * Array:  [{"time":1714564800,"pin":1,"batP":87.43},{"time":1714564830,"pin":0,"batP":87.40}]
+ * NDJSON: {"time":1714564800,"pin":1,"batP":87.43}\n{"time":1714564830,"pin":0,"batP":87.40}\n
+ */
+#define JSON_WRITER_MAX_RECORD_LENGTH   128     // Maximum number of bytes of one record (including the separators). Longer records are cut off.
+
+enum JsonWriterFormats
+{
+    JSON_WRITER_FORMAT_ARRAY = 0,           // All records in one JSON array
+    JSON_WRITER_FORMAT_NDJSON = 1           // One JSON object per line (newline delimited JSON)
+};
+
+typedef struct json_writer
+{
+    JsonWriterFormats format;
+    uint32_t numberRecords;                 // Number of started records
+    bool isEnded;                           // jsonWriter_end() was called
+    bool isFirstField;                      // No field was added to the current record yet
+    uint8_t* buffer;                        // Free part of the response buffer given to jsonWriter_beginRecord() or jsonWriter_end()
+    size_t bufferLength;                    // Number of free bytes of the response buffer
+    char* target;                           // Buffer into which the current record is formatted (the response buffer or pending)
+    size_t targetLength;                    // Size of the target buffer
+    size_t recordLength;                    // Number of bytes of the current record in the target buffer
+    char pending[JSON_WRITER_MAX_RECORD_LENGTH];    // Record that didn't fit into the response buffer
+    uint8_t pendingLength;                  // Number of bytes in pending
+    uint8_t pendingOffset;                  // Number of bytes of pending that were already returned
+} json_writer_t;
+
+/**
+ * Initialize the writer for a new response.
+ */
+void jsonWriter_begin(json_writer_t& writer, JsonWriterFormats format);
+
+/**
+ * Copy the rest of a record that didn't fit into the last buffer. This must be called at the start of each buffer.
+ * @return Number of bytes written to the buffer.
+ */
+size_t jsonWriter_read(json_writer_t& writer, uint8_t* buffer, size_t length);
+
+/**
+ * Check if bytes of a record are still waiting for the next buffer (see jsonWriter_read()). No new record must be started then.
+ */
+bool jsonWriter_hasPendingData(const json_writer_t& writer);
+
+/**
+ * Start the next record. It is formatted directly into the buffer if there is enough space for the longest record.
+ * @param buffer Free part of the response buffer.
+ * @param length Number of free bytes of the response buffer.
+ */
+void jsonWriter_beginRecord(json_writer_t& writer, uint8_t* buffer, size_t length);
+
+/**
+ * Add an unsigned integer field to the current record.
+ */
+void jsonWriter_addUInt(json_writer_t& writer, const char* key, uint32_t value);
+
+/**
+ * Add a number with a fixed number of fractional digits to the current record.
+ * @param scaledValue Value multiplied by 10^numberFractionalDigits (e.g. 8743 for 87.43 with 2 fractional digits).
+ */
+void jsonWriter_addFixed(json_writer_t& writer, const char* key, uint32_t scaledValue, uint8_t numberFractionalDigits);
+
+/**
+ * Finish the current record.
+ * @return Number of bytes written to the buffer given to jsonWriter_beginRecord(). The rest of the record is returned by the next jsonWriter_read().
+ */
+size_t jsonWriter_endRecord(json_writer_t& writer);
+
+/**
+ * Finish the response (closes the array).
+ * @return Number of bytes written to the buffer. The rest is returned by the next jsonWriter_read().
+ */
+size_t jsonWriter_end(json_writer_t& writer, uint8_t* buffer, size_t length);
+
+#endif
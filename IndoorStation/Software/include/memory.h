@@ -2,11 +2,187 @@
 #define MEMORY_H
 
 #include <Arduino.h>
+#include <FS.h>
 #include "config.h"
 #include "structures.h"
 
-#define FILENAME_HISTORY_SENSOR_FORMAT		"/dataSensor%d.bin"
-#define FILENAME_PERSISTED_SYSTEM_CONFIG    "/system_config.bin"
+#define FILENAME_HISTORY_SENSOR_FORMAT		    "/dataSensor%d.bin"         // Legacy history file (single growing file with message_sensor_timestamped_t structs). Converted to segment files in the background by memory_loop().
+#define FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT  "/dataSensor%d.%03u"        // History segment file (sensor index, segment number)
+#define FILENAME_HISTORY_INDEX_SENSOR_FORMAT    "/dataSensor%d.idx"
+#define FILENAME_ROLLUP_HOUR_SENSOR_FORMAT      "/dataSensor%d.rlh"         // Hourly rollups of the history (history_rollup_entry_t structs)
+#define FILENAME_ROLLUP_DAY_SENSOR_FORMAT       "/dataSensor%d.rld"         // Daily rollups of the history (history_rollup_entry_t structs)
+#define FILENAME_ROLLUP_TMP_SENSOR_FORMAT       "/dataSensor%d.rlt"         // Temporary rollup file while the oldest buckets are deleted from the hourly or daily rollups
+#define FILENAME_HISTORY_MERGE_SEGMENT_SENSOR_FORMAT    "/dataSensor%d.m%03u"   // Segment of a merged history (import) that doesn't replace the history yet
+#define FILENAME_HISTORY_MERGE_INDEX_SENSOR_FORMAT      "/dataSensor%d.mix"     // Sparse time index of a merged history (import). It replaces the index together with the history.
+#define FILENAME_HISTORY_MERGE_COMMIT_SENSOR_FORMAT     "/dataSensor%d.mrg"     // Written when the merged history is complete. The merged segments then replace the history (also after a restart). Deleted when the rollups are recalculated from the merged history.
+#define FILENAME_LATEST_STATE_SNAPSHOT          "/latest_state.bin"
+#define FILENAME_PERSISTED_SYSTEM_CONFIG        "/system_config.bin"        // Legacy system config file. Only loaded if none of the slot files is valid.
+#define FILENAME_PERSISTED_SYSTEM_CONFIG_SLOT_A "/system_config_a.bin"
+#define FILENAME_PERSISTED_SYSTEM_CONFIG_SLOT_B "/system_config_b.bin"
+
+#define MEMORY_HISTORY_BLOCK_SIZE               256                                             // Size of the blocks inside the history segments in bytes. Each block starts with a keyframe record and gets one entry in the sparse time index.
+#define MEMORY_HISTORY_SEGMENT_SIZE             (16 * MEMORY_HISTORY_BLOCK_SIZE)                // Size of one history segment file in bytes (including the segment header). A new segment is started when the last one is full.
+#define MEMORY_HISTORY_MAX_SIZE_PER_SENSOR      (128 * 1024UL)                                  // Maximum number of bytes used for the history of each sensor. When reached, the oldest segment is deleted. This also applies to converted legacy history files: their oldest messages beyond this size are dropped.
+#define MEMORY_HISTORY_MAX_SEGMENTS_PER_SENSOR  (MEMORY_HISTORY_MAX_SIZE_PER_SENSOR / MEMORY_HISTORY_SEGMENT_SIZE)
+
+#define MEMORY_ROLLUP_MAX_ENTRIES_HOUR          1024        // Maximum number of buckets in the hourly rollup file (at least 42 days). When reached, the oldest quarter is deleted.
+#define MEMORY_ROLLUP_MAX_ENTRIES_DAY           2048        // Maximum number of buckets in the daily rollup file (at least 5 years). When reached, the oldest quarter is deleted.
+
+#define MEMORY_WRITE_BUFFER_SIZE                MEMORY_HISTORY_BLOCK_SIZE   // Number of bytes per sensor that are buffered in RAM (about 60 encoded sensor messages). When the buffer is full, it is written to the history at once.
+#define MEMORY_WRITE_BUFFER_MAX_AGE_MS          (5 * 60 * 1000UL)           // Buffered sensor messages are written to the history at the latest after this time (max. data loss on a power failure)
+#define MEMORY_LATEST_STATE_RTC_OFFSET          32                          // Offset of the latest state snapshot in the RTC user memory (in 4 byte blocks). The first 128 bytes are used by the bootloader for OTA updates.
+#define MEMORY_SYSTEM_CONFIG_SAVE_DELAY_MS      (3 * 1000UL)                // A changed system config is written when it wasn't changed again for this time (several changes in a row are written at once)
+#define MEMORY_IMPORT_MIN_TIMESTAMP             1577836800                  // Imported messages with an older timestamp (before 2020-01-01, e.g. received before the time was synchronized) are dropped
+#define MEMORY_IMPORT_MAX_FUTURE_S              (24 * 60 * 60L)             // Imported messages with a timestamp more than this number of seconds in the future are dropped (only checked if the time is valid)
+#define MEMORY_IMPORT_TIMEOUT_MS                (60 * 1000UL)               // An active import is aborted by memory_loop() if no data was imported for this time (e.g. an upload that stopped without a disconnect)
+#define MEMORY_IMPORT_STEP_INTERVAL_MS          20UL                        // Minimum time between two steps of an import that was ended (merge of the existing history, recalculation of the rollups)
+#define MEMORY_IMPORT_STEP_MESSAGES             64                          // Maximum number of messages that are merged or added to the rollups in one step of an import
+#define MEMORY_RETENTION_STEP_INTERVAL_MS       1000UL                      // Minimum time between two steps of the retention engine (each step deletes at most one history segment)
+#define MEMORY_HISTORY_CHECK_STEP_INTERVAL_MS   20UL                        // Minimum time between two steps of the history check (each step checks one block of the history)
+#define MEMORY_LEGACY_CONVERSION_STEP_INTERVAL_MS   20UL                    // Minimum time between two steps of the conversion of the legacy history files
+#define MEMORY_LEGACY_CONVERSION_STEP_MESSAGES  64                          // Maximum number of messages of a legacy history file that are converted in one step
+#define MEMORY_TAIL_CACHE_HEAP_SHARE_PERCENT    10                          // Share of the free heap at the first memory_init() that is used for the RAM tail cache of the newest messages of all sensors (see memory_seekHistoryReader())
+#define MEMORY_TAIL_CACHE_MIN_MESSAGES          16                          // The tail cache is disabled if less messages per sensor fit into its share of the heap
+#define MEMORY_TAIL_CACHE_MAX_MESSAGES          512                         // Maximum number of messages per sensor in the tail cache
+#define MEMORY_TAIL_CACHE_NO_MESSAGE            UINT32_MAX                  // Value of memory_history_reader_t.tailCacheNumber if the reader doesn't read from the tail cache
+
+/**
+ * Reader to sequentially read the history of a sensor across all of its segment files (including the messages in the write buffer, that are not written yet).
+ * Positions inside the history are given as (segment number * MEMORY_HISTORY_SEGMENT_SIZE + offset inside the segment).
+ * Other history backends (see historyBackend.h) define their own positions and use the fields of the reader for their own state. Position 0 is always the start of the history.
+ */
+typedef struct memory_history_reader
+{
+    uint8_t sensorIndex;
+    uint32_t position;              // Position of the next byte that is read by memory_readHistory()
+    uint16_t segment;               // Number of the segment that is opened in file
+    File file;                      // Opened segment file
+    uint8_t block[MEMORY_HISTORY_BLOCK_SIZE];   // Block that is decoded by memory_readHistoryMessage()
+    uint32_t blockPosition;         // Position of the block inside the history
+    uint16_t blockLength;           // Number of bytes loaded into the block buffer
+    uint16_t blockOffset;           // Offset of the next record inside the block buffer
+    message_sensor_timestamped_t message;       // Last decoded sensor message (needed to decode the following delta record)
+    uint16_t flagsSegment;          // Number of the segment whose header flags are in segmentFlags
+    uint8_t segmentFlags;           // Flags of the segment header (HISTORY_SEGMENT_FLAG_...), used to decide if the block CRCs are checked
+    bool isMessagePending;          // The message in "message" is returned again by the next read (see memory_unreadHistoryMessage())
+    uint16_t numberRecordsLeft;     // Reverse reading: number of records in the block before the last returned one
+    uint32_t tailCacheNumber = MEMORY_TAIL_CACHE_NO_MESSAGE;    // Number of the next message that is read from the RAM tail cache (set by memory_seekHistoryReader(); MEMORY_TAIL_CACHE_NO_MESSAGE if the history is read)
+#ifdef MEMORY_UNIFIED_HISTORY_LOG
+    File indexFile;                 // Unified log: opened index file of the sensor
+    uint32_t indexNumber;           // Unified log: number of the index entry of the next block that is read (reverse reading: of the last read block)
+    uint16_t indexGeneration;       // Unified log: generation of the index file for which indexNumber is valid (the index file is rewritten when the oldest log segment is deleted)
+    uint8_t messageSensorIndex;     // Unified log: sensor of the last message returned by the reader of all sensors
+    message_sensor_timestamped_t sensorMessages[NUM_SUPPORTED_SENSORS];     // Unified log: last decoded message of each sensor in the block (needed to decode the following delta records)
+#endif
+} memory_history_reader_t;
+
+/**
+ * Reader to read the hourly or daily rollups of a sensor (including the bucket that is still in progress).
+ */
+typedef struct memory_rollup_reader
+{
+    uint8_t sensorIndex;
+    RollupResolutions resolution;
+    File file;                      // Opened rollup file
+    time_t timeFrom;                // Start of the first bucket that is read
+    time_t lastBucketStart;         // Start of the last bucket that was read
+} memory_rollup_reader_t;
+
+/**
+ * Catalog of the storage usage that is kept in RAM, so that the status endpoints don't need to access the file system.
+ */
+typedef struct memory_storage_catalog
+{
+    uint16_t numberMessages[NUM_SUPPORTED_SENSORS];     // Number of available sensor messages of each sensor
+    uint32_t historySize[NUM_SUPPORTED_SENSORS];        // Number of bytes of the history of each sensor (segments, write buffer, sparse time index and legacy file)
+    size_t usedBytes;               // Used bytes of the file system
+    size_t totalBytes;              // Total bytes of the file system
+    bool isRetentionActive;         // The file system usage exceeded the high watermark and the oldest history is deleted until the usage is below the low watermark
+    uint16_t tailCacheMessages;     // Number of the newest messages of each sensor that are kept in the RAM tail cache (0 = disabled)
+} memory_storage_catalog_t;
+
+/**
+ * Findings of the history check for one sensor.
+ */
+typedef struct memory_history_check_sensor_report
+{
+    uint32_t checkedBlocks;         // Number of completed blocks that were checked
+    uint32_t tornBytes;             // Number of bytes of incompletely written data at the end of the history (e.g. after a power loss) that were removed at the start
+    uint16_t invalidSegments;       // Number of segments that are missing, too short or have an unknown header (they are skipped by the readers)
+    uint16_t crcErrorBlocks;        // Number of blocks with a wrong CRC. They are cleared (the readers already skipped their messages).
+    uint16_t invalidRecordBlocks;   // Number of blocks with a record that can't be decoded. The block is cut off in front of this record.
+    uint16_t absurdTimestamps;      // Number of messages with a timestamp before MEMORY_IMPORT_MIN_TIMESTAMP (e.g. received before the time was synchronized) or in the future. They are removed.
+    uint16_t outOfOrderTimestamps;  // Number of messages that are older than the previous message. They are only reported, because the time can be corrected by the time synchronization.
+    uint16_t lostMessages;          // Number of valid messages that were lost, because they didn't fit into the repaired block anymore
+    uint16_t repairedBlocks;        // Number of blocks that were rewritten
+} memory_history_check_sensor_report_t;
+
+/**
+ * Report of the history check (see memory_startHistoryCheck()).
+ */
+typedef struct memory_history_check_report
+{
+    bool isRunning;                 // The check isn't finished yet
+    uint32_t duration_ms;           // Duration of the last complete check
+    memory_history_check_sensor_report_t sensors[NUM_SUPPORTED_SENSORS];
+} memory_history_check_report_t;
+
+/**
+ * State of the import of a history file (see memory_getSensorHistoryImportState()).
+ */
+enum HistoryImportStates
+{
+    HISTORY_IMPORT_STATE_NONE = 0,          // No import was started or the import was aborted
+    HISTORY_IMPORT_STATE_RUNNING = 1,       // The file is received or memory_loop() merges the history, replaces it and recalculates the rollups
+    HISTORY_IMPORT_STATE_SUCCEEDED = 2,     // The whole file was imported
+    HISTORY_IMPORT_STATE_FAILED = 3         // The file was invalid or incomplete, messages were dropped or there wasn't enough space for the merged history
+};
+
+/**
+ * Initialize the memory module. This must be called after LittleFS is mounted and before any other memory function is used.
+ * It restores the state of the histories with the selected history backend (see historyBackend.h). The default backend searches for the history segment files of all sensors and restores the state of the histories from the sparse time index.
+ * Incompletely written messages at the end of the histories (e.g. after a power loss) are removed.
+ * An interrupted replacement of a history by a merged history (import) is completed. Merged segments of unfinished imports are deleted.
+ * Afterwards the history check is started, which checks and repairs the rest of the histories in the background (see memory_startHistoryCheck()).
+ * The RAM tail cache is allocated on the first call (sized from the free heap) and filled with the newest messages of each sensor.
+ */
+void memory_init();
+
+/**
+ * Load the latest message of each sensor from the latest state snapshot. This is much faster than memory_init(), so it can be used to show the sensor states directly after booting.
+ * The copy in the RTC memory (survives soft resets) is preferred over the snapshot file. The snapshot file is written together with the history, so it matches the history after a power loss.
+ * This can be called before memory_init(). The state restored by memory_init() from the history is authoritative.
+ * @param latestMessages Array with NUM_SUPPORTED_SENSORS elements, to which the latest messages are returned (timestamp -1 if there is no message for the sensor).
+ * @return True if a valid snapshot was found; otherwise false (the history must be used).
+ */
+bool memory_loadLatestStateSnapshot(message_sensor_timestamped_t* latestMessages);
+
+/**
+ * Write the buffered sensor messages to the history when the oldest one exceeds MEMORY_WRITE_BUFFER_MAX_AGE_MS. Call this cyclic from the loop().
+ * A changed system config is written when it wasn't changed for MEMORY_SYSTEM_CONFIG_SAVE_DELAY_MS.
+ * Every MEMORY_RETENTION_STEP_INTERVAL_MS the retention engine deletes at most one of the oldest history segments, if the retention policies of the system config
+ * or the file system watermarks (retentionHighWatermark_percent / retentionLowWatermark_percent) require it.
+ * While the history check is running, one block of the history is checked every MEMORY_HISTORY_CHECK_STEP_INTERVAL_MS.
+ */
+void memory_loop();
+
+/**
+ * Write all buffered sensor messages of the requested sensor to the history.
+ * @param sensorIndex Index of the sensor for which the buffered messages are written. Use -1 to write the buffered messages of all sensors.
+ */
+void memory_flushSensorHistory(int8_t sensorIndex);
+
+/**
+ * Write all buffered sensor messages and a changed system config and close all open files. Call this before LittleFS is unmounted or the device is restarted.
+ * Afterwards the module is suspended until the next memory_init(): memory_loop() does nothing and memory_addSensorMessage() drops the messages.
+ */
+void memory_end();
+
+/**
+ * Check if the module is suspended by memory_end() (e.g. while an OTA update is running).
+ * @return True if memory_end() was called and memory_init() wasn't called since then; otherwise false.
+ */
+bool memory_isSuspended();
 
 /**
  * Delete all saved data files (sensor history, sensor MACs).
@@ -20,7 +196,30 @@ void memory_removeAllData();
 void memory_removeSensorHistory(int8_t sensorIndex);
 
 /**
- * Construct a string that describes how much memory of the LittleFS is used.
+ * Get the storage catalog. It is built by memory_init() and kept up to date by the functions of this module, so reading it doesn't access the file system.
+ * @return Reference to the storage catalog (message counts and history sizes of all sensors and the file system usage).
+ */
+const memory_storage_catalog_t& memory_getStorageCatalog();
+
+/**
+ * Start the history check of all sensors. The check runs in the background (memory_loop()) and checks all completed blocks of the history segments:
+ * - CRC of the block: Blocks with a wrong CRC are cleared.
+ * - Records that can't be decoded: The block is cut off in front of the record.
+ * - Timestamps before MEMORY_IMPORT_MIN_TIMESTAMP or more than MEMORY_IMPORT_MAX_FUTURE_S in the future: The messages are removed from the block.
+ * - Timestamps older than the previous message: Only reported.
+ * After a history was repaired, its sparse time index is rebuilt. The check is paused while a history is imported.
+ * Incompletely written data at the end of the histories is already removed by memory_init() (reported as tornBytes).
+ */
+void memory_startHistoryCheck();
+
+/**
+ * Get the report of the running or last history check.
+ * @return Reference to the report (findings and repairs of each sensor).
+ */
+const memory_history_check_report_t& memory_getHistoryCheckReport();
+
+/**
+ * Construct a string that describes how much memory of the LittleFS is used. The usage is taken from the storage catalog.
  * @param shortFormat Return only the percentage
  * @return String describing the memory usage (used bytes, total bytes, percentage).
  */
@@ -32,19 +231,12 @@ const char* memory_getMemoryUsageString(bool shortFormat);
 void memory_showMemoryContent();
 
 /**
- * Get the number of available sensor messages for the requested sensor.
+ * Get the number of available sensor messages for the requested sensor (from the storage catalog).
  * @param sensorIndex Index of the sensor, for which the number of messages is returned. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
  * @return Number of sensor messages for the requested sensor.
  */
 uint16_t memory_getNumberSensorMessages(uint8_t sensorIndex);
 
-/**
- * Get all available sensor messages for the requested sensor.
- * @param sensorIndex Index of the sensor, for which the messages are returned. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
- * @param sensorMessagesBuffer Pointer to the buffer, to which the sensor messages are returned. Make sure, the array is large enough (minimum the number of message returned by memory_getNumberSensorMessages) !!!
- */
-void memory_getSensorMessagesForSensor(uint8_t sensorIndex, message_sensor_timestamped_t* sensorMessagesBuffer);
-
 /**
  * Get the latest available sensor message for the requested sensor.
  * @param sensorIndex Index of the sensor, for which the last message is returned. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
@@ -53,24 +245,246 @@ void memory_getSensorMessagesForSensor(uint8_t sensorIndex, message_sensor_times
 message_sensor_timestamped_t memory_getLatestSensorMessagesForSensor(uint8_t sensorIndex);
 
 /**
- * Add the given message to the history file for the requested sensor.
+ * Get the time range of the history of the requested sensor without decoding a block.
+ * The oldest timestamp is taken from the first index entry. The newest timestamp is kept in RAM, it isn't lowered by messages that are appended or imported with an older timestamp.
+ * @param sensorIndex Index of the sensor. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param timeOldest Timestamp of the oldest message (0 if the index isn't available).
+ * @param timeNewest Timestamp of the newest message.
+ * @return False if the history of the sensor is empty (both timestamps are -1 then).
+ */
+bool memory_getSensorHistoryTimeRange(uint8_t sensorIndex, time_t& timeOldest, time_t& timeNewest);
+
+/**
+ * Check if a received message should be saved according to the sampling policy of the sensor.
+ * The message is compared with the newest saved message of the sensor, which is kept in RAM, so the check doesn't access the file system.
+ * Changes of the door state or of the sensor software version and the first message of a sensor are always saved.
+ * @param sensorIndex Index of the sensor, for which the sensor message was received. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param sensorMessage Received sensor message.
+ * @param policy Sampling policy of the sensor (see history_sampling_policy_t).
+ * @return True if the message should be saved with memory_addSensorMessage(); false if it can be dropped.
+ */
+bool memory_isSensorMessageSampled(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage, const history_sampling_policy_t& policy);
+
+/**
+ * Get the generation of the history of the requested sensor. It is incremented whenever a message is added and whenever the history or the rollups are changed otherwise (removal, import, retention, repair, rebuild).
+ * Results computed from the history or the rollups stay valid as long as the generation doesn't change (see queryCache.h).
+ * @param sensorIndex Index of the sensor. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @return Generation of the history (it wraps around).
+ */
+uint32_t memory_getHistoryGeneration(uint8_t sensorIndex);
+
+/**
+ * Add the given message to the history for the requested sensor.
+ * The message is buffered in RAM first and written together with other messages (see MEMORY_WRITE_BUFFER_SIZE and MEMORY_WRITE_BUFFER_MAX_AGE_MS).
  * @param sensorIndex Index of the sensor, for which the sensor message is saved. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
  * @param sensorMessage Sensor messages that is saved.
- * @return True if message was added; otherwise false
+ * @return True if message was added; otherwise false (e.g. while the module is suspended, see memory_end())
  */
 bool memory_addSensorMessage(uint8_t sensorIndex, message_sensor_timestamped_t sensorMessage);
 
+/**
+ * Start the import of a history file (e.g. an uploaded file) for the requested sensor. The imported messages are merged by timestamp with the existing history.
+ * Both history file formats are supported: the v2 format (as sent by memory_readHistory()) and the legacy format (concatenated message_sensor_timestamped_t structs).
+ * The merged history is written to separate segment files while the existing history stays readable and unchanged. It replaces the history after memory_endSensorHistoryImport() was called.
+ * The memory usage doesn't depend on the size of the imported file.
+ * Only one import can be active at the same time. An active import that wasn't ended is aborted.
+ * @param sensorIndex Index of the sensor, for which the data is imported. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @return True if the import was started; otherwise false (while the legacy history file of the sensor is converted or a previous import that was ended isn't finished yet)
+ */
+bool memory_beginSensorHistoryImport(uint8_t sensorIndex);
+
+/**
+ * Import the next part of the history file started with memory_beginSensorHistoryImport().
+ * The data doesn't have to be aligned to the records (e.g. chunks of an upload).
+ * The imported messages must be in time order. Messages with an implausible timestamp (see MEMORY_IMPORT_MIN_TIMESTAMP and MEMORY_IMPORT_MAX_FUTURE_S) or older than the previous imported message are dropped.
+ * Messages with the same timestamp and pin state as a message of the existing history are dropped as duplicates.
+ * @param sensorIndex Index of the sensor, for which the data is imported. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param data Pointer to the history file data.
+ * @param length Number of bytes to import.
+ * @return True if all data was imported; otherwise false
+ */
+bool memory_importSensorHistory(uint8_t sensorIndex, const uint8_t* data, size_t length);
+
+/**
+ * Mark the end of the history file of the import started with memory_beginSensorHistoryImport().
+ * The rest of the existing history is merged, the history is replaced by the merged history and the rollups are recalculated by memory_loop() in small steps afterwards (see MEMORY_IMPORT_STEP_MESSAGES).
+ * The result is available by memory_getSensorHistoryImportState() when this is finished.
+ * The merge commit file is written before the files are replaced, so a replacement interrupted by a restart is completed by memory_init(). If the merged history couldn't be written completely, the existing history is kept.
+ * @param sensorIndex Index of the sensor, for which the data is imported. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @return True if the import was ended; otherwise false (no import started for this sensor or it was already ended)
+ */
+bool memory_endSensorHistoryImport(uint8_t sensorIndex);
+
+/**
+ * Abort the active import without changing the history and delete the merged segment files (e.g. when the upload was interrupted).
+ * An import is also aborted by memory_loop() if no data was imported for MEMORY_IMPORT_TIMEOUT_MS. Nothing is done if no import is active or it was already ended (memory_endSensorHistoryImport()).
+ */
+void memory_abortSensorHistoryImport();
+
+/**
+ * Get the state of the last import started with memory_beginSensorHistoryImport().
+ * @return HISTORY_IMPORT_STATE_RUNNING until the import is finished by memory_loop(), afterwards the result of the import
+ */
+HistoryImportStates memory_getSensorHistoryImportState();
+
+/**
+ * Get the position inside the history of the requested sensor from which on the sensor messages with a timestamp >= timeFrom can be found.
+ * The sparse time index beside the history segments is searched for this (binary search). If the index is missing or stale, it is rebuilt first.
+ * All messages before the returned position are older than timeFrom. Messages after the position can still be older than timeFrom (up to one block), so the caller has to filter them.
+ * This relies on the messages being appended in time order.
+ * @param sensorIndex Index of the sensor, for which the position is returned. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param timeFrom Timestamp of the first message that is of interest.
+ * @return Position inside the history (segment number * MEMORY_HISTORY_SEGMENT_SIZE + offset inside the segment, other backends define their own positions). This is the start of the history if no index entry is older than timeFrom.
+ */
+uint32_t memory_findSensorMessagePosition(uint8_t sensorIndex, time_t timeFrom);
+
+/**
+ * Rebuild the sparse time index for the history of the requested sensor by reading all history segments.
+ * This is necessary when the index doesn't match the history segments anymore.
+ * @param sensorIndex Index of the sensor, for which the index is rebuilt. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @return True if the index was rebuilt successfully; otherwise false.
+ */
+bool memory_rebuildSensorHistoryIndex(uint8_t sensorIndex);
+
+/**
+ * Open a reader for the history of the requested sensor.
+ * @param reader The reader that is opened.
+ * @param sensorIndex Index of the sensor, for which the history is read. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param position Position inside the history from which on the data is read (e.g. from memory_findSensorMessagePosition()). It is moved to the start of the block. Use 0 to read from the start of the history.
+ */
+void memory_openHistoryReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position);
+
+/**
+ * Read and decode the next sensor message from the reader. The reader continues with the next block and segment file, when the end of a block is reached.
+ * @param reader The reader opened with memory_openHistoryReader().
+ * @param sensorMessage The decoded sensor message.
+ * @return True if a message was read; false if the end of the history is reached.
+ */
+bool memory_readHistoryMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Move the reader to the first message that isn't older than timeFrom. The sparse time index is used to skip the older blocks.
+ * If the RAM tail cache contains all messages from timeFrom on, the reader reads them from the cache without accessing the history.
+ * A cache reader whose next message was evicted in the meantime continues in the history behind the timestamp of the last returned message (messages with the same timestamp are skipped).
+ * @param reader The reader opened with memory_openHistoryReader().
+ * @param timeFrom Timestamp of the first message that is of interest.
+ */
+void memory_seekHistoryReader(memory_history_reader_t& reader, time_t timeFrom);
+
+/**
+ * Open a reader that reads the history of the requested sensor backwards (newest message first) with memory_readPreviousHistoryMessage().
+ * The blocks are read one after another into the block buffer of the reader, so the memory usage doesn't depend on the size of the history.
+ * @param reader The reader that is opened.
+ * @param sensorIndex Index of the sensor, for which the history is read. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param timeTo Timestamp of the newest message that is of interest. Newer messages are skipped.
+ */
+void memory_openHistoryReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo);
+
+/**
+ * Read and decode the previous sensor message from a reader opened with memory_openHistoryReaderReverse().
+ * The records of a block are delta encoded, so the block is decoded from its keyframe up to the requested record.
+ * @param reader The reader opened with memory_openHistoryReaderReverse().
+ * @param sensorMessage The decoded sensor message.
+ * @return True if a message was read; false if the start of the history is reached.
+ */
+bool memory_readPreviousHistoryMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage);
+
+/**
+ * Push back the last message that was read from the reader. It is returned again by the next call of memory_readHistoryMessage() or memory_readPreviousHistoryMessage().
+ * This is used if a message doesn't fit into the current response chunk.
+ * @param reader The reader from which the last message was read.
+ */
+void memory_unreadHistoryMessage(memory_history_reader_t& reader);
+
+/**
+ * Read the next raw history data bytes (v2 format with segment headers) from the reader. This is used to download the history.
+ * The reader continues with the next segment file, when the end of a segment is reached.
+ * History backends without an own download format (e.g. the unified history log, because its segments contain the messages of all sensors) return the messages in the legacy format (concatenated message_sensor_timestamped_t structs).
+ * Don't mix this with memory_readHistoryMessage() on the same reader.
+ * @param reader The reader opened with memory_openHistoryReader().
+ * @param buffer Buffer to which the data is read.
+ * @param length Maximum number of bytes to read.
+ * @return Number of bytes read. 0 if the end of the history is reached.
+ */
+size_t memory_readHistory(memory_history_reader_t& reader, uint8_t* buffer, size_t length);
+
+/**
+ * Close the reader and the opened segment file.
+ * @param reader The reader opened with memory_openHistoryReader().
+ */
+void memory_closeHistoryReader(memory_history_reader_t& reader);
+
+#ifdef MEMORY_UNIFIED_HISTORY_LOG
+/**
+ * Open a reader that reads the messages of all sensors in the order in which they were received (one sequential scan of the unified history log).
+ * @param reader The reader that is opened. Close it with memory_closeHistoryReader().
+ * @param timeFrom Timestamp of the oldest message that is of interest. Older messages at the start are skipped.
+ */
+void memory_openAllSensorsHistoryReader(memory_history_reader_t& reader, time_t timeFrom);
+
+/**
+ * Read the next sensor message of any sensor from a reader opened with memory_openAllSensorsHistoryReader().
+ * @param reader The reader opened with memory_openAllSensorsHistoryReader().
+ * @param sensorIndex Index of the sensor of the message.
+ * @param sensorMessage The decoded sensor message.
+ * @return True if a message was read; false if the end of the log is reached.
+ */
+bool memory_readAllSensorsHistoryMessage(memory_history_reader_t& reader, uint8_t& sensorIndex, message_sensor_timestamped_t& sensorMessage);
+#endif
+
+/**
+ * Rebuild the hourly and daily rollups of the requested sensor by reading the whole history.
+ * Rollups of time ranges, that are not part of the history anymore, are lost.
+ * @param sensorIndex Index of the sensor, for which the rollups are rebuilt. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @return True if the rollups were rebuilt successfully; otherwise false.
+ */
+bool memory_rebuildSensorRollups(uint8_t sensorIndex);
+
+/**
+ * Open a reader for the hourly or daily rollups of the requested sensor.
+ * @param reader The reader that is opened.
+ * @param sensorIndex Index of the sensor, for which the rollups are read. If lager than NUM_SUPPORTED_SENSORS it is limited to this value.
+ * @param resolution Resolution of the rollups that are read.
+ * @param timeFrom The reader starts with the bucket that contains this timestamp.
+ */
+void memory_openRollupReader(memory_rollup_reader_t& reader, uint8_t sensorIndex, RollupResolutions resolution, time_t timeFrom);
+
+/**
+ * Read the next rollup bucket from the reader. The buckets are returned in time order. The last bucket is the one that is still in progress.
+ * @param reader The reader opened with memory_openRollupReader().
+ * @param entry The read rollup bucket.
+ * @return True if a bucket was read; false if there are no more buckets.
+ */
+bool memory_readRollupEntry(memory_rollup_reader_t& reader, history_rollup_entry_t& entry);
+
+/**
+ * Close the reader and the opened rollup file.
+ * @param reader The reader opened with memory_openRollupReader().
+ */
+void memory_closeRollupReader(memory_rollup_reader_t& reader);
+
 /**
  * Save the system config (MAC addresses, modes and LMKs for all supported sensors) to the LittleFS.
  * The system config is used to save the configuration across device restarts.
+ * The config is only copied and marked as changed here. It is written by memory_loop() when it wasn't changed for MEMORY_SYSTEM_CONFIG_SAVE_DELAY_MS (use memory_flushSystemConfig() to write it immediately).
+ * Unchanged configs aren't written again.
  * @param sysConfig The system config struct, which is saved.
- * @return True if the system config was successfully saved; otherwise false.
+ * @return Always true. The config is written later.
  */
 bool memory_saveSystemConfig(system_config_t& sysConfig);
 
+/**
+ * Write a changed system config immediately to the slot file that doesn't contain the newest valid config.
+ * The other slot keeps the previous config, so a power loss during the write never loses the config.
+ * @return True if the system config is written (or was unchanged); otherwise false.
+ */
+bool memory_flushSystemConfig();
+
 /**
  * Load the system config (MAC addresses, modes and LMKs for all supported sensors) from the LittleFS.
  * The system config is used to save the configuration across device restarts.
+ * The valid slot file (magic and CRC) with the newest generation is used. If no slot is valid, the legacy system config file is loaded.
+ * Files written by older versions (before fields were appended to system_config_t) are loaded as well. The missing fields keep their default values.
  * @param sysConfig The system config struct, which is loaded.
  * @return True if the system config was successfully loaded and is valid; otherwise false.
  */
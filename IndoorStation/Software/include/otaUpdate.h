@@ -4,6 +4,8 @@
 #include <ESPAsyncWebServer.h>
 #include <ElegantOTA.h>
 
+#define OTA_UPDATE_TIMEOUT_MS   30000       // A running OTA update is treated as failed if no data is received for this time
+
 void otaUpdate_init(AsyncWebServer* server);
 void otaUpdate_loop();
 
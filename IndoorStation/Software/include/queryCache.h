@@ -0,0 +1,105 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <Arduino.h>
+#include <memory>
+#include "config.h"
+#include "structures.h"
+#include "memory.h"
+
+/*
+ * Small LRU cache for the serialized results of the history queries (/get_data, /get_rollup), so that chart reloads and several open browser tabs don't read the same range from the flash again.
+ * A result is captured while it is sent for the first time. It is only used as long as the history generation of the sensor (see memory_getHistoryGeneration()) doesn't change.
+ * All buffers of the cache (the cached results, results that are still sent after they were evicted and the result that is captured) are limited to QUERY_CACHE_BUDGET_BYTES.
+ */
+#define QUERY_CACHE_MAX_ENTRIES         8                   // Maximum number of cached results
+#define QUERY_CACHE_BUDGET_BYTES        (6 * 1024UL)        // Maximum number of heap bytes used by the cache
+#define QUERY_CACHE_MAX_RESULT_BYTES    2048                // Larger results are not cached (the capture is stopped)
+#define QUERY_CACHE_MIN_FREE_HEAP       (16 * 1024UL)       // No result is captured if less heap would be left afterwards
+
+enum QueryCacheEndpoints
+{
+    QUERY_CACHE_ENDPOINT_DATA = 0,          // /get_data
+    QUERY_CACHE_ENDPOINT_ROLLUP = 1         // /get_rollup
+};
+
+enum QueryCacheFormats
+{
+    QUERY_CACHE_FORMAT_JSON = 0,            // JSON array
+    QUERY_CACHE_FORMAT_NDJSON = 1,          // Newline delimited JSON
+    QUERY_CACHE_FORMAT_BINARY = 2           // Binary records (format=bin of /get_data)
+};
+
+/**
+ * Parameters of a query that identify its result.
+ */
+typedef struct query_cache_key
+{
+    uint8_t endpoint;               // QueryCacheEndpoints
+    uint8_t sensorIndex;
+    uint8_t format;                 // QueryCacheFormats
+    uint32_t params;                // Further parameters of the endpoint (the rollup resolution or maxPoints of /get_data)
+    time_t timeFrom;
+    time_t timeTo;
+} query_cache_key_t;
+
+/**
+ * Result of a query that is captured while it is sent.
+ */
+typedef struct query_cache_capture
+{
+    query_cache_key_t key;
+    uint32_t generation;            // History generation of the sensor at the start of the query
+    uint8_t* data = NULL;           // Captured bytes (NULL if nothing is captured)
+    size_t length = 0;              // Number of captured bytes
+} query_cache_capture_t;
+
+/**
+ * Counters of the query cache.
+ */
+typedef struct query_cache_stats
+{
+    uint32_t hits;                  // Number of queries that were answered from the cache
+    uint32_t misses;                // Number of queries that had to be read from the history
+    uint8_t numberEntries;          // Number of cached results
+    size_t usedBytes;               // Number of heap bytes used by the cache
+} query_cache_stats_t;
+
+/**
+ * Search the cached result of a query. The hit or miss is counted.
+ * @param key Parameters of the query.
+ * @param length Number of bytes of the result.
+ * @return The result (it stays valid as long as the returned pointer is kept, even if it is evicted from the cache); NULL if it isn't cached.
+ */
+std::shared_ptr<const uint8_t> queryCache_find(const query_cache_key_t& key, size_t& length);
+
+/**
+ * Start to capture the result of a query that wasn't found in the cache. A capture that is still running is aborted.
+ * Nothing is captured if the buffer doesn't fit into the budget or the free heap.
+ * @param capture The capture that is started.
+ * @param key Parameters of the query.
+ */
+void queryCache_beginCapture(query_cache_capture_t& capture, const query_cache_key_t& key);
+
+/**
+ * Append the next sent bytes of the result to the capture. The capture is aborted if the result gets larger than QUERY_CACHE_MAX_RESULT_BYTES.
+ */
+void queryCache_appendCapture(query_cache_capture_t& capture, const uint8_t* data, size_t length);
+
+/**
+ * Finish the capture after the complete result was sent and add it to the cache. The least recently used results are evicted if needed.
+ * The result is dropped if the history of the sensor changed during the query.
+ */
+void queryCache_endCapture(query_cache_capture_t& capture);
+
+/**
+ * Abort the capture (e.g. if the query wasn't sent completely). The buffer is freed.
+ */
+void queryCache_abortCapture(query_cache_capture_t& capture);
+
+/**
+ * Get the counters of the query cache.
+ */
+void queryCache_getStats(query_cache_stats_t& stats);
+
+#endif
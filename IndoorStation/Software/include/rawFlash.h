@@ -0,0 +1,68 @@
+#ifndef RAWFLASH_H
+#define RAWFLASH_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+
+/*
+ * Direct access to a flash region outside of the file system (spi_flash_read() / spi_flash_write() / spi_flash_erase_sector()). It is used by the unified history log (see historyLog.h)
+ * to write the log segments as a circular log of flash sectors without the overhead of LittleFS. The config, the index files and the web assets stay in LittleFS.
+ * The region is located behind the maximum sketch size (1 MB) and in front of the area that is used to stage OTA updates (directly in front of the file system at 0x200000 with the 4 MB flash layouts
+ * that have a 2 MB file system). rawFlash_begin() checks that the sketch and the OTA update fit around the region (sketch size up to 768 kB).
+ * NOR flash semantics: Writing can only change bits from 1 to 0, an erased sector reads 0xFF. Writing 0xFF bytes doesn't change the flash content, so unaligned writes are padded with 0xFF.
+ * With RAW_FLASH_SIMULATOR defined, the region is simulated in RAM with the same semantics, so that the storage engine can be tested on the host (Linux).
+ */
+#define RAW_FLASH_SECTOR_SIZE           4096                // Size of an erasable flash sector in bytes
+#define RAW_FLASH_START_ADDRESS         0x100000            // Physical flash address of the region (must be sector aligned)
+#define RAW_FLASH_SIZE                  (256 * 1024UL)      // Size of the region in bytes (must be a multiple of RAW_FLASH_SECTOR_SIZE)
+#define RAW_FLASH_NUMBER_SECTORS        (RAW_FLASH_SIZE / RAW_FLASH_SECTOR_SIZE)
+
+/**
+ * Check that the region doesn't overlap the sketch, the OTA update area or the file system.
+ * @return True if the region can be used; otherwise false (all reads and writes fail).
+ */
+bool rawFlash_begin();
+
+/**
+ * Read bytes from the region. Address and length don't need to be aligned.
+ * @param address Offset inside the region.
+ * @return True if the bytes were read; otherwise false.
+ */
+bool rawFlash_read(uint32_t address, uint8_t* buffer, size_t length);
+
+/**
+ * Write bytes to the region. Address and length don't need to be aligned. The bytes must be erased (0xFF) before, otherwise the result is the AND combination of the old and new bytes.
+ * @param address Offset inside the region.
+ * @return True if the bytes were written; otherwise false.
+ */
+bool rawFlash_write(uint32_t address, const uint8_t* data, size_t length);
+
+/**
+ * Erase a sector of the region (all bytes are set to 0xFF). This takes about 30 ms.
+ * @param sector Number of the sector inside the region.
+ * @return True if the sector was erased; otherwise false.
+ */
+bool rawFlash_eraseSector(uint16_t sector);
+
+#ifdef RAW_FLASH_SIMULATOR
+/**
+ * Erase the whole simulated region and reset the counters.
+ */
+void rawFlash_simulatorReset();
+
+/**
+ * Get the number of erase cycles of a sector of the simulated region.
+ */
+uint32_t rawFlash_simulatorGetEraseCount(uint16_t sector);
+
+/**
+ * Simulate a power loss: Only the next numberBytes bytes are written, all following writes and erases fail (-1 = no limit).
+ */
+void rawFlash_simulatorSetWriteLimit(int32_t numberBytes);
+#endif
+
+#endif
+
+#endif
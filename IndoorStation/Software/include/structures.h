@@ -19,6 +19,50 @@ typedef struct __attribute__((packed)) message_sensor_timestamped
     time_t timestamp;
 }message_sensor_timestamped_t;
 
+// One entry of the sparse time index that is saved beside the history segment files of each sensor. There is one entry for each block of the history segments.
+typedef struct __attribute__((packed)) history_index_entry
+{
+    time_t timestamp;               // This field contains the timestamp of the first sensor message in the block
+    uint32_t position;              // This field contains the position of the block inside the history (segment number * segment size + byte offset inside the segment)
+    uint32_t messageNumber;         // This field contains the consecutive number of the first sensor message in the block (used to count the messages without reading the history)
+}history_index_entry_t;
+
+// One bucket of the hourly or daily rollups that are saved beside the history segment files of each sensor
+typedef struct __attribute__((packed)) history_rollup_entry
+{
+    time_t bucketStart;             // This field contains the start of the hour or day (UTC) that is summarized by this bucket
+    uint16_t numberOpen;            // This field contains the number of sensor messages with the door open
+    uint16_t numberClosed;          // This field contains the number of sensor messages with the door closed
+    uint16_t minBatteryVoltage_mV;  // This field contains the minimum battery voltage in mV
+    uint16_t maxBatteryVoltage_mV;  // This field contains the maximum battery voltage in mV
+    uint16_t lastBatteryVoltage_mV; // This field contains the battery voltage of the last sensor message in mV
+    uint8_t maxNumberSendLoops;     // This field contains the maximum number of loops needed to send a message to the indoor station
+}history_rollup_entry_t;
+
+enum RollupResolutions
+{
+    ROLLUP_RESOLUTION_HOUR = 0,     // One bucket per hour
+    ROLLUP_RESOLUTION_DAY = 1,      // One bucket per day
+    NUM_ROLLUP_RESOLUTIONS = 2
+};
+
+#define HISTORY_SEGMENT_MAGIC               0x32484447UL    // "GDH2" in ASCII. This magic number is used to identify history segments in the v2 format.
+#define HISTORY_SEGMENT_FORMAT_VERSION      2
+#define HISTORY_SEGMENT_FLAG_BLOCK_CRC      0x01            // Each completed block of the segment ends with the CRC32 of the block
+#define HISTORY_SEGMENT_FLAG_SENSOR_ID      0x02            // Each record starts with the sensor id (sensor index + 1). Used by the unified history log (see historyLog.h).
+#define HISTORY_SEGMENT_FLAG_SEGMENT_NUMBER 0x04            // The header is followed by the number of the segment (uint32_t). Used by the unified history log to find the order of the segments in a circular flash region.
+
+// Header at the beginning of each history segment (and of each downloaded history file)
+typedef struct __attribute__((packed)) history_segment_header
+{
+    uint32_t magic;                 // This field contains the HISTORY_SEGMENT_MAGIC
+    uint8_t version;                // This field contains the HISTORY_SEGMENT_FORMAT_VERSION
+    uint8_t flags;                  // This field contains the HISTORY_SEGMENT_FLAG_... bits. Unknown bits are reserved (0).
+    uint16_t blockSize;             // This field contains the size of the blocks in bytes. Each block starts with a keyframe record.
+    uint16_t segmentSize;           // This field contains the size of a full segment in bytes
+    time_t baseTimestamp;           // This field contains the timestamp of the first sensor message in the segment
+}history_segment_header_t;
+
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 enum SensorModes
@@ -42,22 +86,69 @@ typedef struct sensor_config
     bool useEncryption = false;
 } sensor_config_t;
 
+typedef struct retention_policy
+{
+    uint16_t maxAge_days = 0;           // Older history segments are deleted (0 = no age limit)
+    uint16_t maxSize_kB = 0;            // The oldest history segments are deleted when the history is larger (0 = only limited by MEMORY_HISTORY_MAX_SIZE_PER_SENSOR)
+} retention_policy_t;
+
+enum HistorySamplingModes
+{
+    HISTORY_SAMPLING_ALWAYS = 0,            // Every received message is saved
+    HISTORY_SAMPLING_STATE_CHANGE = 1,      // Only messages with a changed door state are saved
+    HISTORY_SAMPLING_SIGNIFICANT = 2,       // Messages with a changed door state, a significant battery voltage change or a long time since the last saved message are saved
+};
+
+typedef struct history_sampling_policy
+{
+    uint8_t mode = HISTORY_SAMPLING_ALWAYS;     // HistorySamplingModes
+    uint16_t minVoltageDelta_mV = 50;           // HISTORY_SAMPLING_SIGNIFICANT: A message is saved if its battery voltage differs more than this from the last saved message
+    uint16_t maxInterval_hours = 24;            // HISTORY_SAMPLING_SIGNIFICANT: A message is saved if the last saved message is older than this (0 = no time limit)
+} history_sampling_policy_t;
+
 typedef struct system_config
 {
     sensor_config_t sensors[NUM_SUPPORTED_SENSORS];
     uint8_t pmk[ESPNOW_KEY_LEN] = {0};
     uint8_t batteryEmptyThreshold_percent = 0; // Default value, will be set in main_setDefaultSystemConfig
+    // Fields added later are appended here, so that the config files of older versions can still be loaded (see SYSTEM_CONFIG_V1_DATA_SIZE)
+    retention_policy_t retentionPolicies[NUM_SUPPORTED_SENSORS];   // Retention policy of the history of each sensor
+    uint8_t retentionHighWatermark_percent = 85;    // The oldest history is deleted when the file system usage exceeds this value ...
+    uint8_t retentionLowWatermark_percent = 70;     // ... until the usage is below this value
+    history_sampling_policy_t samplingPolicies[NUM_SUPPORTED_SENSORS];  // Policy of each sensor which received messages are saved in the history
 } system_config_t;
 
+#define SYSTEM_CONFIG_V1_DATA_SIZE      offsetof(system_config_t, retentionPolicies)   // Number of data bytes of the system config files written before the retention fields were added
+#define SYSTEM_CONFIG_V2_DATA_SIZE      offsetof(system_config_t, samplingPolicies)    // Number of data bytes of the system config files written before the sampling fields were added
+
 #define MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC   0x53434647UL  // "SCFG"
 
 typedef struct persisted_system_config
 {
     uint32_t magic = MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC;
+    uint32_t generation = 0;            // Incremented with every save. The config is saved alternately to two slot files and the valid slot with the newest generation is loaded.
     system_config_t system_config;
     uint32_t crc32 = 0;
 } persisted_system_config_t;
 
+typedef struct persisted_system_config_legacy     // Format of the single system config file used before the two slot files (only loaded if no slot is valid)
+{
+    uint32_t magic = MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC;
+    system_config_t system_config;
+    uint32_t crc32 = 0;
+} persisted_system_config_legacy_t;
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#define MEMORY_LATEST_STATE_SNAPSHOT_MAGIC     0x4C415453UL  // "STAL"
+
+typedef struct latest_state_snapshot                // Latest message of each sensor. Kept in the RTC memory and a small file to show the sensor states directly after booting. The size is a multiple of 4 bytes (required for the RTC memory).
+{
+    uint32_t magic = MEMORY_LATEST_STATE_SNAPSHOT_MAGIC;
+    message_sensor_timestamped_t latestMessages[NUM_SUPPORTED_SENSORS];    // timestamp -1 if there is no message for the sensor
+    uint32_t crc32 = 0;
+} latest_state_snapshot_t;
+
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 #define PAIRING_MAGIC_NUMBER                0x50414952      // "PAIR" in ASCII. This magic number is used to identify pairing messages from the sensors.
@@ -16,6 +16,16 @@
  */
 uint32_t utils_calculateCRC32(const uint8_t* data, size_t length);
 
+/**
+ * Continue the CRC32 calculation with more data. utils_calculateCRC32(data, length) equals utils_updateCRC32(0xFFFFFFFF, data, length).
+ * This is used to calculate the checksum of data that is appended in several parts.
+ * @param crc The CRC32 of the previous data (0xFFFFFFFF at the start)
+ * @param data Pointer to the input data
+ * @param length Length of the input data in bytes
+ * @return The CRC32 checksum of the previous data and the input data
+ */
+uint32_t utils_updateCRC32(uint32_t crc, const uint8_t* data, size_t length);
+
 /**
  * Parse a MAC address string in the format "XX:XX:XX:XX:XX:XX" and convert it to a byte array.
  * @param str The input string containing the MAC address
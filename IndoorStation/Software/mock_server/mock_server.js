@@ -23,6 +23,8 @@ const SENSOR_MODE_ONLY_DISPLAY = 3;     // Messages are only displayed via the L
 const SENSOR_MODE_PAIRING = 4;          // Message from Indoor Station to corresponding sensor to configure the MAC address in the sensor, LED flashes red and blue, nothing is saved
 
 let batteryEmptyThreshold = 15;
+let retentionHighWatermark = 85;
+let retentionLowWatermark = 70;
 
 // Initialize arrays based on NUM_SUPPORTED_SENSORS
 let sensorModes = new Array(NUM_SUPPORTED_SENSORS).fill(SENSOR_MODE_NORMAL);
@@ -36,6 +38,11 @@ for (let i = 0; i < NUM_SUPPORTED_SENSORS; i++) {
 }
 let sensorsPaired = new Array(NUM_SUPPORTED_SENSORS).fill(true);
 let sensorsEncrypted = new Array(NUM_SUPPORTED_SENSORS).fill(true);
+let sensorRetentionMaxAge = new Array(NUM_SUPPORTED_SENSORS).fill(0);
+let sensorRetentionMaxSize = new Array(NUM_SUPPORTED_SENSORS).fill(0);
+let sensorSamplingMode = new Array(NUM_SUPPORTED_SENSORS).fill(0);               // HistorySamplingModes enum from structures.h (0 = save every message)
+let sensorSamplingVoltageDelta = new Array(NUM_SUPPORTED_SENSORS).fill(50);
+let sensorSamplingInterval = new Array(NUM_SUPPORTED_SENSORS).fill(24);
 
 // Set specific modes for testing
 sensorModes[0] = SENSOR_MODE_CHARGING;
@@ -243,7 +250,13 @@ app.get("/get_sensor_status", (req, res) =>
             numMessages: getNumMessagesPerSensorFromBinFile(i),
             swVersion: "v0.0",
             isPaired: sensorsPaired[i],
-            useEncryption: sensorsEncrypted[i]
+            useEncryption: sensorsEncrypted[i],
+            historySize: getNumMessagesPerSensorFromBinFile(i) * 13,
+            retentionMaxAge: sensorRetentionMaxAge[i],
+            retentionMaxSize: sensorRetentionMaxSize[i],
+            samplingMode: sensorSamplingMode[i],
+            samplingVoltageDelta: sensorSamplingVoltageDelta[i],
+            samplingInterval: sensorSamplingInterval[i]
         };
         sensors.push(sensor);
     }
@@ -258,7 +271,14 @@ app.get("/get_indoor_station_info", (req, res) =>
         mac: "01:02:03:04:05:06",
         swVersion: "v0.0",
         memoryUsage: "9.77 %",
-        batteryEmptyThreshold: batteryEmptyThreshold
+        batteryEmptyThreshold: batteryEmptyThreshold,
+        retentionHighWatermark: retentionHighWatermark,
+        retentionLowWatermark: retentionLowWatermark,
+        retentionActive: false,
+        queryCacheHits: 12,
+        queryCacheMisses: 5,
+        queryCacheEntries: 3,
+        queryCacheBytes: 4352
     };
     res.json(info);
 });
@@ -310,6 +330,56 @@ app.get("/set_battery_empty_threshold", (req, res) =>
 
 // #########################################################################################
 
+app.get("/set_retention_policy", (req, res) => 
+{
+    const sensorIndex = parseInt(req.query.sensorIndex);
+    if(sensorIndex >= 0 && sensorIndex < NUM_SUPPORTED_SENSORS)
+    {
+        sensorRetentionMaxAge[sensorIndex] = Math.min(Math.max(parseInt(req.query.maxAge) || 0, 0), 65535);
+        sensorRetentionMaxSize[sensorIndex] = Math.min(Math.max(parseInt(req.query.maxSize) || 0, 0), 128);
+    }
+    res.redirect("/system_management.html");
+});
+
+// #########################################################################################
+
+app.get("/set_sampling_policy", (req, res) => 
+{
+    const sensorIndex = parseInt(req.query.sensorIndex);
+    if(sensorIndex >= 0 && sensorIndex < NUM_SUPPORTED_SENSORS)
+    {
+        if(req.query.mode !== undefined)
+        {
+            sensorSamplingMode[sensorIndex] = Math.min(Math.max(parseInt(req.query.mode) || 0, 0), 2);
+        }
+        if(req.query.voltageDelta !== undefined)
+        {
+            sensorSamplingVoltageDelta[sensorIndex] = Math.min(Math.max(parseInt(req.query.voltageDelta) || 0, 0), 65535);
+        }
+        if(req.query.interval !== undefined)
+        {
+            sensorSamplingInterval[sensorIndex] = Math.min(Math.max(parseInt(req.query.interval) || 0, 0), 65535);
+        }
+    }
+    res.redirect("/system_management.html");
+});
+
+// #########################################################################################
+
+app.get("/set_retention_watermarks", (req, res) => 
+{
+    const high = parseInt(req.query.high);
+    const low = parseInt(req.query.low);
+    if(high > 0 && high <= 100 && low >= 0 && low < high) // Ensure valid percentages with a hysteresis
+    {
+        retentionHighWatermark = high;
+        retentionLowWatermark = low;
+    }
+    res.send("OK");
+});
+
+// #########################################################################################
+
 app.post("/remove_data", (req, res) => 
 {
     const sensorIndex = parseInt(req.body.sensorIndex);
@@ -343,6 +413,37 @@ app.post("/remove_data", (req, res) =>
 
 // #########################################################################################
 
+app.get("/get_history_check", (req, res) =>
+{
+    // The mock server has no block based history, so the check never finds anything
+    const sensors = [];
+    for(let i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        sensors.push({
+            index: i,
+            checkedBlocks: 0,
+            tornBytes: 0,
+            invalidSegments: 0,
+            crcErrorBlocks: 0,
+            invalidRecordBlocks: 0,
+            absurdTimestamps: 0,
+            outOfOrderTimestamps: 0,
+            lostMessages: 0,
+            repairedBlocks: 0
+        });
+    }
+    res.json({ running: false, duration_ms: 0, sensors: sensors });
+});
+
+// #########################################################################################
+
+app.post("/start_history_check", (req, res) =>
+{
+    res.send("OK");
+});
+
+// #########################################################################################
+
 app.post("/upload_data", upload.single('data'), (req, res) =>
 {
     const sensorIndex = parseInt(req.body.sensorIndex);
@@ -393,6 +494,52 @@ app.get("/download_data", (req, res) =>
 
 // #########################################################################################
 
+app.get("/export", (req, res) =>
+{
+    const sensorIndex = parseInt(req.query.sensorIndex);
+    if(isNaN(sensorIndex))
+    {
+        res.send("sensorIndex parameter not set or out of range");
+        return;
+    }
+    const format = req.query.format || "csv";
+    if(format != "csv" && format != "ndjson")
+    {
+        res.status(400).send("format parameter must be csv or ndjson");
+        return;
+    }
+    const from = parseInt(req.query.from) || 0;
+    const to = parseInt(req.query.to) || Number.MAX_SAFE_INTEGER;
+
+    // The compression of the indoor station isn't simulated (the export is always sent uncompressed)
+    res.setHeader("Content-Type", (format == "ndjson") ? "application/x-ndjson" : "text/csv");
+    res.setHeader("Content-Disposition", "attachment; filename=\"dataSensor" + sensorIndex + "." + format + "\"");
+    if(format == "csv")
+    {
+        res.write("time,pin,voltage_mV,batP,loops\n");
+    }
+    for(const m of readSensorBinFile(sensorIndex))
+    {
+        if(m.timestamp < from || m.timestamp > to)
+        {
+            continue;
+        }
+        const time = new Date(m.timestamp * 1000).toISOString().replace(/\.\d{3}Z$/, "Z");
+        const batP = battery_voltageToPercent(m.batteryVoltage_mV).toFixed(1);
+        if(format == "ndjson")
+        {
+            res.write(`{"time":"${time}","pin":${m.pinState ? 1 : 0},"voltage_mV":${m.batteryVoltage_mV},"batP":${batP},"loops":${m.numberSendLoops}}\n`);
+        }
+        else
+        {
+            res.write(`${time},${m.pinState ? 1 : 0},${m.batteryVoltage_mV},${batP},${m.numberSendLoops}\n`);
+        }
+    }
+    res.end();
+});
+
+// #########################################################################################
+
 app.get("/get_data", (req, res) => 
 {
     const sensorIndex = parseInt(req.query.sensorIndex);
@@ -403,6 +550,12 @@ app.get("/get_data", (req, res) =>
     }
     const from = parseInt(req.query.from) || 0;
     const to = parseInt(req.query.to) || Number.MAX_SAFE_INTEGER;
+    const format = req.query.format || "json";
+    if(format != "json" && format != "ndjson" && format != "bin")
+    {
+        res.status(400).send("format parameter must be json, ndjson or bin");
+        return;
+    }
 
     const messages = readSensorBinFile(sensorIndex);
     if(messages.length == 0)
@@ -411,14 +564,19 @@ app.get("/get_data", (req, res) =>
         return;
     }
 
-    res.setHeader("Content-Type", "text/plain");
+    res.setHeader("Content-Type", (format == "bin") ? "application/octet-stream" : ((format == "ndjson") ? "application/x-ndjson" : "application/json"));
 
     let index = 0;
+    let numberRecords = 0;
     const interval = setInterval(() =>
     {
         if(index >= messages.length)
         {
             clearInterval(interval);
+            if(format == "json")
+            {
+                res.write((numberRecords == 0) ? "[]" : "]");
+            }
             res.end();
             return;
         }
@@ -431,6 +589,19 @@ app.get("/get_data", (req, res) =>
             return;
         }
 
+        if(format == "bin")
+        {
+            // timestamp (uint32), battery voltage in mV (uint16), pin state (uint8), number of send loops (uint8), all little-endian
+            const record = Buffer.alloc(8);
+            record.writeUInt32LE(m.timestamp, 0);
+            record.writeUInt16LE(m.batteryVoltage_mV, 4);
+            record.writeUInt8(m.pinState ? 1 : 0, 6);
+            record.writeUInt8(m.numberSendLoops, 7);
+            res.write(record);
+            index++;
+            return;
+        }
+
         const obj =
         {
             time: m.timestamp,
@@ -438,9 +609,17 @@ app.get("/get_data", (req, res) =>
             batP: battery_voltageToPercent(m.batteryVoltage_mV)
         };
 
-        // send JSON
+        // send JSON (all records in one array or one record per line)
         const json = JSON.stringify(obj);
-        res.write(json);
+        if(format == "ndjson")
+        {
+            res.write(json + "\n");
+        }
+        else
+        {
+            res.write(((numberRecords == 0) ? "[" : ",") + json);
+        }
+        numberRecords++;
         index++;
 
     }, 2000 / messages.length); // simulate chunked transfer like ESP
@@ -448,6 +627,105 @@ app.get("/get_data", (req, res) =>
 
 // #########################################################################################
 
+// Same downsampling as the indoor station: the messages with the minimum and maximum battery voltage of each time bucket and all pin state changes are kept
+function downsampleMessages(messages, maxPoints)
+{
+    if(maxPoints == 0 || messages.length == 0)
+    {
+        return messages;
+    }
+    const timeFrom = messages[0].timestamp;
+    const bucketDuration = Math.floor((messages[messages.length - 1].timestamp - timeFrom) / Math.floor(maxPoints / 2)) + 1;
+    const result = [];
+    let bucket = [];
+    const flushBucket = () =>
+    {
+        if(bucket.length > 0)
+        {
+            const min = bucket.reduce((a, b) => (b.batteryVoltage_mV < a.batteryVoltage_mV) ? b : a);
+            const max = bucket.reduce((a, b) => (b.batteryVoltage_mV > a.batteryVoltage_mV) ? b : a);
+            bucket.filter(m => m === min || m === max).forEach(m => result.push(m));
+        }
+        bucket = [];
+    };
+    let lastPinState = null;
+    messages.forEach(m =>
+    {
+        if(m.pinState !== lastPinState)
+        {
+            flushBucket();
+            result.push(m);
+            lastPinState = m.pinState;
+            return;
+        }
+        if(bucket.length > 0 && Math.floor((m.timestamp - timeFrom) / bucketDuration) != Math.floor((bucket[0].timestamp - timeFrom) / bucketDuration))
+        {
+            flushBucket();
+        }
+        bucket.push(m);
+    });
+    flushBucket();
+    return result;
+}
+
+app.get("/get_data_multi", (req, res) => 
+{
+    const sensorIndices = (req.query.sensors !== undefined) ? req.query.sensors.split(",").map(index => parseInt(index)) : [0, 1, 2];
+    if(sensorIndices.some(index => isNaN(index) || index < 0 || index > 2) || new Set(sensorIndices).size != sensorIndices.length)
+    {
+        res.status(400).send("sensors parameter must be a comma separated list of different sensor indices");
+        return;
+    }
+    const from = parseInt(req.query.from) || 0;
+    const to = parseInt(req.query.to) || Number.MAX_SAFE_INTEGER;
+    const format = req.query.format || "json";
+    if(format != "json" && format != "ndjson" && format != "bin")
+    {
+        res.status(400).send("format parameter must be json, ndjson or bin");
+        return;
+    }
+    const maxPoints = (req.query.maxPoints !== undefined) ? parseInt(req.query.maxPoints) : 0;
+    if(isNaN(maxPoints) || (req.query.maxPoints !== undefined && (maxPoints < 2 || maxPoints > 65535)))
+    {
+        res.status(400).send("maxPoints parameter must be between 2 and 65535");
+        return;
+    }
+
+    // Merge the histories of all requested sensors by their timestamps
+    const records = [];
+    sensorIndices.forEach(sensorIndex =>
+    {
+        const messages = readSensorBinFile(sensorIndex).filter(m => m.timestamp >= from && m.timestamp <= to);
+        downsampleMessages(messages, maxPoints).forEach(m =>
+        {
+            records.push({ sensorIndex: sensorIndex, m: m });
+        });
+    });
+    records.sort((a, b) => a.m.timestamp - b.m.timestamp);
+
+    res.setHeader("Content-Type", (format == "bin") ? "application/octet-stream" : ((format == "ndjson") ? "application/x-ndjson" : "application/json"));
+    if(format == "bin")
+    {
+        // record of /get_data followed by the sensor index (uint8)
+        const buffer = Buffer.alloc(records.length * 9);
+        records.forEach((record, i) =>
+        {
+            buffer.writeUInt32LE(record.m.timestamp, i * 9);
+            buffer.writeUInt16LE(record.m.batteryVoltage_mV, i * 9 + 4);
+            buffer.writeUInt8(record.m.pinState ? 1 : 0, i * 9 + 6);
+            buffer.writeUInt8(record.m.numberSendLoops, i * 9 + 7);
+            buffer.writeUInt8(record.sensorIndex, i * 9 + 8);
+        });
+        res.end(buffer);
+        return;
+    }
+
+    const lines = records.map(record => JSON.stringify({ sensor: record.sensorIndex, time: record.m.timestamp, pin: record.m.pinState ? 1 : 0, batP: battery_voltageToPercent(record.m.batteryVoltage_mV) }));
+    res.end((format == "ndjson") ? lines.map(line => line + "\n").join("") : "[" + lines.join(",") + "]");
+});
+
+// #########################################################################################
+
 app.get("/get_pairing_info", (req, res) => 
 {
     const info = {
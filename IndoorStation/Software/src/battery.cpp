@@ -24,17 +24,24 @@ batteryLookupTableEntry_t batteryLookupTable[] = {
 
 #define NUM_BATTERY_LOOKUP_TABLE_ENTRIES        (sizeof(batteryLookupTable) / sizeof(batteryLookupTable[0]))
 
-float battery_voltageToPercent(uint16_t batteryVoltage_mV, uint8_t numberFractionalDigits)
+uint32_t battery_voltageToScaledPercent(uint16_t batteryVoltage_mV, uint8_t numberFractionalDigits)
 {
+    // The multiplier determines the number of fractional digits. 1000=10^3 -> 3 digits, 100=10^2 -> 2 digits ...
+    uint32_t multiplier = 1;
+    for(uint8_t i = 0; i < numberFractionalDigits; i++)
+    {
+        multiplier *= 10;
+    }
+
     // if the voltage is smaller or equal than the first lookup table entry voltage, return the first entry percentage
     if(batteryVoltage_mV <= batteryLookupTable[0].batteryVoltage_mV)
     {
-        return (float)batteryLookupTable[0].batteryLevel_percent;
+        return batteryLookupTable[0].batteryLevel_percent * multiplier;
     }
     // if the voltage is greater or equal than the last lookup table entry voltage, return the last entry percentage
     if(batteryVoltage_mV >= batteryLookupTable[NUM_BATTERY_LOOKUP_TABLE_ENTRIES - 1].batteryVoltage_mV)
     {
-        return (float)batteryLookupTable[NUM_BATTERY_LOOKUP_TABLE_ENTRIES - 1].batteryLevel_percent;
+        return batteryLookupTable[NUM_BATTERY_LOOKUP_TABLE_ENTRIES - 1].batteryLevel_percent * multiplier;
     }
 
     // Loop over each range in the lookup table and check if the voltage falls in the current range
@@ -45,17 +52,19 @@ float battery_voltageToPercent(uint16_t batteryVoltage_mV, uint8_t numberFractio
 
         if(batteryVoltage_mV > entry1.batteryVoltage_mV && batteryVoltage_mV <= entry2.batteryVoltage_mV)
         {
-            // The multiplier determines the number of fractional digits. 1000=10^3 -> 3 digits, 100=10^2 -> 2 digits ...
-            uint16_t multiplier = pow(10, numberFractionalDigits);
             // interpolate the battery voltage
-            float batteryPercentage = (float)(map(batteryVoltage_mV, entry1.batteryVoltage_mV, entry2.batteryVoltage_mV, entry1.batteryLevel_percent * multiplier, entry2.batteryLevel_percent * multiplier) / (float)multiplier);
-            return batteryPercentage;
+            return map(batteryVoltage_mV, entry1.batteryVoltage_mV, entry2.batteryVoltage_mV, entry1.batteryLevel_percent * multiplier, entry2.batteryLevel_percent * multiplier);
         }
     }
 
     return 0;       // If you get to this line, something with the lookup table seems to be wrong.
 }
 
+float battery_voltageToPercent(uint16_t batteryVoltage_mV, uint8_t numberFractionalDigits)
+{
+    return battery_voltageToScaledPercent(batteryVoltage_mV, numberFractionalDigits) / (float)pow(10, numberFractionalDigits);
+}
+
 bool battery_isEmpty(uint16_t batteryVoltage_mV, uint8_t threshold_percent)
 {
     uint8_t batteryLevel_percent = battery_voltageToPercent(batteryVoltage_mV);
@@ -0,0 +1,235 @@
+#include "deflateStream.h"
+
+#define DEFLATE_STREAM_MIN_MATCH        3
+#define DEFLATE_STREAM_MAX_MATCH        258
+#define DEFLATE_STREAM_ADLER32_MOD      65521
+
+// Base values and number of extra bits of the length codes 257..285 (RFC 1951, 3.2.5)
+const uint16_t deflateStream_lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t deflateStream_lengthExtraBits[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+// Base values and number of extra bits of the distance codes 0..19 (distances up to 1024, this is enough for the window size)
+const uint16_t deflateStream_distanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769 };
+const uint8_t deflateStream_distanceExtraBits[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8 };
+
+#define DEFLATE_STREAM_NUM_LENGTH_CODES     (sizeof(deflateStream_lengthBase) / sizeof(deflateStream_lengthBase[0]))
+#define DEFLATE_STREAM_NUM_DISTANCE_CODES   (sizeof(deflateStream_distanceBase) / sizeof(deflateStream_distanceBase[0]))
+
+#if DEFLATE_STREAM_WINDOW_SIZE > 1024
+#error "The distance table only covers window sizes up to 1024 bytes"
+#endif
+
+/**
+ * Append the bits to the bit buffer (lowest bit first) and write all complete bytes to the output.
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_writeBits(deflate_stream_t& stream, uint32_t value, uint8_t numberBits, uint8_t* output)
+{
+    size_t length = 0;
+    stream.bitBuffer |= value << stream.bitCount;
+    stream.bitCount += numberBits;
+    while(stream.bitCount >= 8)
+    {
+        output[length++] = (uint8_t)stream.bitBuffer;
+        stream.bitBuffer >>= 8;
+        stream.bitCount -= 8;
+    }
+    return length;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append a Huffman code. Huffman codes are stored starting with the highest bit, so the bits are reversed.
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_writeCode(deflate_stream_t& stream, uint16_t code, uint8_t numberBits, uint8_t* output)
+{
+    uint16_t reversed = 0;
+    for(uint8_t i = 0; i < numberBits; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 0x01);
+    }
+    return deflateStream_writeBits(stream, reversed, numberBits, output);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the fixed Huffman code of the literal/length symbol (0..287).
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_writeSymbol(deflate_stream_t& stream, uint16_t symbol, uint8_t* output)
+{
+    if(symbol < 144)
+    {
+        return deflateStream_writeCode(stream, 0x30 + symbol, 8, output);
+    }
+    else if(symbol < 256)
+    {
+        return deflateStream_writeCode(stream, 0x190 + (symbol - 144), 9, output);
+    }
+    else if(symbol < 280)
+    {
+        return deflateStream_writeCode(stream, symbol - 256, 7, output);
+    }
+    return deflateStream_writeCode(stream, 0xC0 + (symbol - 280), 8, output);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append a match with the given length (3..258) and distance (1..DEFLATE_STREAM_WINDOW_SIZE).
+ * @return Number of bytes written to the output.
+ */
+size_t deflateStream_writeMatch(deflate_stream_t& stream, uint16_t matchLength, uint16_t distance, uint8_t* output)
+{
+    size_t length = 0;
+    uint8_t code = DEFLATE_STREAM_NUM_LENGTH_CODES - 1;
+    while(deflateStream_lengthBase[code] > matchLength)
+    {
+        code--;
+    }
+    length += deflateStream_writeSymbol(stream, 257 + code, &output[length]);
+    length += deflateStream_writeBits(stream, matchLength - deflateStream_lengthBase[code], deflateStream_lengthExtraBits[code], &output[length]);
+
+    code = DEFLATE_STREAM_NUM_DISTANCE_CODES - 1;
+    while(deflateStream_distanceBase[code] > distance)
+    {
+        code--;
+    }
+    length += deflateStream_writeCode(stream, code, 5, &output[length]);
+    length += deflateStream_writeBits(stream, distance - deflateStream_distanceBase[code], deflateStream_distanceExtraBits[code], &output[length]);
+    return length;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Hash of the 3 bytes starting at the given position in the buffer.
+ */
+uint8_t deflateStream_hash(const uint8_t* data)
+{
+    uint32_t value = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    return (uint8_t)((value * 2654435761UL) >> 24) & (DEFLATE_STREAM_HASH_SIZE - 1);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t deflateStream_begin(deflate_stream_t& stream, uint8_t* output)
+{
+    stream.windowLength = 0;
+    memset(stream.hashTable, 0, sizeof(stream.hashTable));
+    stream.bitBuffer = 0;
+    stream.bitCount = 0;
+    stream.adler32 = 1;
+
+    // zlib header: deflate with 32 kB window (CMF = 0x78), fastest compression level without dictionary (FLG = 0x01, (CMF * 256 + FLG) % 31 == 0)
+    // The actual window is smaller, which is allowed (the decoder only needs to support the maximum distance).
+    output[0] = 0x78;
+    output[1] = 0x01;
+
+    // The whole stream is one final block with fixed Huffman codes (BFINAL = 1, BTYPE = 01)
+    size_t length = 2;
+    length += deflateStream_writeBits(stream, 1, 1, &output[length]);
+    length += deflateStream_writeBits(stream, 1, 2, &output[length]);
+    return length;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t deflateStream_compress(deflate_stream_t& stream, const uint8_t* data, size_t length, uint8_t* output)
+{
+    if(length > DEFLATE_STREAM_MAX_INPUT_SIZE)
+    {
+        length = DEFLATE_STREAM_MAX_INPUT_SIZE;
+    }
+
+    // Update the Adler-32 checksum. The sums can't overflow for up to DEFLATE_STREAM_MAX_INPUT_SIZE bytes, so the modulo is only needed once.
+    uint32_t adlerA = stream.adler32 & 0xFFFF;
+    uint32_t adlerB = stream.adler32 >> 16;
+    for(size_t i = 0; i < length; i++)
+    {
+        adlerA += data[i];
+        adlerB += adlerA;
+    }
+    stream.adler32 = ((adlerB % DEFLATE_STREAM_ADLER32_MOD) << 16) | (adlerA % DEFLATE_STREAM_ADLER32_MOD);
+
+    memcpy(&stream.buffer[stream.windowLength], data, length);
+    uint16_t position = stream.windowLength;
+    uint16_t end = stream.windowLength + length;
+    size_t outputLength = 0;
+
+    while(position < end)
+    {
+        uint16_t matchLength = 0;
+        uint16_t distance = 0;
+        if(end - position >= DEFLATE_STREAM_MIN_MATCH)
+        {
+            uint8_t hash = deflateStream_hash(&stream.buffer[position]);
+            uint16_t candidate = stream.hashTable[hash];
+            stream.hashTable[hash] = position + 1;
+            if(candidate != 0 && (position - (candidate - 1)) <= DEFLATE_STREAM_WINDOW_SIZE)
+            {
+                candidate--;
+                uint16_t maxLength = min((uint16_t)(end - position), (uint16_t)DEFLATE_STREAM_MAX_MATCH);
+                while(matchLength < maxLength && stream.buffer[candidate + matchLength] == stream.buffer[position + matchLength])
+                {
+                    matchLength++;
+                }
+                distance = position - candidate;
+            }
+        }
+
+        if(matchLength >= DEFLATE_STREAM_MIN_MATCH)
+        {
+            outputLength += deflateStream_writeMatch(stream, matchLength, distance, &output[outputLength]);
+            // Add the skipped positions to the hash table, so that following data can refer to them
+            for(uint16_t i = position + 1; i < position + matchLength && i + DEFLATE_STREAM_MIN_MATCH <= end; i++)
+            {
+                stream.hashTable[deflateStream_hash(&stream.buffer[i])] = i + 1;
+            }
+            position += matchLength;
+        }
+        else
+        {
+            outputLength += deflateStream_writeSymbol(stream, stream.buffer[position], &output[outputLength]);
+            position++;
+        }
+    }
+
+    // Keep only the last DEFLATE_STREAM_WINDOW_SIZE bytes as window for the next call
+    if(end > DEFLATE_STREAM_WINDOW_SIZE)
+    {
+        uint16_t shift = end - DEFLATE_STREAM_WINDOW_SIZE;
+        memmove(stream.buffer, &stream.buffer[shift], DEFLATE_STREAM_WINDOW_SIZE);
+        for(uint16_t i = 0; i < DEFLATE_STREAM_HASH_SIZE; i++)
+        {
+            stream.hashTable[i] = (stream.hashTable[i] > shift) ? (stream.hashTable[i] - shift) : 0;
+        }
+        stream.windowLength = DEFLATE_STREAM_WINDOW_SIZE;
+    }
+    else
+    {
+        stream.windowLength = end;
+    }
+    return outputLength;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t deflateStream_finish(deflate_stream_t& stream, uint8_t* output)
+{
+    // End of block symbol, then fill up the last byte with 0 bits
+    size_t length = deflateStream_writeSymbol(stream, 256, output);
+    if(stream.bitCount > 0)
+    {
+        length += deflateStream_writeBits(stream, 0, 8 - stream.bitCount, &output[length]);
+    }
+
+    // zlib trailer: Adler-32 checksum of the uncompressed data (big endian)
+    output[length++] = (uint8_t)(stream.adler32 >> 24);
+    output[length++] = (uint8_t)(stream.adler32 >> 16);
+    output[length++] = (uint8_t)(stream.adler32 >> 8);
+    output[length++] = (uint8_t)stream.adler32;
+    return length;
+}
@@ -0,0 +1,170 @@
+#include "historyCodec.h"
+#include "utils.h"
+
+/**
+ * Write the value as unsigned LEB128 varint (7 bits per byte, lowest bits first).
+ * @return Number of bytes written.
+ */
+size_t historyCodec_writeVarint(uint64_t value, uint8_t* buffer)
+{
+    size_t length = 0;
+    while(value >= 0x80)
+    {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    return length;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read an unsigned LEB128 varint.
+ * @return Number of bytes read. 0 if the varint is incomplete or too long.
+ */
+size_t historyCodec_readVarint(const uint8_t* buffer, size_t length, uint64_t& value)
+{
+    value = 0;
+    for(size_t i = 0; i < length && i < 10; i++)
+    {
+        value |= (uint64_t)(buffer[i] & 0x7F) << (7 * i);
+        if((buffer[i] & 0x80) == 0)
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+// Zigzag encoding maps signed values to unsigned values with a small magnitude (0, -1, 1, -2, 2, ... --> 0, 1, 2, 3, 4, ...)
+uint64_t historyCodec_zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t historyCodec_zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t historyCodec_encodeMessage(const message_sensor_timestamped_t& message, const message_sensor_timestamped_t* previousMessage, uint8_t* buffer)
+{
+    uint8_t tag = HISTORY_CODEC_TAG_RECORD;
+    if(message.msg.pinState)
+    {
+        tag |= HISTORY_CODEC_TAG_PIN_STATE;
+    }
+
+    size_t length = 1;
+    if(previousMessage == NULL)
+    {
+        tag |= HISTORY_CODEC_TAG_KEYFRAME | HISTORY_CODEC_TAG_LOOPS | HISTORY_CODEC_TAG_VERSION;
+        length += historyCodec_writeVarint(historyCodec_zigzagEncode(message.timestamp), buffer + length);
+        length += historyCodec_writeVarint(message.msg.batteryVoltage_mV, buffer + length);
+    }
+    else
+    {
+        if(message.timestamp < previousMessage->timestamp)
+        {
+            tag |= HISTORY_CODEC_TAG_TIME_BACKWARDS;
+            length += historyCodec_writeVarint((uint64_t)(previousMessage->timestamp - message.timestamp), buffer + length);
+        }
+        else
+        {
+            length += historyCodec_writeVarint((uint64_t)(message.timestamp - previousMessage->timestamp), buffer + length);
+        }
+        length += historyCodec_writeVarint(historyCodec_zigzagEncode((int32_t)message.msg.batteryVoltage_mV - (int32_t)previousMessage->msg.batteryVoltage_mV), buffer + length);
+        if(message.msg.numberSendLoops != previousMessage->msg.numberSendLoops)
+        {
+            tag |= HISTORY_CODEC_TAG_LOOPS;
+        }
+        if(message.msg.sensor_sw_version != previousMessage->msg.sensor_sw_version)
+        {
+            tag |= HISTORY_CODEC_TAG_VERSION;
+        }
+    }
+
+    if(tag & HISTORY_CODEC_TAG_LOOPS)
+    {
+        buffer[length++] = message.msg.numberSendLoops;
+    }
+    if(tag & HISTORY_CODEC_TAG_VERSION)
+    {
+        buffer[length++] = message.msg.sensor_sw_version;
+    }
+    buffer[0] = tag;
+    return length;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t historyCodec_decodeMessage(const uint8_t* buffer, size_t length, message_sensor_timestamped_t& message)
+{
+    if(length == 0)
+    {
+        return 0;
+    }
+    uint8_t tag = buffer[0];
+    if((tag & HISTORY_CODEC_TAG_RECORD) == 0 || (tag & HISTORY_CODEC_TAG_RESERVED_MASK) != 0)
+    {
+        return 0;       // padding, erased flash or unknown record
+    }
+
+    message_sensor_timestamped_t decodedMessage = message;
+    decodedMessage.msg.pinState = (tag & HISTORY_CODEC_TAG_PIN_STATE) != 0;
+
+    size_t position = 1;
+    uint64_t timeValue, voltageValue;
+    size_t fieldLength = historyCodec_readVarint(buffer + position, length - position, timeValue);
+    if(fieldLength == 0) { return 0; }
+    position += fieldLength;
+    fieldLength = historyCodec_readVarint(buffer + position, length - position, voltageValue);
+    if(fieldLength == 0) { return 0; }
+    position += fieldLength;
+
+    if(tag & HISTORY_CODEC_TAG_KEYFRAME)
+    {
+        decodedMessage.timestamp = (time_t)historyCodec_zigzagDecode(timeValue);
+        decodedMessage.msg.batteryVoltage_mV = (uint16_t)voltageValue;
+    }
+    else
+    {
+        decodedMessage.timestamp += (tag & HISTORY_CODEC_TAG_TIME_BACKWARDS) ? -(time_t)timeValue : (time_t)timeValue;
+        decodedMessage.msg.batteryVoltage_mV += (int16_t)historyCodec_zigzagDecode(voltageValue);
+    }
+
+    if(tag & HISTORY_CODEC_TAG_LOOPS)
+    {
+        if(position >= length) { return 0; }
+        decodedMessage.msg.numberSendLoops = buffer[position++];
+    }
+    if(tag & HISTORY_CODEC_TAG_VERSION)
+    {
+        if(position >= length) { return 0; }
+        decodedMessage.msg.sensor_sw_version = buffer[position++];
+    }
+
+    message = decodedMessage;
+    return position;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyCodec_isValidSegmentHeader(const history_segment_header_t& header, uint16_t blockSize, uint16_t segmentSize)
+{
+    return header.magic == HISTORY_SEGMENT_MAGIC && header.version == HISTORY_SEGMENT_FORMAT_VERSION && header.blockSize == blockSize && header.segmentSize == segmentSize;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyCodec_isValidBlock(const uint8_t* block, uint16_t blockSize)
+{
+    uint32_t crc;
+    memcpy(&crc, &block[blockSize - HISTORY_CODEC_BLOCK_CRC_SIZE], HISTORY_CODEC_BLOCK_CRC_SIZE);
+    return crc == utils_calculateCRC32(block, blockSize - HISTORY_CODEC_BLOCK_CRC_SIZE);
+}
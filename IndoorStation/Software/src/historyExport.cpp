@@ -0,0 +1,136 @@
+#include "historyExport.h"
+#include "battery.h"
+
+/**
+ * Format the sensor message as one line of the export.
+ * @return Number of characters written to the buffer (without the terminating 0).
+ */
+size_t historyExport_formatMessage(const history_export_t& exp, const message_sensor_timestamped_t& sensorMessage, char* buffer, size_t length)
+{
+    char timeBuf[24];
+    time_t time = sensorMessage.timestamp;
+    struct tm tm_struct;
+    gmtime_r(&time, &tm_struct);
+    strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%dT%H:%M:%SZ", &tm_struct);
+
+    int lineLength;
+    if(exp.format == HISTORY_EXPORT_FORMAT_NDJSON)
+    {
+        lineLength = snprintf(buffer, length, "{\"time\":\"%s\",\"pin\":%d,\"voltage_mV\":%u,\"batP\":%.1f,\"loops\":%u}\n", timeBuf, sensorMessage.msg.pinState ? 1 : 0, sensorMessage.msg.batteryVoltage_mV, battery_voltageToPercent(sensorMessage.msg.batteryVoltage_mV, 1), sensorMessage.msg.numberSendLoops);
+    }
+    else
+    {
+        lineLength = snprintf(buffer, length, "%s,%d,%u,%.1f,%u\n", timeBuf, sensorMessage.msg.pinState ? 1 : 0, sensorMessage.msg.batteryVoltage_mV, battery_voltageToPercent(sensorMessage.msg.batteryVoltage_mV, 1), sensorMessage.msg.numberSendLoops);
+    }
+    return (lineLength < 0) ? 0 : min((size_t)lineLength, length - 1);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Produce the next part of the export (header, sensor messages or end of the compressed stream) and make it the pending data.
+ */
+void historyExport_produce(history_export_t& exp)
+{
+    size_t textLength = 0;
+    size_t compressedLength = 0;
+
+    switch(exp.state)
+    {
+        case HISTORY_EXPORT_STATE_HEADER:
+            if(exp.isCompressed)
+            {
+                compressedLength = deflateStream_begin(exp.deflate, exp.compressed);
+            }
+            if(exp.format == HISTORY_EXPORT_FORMAT_CSV)
+            {
+                textLength = sprintf((char*)exp.text, "time,pin,voltage_mV,batP,loops\n");
+            }
+            exp.state = HISTORY_EXPORT_STATE_RECORDS;
+            break;
+        case HISTORY_EXPORT_STATE_RECORDS:
+            while(textLength + HISTORY_EXPORT_MAX_LINE_LENGTH <= HISTORY_EXPORT_TEXT_BUFFER_SIZE)
+            {
+                message_sensor_timestamped_t sensorMessage;
+                // The messages are saved in time order. So all following messages are also out of the requested range.
+                if(!memory_readHistoryMessage(exp.reader, sensorMessage) || sensorMessage.timestamp > exp.timeTo)
+                {
+                    memory_closeHistoryReader(exp.reader);
+                    exp.state = exp.isCompressed ? HISTORY_EXPORT_STATE_TRAILER : HISTORY_EXPORT_STATE_DONE;
+                    break;
+                }
+                // Skip the message if the timestamp is before the requested range
+                if(sensorMessage.timestamp < exp.timeFrom)
+                {
+                    continue;
+                }
+                textLength += historyExport_formatMessage(exp, sensorMessage, (char*)&exp.text[textLength], HISTORY_EXPORT_MAX_LINE_LENGTH);
+            }
+            break;
+        case HISTORY_EXPORT_STATE_TRAILER:
+            compressedLength = deflateStream_finish(exp.deflate, exp.compressed);
+            exp.state = HISTORY_EXPORT_STATE_DONE;
+            break;
+        default:
+            break;
+    }
+
+    if(exp.isCompressed)
+    {
+        compressedLength += deflateStream_compress(exp.deflate, exp.text, textLength, &exp.compressed[compressedLength]);
+        exp.pendingData = exp.compressed;
+        exp.pendingLength = compressedLength;
+    }
+    else
+    {
+        exp.pendingData = exp.text;
+        exp.pendingLength = textLength;
+    }
+    exp.pendingOffset = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyExport_begin(history_export_t& exp, uint8_t sensorIndex, time_t timeFrom, time_t timeTo, HistoryExportFormats format, bool isCompressed)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS) { sensorIndex = NUM_SUPPORTED_SENSORS - 1; }
+
+    exp.timeFrom = timeFrom;
+    exp.timeTo = timeTo;
+    exp.format = format;
+    exp.isCompressed = isCompressed;
+    exp.state = HISTORY_EXPORT_STATE_HEADER;
+    exp.pendingData = exp.text;
+    exp.pendingLength = 0;
+    exp.pendingOffset = 0;
+
+    // Skip all messages that are older than the requested range by using the sparse time index
+    memory_openHistoryReader(exp.reader, sensorIndex, 0);
+    memory_seekHistoryReader(exp.reader, timeFrom);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t historyExport_read(history_export_t& exp, uint8_t* buffer, size_t length)
+{
+    size_t readLength = 0;
+    while(readLength < length)
+    {
+        if(exp.pendingOffset < exp.pendingLength)
+        {
+            size_t copyLength = min(length - readLength, exp.pendingLength - exp.pendingOffset);
+            memcpy(&buffer[readLength], &exp.pendingData[exp.pendingOffset], copyLength);
+            exp.pendingOffset += copyLength;
+            readLength += copyLength;
+        }
+        else if(exp.state == HISTORY_EXPORT_STATE_DONE)
+        {
+            break;
+        }
+        else
+        {
+            historyExport_produce(exp);
+        }
+    }
+    return readLength;
+}
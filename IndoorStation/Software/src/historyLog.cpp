@@ -0,0 +1,1548 @@
+#include "historyLog.h"
+#include "utils.h"
+#include "historyCodec.h"
+#include <FS.h>
+#include <LittleFS.h>
+
+#ifdef MEMORY_UNIFIED_HISTORY_LOG
+
+#define HISTORY_LOG_MAX_RECORD_SIZE             (1 + HISTORY_CODEC_MAX_RECORD_SIZE)     // Sensor id and encoded message
+#define HISTORY_LOG_MAX_PENDING_INDEX_ENTRIES   (MEMORY_WRITE_BUFFER_SIZE / MEMORY_HISTORY_BLOCK_SIZE + 1)
+#define HISTORY_LOG_NO_BLOCK                    UINT32_MAX      // Block position of readers that didn't load a block yet and of sensors without a message in the log
+#define HISTORY_LOG_SEGMENT_HEADER_SIZE         (sizeof(history_segment_header_t) + sizeof(uint32_t))  // Segment header followed by the segment number (HISTORY_SEGMENT_FLAG_SEGMENT_NUMBER)
+
+#if defined(MEMORY_RAW_FLASH_HISTORY_LOG) && (MEMORY_HISTORY_SEGMENT_SIZE != RAW_FLASH_SECTOR_SIZE)
+    #error "The segments of the raw flash history log must have the size of a flash sector"
+#endif
+
+enum HistoryLogDecodeResults
+{
+    HISTORY_LOG_DECODE_RECORD = 0,              // A record was decoded
+    HISTORY_LOG_DECODE_END_OF_BLOCK = 1,        // The rest of the block is unused or invalid
+    HISTORY_LOG_DECODE_NEED_MORE_DATA = 2       // The loaded part of the block ends (incomplete record or the block isn't completed yet)
+};
+
+uint16_t historyLog_firstSegment = 0;           // Number of the oldest log segment
+uint16_t historyLog_numberSegments = 0;         // Number of log segments (0 = empty log)
+uint32_t historyLog_lastSegmentSize = 0;        // Number of bytes written to the newest log segment
+#ifndef MEMORY_RAW_FLASH_HISTORY_LOG
+File historyLog_appendFile;                     // The newest log segment is kept open between the writes
+#endif
+
+uint8_t historyLog_writeBufferData[MEMORY_WRITE_BUFFER_SIZE];  // Records of all sensors that are not written to the log yet. They belong directly behind the newest segment.
+uint16_t historyLog_writeBufferLength = 0;                      // Number of bytes in the write buffer
+unsigned long historyLog_writeBufferFirstMillis = 0;            // Time at which the oldest record in the write buffer was added
+uint32_t historyLog_writeBlockCRC = 0xFFFFFFFF;                 // CRC32 of the bytes of the newest (not completed) block. It is written at the end of the block when the block is completed.
+
+message_sensor_timestamped_t historyLog_latestMessage[NUM_SUPPORTED_SENSORS];   // Newest message of each sensor (timestamp -1 if there is none)
+uint32_t historyLog_sensorBlockPosition[NUM_SUPPORTED_SENSORS];                 // Position of the block that contains the newest record of each sensor. The next message of the sensor is only delta encoded if it is added to the same block.
+uint32_t historyLog_firstMessageNumber[NUM_SUPPORTED_SENSORS];                  // Consecutive number of the oldest message of each sensor
+uint32_t historyLog_nextMessageNumber[NUM_SUPPORTED_SENSORS];                   // Consecutive number that is used for the next message of each sensor
+uint32_t historyLog_sensorStartPosition[NUM_SUPPORTED_SENSORS];                 // Records of each sensor in blocks before this position were removed (see historyLog_removeSensor())
+uint32_t historyLog_indexNumberEntries[NUM_SUPPORTED_SENSORS];                  // Number of entries in the index file of each sensor
+uint16_t historyLog_indexGeneration[NUM_SUPPORTED_SENSORS];                     // Incremented when the index file of a sensor is rewritten, so that the readers search their index entry again
+history_index_entry_t historyLog_pendingIndexEntries[NUM_SUPPORTED_SENSORS][HISTORY_LOG_MAX_PENDING_INDEX_ENTRIES];  // Index entries of the blocks that are not written to the index file yet (they follow the entries of the file)
+uint8_t historyLog_numberPendingIndexEntries[NUM_SUPPORTED_SENSORS];
+history_backend_stats_t historyLog_stats;                                       // Statistics of the log since historyLog_init()
+
+/**
+ * Get the number of the newest log segment. Only valid if the log has at least one segment.
+ */
+uint16_t historyLog_getLastSegment()
+{
+    return historyLog_firstSegment + historyLog_numberSegments - 1;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the position of the start of the oldest log segment.
+ */
+uint32_t historyLog_getFirstPosition()
+{
+    return historyLog_firstSegment * MEMORY_HISTORY_SEGMENT_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the position directly behind the last byte that was written to the log segments. The write buffer will be written starting at this position.
+ */
+uint32_t historyLog_getPersistedEndPosition()
+{
+    if(historyLog_numberSegments == 0)
+    {
+        return historyLog_getFirstPosition();
+    }
+    return historyLog_getLastSegment() * MEMORY_HISTORY_SEGMENT_SIZE + historyLog_lastSegmentSize;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the position directly behind the last byte of the log (including the write buffer). The next record is appended at this position.
+ */
+uint32_t historyLog_getEndPosition()
+{
+    return historyLog_getPersistedEndPosition() + historyLog_writeBufferLength;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the file name of the index file of the requested sensor.
+ */
+void historyLog_getIndexFileName(char* strBuf, uint8_t sensorIndex)
+{
+    sprintf(strBuf, FILENAME_HISTORY_LOG_INDEX_SENSOR_FORMAT, sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the number of index entries of the requested sensor (index file and pending entries).
+ */
+uint32_t historyLog_getNumberIndexEntries(uint8_t sensorIndex)
+{
+    return historyLog_indexNumberEntries[sensorIndex] + historyLog_numberPendingIndexEntries[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read an index entry of the requested sensor. The entries behind the index file are taken from the pending entries.
+ * @param indexFile The opened index file of the sensor (only needed for entries of the index file).
+ * @return True if the entry was read; otherwise false.
+ */
+bool historyLog_readIndexEntry(File& indexFile, uint8_t sensorIndex, uint32_t number, history_index_entry_t& indexEntry)
+{
+    if(number >= historyLog_indexNumberEntries[sensorIndex])
+    {
+        number -= historyLog_indexNumberEntries[sensorIndex];
+        if(number >= historyLog_numberPendingIndexEntries[sensorIndex])
+        {
+            return false;
+        }
+        indexEntry = historyLog_pendingIndexEntries[sensorIndex][number];
+        return true;
+    }
+    return indexFile.seek(number * sizeof(history_index_entry_t), SeekSet) && indexFile.read((uint8_t*)&indexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Binary search in the index of the requested sensor (including the pending entries).
+ * @param value Position or timestamp that is searched.
+ * @param isTimestamp Compare the timestamps of the entries instead of the positions.
+ * @return Number of the first entry whose position (or timestamp) is >= value. This is the number of entries if there is none.
+ */
+uint32_t historyLog_searchIndex(uint8_t sensorIndex, int64_t value, bool isTimestamp)
+{
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+
+    uint32_t low = 0;
+    uint32_t high = historyLog_getNumberIndexEntries(sensorIndex);
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        history_index_entry_t indexEntry;
+        if(!historyLog_readIndexEntry(indexFile, sensorIndex, middle, indexEntry))
+        {
+            break;
+        }
+
+        if((isTimestamp ? (int64_t)indexEntry.timestamp : (int64_t)indexEntry.position) < value)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    indexFile.close();
+    return low;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Remove the index entries of the requested sensor that are outside of the range minPosition..endPosition and read the number of entries of the index file.
+ * The index entries are sorted by position, so only the first and the last entry have to be checked. The index file is only rewritten if entries are removed.
+ */
+void historyLog_trimIndex(uint8_t sensorIndex, uint32_t minPosition, uint32_t endPosition)
+{
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    uint32_t numberEntries = indexFile ? indexFile.size() / sizeof(history_index_entry_t) : 0;
+    bool isTrimNeeded = indexFile && (indexFile.size() % sizeof(history_index_entry_t)) != 0;      // incompletely written entry
+    if(numberEntries > 0 && !isTrimNeeded)
+    {
+        history_index_entry_t firstEntry, lastEntry;
+        isTrimNeeded = !(indexFile.read((uint8_t*)&firstEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t) &&
+                         indexFile.seek((numberEntries - 1) * sizeof(history_index_entry_t), SeekSet) &&
+                         indexFile.read((uint8_t*)&lastEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t)) ||
+                       firstEntry.position < minPosition || lastEntry.position >= endPosition;
+    }
+    if(!isTrimNeeded)
+    {
+        indexFile.close();
+        historyLog_indexNumberEntries[sensorIndex] = numberEntries;
+        return;
+    }
+
+    char strBufTmp[sizeof(strBuf) + 4];
+    sprintf(strBufTmp, "%s.tmp", strBuf);
+    File indexFileTmp = LittleFS.open(strBufTmp, "w");
+    indexFile.seek(0, SeekSet);
+    numberEntries = 0;
+    history_index_entry_t indexEntry;
+    while(indexFile.read((uint8_t*)&indexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t))
+    {
+        if(indexEntry.position >= minPosition && indexEntry.position < endPosition)
+        {
+            if(numberEntries == 0)
+            {
+                historyLog_firstMessageNumber[sensorIndex] = indexEntry.messageNumber;
+            }
+            indexFileTmp.write((uint8_t*)&indexEntry, sizeof(history_index_entry_t));
+            numberEntries++;
+        }
+    }
+    indexFile.close();
+    indexFileTmp.close();
+    LittleFS.remove(strBuf);
+    LittleFS.rename(strBufTmp, strBuf);
+
+    if(numberEntries == 0)
+    {
+        // The oldest remaining message is the first one of the oldest pending block
+        historyLog_firstMessageNumber[sensorIndex] = (historyLog_numberPendingIndexEntries[sensorIndex] > 0) ? historyLog_pendingIndexEntries[sensorIndex][0].messageNumber : historyLog_nextMessageNumber[sensorIndex];
+    }
+    historyLog_indexNumberEntries[sensorIndex] = numberEntries;
+    historyLog_indexGeneration[sensorIndex]++;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+/**
+ * Get the address of the requested offset of the log segment inside the raw flash region. The segments are saved in the sectors of the region in a circle.
+ */
+uint32_t historyLog_getFlashAddress(uint16_t segment, uint32_t offset)
+{
+    return (segment % RAW_FLASH_NUMBER_SECTORS) * RAW_FLASH_SECTOR_SIZE + offset;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read the segment number from the header of the log segment in the requested sector.
+ * @return True if the sector contains a valid log segment; false if it is erased, removed or its header wasn't written completely.
+ */
+bool historyLog_readSegmentNumber(uint16_t sector, uint32_t& segmentNumber)
+{
+    uint8_t buffer[HISTORY_LOG_SEGMENT_HEADER_SIZE];
+    history_segment_header_t header;
+    if(!rawFlash_read(sector * RAW_FLASH_SECTOR_SIZE, buffer, sizeof(buffer)))
+    {
+        return false;
+    }
+    memcpy(&header, buffer, sizeof(history_segment_header_t));
+    memcpy(&segmentNumber, &buffer[sizeof(history_segment_header_t)], sizeof(uint32_t));
+    return historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE) &&
+           (header.flags & HISTORY_SEGMENT_FLAG_SENSOR_ID) && (header.flags & HISTORY_SEGMENT_FLAG_SEGMENT_NUMBER) &&
+           segmentNumber <= UINT16_MAX && (segmentNumber % RAW_FLASH_NUMBER_SECTORS) == sector;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check if all bytes of the range of the raw flash region are erased (0xFF).
+ */
+bool historyLog_isFlashErased(uint32_t address, uint32_t length)
+{
+    uint8_t buffer[64];
+    while(length > 0)
+    {
+        size_t chunkLength = min(length, (uint32_t)sizeof(buffer));
+        if(!rawFlash_read(address, buffer, chunkLength))
+        {
+            return false;
+        }
+        for(size_t i = 0; i < chunkLength; i++)
+        {
+            if(buffer[i] != 0xFF)
+            {
+                return false;
+            }
+        }
+        address += chunkLength;
+        length -= chunkLength;
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#endif
+
+/**
+ * Find the oldest and newest log segment and the number of bytes written to the newest segment.
+ */
+void historyLog_findSegments()
+{
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    if(!rawFlash_begin())
+    {
+        return;
+    }
+
+    // The newest segment has the highest segment number. The segments in front of it are valid as long as their sectors contain the expected segment numbers.
+    uint32_t lastSegment = 0;
+    uint32_t segmentNumber;
+    for(uint16_t sector = 0; sector < RAW_FLASH_NUMBER_SECTORS; sector++)
+    {
+        if(historyLog_readSegmentNumber(sector, segmentNumber) && (historyLog_numberSegments == 0 || segmentNumber > lastSegment))
+        {
+            lastSegment = segmentNumber;
+            historyLog_numberSegments = 1;
+        }
+    }
+    if(historyLog_numberSegments == 0)
+    {
+        return;
+    }
+    while(historyLog_numberSegments < RAW_FLASH_NUMBER_SECTORS && lastSegment >= historyLog_numberSegments &&
+          historyLog_readSegmentNumber((lastSegment - historyLog_numberSegments) % RAW_FLASH_NUMBER_SECTORS, segmentNumber) && segmentNumber == lastSegment - historyLog_numberSegments)
+    {
+        historyLog_numberSegments++;
+    }
+    historyLog_firstSegment = lastSegment - historyLog_numberSegments + 1;
+
+    // The completed blocks of the newest segment have a valid CRC, the rest of the sector is still erased. An incompletely written block is checked by historyLog_init().
+    uint8_t block[MEMORY_HISTORY_BLOCK_SIZE];
+    historyLog_lastSegmentSize = 0;
+    while(historyLog_lastSegmentSize < MEMORY_HISTORY_SEGMENT_SIZE && rawFlash_read(historyLog_getFlashAddress(lastSegment, historyLog_lastSegmentSize), block, MEMORY_HISTORY_BLOCK_SIZE))
+    {
+        if(historyCodec_isValidBlock(block, MEMORY_HISTORY_BLOCK_SIZE))
+        {
+            historyLog_lastSegmentSize += MEMORY_HISTORY_BLOCK_SIZE;
+            continue;
+        }
+        if(!historyLog_isFlashErased(historyLog_getFlashAddress(lastSegment, historyLog_lastSegmentSize), MEMORY_HISTORY_BLOCK_SIZE))
+        {
+            historyLog_lastSegmentSize += MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE;
+        }
+        break;
+    }
+#else
+    uint16_t lastSegment = 0;
+    Dir dir = LittleFS.openDir("/");
+    while(dir.next())
+    {
+        unsigned int segment;
+        int numberCharsParsed = 0;
+        String fileName = dir.fileName();
+        if(sscanf(fileName.c_str(), "dataLog.%u%n", &segment, &numberCharsParsed) == 1 && numberCharsParsed == (int)fileName.length())
+        {
+            if(historyLog_numberSegments == 0 || segment < historyLog_firstSegment)
+            {
+                historyLog_firstSegment = segment;
+            }
+            if(historyLog_numberSegments == 0 || segment > lastSegment)
+            {
+                lastSegment = segment;
+                historyLog_lastSegmentSize = dir.fileSize();
+            }
+            historyLog_numberSegments = lastSegment - historyLog_firstSegment + 1;
+        }
+    }
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read bytes of the requested log segment. The segment file is kept open in the reader.
+ * @return Number of bytes read.
+ */
+size_t historyLog_readSegment(memory_history_reader_t& reader, uint16_t segment, uint32_t offset, uint8_t* buffer, size_t length)
+{
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    (void)reader;           // the flash is read directly
+    return rawFlash_read(historyLog_getFlashAddress(segment, offset), buffer, length) ? length : 0;
+#else
+    if(!reader.file || reader.segment != segment)
+    {
+        reader.file.close();
+        reader.segment = segment;
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_LOG_SEGMENT_FORMAT, segment);
+        reader.file = LittleFS.open(strBuf, "r");
+    }
+    if(reader.file.position() != offset)
+    {
+        reader.file.seek(offset, SeekSet);
+    }
+    return reader.file.read(buffer, length);
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Close the newest log segment opened for appending by historyLog_prepareAppend().
+ */
+void historyLog_closeSegment()
+{
+#ifndef MEMORY_RAW_FLASH_HISTORY_LOG
+    historyLog_appendFile.close();
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Prepare the newest log segment for appending. If the newest segment is full, a new segment is started. If this exceeds the maximum number of segments, the oldest segment is deleted.
+ * The segment file stays open until historyLog_end() is called. In the raw flash region, the sector of a new segment is erased.
+ * @return True if bytes can be appended to the newest segment; otherwise false.
+ */
+bool historyLog_prepareAppend()
+{
+    if(historyLog_numberSegments == 0)
+    {
+        historyLog_closeSegment();
+        historyLog_numberSegments = 1;
+        historyLog_lastSegmentSize = 0;
+    }
+    else if(historyLog_lastSegmentSize >= MEMORY_HISTORY_SEGMENT_SIZE)
+    {
+        historyLog_closeSegment();
+        historyLog_numberSegments++;
+        historyLog_lastSegmentSize = 0;
+        while(historyLog_numberSegments > HISTORY_LOG_MAX_SEGMENTS && historyLog_removeOldestSegment());
+    }
+
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    if(historyLog_lastSegmentSize == 0)
+    {
+        return rawFlash_eraseSector(historyLog_getLastSegment() % RAW_FLASH_NUMBER_SECTORS);
+    }
+    return true;
+#else
+    if(!historyLog_appendFile)
+    {
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_LOG_SEGMENT_FORMAT, historyLog_getLastSegment());
+        historyLog_appendFile = LittleFS.open(strBuf, "a");
+    }
+    return historyLog_appendFile;
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append bytes to the newest log segment prepared with historyLog_prepareAppend().
+ * @return Number of bytes written.
+ */
+size_t historyLog_writeSegment(const uint8_t* data, size_t length)
+{
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    // A failed write is repeated with the same bytes. This doesn't harm the bytes that were already written, because writing can only clear bits.
+    return rawFlash_write(historyLog_getFlashAddress(historyLog_getLastSegment(), historyLog_lastSegmentSize), data, length) ? length : 0;
+#else
+    size_t writtenSize = historyLog_appendFile.write(data, length);
+    historyLog_appendFile.flush();
+    return writtenSize;
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Delete the requested log segment. In the raw flash region, the magic number of the segment header is cleared. The sector is erased when it is used for a new segment.
+ */
+void historyLog_removeSegment(uint16_t segment)
+{
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    uint32_t magic = 0;
+    rawFlash_write(historyLog_getFlashAddress(segment, 0), (uint8_t*)&magic, sizeof(magic));
+#else
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_LOG_SEGMENT_FORMAT, segment);
+    LittleFS.remove(strBuf);
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Remove the bytes of the newest log segment behind the requested size.
+ * Flash can't be truncated: The bytes behind the size are only overwritten by the next appends if they are still erased. Otherwise the block is completed with padding and CRC
+ * (the incompletely written bytes are cleared; writing the CRC again over a partially written CRC is possible, because writing can only clear bits) and the appends continue with the next erased block or segment.
+ * @return The new size of the newest segment.
+ */
+uint32_t historyLog_truncateLastSegment(uint32_t size)
+{
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    uint32_t segmentAddress = historyLog_getFlashAddress(historyLog_getLastSegment(), 0);
+    if(historyLog_isFlashErased(segmentAddress + size, MEMORY_HISTORY_SEGMENT_SIZE - size))
+    {
+        return size;
+    }
+
+    uint32_t blockStart = size - (size % MEMORY_HISTORY_BLOCK_SIZE);
+    uint32_t blockEnd = (size == blockStart) ? size : blockStart + MEMORY_HISTORY_BLOCK_SIZE;
+    uint8_t block[MEMORY_HISTORY_BLOCK_SIZE];
+    if(blockEnd != size && rawFlash_read(segmentAddress + blockStart, block, size - blockStart))
+    {
+        memset(&block[size - blockStart], HISTORY_CODEC_TAG_PADDING, MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE - (size - blockStart));
+        uint32_t blockCRC = utils_calculateCRC32(block, MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE);
+        memcpy(&block[MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE], &blockCRC, HISTORY_CODEC_BLOCK_CRC_SIZE);
+        rawFlash_write(segmentAddress + size, &block[size - blockStart], blockEnd - size);
+    }
+    return historyLog_isFlashErased(segmentAddress + blockEnd, MEMORY_HISTORY_SEGMENT_SIZE - blockEnd) ? blockEnd : MEMORY_HISTORY_SEGMENT_SIZE;
+#else
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_LOG_SEGMENT_FORMAT, historyLog_getLastSegment());
+    File segmentFile = LittleFS.open(strBuf, "r+");
+    segmentFile.truncate(size);
+    segmentFile.close();
+    return size;
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Complete the current block in the write buffer with padding (at least one byte) and the CRC of the block.
+ * @param bufferEnd End of the write buffer. There must be space for paddingLength bytes.
+ */
+void historyLog_appendPadding(uint8_t* bufferEnd, size_t paddingLength)
+{
+    memset(bufferEnd, HISTORY_CODEC_TAG_PADDING, paddingLength - HISTORY_CODEC_BLOCK_CRC_SIZE);
+    uint32_t blockCRC = utils_updateCRC32(historyLog_writeBlockCRC, bufferEnd, paddingLength - HISTORY_CODEC_BLOCK_CRC_SIZE);
+    memcpy(bufferEnd + paddingLength - HISTORY_CODEC_BLOCK_CRC_SIZE, &blockCRC, HISTORY_CODEC_BLOCK_CRC_SIZE);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Initialize a reader of the requested sensor (NUM_SUPPORTED_SENSORS for the reader of all sensors) without loading a block.
+ */
+void historyLog_initReader(memory_history_reader_t& reader, uint8_t sensorIndex)
+{
+    reader.sensorIndex = sensorIndex;
+    reader.position = 0;
+    reader.segment = 0;
+    reader.file = File();
+    reader.indexFile = File();
+    reader.blockPosition = HISTORY_LOG_NO_BLOCK;
+    reader.blockLength = 0;
+    reader.blockOffset = 0;
+    reader.message.timestamp = -1;
+    reader.flagsSegment = UINT16_MAX;
+    reader.segmentFlags = 0;
+    reader.isMessagePending = false;
+    reader.numberRecordsLeft = 0;
+    reader.indexNumber = 0;
+    reader.indexGeneration = (sensorIndex < NUM_SUPPORTED_SENSORS) ? historyLog_indexGeneration[sensorIndex] : 0;
+    reader.messageSensorIndex = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read log bytes from the given position. The requested range must be inside one segment. The bytes behind the newest segment are taken from the write buffer.
+ * @return Number of bytes read. This is less than length if the end of the log is reached or the segment file is missing or shorter than expected.
+ */
+size_t historyLog_readRange(memory_history_reader_t& reader, uint32_t position, uint8_t* buffer, size_t length)
+{
+    uint32_t persistedEndPosition = historyLog_getPersistedEndPosition();
+    size_t numReadBytes = 0;
+    if(position < persistedEndPosition)
+    {
+        size_t numberBytesInFile = min((uint32_t)length, persistedEndPosition - position);
+        numReadBytes = historyLog_readSegment(reader, position / MEMORY_HISTORY_SEGMENT_SIZE, position % MEMORY_HISTORY_SEGMENT_SIZE, buffer, numberBytesInFile);
+        if(numReadBytes != numberBytesInFile)
+        {
+            return numReadBytes;
+        }
+    }
+
+    // The write buffer follows directly behind the persisted bytes
+    if(numReadBytes < length && position + numReadBytes >= persistedEndPosition)
+    {
+        uint32_t offsetInWriteBuffer = position + numReadBytes - persistedEndPosition;
+        if(offsetInWriteBuffer < historyLog_writeBufferLength)
+        {
+            size_t numberBytesToCopy = min((uint32_t)(length - numReadBytes), (uint32_t)(historyLog_writeBufferLength - offsetInWriteBuffer));
+            memcpy(buffer + numReadBytes, &historyLog_writeBufferData[offsetInWriteBuffer], numberBytesToCopy);
+            numReadBytes += numberBytesToCopy;
+        }
+    }
+    return numReadBytes;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Load the block at the given position into the block buffer of the reader (as far as it is written).
+ */
+void historyLog_loadBlock(memory_history_reader_t& reader, uint32_t blockPosition)
+{
+    reader.blockPosition = blockPosition;
+    reader.blockOffset = 0;
+    reader.blockLength = historyLog_readRange(reader, blockPosition, reader.block, MEMORY_HISTORY_BLOCK_SIZE);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Load the rest of the block of the reader (this also gets the records that were added since the block was loaded).
+ * @return Number of loaded bytes.
+ */
+size_t historyLog_loadMoreData(memory_history_reader_t& reader)
+{
+    if(reader.blockLength >= MEMORY_HISTORY_BLOCK_SIZE)
+    {
+        return 0;
+    }
+    size_t numReadBytes = historyLog_readRange(reader, reader.blockPosition + reader.blockLength, &reader.block[reader.blockLength], MEMORY_HISTORY_BLOCK_SIZE - reader.blockLength);
+    reader.blockLength += numReadBytes;
+    return numReadBytes;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Move the reader behind the segment header, if the block is the first one of a segment, and check the CRC of a completed block.
+ * Blocks of segments with an unknown header and blocks with a wrong CRC are skipped (the offset is moved to the end of the block).
+ * @return False if the segment header isn't loaded completely yet.
+ */
+bool historyLog_startBlock(memory_history_reader_t& reader)
+{
+    reader.blockOffset = 0;
+    if((reader.blockPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0)
+    {
+        history_segment_header_t header;
+        if(reader.blockLength < sizeof(history_segment_header_t))
+        {
+            return false;
+        }
+        memcpy(&header, reader.block, sizeof(history_segment_header_t));
+        if(!historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE) || !(header.flags & HISTORY_SEGMENT_FLAG_SENSOR_ID))
+        {
+            reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+            return true;
+        }
+        uint16_t headerSize = (header.flags & HISTORY_SEGMENT_FLAG_SEGMENT_NUMBER) ? HISTORY_LOG_SEGMENT_HEADER_SIZE : sizeof(history_segment_header_t);
+        if(reader.blockLength < headerSize)
+        {
+            return false;
+        }
+        reader.blockOffset = headerSize;
+    }
+
+    if(reader.blockLength == MEMORY_HISTORY_BLOCK_SIZE && !historyCodec_isValidBlock(reader.block, MEMORY_HISTORY_BLOCK_SIZE))
+    {
+        #ifdef DEBUG_OUTPUT
+            Serial.printf("History log block CRC mismatch (position %u). The block is skipped.\n", reader.blockPosition);
+        #endif
+        reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Decode the next record in the block buffer of the reader. The message is decoded relative to the previous message of the same sensor in the block (reader.sensorMessages).
+ * @param sensorIndex Returns the sensor of the decoded record.
+ */
+HistoryLogDecodeResults historyLog_decodeRecord(memory_history_reader_t& reader, uint8_t& sensorIndex)
+{
+    if(reader.blockOffset == 0 && !historyLog_startBlock(reader))
+    {
+        return HISTORY_LOG_DECODE_NEED_MORE_DATA;
+    }
+    if(reader.blockOffset >= MEMORY_HISTORY_BLOCK_SIZE)
+    {
+        return HISTORY_LOG_DECODE_END_OF_BLOCK;
+    }
+    if(reader.blockOffset >= reader.blockLength)
+    {
+        return HISTORY_LOG_DECODE_NEED_MORE_DATA;
+    }
+
+    uint8_t sensorId = reader.block[reader.blockOffset];
+    if(sensorId == HISTORY_CODEC_TAG_PADDING || sensorId > NUM_SUPPORTED_SENSORS)
+    {
+        // The rest of the block is unused (or erased flash / unknown data)
+        reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+        return HISTORY_LOG_DECODE_END_OF_BLOCK;
+    }
+    size_t recordLength = historyCodec_decodeMessage(&reader.block[reader.blockOffset + 1], reader.blockLength - reader.blockOffset - 1, reader.sensorMessages[sensorId - 1]);
+    if(recordLength == 0)
+    {
+        if(reader.blockLength == MEMORY_HISTORY_BLOCK_SIZE)
+        {
+            // Invalid record. Continue with the next block.
+            reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+            return HISTORY_LOG_DECODE_END_OF_BLOCK;
+        }
+        return HISTORY_LOG_DECODE_NEED_MORE_DATA;       // incomplete record at the end of the loaded data
+    }
+    reader.blockOffset += 1 + recordLength;
+    sensorIndex = sensorId - 1;
+    return HISTORY_LOG_DECODE_RECORD;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Decode the records of the block in the block buffer of the reader from the start of the block on and count the messages of the reader's sensor.
+ * @param maxNumberRecords Decoding stops after this number of messages of the sensor.
+ * @return Number of decoded messages of the sensor. The last one is in reader.message.
+ */
+uint16_t historyLog_decodeSensorRecords(memory_history_reader_t& reader, uint16_t maxNumberRecords)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    uint16_t numberRecords = 0;
+    uint8_t recordSensorIndex;
+    reader.blockOffset = 0;
+    while(numberRecords < maxNumberRecords && historyLog_decodeRecord(reader, recordSensorIndex) == HISTORY_LOG_DECODE_RECORD)
+    {
+        if(recordSensorIndex == sensorIndex && reader.blockPosition >= historyLog_sensorStartPosition[sensorIndex])
+        {
+            reader.message = reader.sensorMessages[sensorIndex];
+            numberRecords++;
+        }
+    }
+    return numberRecords;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read an index entry of the reader's sensor. The index file is kept open in the reader and opened again, if the entry was appended after it was opened.
+ */
+bool historyLog_readReaderIndexEntry(memory_history_reader_t& reader, uint32_t number, history_index_entry_t& indexEntry)
+{
+    if(number < historyLog_indexNumberEntries[reader.sensorIndex] && (!reader.indexFile || reader.indexFile.size() < (number + 1) * sizeof(history_index_entry_t)))
+    {
+        reader.indexFile.close();
+        char strBuf[32];
+        historyLog_getIndexFileName(strBuf, reader.sensorIndex);
+        reader.indexFile = LittleFS.open(strBuf, "r");
+    }
+    return historyLog_readIndexEntry(reader.indexFile, reader.sensorIndex, number, indexEntry);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Load the next block behind the current block of the reader that contains messages of the reader's sensor.
+ * @return True if a block was loaded; false if there is no such block (the reader isn't changed).
+ */
+bool historyLog_loadNextSensorBlock(memory_history_reader_t& reader)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    if(reader.indexGeneration != historyLog_indexGeneration[sensorIndex])
+    {
+        // The index file was rewritten. Search the entry behind the current block again.
+        reader.indexFile.close();
+        reader.indexNumber = historyLog_searchIndex(sensorIndex, (reader.blockPosition == HISTORY_LOG_NO_BLOCK) ? 0 : (int64_t)reader.blockPosition + 1, false);
+        reader.indexGeneration = historyLog_indexGeneration[sensorIndex];
+    }
+
+    history_index_entry_t indexEntry;
+    while(historyLog_readReaderIndexEntry(reader, reader.indexNumber, indexEntry))
+    {
+        reader.indexNumber++;
+        if(indexEntry.position >= historyLog_getFirstPosition() && (reader.blockPosition == HISTORY_LOG_NO_BLOCK || indexEntry.position > reader.blockPosition))
+        {
+            historyLog_loadBlock(reader, indexEntry.position);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Add an index entry for the block to the index of the requested sensor.
+ * @param indexFile The index file opened for appending. The entry is added to the pending entries instead, if this is NULL or the block starts in the write buffer (they are written by historyLog_writeBuffer()).
+ */
+void historyLog_addIndexEntry(uint8_t sensorIndex, uint32_t blockPosition, time_t timestamp, File* indexFile)
+{
+    history_index_entry_t indexEntry;
+    indexEntry.timestamp = timestamp;
+    indexEntry.position = blockPosition;
+    indexEntry.messageNumber = historyLog_nextMessageNumber[sensorIndex];
+    if(indexFile != NULL && blockPosition < historyLog_getPersistedEndPosition())
+    {
+        indexFile->write((uint8_t*)&indexEntry, sizeof(history_index_entry_t));
+        historyLog_indexNumberEntries[sensorIndex]++;
+    }
+    else if(historyLog_numberPendingIndexEntries[sensorIndex] < HISTORY_LOG_MAX_PENDING_INDEX_ENTRIES)
+    {
+        historyLog_pendingIndexEntries[sensorIndex][historyLog_numberPendingIndexEntries[sensorIndex]++] = indexEntry;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Restore the state of the requested sensor after a restart from its index and the last block of the sensor.
+ * @param reader Reader used to decode the block.
+ */
+void historyLog_restoreSensor(memory_history_reader_t& reader, uint8_t sensorIndex)
+{
+    historyLog_trimIndex(sensorIndex, max(historyLog_getFirstPosition(), historyLog_sensorStartPosition[sensorIndex]), historyLog_getPersistedEndPosition());
+    uint32_t numberEntries = historyLog_indexNumberEntries[sensorIndex];
+    if(numberEntries == 0)
+    {
+        return;
+    }
+
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    history_index_entry_t firstIndexEntry, lastIndexEntry;
+    if(!historyLog_readIndexEntry(indexFile, sensorIndex, 0, firstIndexEntry) || !historyLog_readIndexEntry(indexFile, sensorIndex, numberEntries - 1, lastIndexEntry))
+    {
+        indexFile.close();
+        historyLog_rebuildIndex(sensorIndex);
+        return;
+    }
+    indexFile.close();
+
+    // Only the last block of the sensor has to be decoded
+    historyLog_initReader(reader, sensorIndex);
+    historyLog_loadBlock(reader, lastIndexEntry.position);
+    uint16_t numberRecords = historyLog_decodeSensorRecords(reader, UINT16_MAX);
+    reader.file.close();
+    historyLog_firstMessageNumber[sensorIndex] = firstIndexEntry.messageNumber;
+    historyLog_nextMessageNumber[sensorIndex] = lastIndexEntry.messageNumber + numberRecords;
+    if(numberRecords > 0)
+    {
+        historyLog_latestMessage[sensorIndex] = reader.message;
+        historyLog_sensorBlockPosition[sensorIndex] = lastIndexEntry.position;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_init()
+{
+    historyLog_firstSegment = 0;
+    historyLog_numberSegments = 0;
+    historyLog_lastSegmentSize = 0;
+    historyLog_writeBufferLength = 0;
+    historyLog_writeBlockCRC = 0xFFFFFFFF;
+    memset(&historyLog_stats, 0, sizeof(historyLog_stats));
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        historyLog_latestMessage[i].timestamp = -1;
+        historyLog_sensorBlockPosition[i] = HISTORY_LOG_NO_BLOCK;
+        historyLog_firstMessageNumber[i] = 0;
+        historyLog_nextMessageNumber[i] = 0;
+        historyLog_sensorStartPosition[i] = 0;
+        historyLog_indexNumberEntries[i] = 0;
+        historyLog_numberPendingIndexEntries[i] = 0;
+    }
+
+    historyLog_findSegments();
+
+    File removedFile = LittleFS.open(FILENAME_HISTORY_LOG_REMOVED, "r");
+    if(removedFile && removedFile.read((uint8_t*)historyLog_sensorStartPosition, sizeof(historyLog_sensorStartPosition)) != sizeof(historyLog_sensorStartPosition))
+    {
+        memset(historyLog_sensorStartPosition, 0, sizeof(historyLog_sensorStartPosition));
+    }
+    removedFile.close();
+
+    memory_history_reader_t reader;
+    uint32_t persistedEndPosition = historyLog_getPersistedEndPosition();
+    if(historyLog_numberSegments > 0 && (persistedEndPosition % MEMORY_HISTORY_BLOCK_SIZE) != 0)
+    {
+        // The end of the log wasn't written completely (e.g. after a power loss). Remove the incomplete data behind the last valid record.
+        historyLog_initReader(reader, NUM_SUPPORTED_SENSORS);
+        historyLog_loadBlock(reader, persistedEndPosition - (persistedEndPosition % MEMORY_HISTORY_BLOCK_SIZE));
+        uint16_t endOffset = 0;
+        uint8_t recordSensorIndex;
+        while(historyLog_decodeRecord(reader, recordSensorIndex) == HISTORY_LOG_DECODE_RECORD)
+        {
+            endOffset = reader.blockOffset;
+        }
+        reader.file.close();
+
+        uint32_t endPosition = reader.blockPosition + endOffset;
+        uint32_t lastSegmentPosition = historyLog_getLastSegment() * MEMORY_HISTORY_SEGMENT_SIZE;
+        if(endPosition < persistedEndPosition)
+        {
+            if(endPosition > lastSegmentPosition)
+            {
+                historyLog_lastSegmentSize = historyLog_truncateLastSegment(endPosition - lastSegmentPosition);
+            }
+            else
+            {
+                historyLog_removeSegment(historyLog_getLastSegment());
+                historyLog_numberSegments--;
+                historyLog_lastSegmentSize = (historyLog_numberSegments > 0) ? MEMORY_HISTORY_SEGMENT_SIZE : 0;
+            }
+            persistedEndPosition = historyLog_getPersistedEndPosition();
+        }
+    }
+
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        historyLog_restoreSensor(reader, i);
+    }
+
+    // The index files are written after the log, so the entries of the blocks of the last write can be missing (at most the last two blocks)
+    uint32_t lastBlockPosition = (persistedEndPosition > historyLog_getFirstPosition()) ? (persistedEndPosition - 1) - ((persistedEndPosition - 1) % MEMORY_HISTORY_BLOCK_SIZE) : historyLog_getFirstPosition();
+    uint32_t restoredBlockPosition[NUM_SUPPORTED_SENSORS];
+    memcpy(restoredBlockPosition, historyLog_sensorBlockPosition, sizeof(restoredBlockPosition));
+    historyLog_initReader(reader, NUM_SUPPORTED_SENSORS);
+    reader.position = max(historyLog_getFirstPosition(), (lastBlockPosition >= MEMORY_HISTORY_BLOCK_SIZE) ? lastBlockPosition - MEMORY_HISTORY_BLOCK_SIZE : 0);
+    uint8_t sensorIndex;
+    message_sensor_timestamped_t sensorMessage;
+    while(historyLog_readAllSensorsMessage(reader, sensorIndex, sensorMessage))
+    {
+        if(restoredBlockPosition[sensorIndex] != HISTORY_LOG_NO_BLOCK && reader.blockPosition <= restoredBlockPosition[sensorIndex])
+        {
+            continue;       // already counted by historyLog_restoreSensor()
+        }
+        if(historyLog_sensorBlockPosition[sensorIndex] != reader.blockPosition)
+        {
+            char strBuf[32];
+            historyLog_getIndexFileName(strBuf, sensorIndex);
+            File indexFile = LittleFS.open(strBuf, "a");
+            historyLog_addIndexEntry(sensorIndex, reader.blockPosition, sensorMessage.timestamp, &indexFile);
+            indexFile.close();
+            historyLog_sensorBlockPosition[sensorIndex] = reader.blockPosition;
+        }
+        historyLog_latestMessage[sensorIndex] = sensorMessage;
+        historyLog_nextMessageNumber[sensorIndex]++;
+    }
+    reader.file.close();
+
+    // CRC of the newest (not completed) block
+    if((persistedEndPosition % MEMORY_HISTORY_BLOCK_SIZE) != 0)
+    {
+        historyLog_initReader(reader, NUM_SUPPORTED_SENSORS);
+        historyLog_loadBlock(reader, lastBlockPosition);
+        historyLog_writeBlockCRC = utils_updateCRC32(0xFFFFFFFF, reader.block, reader.blockLength);
+        reader.file.close();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_end()
+{
+    historyLog_writeBuffer(-1);
+    historyLog_closeSegment();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_appendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    uint32_t position = historyLog_getEndPosition();
+    uint32_t blockOffset = position % MEMORY_HISTORY_BLOCK_SIZE;
+    uint8_t record[HISTORY_LOG_MAX_RECORD_SIZE];
+    size_t recordLength = 0;
+    size_t paddingLength = 0;
+    record[0] = sensorIndex + 1;
+    if(blockOffset != 0)
+    {
+        // The message is delta encoded if the previous message of the sensor is in the same block
+        bool isDeltaRecord = (historyLog_sensorBlockPosition[sensorIndex] == position - blockOffset);
+        recordLength = 1 + historyCodec_encodeMessage(sensorMessage, isDeltaRecord ? &historyLog_latestMessage[sensorIndex] : NULL, &record[1]);
+        if(blockOffset + recordLength >= MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE)
+        {
+            // The record doesn't fit into the block anymore. Complete the block and start a new block.
+            paddingLength = MEMORY_HISTORY_BLOCK_SIZE - blockOffset;
+            recordLength = 0;
+        }
+    }
+    uint32_t recordPosition = position + paddingLength;
+    uint32_t recordBlockPosition = recordPosition - (recordPosition % MEMORY_HISTORY_BLOCK_SIZE);
+    bool startsSegment = (recordPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0;
+    bool startsBlock = (recordPosition % MEMORY_HISTORY_BLOCK_SIZE) == 0;
+    if(recordLength == 0)
+    {
+        recordLength = 1 + historyCodec_encodeMessage(sensorMessage, NULL, &record[1]);
+    }
+
+    size_t dataLength = paddingLength + (startsSegment ? HISTORY_LOG_SEGMENT_HEADER_SIZE : 0) + recordLength;
+    if(historyLog_writeBufferLength + dataLength > MEMORY_WRITE_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    if(historyLog_writeBufferLength == 0)
+    {
+        historyLog_writeBufferFirstMillis = millis();
+    }
+    uint8_t* bufferEnd = &historyLog_writeBufferData[historyLog_writeBufferLength];
+    uint8_t* dataStart = bufferEnd;
+    if(paddingLength > 0)
+    {
+        historyLog_appendPadding(bufferEnd, paddingLength);
+        bufferEnd += paddingLength;
+        dataStart = bufferEnd;
+    }
+    if(startsBlock)
+    {
+        historyLog_writeBlockCRC = 0xFFFFFFFF;
+    }
+    if(startsSegment)
+    {
+        history_segment_header_t header;
+        header.magic = HISTORY_SEGMENT_MAGIC;
+        header.version = HISTORY_SEGMENT_FORMAT_VERSION;
+        header.flags = HISTORY_SEGMENT_FLAG_BLOCK_CRC | HISTORY_SEGMENT_FLAG_SENSOR_ID | HISTORY_SEGMENT_FLAG_SEGMENT_NUMBER;
+        header.blockSize = MEMORY_HISTORY_BLOCK_SIZE;
+        header.segmentSize = MEMORY_HISTORY_SEGMENT_SIZE;
+        header.baseTimestamp = sensorMessage.timestamp;
+        memcpy(bufferEnd, &header, sizeof(history_segment_header_t));
+        bufferEnd += sizeof(history_segment_header_t);
+        uint32_t segmentNumber = recordPosition / MEMORY_HISTORY_SEGMENT_SIZE;
+        memcpy(bufferEnd, &segmentNumber, sizeof(uint32_t));
+        bufferEnd += sizeof(uint32_t);
+    }
+    memcpy(bufferEnd, record, recordLength);
+    bufferEnd += recordLength;
+    historyLog_writeBufferLength += dataLength;
+    historyLog_writeBlockCRC = utils_updateCRC32(historyLog_writeBlockCRC, dataStart, bufferEnd - dataStart);
+
+    if(historyLog_sensorBlockPosition[sensorIndex] != recordBlockPosition)
+    {
+        // First message of the sensor in this block (keyframe). The block can already be partially written, so the entry is always written by historyLog_writeBuffer().
+        historyLog_addIndexEntry(sensorIndex, recordBlockPosition, sensorMessage.timestamp, NULL);
+        historyLog_sensorBlockPosition[sensorIndex] = recordBlockPosition;
+    }
+    historyLog_latestMessage[sensorIndex] = sensorMessage;
+    historyLog_nextMessageNumber[sensorIndex]++;
+    historyLog_stats.numberAppendedMessages++;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_writeBuffer(int8_t sensorIndex)
+{
+    (void)sensorIndex;      // all sensors share the write buffer
+    uint16_t numberBytesWritten = 0;
+    while(numberBytesWritten < historyLog_writeBufferLength)
+    {
+        if(!historyLog_prepareAppend())
+        {
+            break;
+        }
+
+        size_t numberBytesToWrite = min((uint32_t)(historyLog_writeBufferLength - numberBytesWritten), (uint32_t)(MEMORY_HISTORY_SEGMENT_SIZE - historyLog_lastSegmentSize));
+        size_t writtenSize = historyLog_writeSegment(&historyLog_writeBufferData[numberBytesWritten], numberBytesToWrite);
+        historyLog_lastSegmentSize += writtenSize;
+        numberBytesWritten += writtenSize;
+        historyLog_stats.numberWrites++;
+        historyLog_stats.writtenBytes += writtenSize;
+        if(writtenSize != numberBytesToWrite)
+        {
+            break;
+        }
+    }
+
+    // Keep the bytes that couldn't be written in the write buffer. They are retried with the next write.
+    historyLog_writeBufferLength -= numberBytesWritten;
+    memmove(&historyLog_writeBufferData[0], &historyLog_writeBufferData[numberBytesWritten], historyLog_writeBufferLength);
+    if(historyLog_writeBufferLength > 0)
+    {
+        historyLog_writeBufferFirstMillis = millis();
+    }
+
+    // Add the pending index entries of the written blocks to the index files
+    uint32_t persistedEndPosition = historyLog_getPersistedEndPosition();
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        uint8_t numberNewIndexEntries = 0;
+        while(numberNewIndexEntries < historyLog_numberPendingIndexEntries[i] && historyLog_pendingIndexEntries[i][numberNewIndexEntries].position < persistedEndPosition)
+        {
+            numberNewIndexEntries++;
+        }
+        if(numberNewIndexEntries == 0)
+        {
+            continue;
+        }
+
+        char strBuf[32];
+        historyLog_getIndexFileName(strBuf, i);
+        File indexFile = LittleFS.open(strBuf, "a");
+        if(indexFile.size() != historyLog_indexNumberEntries[i] * sizeof(history_index_entry_t))
+        {
+            // The index doesn't match the log. Rebuild it completely (this also covers the new blocks).
+            indexFile.close();
+            historyLog_rebuildIndex(i);
+            continue;
+        }
+        indexFile.write((uint8_t*)&historyLog_pendingIndexEntries[i][0], numberNewIndexEntries * sizeof(history_index_entry_t));
+        indexFile.close();
+        historyLog_stats.writtenBytes += numberNewIndexEntries * sizeof(history_index_entry_t);
+        historyLog_indexNumberEntries[i] += numberNewIndexEntries;
+        historyLog_numberPendingIndexEntries[i] -= numberNewIndexEntries;
+        memmove(&historyLog_pendingIndexEntries[i][0], &historyLog_pendingIndexEntries[i][numberNewIndexEntries], historyLog_numberPendingIndexEntries[i] * sizeof(history_index_entry_t));
+    }
+
+    return historyLog_writeBufferLength == 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint16_t historyLog_getWriteBufferLength(uint8_t sensorIndex)
+{
+    (void)sensorIndex;      // all sensors share the write buffer
+    return historyLog_writeBufferLength;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long historyLog_getWriteBufferFirstMillis(uint8_t sensorIndex)
+{
+    (void)sensorIndex;      // all sensors share the write buffer
+    return historyLog_writeBufferFirstMillis;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_removeOldestSegment()
+{
+    if(historyLog_numberSegments < 2)
+    {
+        return false;
+    }
+
+    historyLog_removeSegment(historyLog_firstSegment);
+    historyLog_firstSegment++;
+    historyLog_numberSegments--;
+
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        historyLog_trimIndex(i, max(historyLog_getFirstPosition(), historyLog_sensorStartPosition[i]), UINT32_MAX);
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_removeSensor(uint8_t sensorIndex)
+{
+    // Complete the current block. The following blocks only contain messages of the sensor that are added after the removal.
+    uint32_t position = historyLog_getEndPosition();
+    uint32_t blockOffset = position % MEMORY_HISTORY_BLOCK_SIZE;
+    if(blockOffset != 0)
+    {
+        size_t paddingLength = MEMORY_HISTORY_BLOCK_SIZE - blockOffset;
+        if(historyLog_writeBufferLength + paddingLength > MEMORY_WRITE_BUFFER_SIZE)
+        {
+            historyLog_writeBuffer(-1);
+        }
+        if(historyLog_writeBufferLength + paddingLength <= MEMORY_WRITE_BUFFER_SIZE)
+        {
+            if(historyLog_writeBufferLength == 0)
+            {
+                historyLog_writeBufferFirstMillis = millis();
+            }
+            historyLog_appendPadding(&historyLog_writeBufferData[historyLog_writeBufferLength], paddingLength);
+            historyLog_writeBufferLength += paddingLength;
+        }
+        position += paddingLength;
+    }
+
+    // The start position is saved first. An index file that isn't deleted because of a restart is trimmed by historyLog_init().
+    historyLog_sensorStartPosition[sensorIndex] = position;
+    File removedFile = LittleFS.open(FILENAME_HISTORY_LOG_REMOVED, "w");
+    removedFile.write((uint8_t*)historyLog_sensorStartPosition, sizeof(historyLog_sensorStartPosition));
+    removedFile.close();
+
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    LittleFS.remove(strBuf);
+    historyLog_indexNumberEntries[sensorIndex] = 0;
+    historyLog_numberPendingIndexEntries[sensorIndex] = 0;
+    historyLog_indexGeneration[sensorIndex]++;
+    historyLog_firstMessageNumber[sensorIndex] = 0;
+    historyLog_nextMessageNumber[sensorIndex] = 0;
+    historyLog_latestMessage[sensorIndex].timestamp = -1;
+    historyLog_sensorBlockPosition[sensorIndex] = HISTORY_LOG_NO_BLOCK;
+
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if(historyLog_getNumberMessages(i) > 0)
+        {
+            return;
+        }
+    }
+
+    // No sensor has messages anymore. Delete the whole log.
+    historyLog_closeSegment();
+    for(uint16_t segment = historyLog_firstSegment; segment < historyLog_firstSegment + historyLog_numberSegments; segment++)
+    {
+        historyLog_removeSegment(segment);
+    }
+    LittleFS.remove(FILENAME_HISTORY_LOG_REMOVED);
+    historyLog_firstSegment = 0;
+    historyLog_numberSegments = 0;
+    historyLog_lastSegmentSize = 0;
+    historyLog_writeBufferLength = 0;
+    historyLog_writeBlockCRC = 0xFFFFFFFF;
+    memset(historyLog_sensorStartPosition, 0, sizeof(historyLog_sensorStartPosition));
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+message_sensor_timestamped_t historyLog_getLatestMessage(uint8_t sensorIndex)
+{
+    return historyLog_latestMessage[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+time_t historyLog_getFirstTimestamp(uint8_t sensorIndex)
+{
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    history_index_entry_t indexEntry;
+    bool isRead = historyLog_readIndexEntry(indexFile, sensorIndex, 0, indexEntry);
+    indexFile.close();
+    return isRead ? indexEntry.timestamp : -1;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyLog_getNumberMessages(uint8_t sensorIndex)
+{
+    return historyLog_nextMessageNumber[sensorIndex] - historyLog_firstMessageNumber[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyLog_getHistorySize(uint8_t sensorIndex)
+{
+    uint32_t numberMessagesTotal = 0;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        numberMessagesTotal += historyLog_getNumberMessages(i);
+    }
+    uint32_t logShare = 0;
+    if(numberMessagesTotal > 0)
+    {
+        logShare = (uint64_t)(historyLog_getEndPosition() - historyLog_getFirstPosition()) * historyLog_getNumberMessages(sensorIndex) / numberMessagesTotal;
+    }
+    return logShare + historyLog_getNumberIndexEntries(sensorIndex) * sizeof(history_index_entry_t);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_getStats(history_backend_stats_t& stats)
+{
+    stats = historyLog_stats;
+    stats.usedBytes = historyLog_getEndPosition() - historyLog_getFirstPosition();
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        stats.usedBytes += historyLog_getNumberIndexEntries(i) * sizeof(history_index_entry_t);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyLog_findMessagePosition(uint8_t sensorIndex, time_t timeFrom)
+{
+    // The entry in front of the first entry with a timestamp >= timeFrom is the last one with a timestamp < timeFrom. All messages before its block are older than timeFrom.
+    uint32_t number = historyLog_searchIndex(sensorIndex, timeFrom, true);
+    if(number == 0)
+    {
+        return historyLog_getFirstPosition();
+    }
+
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    history_index_entry_t indexEntry;
+    uint32_t position = historyLog_readIndexEntry(indexFile, sensorIndex, number - 1, indexEntry) ? indexEntry.position : historyLog_getFirstPosition();
+    indexFile.close();
+    return position;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_rebuildIndex(uint8_t sensorIndex)
+{
+    char strBuf[32];
+    historyLog_getIndexFileName(strBuf, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "w");
+    if(!indexFile)
+    {
+        return false;
+    }
+
+    // The messages are numbered again starting from the oldest one
+    historyLog_firstMessageNumber[sensorIndex] = 0;
+    historyLog_nextMessageNumber[sensorIndex] = 0;
+    historyLog_latestMessage[sensorIndex].timestamp = -1;
+    historyLog_sensorBlockPosition[sensorIndex] = HISTORY_LOG_NO_BLOCK;
+    historyLog_indexNumberEntries[sensorIndex] = 0;
+    historyLog_numberPendingIndexEntries[sensorIndex] = 0;
+    historyLog_indexGeneration[sensorIndex]++;
+
+    memory_history_reader_t reader;
+    historyLog_initReader(reader, NUM_SUPPORTED_SENSORS);
+    reader.position = historyLog_getFirstPosition();
+    uint8_t recordSensorIndex;
+    message_sensor_timestamped_t sensorMessage;
+    while(historyLog_readAllSensorsMessage(reader, recordSensorIndex, sensorMessage))
+    {
+        if(recordSensorIndex != sensorIndex)
+        {
+            continue;
+        }
+        if(historyLog_sensorBlockPosition[sensorIndex] != reader.blockPosition)
+        {
+            historyLog_addIndexEntry(sensorIndex, reader.blockPosition, sensorMessage.timestamp, &indexFile);
+            historyLog_sensorBlockPosition[sensorIndex] = reader.blockPosition;
+        }
+        historyLog_latestMessage[sensorIndex] = sensorMessage;
+        historyLog_nextMessageNumber[sensorIndex]++;
+    }
+    reader.file.close();
+    indexFile.close();
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_openReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position)
+{
+    historyLog_initReader(reader, sensorIndex);
+    reader.indexNumber = historyLog_searchIndex(sensorIndex, position - (position % MEMORY_HISTORY_BLOCK_SIZE), false);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_readMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    while(true)
+    {
+        if(reader.blockPosition != HISTORY_LOG_NO_BLOCK)
+        {
+            uint8_t recordSensorIndex;
+            HistoryLogDecodeResults result = historyLog_decodeRecord(reader, recordSensorIndex);
+            if(result == HISTORY_LOG_DECODE_RECORD)
+            {
+                if(recordSensorIndex == sensorIndex && reader.blockPosition >= historyLog_sensorStartPosition[sensorIndex])
+                {
+                    reader.message = reader.sensorMessages[sensorIndex];
+                    sensorMessage = reader.message;
+                    return true;
+                }
+                continue;       // message of another sensor
+            }
+            if(result == HISTORY_LOG_DECODE_NEED_MORE_DATA && historyLog_loadMoreData(reader) > 0)
+            {
+                continue;
+            }
+        }
+
+        // Continue with the next block that contains messages of the sensor
+        if(!historyLog_loadNextSensorBlock(reader))
+        {
+            return false;       // end of the log reached
+        }
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_openReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo)
+{
+    historyLog_initReader(reader, sensorIndex);
+    reader.indexNumber = historyLog_getNumberIndexEntries(sensorIndex);
+    if(timeTo < historyLog_latestMessage[sensorIndex].timestamp)
+    {
+        // The blocks from the first entry with a timestamp > timeTo on only contain newer messages
+        reader.indexNumber = historyLog_searchIndex(sensorIndex, (int64_t)timeTo + 1, true);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_readPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    if(reader.numberRecordsLeft > 0)
+    {
+        // Decode the block again up to the message before the last returned one
+        historyLog_decodeSensorRecords(reader, reader.numberRecordsLeft);
+        reader.numberRecordsLeft--;
+        sensorMessage = reader.message;
+        return true;
+    }
+
+    if(reader.indexGeneration != historyLog_indexGeneration[sensorIndex])
+    {
+        // The index file was rewritten. Search the entry of the current block again.
+        reader.indexFile.close();
+        reader.indexNumber = (reader.blockPosition == HISTORY_LOG_NO_BLOCK) ? historyLog_getNumberIndexEntries(sensorIndex) : historyLog_searchIndex(sensorIndex, reader.blockPosition, false);
+        reader.indexGeneration = historyLog_indexGeneration[sensorIndex];
+    }
+
+    // Load the previous block that contains messages of the sensor
+    history_index_entry_t indexEntry;
+    while(reader.indexNumber > 0 && historyLog_readReaderIndexEntry(reader, reader.indexNumber - 1, indexEntry) && indexEntry.position >= historyLog_getFirstPosition())
+    {
+        reader.indexNumber--;
+        historyLog_loadBlock(reader, indexEntry.position);
+        uint16_t numberRecords = historyLog_decodeSensorRecords(reader, UINT16_MAX);
+        if(numberRecords > 0)
+        {
+            reader.numberRecordsLeft = numberRecords - 1;
+            sensorMessage = reader.message;
+            return true;
+        }
+    }
+    return false;       // start of the log reached
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_closeReader(memory_history_reader_t& reader)
+{
+    reader.file.close();
+    reader.indexFile.close();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyLog_openAllSensorsReader(memory_history_reader_t& reader, time_t timeFrom)
+{
+    historyLog_initReader(reader, NUM_SUPPORTED_SENSORS);
+
+    // Binary search for the last segment whose first message is older than timeFrom (base timestamp of the segment header)
+    uint16_t startSegment = historyLog_firstSegment;
+    uint32_t low = historyLog_firstSegment + 1;
+    uint32_t high = historyLog_firstSegment + historyLog_numberSegments;
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        history_segment_header_t header;
+        if(historyLog_readRange(reader, middle * MEMORY_HISTORY_SEGMENT_SIZE, (uint8_t*)&header, sizeof(history_segment_header_t)) == sizeof(history_segment_header_t) &&
+            historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE) && header.baseTimestamp < timeFrom)
+        {
+            startSegment = middle;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    reader.position = startSegment * MEMORY_HISTORY_SEGMENT_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyLog_readAllSensorsMessage(memory_history_reader_t& reader, uint8_t& sensorIndex, message_sensor_timestamped_t& sensorMessage)
+{
+    if(reader.isMessagePending)
+    {
+        reader.isMessagePending = false;
+        sensorIndex = reader.messageSensorIndex;
+        sensorMessage = reader.message;
+        return true;
+    }
+
+    while(true)
+    {
+        if(reader.blockPosition != HISTORY_LOG_NO_BLOCK)
+        {
+            uint8_t recordSensorIndex;
+            HistoryLogDecodeResults result = historyLog_decodeRecord(reader, recordSensorIndex);
+            if(result == HISTORY_LOG_DECODE_RECORD)
+            {
+                if(reader.blockPosition >= historyLog_sensorStartPosition[recordSensorIndex])
+                {
+                    reader.messageSensorIndex = recordSensorIndex;
+                    reader.message = reader.sensorMessages[recordSensorIndex];
+                    sensorIndex = recordSensorIndex;
+                    sensorMessage = reader.message;
+                    return true;
+                }
+                continue;       // removed message
+            }
+            if(result == HISTORY_LOG_DECODE_NEED_MORE_DATA)
+            {
+                if(historyLog_loadMoreData(reader) > 0)
+                {
+                    continue;
+                }
+                if(reader.blockPosition + reader.blockLength >= historyLog_getEndPosition())
+                {
+                    return false;       // end of the log reached
+                }
+                // The segment file is missing or shorter than expected. Continue with the next block.
+            }
+        }
+
+        uint32_t blockPosition = (reader.blockPosition == HISTORY_LOG_NO_BLOCK) ? reader.position : reader.blockPosition + MEMORY_HISTORY_BLOCK_SIZE;
+        blockPosition = max(blockPosition, historyLog_getFirstPosition());
+        if(blockPosition >= historyLog_getEndPosition())
+        {
+            return false;       // end of the log reached
+        }
+        historyLog_loadBlock(reader, blockPosition);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const history_backend_t historyLog_backend =
+{
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+    "rawFlashLog",
+#else
+    "log",
+#endif
+    historyLog_init,
+    historyLog_end,
+    historyLog_appendMessage,
+    historyLog_writeBuffer,
+    historyLog_getWriteBufferLength,
+    historyLog_getWriteBufferFirstMillis,
+    historyLog_removeSensor,
+    historyLog_removeOldestSegment,
+    historyLog_getLatestMessage,
+    historyLog_getFirstTimestamp,
+    historyLog_getNumberMessages,
+    historyLog_getHistorySize,
+    historyLog_getStats,
+    historyLog_findMessagePosition,
+    historyLog_rebuildIndex,
+    historyLog_openReader,
+    historyLog_readMessage,
+    historyLog_openReaderReverse,
+    historyLog_readPreviousMessage,
+    NULL,                               // downloaded in the legacy format
+    historyLog_closeReader
+};
+
+#endif
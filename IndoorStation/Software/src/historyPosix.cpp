@@ -0,0 +1,416 @@
+#include "historyPosix.h"
+
+#ifndef ARDUINO
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define HISTORY_POSIX_MESSAGE_SIZE      sizeof(message_sensor_timestamped_t)
+#define HISTORY_POSIX_READ_SIZE         ((MEMORY_HISTORY_BLOCK_SIZE / HISTORY_POSIX_MESSAGE_SIZE) * HISTORY_POSIX_MESSAGE_SIZE)    // Number of bytes that are read into the block buffer of a reader at once (whole messages)
+
+char historyPosix_directory[256] = ".";         // Directory of the history files
+bool historyPosix_syncWrites = false;           // fsync() is called after each write of a write buffer
+
+int historyPosix_files[NUM_SUPPORTED_SENSORS];              // File descriptor of the history file of each sensor (-1 if it isn't open)
+uint32_t historyPosix_fileSize[NUM_SUPPORTED_SENSORS];      // Number of bytes in the history file of each sensor
+message_sensor_timestamped_t historyPosix_writeBufferData[NUM_SUPPORTED_SENSORS][HISTORY_POSIX_WRITE_BUFFER_MESSAGES];     // Messages of each sensor that are not written yet. They belong directly behind the file.
+uint16_t historyPosix_writeBufferNumber[NUM_SUPPORTED_SENSORS];                 // Number of messages in the write buffer of each sensor
+unsigned long historyPosix_writeBufferFirstMillis[NUM_SUPPORTED_SENSORS];       // Time at which the oldest message in the write buffer of each sensor was added
+message_sensor_timestamped_t historyPosix_latestMessage[NUM_SUPPORTED_SENSORS]; // Newest message of each sensor (timestamp -1 if there is none)
+history_backend_stats_t historyPosix_stats;                                     // Statistics since historyPosix_init()
+
+/**
+ * Get the number of bytes of the history of the sensor including the write buffer.
+ */
+uint32_t historyPosix_getEndPosition(uint8_t sensorIndex)
+{
+    return historyPosix_fileSize[sensorIndex] + historyPosix_writeBufferNumber[sensorIndex] * HISTORY_POSIX_MESSAGE_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Load the messages of the sensor from the start position up to (excluding) the end position into the block buffer of the reader.
+ * The loaded range is limited to the block buffer size and to either the history file or the write buffer.
+ * @return True if at least one message was loaded; otherwise false.
+ */
+bool historyPosix_loadMessages(memory_history_reader_t& reader, uint32_t startPosition, uint32_t endPosition)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    uint32_t fileSize = historyPosix_fileSize[sensorIndex];
+    reader.blockPosition = startPosition;
+    reader.blockLength = 0;
+    reader.blockOffset = 0;
+    if(startPosition < fileSize)
+    {
+        size_t length = min((uint32_t)HISTORY_POSIX_READ_SIZE, min(endPosition, fileSize) - startPosition);
+        ssize_t numReadBytes = pread(historyPosix_files[sensorIndex], reader.block, length, startPosition);
+        if(numReadBytes > 0)
+        {
+            reader.blockLength = numReadBytes - (numReadBytes % HISTORY_POSIX_MESSAGE_SIZE);
+        }
+    }
+    else
+    {
+        uint32_t number = (startPosition - fileSize) / HISTORY_POSIX_MESSAGE_SIZE;
+        uint32_t numberMessages = min((uint32_t)(HISTORY_POSIX_READ_SIZE / HISTORY_POSIX_MESSAGE_SIZE), (uint32_t)historyPosix_writeBufferNumber[sensorIndex] - min(number, (uint32_t)historyPosix_writeBufferNumber[sensorIndex]));
+        numberMessages = min(numberMessages, (uint32_t)((endPosition - startPosition) / HISTORY_POSIX_MESSAGE_SIZE));
+        memcpy(reader.block, &historyPosix_writeBufferData[sensorIndex][number], numberMessages * HISTORY_POSIX_MESSAGE_SIZE);
+        reader.blockLength = numberMessages * HISTORY_POSIX_MESSAGE_SIZE;
+    }
+    return reader.blockLength > 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read the message with the given number of the sensor from the history file or from the write buffer.
+ */
+bool historyPosix_readMessageNumber(uint8_t sensorIndex, uint32_t number, message_sensor_timestamped_t& sensorMessage)
+{
+    uint32_t numberFileMessages = historyPosix_fileSize[sensorIndex] / HISTORY_POSIX_MESSAGE_SIZE;
+    if(number >= numberFileMessages)
+    {
+        sensorMessage = historyPosix_writeBufferData[sensorIndex][number - numberFileMessages];
+        return true;
+    }
+    return pread(historyPosix_files[sensorIndex], &sensorMessage, HISTORY_POSIX_MESSAGE_SIZE, number * HISTORY_POSIX_MESSAGE_SIZE) == (ssize_t)HISTORY_POSIX_MESSAGE_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Initialize the reader. The next message is read from position (reader.blockPosition + reader.blockOffset).
+ */
+void historyPosix_initReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position)
+{
+    reader.sensorIndex = sensorIndex;
+    reader.position = 0;
+    reader.segment = 0;
+    reader.blockPosition = position;
+    reader.blockLength = 0;
+    reader.blockOffset = 0;
+    reader.message.timestamp = -1;
+    reader.isMessagePending = false;
+    reader.numberRecordsLeft = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_configure(const char* directory, bool syncWrites)
+{
+    strncpy(historyPosix_directory, directory, sizeof(historyPosix_directory) - 1);
+    historyPosix_directory[sizeof(historyPosix_directory) - 1] = '\0';
+    historyPosix_syncWrites = syncWrites;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_init()
+{
+    memset(&historyPosix_stats, 0, sizeof(historyPosix_stats));
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        char strBuf[300];
+        snprintf(strBuf, sizeof(strBuf), FILENAME_HISTORY_POSIX_SENSOR_FORMAT, historyPosix_directory, i);
+        historyPosix_files[i] = open(strBuf, O_RDWR | O_CREAT | O_APPEND, 0644);
+        historyPosix_writeBufferNumber[i] = 0;
+        historyPosix_latestMessage[i].timestamp = -1;
+
+        off_t fileSize = (historyPosix_files[i] >= 0) ? lseek(historyPosix_files[i], 0, SEEK_END) : 0;
+        historyPosix_fileSize[i] = (fileSize > 0) ? fileSize - (fileSize % HISTORY_POSIX_MESSAGE_SIZE) : 0;
+        if(historyPosix_fileSize[i] != fileSize)
+        {
+            // Remove the incompletely written message
+            if(ftruncate(historyPosix_files[i], historyPosix_fileSize[i]) != 0)
+            {
+                #ifdef DEBUG_OUTPUT
+                    Serial.printf("Truncating the history file of sensor %d failed.\n", i);
+                #endif
+            }
+        }
+        if(historyPosix_fileSize[i] > 0)
+        {
+            historyPosix_readMessageNumber(i, historyPosix_fileSize[i] / HISTORY_POSIX_MESSAGE_SIZE - 1, historyPosix_latestMessage[i]);
+        }
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_end()
+{
+    historyPosix_writeBuffer(-1);
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if(historyPosix_files[i] >= 0)
+        {
+            close(historyPosix_files[i]);
+            historyPosix_files[i] = -1;
+        }
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyPosix_appendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    uint16_t& numberMessages = historyPosix_writeBufferNumber[sensorIndex];
+    if(numberMessages >= HISTORY_POSIX_WRITE_BUFFER_MESSAGES)
+    {
+        return false;
+    }
+    if(numberMessages == 0)
+    {
+        historyPosix_writeBufferFirstMillis[sensorIndex] = millis();
+    }
+    historyPosix_writeBufferData[sensorIndex][numberMessages] = sensorMessage;
+    numberMessages++;
+    historyPosix_latestMessage[sensorIndex] = sensorMessage;
+    historyPosix_stats.numberAppendedMessages++;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyPosix_writeBuffer(int8_t sensorIndex)
+{
+    bool isWritten = true;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if((sensorIndex != -1 && i != sensorIndex) || historyPosix_writeBufferNumber[i] == 0)
+        {
+            continue;
+        }
+
+        size_t length = historyPosix_writeBufferNumber[i] * HISTORY_POSIX_MESSAGE_SIZE;
+        ssize_t writtenSize = write(historyPosix_files[i], historyPosix_writeBufferData[i], length);
+        if(writtenSize != (ssize_t)length)
+        {
+            // Remove the partially written messages. They are written again with the next write.
+            if(writtenSize > 0 && ftruncate(historyPosix_files[i], historyPosix_fileSize[i]) != 0)
+            {
+                #ifdef DEBUG_OUTPUT
+                    Serial.printf("Truncating the history file of sensor %d failed.\n", i);
+                #endif
+            }
+            isWritten = false;
+            continue;
+        }
+        if(historyPosix_syncWrites)
+        {
+            fsync(historyPosix_files[i]);
+        }
+        historyPosix_fileSize[i] += length;
+        historyPosix_writeBufferNumber[i] = 0;
+        historyPosix_stats.numberWrites++;
+        historyPosix_stats.writtenBytes += length;
+    }
+    return isWritten;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint16_t historyPosix_getWriteBufferLength(uint8_t sensorIndex)
+{
+    return historyPosix_writeBufferNumber[sensorIndex] * HISTORY_POSIX_MESSAGE_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long historyPosix_getWriteBufferFirstMillis(uint8_t sensorIndex)
+{
+    return historyPosix_writeBufferFirstMillis[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_removeSensor(uint8_t sensorIndex)
+{
+    historyPosix_writeBufferNumber[sensorIndex] = 0;
+    historyPosix_latestMessage[sensorIndex].timestamp = -1;
+    if(historyPosix_files[sensorIndex] >= 0 && ftruncate(historyPosix_files[sensorIndex], 0) == 0)
+    {
+        historyPosix_fileSize[sensorIndex] = 0;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+message_sensor_timestamped_t historyPosix_getLatestMessage(uint8_t sensorIndex)
+{
+    return historyPosix_latestMessage[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+time_t historyPosix_getFirstTimestamp(uint8_t sensorIndex)
+{
+    // The messages are saved uncompressed, so the first record is the oldest message
+    message_sensor_timestamped_t sensorMessage;
+    if(historyPosix_getEndPosition(sensorIndex) < HISTORY_POSIX_MESSAGE_SIZE || !historyPosix_readMessageNumber(sensorIndex, 0, sensorMessage))
+    {
+        return -1;
+    }
+    return sensorMessage.timestamp;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyPosix_getNumberMessages(uint8_t sensorIndex)
+{
+    return historyPosix_getEndPosition(sensorIndex) / HISTORY_POSIX_MESSAGE_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyPosix_getHistorySize(uint8_t sensorIndex)
+{
+    return historyPosix_getEndPosition(sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_getStats(history_backend_stats_t& stats)
+{
+    stats = historyPosix_stats;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        stats.usedBytes += historyPosix_getHistorySize(i);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyPosix_findMessagePosition(uint8_t sensorIndex, time_t timeFrom)
+{
+    uint32_t low = 0;
+    uint32_t high = historyPosix_getNumberMessages(sensorIndex);
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        message_sensor_timestamped_t sensorMessage;
+        if(!historyPosix_readMessageNumber(sensorIndex, middle, sensorMessage))
+        {
+            break;      // read error, all messages in front of low are known to be older
+        }
+        if(sensorMessage.timestamp < timeFrom)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low * HISTORY_POSIX_MESSAGE_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_openReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position)
+{
+    historyPosix_initReader(reader, sensorIndex, position - (position % HISTORY_POSIX_MESSAGE_SIZE));
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyPosix_readMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    if(reader.blockOffset + HISTORY_POSIX_MESSAGE_SIZE > reader.blockLength)
+    {
+        uint32_t position = reader.blockPosition + reader.blockOffset;
+        if(!historyPosix_loadMessages(reader, position, historyPosix_getEndPosition(reader.sensorIndex)))
+        {
+            reader.blockPosition = position;        // try again from this position with the next read
+            return false;       // end of the history reached
+        }
+    }
+    memcpy(&reader.message, &reader.block[reader.blockOffset], HISTORY_POSIX_MESSAGE_SIZE);
+    reader.blockOffset += HISTORY_POSIX_MESSAGE_SIZE;
+    sensorMessage = reader.message;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyPosix_openReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo)
+{
+    // The next message is read from in front of the position
+    historyPosix_initReader(reader, sensorIndex, historyPosix_getEndPosition(sensorIndex));
+    if(timeTo < historyPosix_latestMessage[sensorIndex].timestamp)
+    {
+        reader.blockPosition = historyPosix_findMessagePosition(sensorIndex, timeTo + 1);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyPosix_readPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint32_t position = reader.blockPosition + reader.blockOffset;
+    if(position < HISTORY_POSIX_MESSAGE_SIZE)
+    {
+        return false;       // start of the history reached
+    }
+    position -= HISTORY_POSIX_MESSAGE_SIZE;
+    if(position < reader.blockPosition || reader.blockLength == 0)
+    {
+        // Load the messages in front of the position. Messages in the write buffer are loaded one by one, they are never read from the file and the buffer at once.
+        uint32_t fileSize = historyPosix_fileSize[reader.sensorIndex];
+        uint32_t startPosition = position;
+        if(position < fileSize)
+        {
+            startPosition = (position + HISTORY_POSIX_MESSAGE_SIZE > HISTORY_POSIX_READ_SIZE) ? position + HISTORY_POSIX_MESSAGE_SIZE - HISTORY_POSIX_READ_SIZE : 0;
+        }
+        if(!historyPosix_loadMessages(reader, startPosition, position + HISTORY_POSIX_MESSAGE_SIZE) || reader.blockPosition + reader.blockLength <= position)
+        {
+            reader.blockPosition = position + HISTORY_POSIX_MESSAGE_SIZE;
+            return false;       // read error
+        }
+    }
+    reader.blockOffset = position - reader.blockPosition;
+    memcpy(&reader.message, &reader.block[reader.blockOffset], HISTORY_POSIX_MESSAGE_SIZE);
+    sensorMessage = reader.message;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Nothing to close, the history files stay open until historyPosix_end().
+ */
+void historyPosix_closeReader(memory_history_reader_t& reader)
+{
+    (void)reader;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const history_backend_t historyPosix_backend =
+{
+    "posix",
+    historyPosix_init,
+    historyPosix_end,
+    historyPosix_appendMessage,
+    historyPosix_writeBuffer,
+    historyPosix_getWriteBufferLength,
+    historyPosix_getWriteBufferFirstMillis,
+    historyPosix_removeSensor,
+    NULL,                               // the files are limited by the host only
+    historyPosix_getLatestMessage,
+    historyPosix_getFirstTimestamp,
+    historyPosix_getNumberMessages,
+    historyPosix_getHistorySize,
+    historyPosix_getStats,
+    historyPosix_findMessagePosition,
+    NULL,                               // no index (binary search in the file)
+    historyPosix_openReader,
+    historyPosix_readMessage,
+    historyPosix_openReaderReverse,
+    historyPosix_readPreviousMessage,
+    NULL,                               // the file already has the legacy format
+    historyPosix_closeReader
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "historyRam.h"
+
+#if defined(MEMORY_RAM_HISTORY_BACKEND) || !defined(ARDUINO)
+
+message_sensor_timestamped_t historyRam_messages[NUM_SUPPORTED_SENSORS][HISTORY_RAM_MAX_MESSAGES_PER_SENSOR];   // Ring buffer of each sensor. Message number n is saved at index (n % HISTORY_RAM_MAX_MESSAGES_PER_SENSOR).
+uint32_t historyRam_firstMessageNumber[NUM_SUPPORTED_SENSORS];      // Number of the oldest message of each sensor that is still in the ring buffer
+uint32_t historyRam_nextMessageNumber[NUM_SUPPORTED_SENSORS];       // Number that is used for the next message of each sensor
+history_backend_stats_t historyRam_stats;                           // Statistics since historyRam_init()
+
+/**
+ * Get the message with the given number from the ring buffer of the sensor. The number must be between the first and the next message number.
+ */
+const message_sensor_timestamped_t& historyRam_getMessage(uint8_t sensorIndex, uint32_t number)
+{
+    return historyRam_messages[sensorIndex][number % HISTORY_RAM_MAX_MESSAGES_PER_SENSOR];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Initialize the reader. The number of the next message that is read is kept in reader.blockPosition.
+ */
+void historyRam_initReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t number)
+{
+    reader.sensorIndex = sensorIndex;
+    reader.position = 0;
+    reader.segment = 0;
+    reader.blockPosition = number;
+    reader.blockLength = 0;
+    reader.blockOffset = 0;
+    reader.message.timestamp = -1;
+    reader.isMessagePending = false;
+    reader.numberRecordsLeft = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyRam_init()
+{
+    memset(historyRam_firstMessageNumber, 0, sizeof(historyRam_firstMessageNumber));
+    memset(historyRam_nextMessageNumber, 0, sizeof(historyRam_nextMessageNumber));
+    memset(&historyRam_stats, 0, sizeof(historyRam_stats));
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Nothing to do, the messages are only kept in RAM.
+ */
+void historyRam_end()
+{
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyRam_appendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    if(historyRam_getNumberMessages(sensorIndex) >= HISTORY_RAM_MAX_MESSAGES_PER_SENSOR)
+    {
+        historyRam_firstMessageNumber[sensorIndex]++;       // overwrite the oldest message
+    }
+    historyRam_messages[sensorIndex][historyRam_nextMessageNumber[sensorIndex] % HISTORY_RAM_MAX_MESSAGES_PER_SENSOR] = sensorMessage;
+    historyRam_nextMessageNumber[sensorIndex]++;
+    historyRam_stats.numberAppendedMessages++;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * The messages are added to the ring buffer directly, there is no write buffer.
+ */
+bool historyRam_writeBuffer(int8_t sensorIndex)
+{
+    (void)sensorIndex;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint16_t historyRam_getWriteBufferLength(uint8_t sensorIndex)
+{
+    (void)sensorIndex;
+    return 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long historyRam_getWriteBufferFirstMillis(uint8_t sensorIndex)
+{
+    (void)sensorIndex;
+    return 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyRam_removeSensor(uint8_t sensorIndex)
+{
+    historyRam_firstMessageNumber[sensorIndex] = historyRam_nextMessageNumber[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+message_sensor_timestamped_t historyRam_getLatestMessage(uint8_t sensorIndex)
+{
+    message_sensor_timestamped_t sensorMessage;
+    sensorMessage.timestamp = -1;
+    if(historyRam_getNumberMessages(sensorIndex) > 0)
+    {
+        sensorMessage = historyRam_getMessage(sensorIndex, historyRam_nextMessageNumber[sensorIndex] - 1);
+    }
+    return sensorMessage;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+time_t historyRam_getFirstTimestamp(uint8_t sensorIndex)
+{
+    if(historyRam_getNumberMessages(sensorIndex) == 0)
+    {
+        return -1;
+    }
+    return historyRam_getMessage(sensorIndex, historyRam_firstMessageNumber[sensorIndex]).timestamp;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyRam_getNumberMessages(uint8_t sensorIndex)
+{
+    return historyRam_nextMessageNumber[sensorIndex] - historyRam_firstMessageNumber[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyRam_getHistorySize(uint8_t sensorIndex)
+{
+    return historyRam_getNumberMessages(sensorIndex) * sizeof(message_sensor_timestamped_t);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyRam_getStats(history_backend_stats_t& stats)
+{
+    stats = historyRam_stats;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        stats.usedBytes += historyRam_getHistorySize(i);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t historyRam_findMessagePosition(uint8_t sensorIndex, time_t timeFrom)
+{
+    uint32_t low = historyRam_firstMessageNumber[sensorIndex];
+    uint32_t high = historyRam_nextMessageNumber[sensorIndex];
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if(historyRam_getMessage(sensorIndex, middle).timestamp < timeFrom)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyRam_openReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position)
+{
+    historyRam_initReader(reader, sensorIndex, position);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyRam_readMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    reader.blockPosition = max(reader.blockPosition, historyRam_firstMessageNumber[sensorIndex]);
+    if(reader.blockPosition >= historyRam_nextMessageNumber[sensorIndex])
+    {
+        return false;       // end of the history reached
+    }
+    reader.message = historyRam_getMessage(sensorIndex, reader.blockPosition);
+    reader.blockPosition++;
+    sensorMessage = reader.message;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void historyRam_openReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo)
+{
+    // blockPosition is the number behind the next message that is read
+    historyRam_initReader(reader, sensorIndex, historyRam_nextMessageNumber[sensorIndex]);
+    if(timeTo < historyRam_getLatestMessage(sensorIndex).timestamp)
+    {
+        reader.blockPosition = historyRam_findMessagePosition(sensorIndex, timeTo + 1);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool historyRam_readPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    if(reader.blockPosition <= historyRam_firstMessageNumber[sensorIndex])
+    {
+        return false;       // start of the history reached (or the older messages were overwritten in the meantime)
+    }
+    reader.blockPosition--;
+    reader.message = historyRam_getMessage(sensorIndex, reader.blockPosition);
+    sensorMessage = reader.message;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Nothing to close, the reader doesn't open any files.
+ */
+void historyRam_closeReader(memory_history_reader_t& reader)
+{
+    (void)reader;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const history_backend_t historyRam_backend =
+{
+    "ram",
+    historyRam_init,
+    historyRam_end,
+    historyRam_appendMessage,
+    historyRam_writeBuffer,
+    historyRam_getWriteBufferLength,
+    historyRam_getWriteBufferFirstMillis,
+    historyRam_removeSensor,
+    NULL,                               // nothing is saved in the file system
+    historyRam_getLatestMessage,
+    historyRam_getFirstTimestamp,
+    historyRam_getNumberMessages,
+    historyRam_getHistorySize,
+    historyRam_getStats,
+    historyRam_findMessagePosition,
+    NULL,                               // no index
+    historyRam_openReader,
+    historyRam_readMessage,
+    historyRam_openReaderReverse,
+    historyRam_readPreviousMessage,
+    NULL,                               // downloaded in the legacy format
+    historyRam_closeReader
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "jsonWriter.h"
+
+/**
+ * Append the characters to the current record. Characters that exceed the target buffer are dropped.
+ */
+void jsonWriter_append(json_writer_t& writer, const char* data, size_t length)
+{
+    size_t numberChars = min(length, writer.targetLength - writer.recordLength);
+    memcpy(writer.target + writer.recordLength, data, numberChars);
+    writer.recordLength += numberChars;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the decimal digits of the value to the current record (at least minNumberDigits digits, with leading zeros).
+ */
+void jsonWriter_appendDigits(json_writer_t& writer, uint32_t value, uint8_t minNumberDigits)
+{
+    char digits[10];
+    uint8_t numberDigits = 0;
+    do
+    {
+        digits[sizeof(digits) - 1 - numberDigits] = '0' + (value % 10);
+        value /= 10;
+        numberDigits++;
+    } while((value > 0 || numberDigits < minNumberDigits) && numberDigits < sizeof(digits));
+    jsonWriter_append(writer, &digits[sizeof(digits) - numberDigits], numberDigits);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the key of the next field (with the separator to the previous field).
+ */
+void jsonWriter_appendKey(json_writer_t& writer, const char* key)
+{
+    if(!writer.isFirstField)
+    {
+        jsonWriter_append(writer, ",", 1);
+    }
+    writer.isFirstField = false;
+    jsonWriter_append(writer, "\"", 1);
+    jsonWriter_append(writer, key, strlen(key));
+    jsonWriter_append(writer, "\":", 2);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Return the part of the record that was formatted into the pending buffer and fits into the response buffer.
+ */
+size_t jsonWriter_finishTarget(json_writer_t& writer)
+{
+    if(writer.target != writer.pending)
+    {
+        return writer.recordLength;     // formatted directly into the response buffer
+    }
+    writer.pendingLength = writer.recordLength;
+    writer.pendingOffset = 0;
+    return jsonWriter_read(writer, writer.buffer, writer.bufferLength);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Select the buffer for the next formatted bytes. The response buffer is used if the longest record fits into it.
+ */
+void jsonWriter_selectTarget(json_writer_t& writer, uint8_t* buffer, size_t length)
+{
+    writer.buffer = buffer;
+    writer.bufferLength = length;
+    if(length >= JSON_WRITER_MAX_RECORD_LENGTH)
+    {
+        writer.target = (char*)buffer;
+        writer.targetLength = length;
+    }
+    else
+    {
+        writer.target = writer.pending;
+        writer.targetLength = JSON_WRITER_MAX_RECORD_LENGTH;
+    }
+    writer.recordLength = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void jsonWriter_begin(json_writer_t& writer, JsonWriterFormats format)
+{
+    writer.format = format;
+    writer.numberRecords = 0;
+    writer.isEnded = false;
+    writer.isFirstField = true;
+    writer.buffer = NULL;
+    writer.bufferLength = 0;
+    writer.target = writer.pending;
+    writer.targetLength = 0;
+    writer.recordLength = 0;
+    writer.pendingLength = 0;
+    writer.pendingOffset = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t jsonWriter_read(json_writer_t& writer, uint8_t* buffer, size_t length)
+{
+    size_t numberBytes = min(length, (size_t)(writer.pendingLength - writer.pendingOffset));
+    memcpy(buffer, writer.pending + writer.pendingOffset, numberBytes);
+    writer.pendingOffset += numberBytes;
+    if(writer.pendingOffset >= writer.pendingLength)
+    {
+        writer.pendingLength = 0;
+        writer.pendingOffset = 0;
+    }
+    return numberBytes;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool jsonWriter_hasPendingData(const json_writer_t& writer)
+{
+    return writer.pendingLength > 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void jsonWriter_beginRecord(json_writer_t& writer, uint8_t* buffer, size_t length)
+{
+    jsonWriter_selectTarget(writer, buffer, length);
+    if(writer.format == JSON_WRITER_FORMAT_ARRAY)
+    {
+        jsonWriter_append(writer, (writer.numberRecords == 0) ? "[" : ",", 1);
+    }
+    jsonWriter_append(writer, "{", 1);
+    writer.isFirstField = true;
+    writer.numberRecords++;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void jsonWriter_addUInt(json_writer_t& writer, const char* key, uint32_t value)
+{
+    jsonWriter_appendKey(writer, key);
+    jsonWriter_appendDigits(writer, value, 1);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void jsonWriter_addFixed(json_writer_t& writer, const char* key, uint32_t scaledValue, uint8_t numberFractionalDigits)
+{
+    uint32_t multiplier = 1;
+    for(uint8_t i = 0; i < numberFractionalDigits; i++)
+    {
+        multiplier *= 10;
+    }
+    jsonWriter_appendKey(writer, key);
+    jsonWriter_appendDigits(writer, scaledValue / multiplier, 1);
+    if(numberFractionalDigits > 0)
+    {
+        jsonWriter_append(writer, ".", 1);
+        jsonWriter_appendDigits(writer, scaledValue % multiplier, numberFractionalDigits);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t jsonWriter_endRecord(json_writer_t& writer)
+{
+    jsonWriter_append(writer, "}", 1);
+    if(writer.format == JSON_WRITER_FORMAT_NDJSON)
+    {
+        jsonWriter_append(writer, "\n", 1);
+    }
+    return jsonWriter_finishTarget(writer);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t jsonWriter_end(json_writer_t& writer, uint8_t* buffer, size_t length)
+{
+    if(writer.isEnded)
+    {
+        return 0;
+    }
+    writer.isEnded = true;
+    if(writer.format != JSON_WRITER_FORMAT_ARRAY)
+    {
+        return 0;
+    }
+    jsonWriter_selectTarget(writer, buffer, length);
+    jsonWriter_append(writer, (writer.numberRecords == 0) ? "[]" : "]", (writer.numberRecords == 0) ? 2 : 1);
+    return jsonWriter_finishTarget(writer);
+}
@@ -5,6 +5,7 @@
 // https://randomnerdtutorials.com/esp-now-auto-pairing-esp32-esp8266/
 
 #include <Arduino.h>
+#include <memory>
 #include <espnow.h>
 #include <ESP8266WiFi.h>
 #include <ESPAsyncWebServer.h>
@@ -21,12 +22,64 @@
 #include "timeHandling.h"
 #include "otaUpdate.h"
 #include "memory.h"
+#include "historyExport.h"
+#include "queryCache.h"
+#include "jsonWriter.h"
 #include "pairing.h"
 #include "utils.h"
 #include "version.h"
 
 // To increase the FS size https://arduino-esp8266.readthedocs.io/en/latest/filesystem.html#flash-layout
 
+#define GET_DATA_BINARY_RECORD_SIZE     8       // Size of one record of the binary /get_data format: timestamp (uint32), battery voltage in mV (uint16), pin state (uint8), number of send loops (uint8), all little-endian
+#define GET_DATA_MULTI_BINARY_RECORD_SIZE   (GET_DATA_BINARY_RECORD_SIZE + 1)  // Size of one record of the binary /get_data_multi format: record of the binary /get_data format followed by the sensor index (uint8)
+#define GET_DATA_MAX_STREAMS            (2 * NUM_SUPPORTED_SENSORS + 1)     // Maximum number of sensor histories that are streamed at the same time by /get_data and /get_data_multi (two /get_data_multi responses with all sensors and one /get_data response, or several /get_data responses). Further requests are answered with 503.
+#define GET_DATA_RETRY_AFTER_S          2       // Retry-After time in seconds that is sent with the 503 response if all /get_data streams are used
+#define GET_ROLLUP_MAX_STREAMS          2       // Maximum number of /get_rollup responses that are streamed at the same time. Further requests are answered with 503.
+#define GET_DATA_MAX_QUEUED_MESSAGES    3       // Maximum number of messages that are queued by a downsampled stream (the two messages of a bucket and a pin state transition)
+
+/**
+ * State of a streamed /get_data response. Each request uses its own context, so that several clients can load the history at the same time.
+ * /get_data_multi uses one context for each requested sensor. They are linked by nextMergedStream, the first one formats the response.
+ */
+typedef struct get_data_stream
+{
+    bool isUsed;                            // The context belongs to a request that isn't disconnected yet
+    uint8_t sensorIndex;
+    memory_history_reader_t reader;
+    time_t timeFrom;
+    time_t timeTo;                          // End of the requested range. It is limited to the newest message at the start of the request.
+    bool isEnd;                             // All messages of the range were read from the reader
+    time_t bucketDuration;                  // Downsampling (maxPoints parameter): duration of the time buckets that are reduced to their messages with the minimum and maximum battery voltage (0 = all messages are sent)
+    time_t bucketEnd;                       // Downsampling: end of the current bucket (exclusive)
+    bool isBucketEmpty;                     // Downsampling: no message was added to the current bucket yet
+    message_sensor_timestamped_t bucketMinMessage;  // Downsampling: message of the current bucket with the minimum battery voltage
+    message_sensor_timestamped_t bucketMaxMessage;  // Downsampling: message of the current bucket with the maximum battery voltage
+    uint32_t bucketMinNumber;               // Downsampling: number of bucketMinMessage in the stream (keeps the time order if both messages have the same timestamp)
+    uint32_t bucketMaxNumber;               // Downsampling: number of bucketMaxMessage in the stream
+    uint32_t numberReadMessages;            // Number of messages of the range that were read from the reader
+    int8_t lastPinState;                    // Pin state of the last read message (-1 before the first message)
+    message_sensor_timestamped_t queuedMessages[GET_DATA_MAX_QUEUED_MESSAGES];  // Messages that are sent next (in time order)
+    uint8_t numberQueuedMessages;
+    bool isBinary;                          // The response uses the binary format (format=bin) instead of JSON
+    bool isMerged;                          // The response is sent by /get_data_multi and the records contain the sensor index
+    struct get_data_stream* nextMergedStream;   // Context of the next sensor of the /get_data_multi response (NULL for the last one and for /get_data)
+    json_writer_t writer;                   // Formats the JSON records
+    query_cache_capture_t capture;          // Result that is captured for the query cache (only /get_data)
+} get_data_stream_t;
+
+/**
+ * State of a streamed /get_rollup response. Each request uses its own context (like /get_data).
+ */
+typedef struct get_rollup_stream
+{
+    bool isUsed;                            // The context belongs to a request that isn't disconnected yet
+    memory_rollup_reader_t reader;
+    time_t timeTo;                          // End of the requested range (bucket start)
+    json_writer_t writer;                   // Formats the JSON records
+    query_cache_capture_t capture;          // Result that is captured for the query cache
+} get_rollup_stream_t;
+
 system_config_t sysConfig;
 
 Button2 btn_pairing, btn_reset;             // create button objects
@@ -39,12 +92,9 @@ uint8_t received_mac_addr[6];
 
 message_sensor_timestamped_t sensor_messages_latest[NUM_SUPPORTED_SENSORS];
 
-File serverGetDataMemoryFile;
-int8_t serverGetDataSensorIndex;
-time_t serverGetDataTimeFrom;
-time_t serverGetDataTimeTo;
-message_sensor_timestamped_t serverGetDataPendingMessage;
-bool serverGetDataHasPendingMessage = false;
+get_data_stream_t serverGetDataStreams[GET_DATA_MAX_STREAMS];     // Pool of the contexts of the /get_data responses
+get_rollup_stream_t serverGetRollupStreams[GET_ROLLUP_MAX_STREAMS];   // Pool of the contexts of the /get_rollup responses
+AsyncWebServerRequest* serverImportRequest = NULL;                  // Upload request whose history import is active (NULL if none). Only compared, never dereferenced.
 
 /**********************************************************************/
 
@@ -159,6 +209,10 @@ void btnHandler_reset_longClick(Button2& btn)
 {
     memory_removeAllData();
     wifiHandling_eraseCredentials();
+
+    // Close the history backend and the rollup files before the restart (like for an OTA update)
+    memory_end();
+    LittleFS.end();
     delay(2000);
     ESP.restart();
 }
@@ -222,6 +276,13 @@ void main_setDefaultSystemConfig(system_config_t& sysConfig)
     }
     memset(sysConfig.pmk, 0, sizeof(sysConfig.pmk));    // set to all 0 to indicate that no PMK is set for this sensor. A valid PMK must be generated (e.g. with main_makeSureEncryptionKeysAreSetInSystemConfig()).
     sysConfig.batteryEmptyThreshold_percent = 15;       // Default to 15%
+    for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        sysConfig.retentionPolicies[i] = retention_policy_t();  // No age or size limit
+        sysConfig.samplingPolicies[i] = history_sampling_policy_t();    // Save every message
+    }
+    sysConfig.retentionHighWatermark_percent = 85;
+    sysConfig.retentionLowWatermark_percent = 70;
 }
 
 /**
@@ -319,7 +380,7 @@ bool main_addEncryptedPeer(sensor_config_t& sensorConfig)
 
 void onUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final)
 {
-    // For the first chunk: read sensorIndex from the request and open the file
+    // For the first chunk: read sensorIndex from the request and start the merge with the existing history
     if (index == 0)
     {
         int sensorIndex = -1;
@@ -329,38 +390,589 @@ void onUpload(AsyncWebServerRequest *request, String filename, size_t index, uin
         }
         if (sensorIndex >= 0 && sensorIndex < NUM_SUPPORTED_SENSORS)
         {
-            // open the file with the correct format (ignoring the uploaded filename) on first call and store the file handle in the request object
-            char strBuf[32];
-            sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-            request->_tempFile = LittleFS.open(strBuf, "w");
+            // The uploaded file is merged with the history of the sensor (ignoring the uploaded filename). The existing history is only replaced when the upload is complete.
+            // Store the sensor index in the request object for the following chunks.
+            if (memory_beginSensorHistoryImport(sensorIndex))
+            {
+                request->_tempObject = malloc(sizeof(uint8_t));
+                *(uint8_t*)request->_tempObject = sensorIndex;
+
+                // An interrupted upload mustn't leave the import active. The disconnect of an earlier upload doesn't abort the import of a later one.
+                serverImportRequest = request;
+                request->onDisconnect([request]()
+                {
+                    if(serverImportRequest == request)
+                    {
+                        memory_abortSensorHistoryImport();      // Nothing is done if the whole file was received
+                        serverImportRequest = NULL;
+                    }
+                });
+            }
+            else
+            {
+                request->_tempObject = NULL;
+            }
         }
         else
         {
-            request->_tempFile = File(); // invalid / empty file object
+            request->_tempObject = NULL;
         }
     }
 
-    if (len > 0 && request->_tempFile)    // write only if data exists AND file was opened successfully
+    if (len > 0 && request->_tempObject != NULL)    // write only if data exists AND a valid sensorIndex was given
     {
-        // stream the incoming chunk to the opened file
-        request->_tempFile.write(data, len);
+        // stream the incoming chunk to the history of the sensor (legacy or v2 format)
+        memory_importSensorHistory(*(uint8_t*)request->_tempObject, data, len);
     }
 
     // Upload finished
     if (final)
     {
-        if (request->_tempFile)    // file was opened successfully before
+        if (request->_tempObject != NULL && memory_endSensorHistoryImport(*(uint8_t*)request->_tempObject))    // a valid sensorIndex was given before
+        {
+            // memory_loop() merges the rest of the history and replaces it in small steps. The response is delayed until the import is finished.
+            AsyncWebServerResponse *response = request->beginChunkedResponse("text/html", [request](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+            {
+                if (index > 0)
+                {
+                    return 0;
+                }
+                HistoryImportStates state = (serverImportRequest == request) ? memory_getSensorHistoryImportState() : HISTORY_IMPORT_STATE_FAILED;
+                if (state == HISTORY_IMPORT_STATE_RUNNING)
+                {
+                    return RESPONSE_TRY_AGAIN;      // Polled again by the web server
+                }
+
+                // Only redirect if the file was imported completely
+                const char* text = (state == HISTORY_IMPORT_STATE_SUCCEEDED) ? "<meta http-equiv=\"refresh\" content=\"0; url=/system_management.html\">" : "Upload incomplete: The file contains invalid messages or the merged history could not be written!";
+                size_t length = strlen(text);
+                if (length > maxLen)
+                {
+                    return RESPONSE_TRY_AGAIN;
+                }
+                serverImportRequest = NULL;
+                updateLastSensorMessages();
+                memcpy(buffer, text, length);
+                return length;
+            });
+            request->send(response);
+        }
+        else if (request->_tempObject != NULL)
+        {
+            serverImportRequest = NULL;
+            request->send(200, "text/plain", "Upload incomplete: The file contains invalid messages or the merged history could not be written!");
+        }
+        else                      // return an error message only if no valid sensorIndex was given. If an invalid sensorIndex was given, the upload ends in the <IP>/upload_data page (white page)
+        {
+            request->send(200, "text/plain", "Upload failed: Invalid sensorIndex, file could not be written or an earlier upload is still being imported!");
+        }
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the sensor message as record of the binary /get_data format (see GET_DATA_BINARY_RECORD_SIZE).
+ * The battery percentage isn't included, the page calculates it from the voltage.
+ */
+void main_writeBinaryDataRecord(uint8_t* buffer, const message_sensor_timestamped_t& sensorMessage)
+{
+    uint32_t timestamp = sensorMessage.timestamp;
+    buffer[0] = timestamp & 0xFF;
+    buffer[1] = (timestamp >> 8) & 0xFF;
+    buffer[2] = (timestamp >> 16) & 0xFF;
+    buffer[3] = (timestamp >> 24) & 0xFF;
+    buffer[4] = sensorMessage.msg.batteryVoltage_mV & 0xFF;
+    buffer[5] = (sensorMessage.msg.batteryVoltage_mV >> 8) & 0xFF;
+    buffer[6] = sensorMessage.msg.pinState ? 1 : 0;
+    buffer[7] = sensorMessage.msg.numberSendLoops;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get unused contexts for a /get_data or /get_data_multi response.
+ * @param numberStreams Number of sensors whose histories are streamed. The contexts are linked by nextMergedStream.
+ * @return The first context; NULL if not enough contexts are unused.
+ */
+get_data_stream_t* main_allocGetDataStreams(uint8_t numberStreams)
+{
+    uint8_t numberUnused = 0;
+    for(uint8_t i = 0; i < GET_DATA_MAX_STREAMS; i++)
+    {
+        if(!serverGetDataStreams[i].isUsed)
+        {
+            numberUnused++;
+        }
+    }
+    if(numberStreams == 0 || numberUnused < numberStreams)
+    {
+        return NULL;
+    }
+
+    get_data_stream_t* firstStream = NULL;
+    for(uint8_t i = GET_DATA_MAX_STREAMS; i > 0 && numberStreams > 0; i--)
+    {
+        get_data_stream_t& stream = serverGetDataStreams[i - 1];
+        if(!stream.isUsed)
+        {
+            stream.isUsed = true;
+            stream.nextMergedStream = firstStream;
+            firstStream = &stream;
+            numberStreams--;
+        }
+    }
+    return firstStream;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Release the contexts of a /get_data or /get_data_multi response when the client is disconnected (after the complete response or an aborted transfer).
+ */
+void main_freeGetDataStreams(get_data_stream_t* stream)
+{
+    while(stream != NULL)
+    {
+        get_data_stream_t* nextStream = stream->nextMergedStream;
+        memory_closeHistoryReader(stream->reader);
+        queryCache_abortCapture(stream->capture);       // nothing is left if the result was added to the cache
+        stream->nextMergedStream = NULL;
+        stream->isUsed = false;
+        stream = nextStream;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Start to read the history of the sensor for a /get_data or /get_data_multi response.
+ * Only the messages that exist at the start of the request are sent. Messages that are appended while the response is streamed are not included.
+ * @param maxPoints Approximate number of messages that are sent (downsampling, see main_peekGetDataMessage()); 0 = all messages are sent.
+ */
+void main_beginGetDataStream(get_data_stream_t& stream, uint8_t sensorIndex, time_t timeFrom, time_t timeTo, uint16_t maxPoints, bool isBinary, bool isMerged, JsonWriterFormats jsonFormat)
+{
+    // The range is limited to the history at the start of the request. The time range of the history is taken from the index, no block is decoded.
+    time_t timeOldest, timeNewest;
+    memory_getSensorHistoryTimeRange(sensorIndex, timeOldest, timeNewest);
+
+    stream.sensorIndex = sensorIndex;
+    stream.timeFrom = max(timeFrom, timeOldest);
+    stream.timeTo = min(timeTo, timeNewest);
+    stream.isEnd = false;
+    stream.isBinary = isBinary;
+    stream.isMerged = isMerged;
+    stream.bucketDuration = 0;
+    stream.isBucketEmpty = true;
+    stream.numberReadMessages = 0;
+    stream.lastPinState = -1;
+    stream.numberQueuedMessages = 0;
+    jsonWriter_begin(stream.writer, jsonFormat);
+
+    // The range from the oldest message to the end is divided into buckets with up to two messages each
+    if(maxPoints > 0 && stream.timeTo >= stream.timeFrom)
+    {
+        stream.bucketDuration = (stream.timeTo - stream.timeFrom) / (maxPoints / 2) + 1;
+    }
+
+    // Skip all messages that are older than the requested range by using the sparse time index. Recent ranges are read from the RAM tail cache.
+    memory_openHistoryReader(stream.reader, sensorIndex, 0);
+    memory_seekHistoryReader(stream.reader, stream.timeFrom);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Queue the messages of the current bucket (the ones with the minimum and maximum battery voltage) in time order and start a new bucket.
+ */
+void main_flushGetDataBucket(get_data_stream_t& stream)
+{
+    if(stream.isBucketEmpty)
+    {
+        return;
+    }
+    bool isMinFirst = stream.bucketMinNumber <= stream.bucketMaxNumber;
+    stream.queuedMessages[stream.numberQueuedMessages++] = isMinFirst ? stream.bucketMinMessage : stream.bucketMaxMessage;
+    if(stream.bucketMinNumber != stream.bucketMaxNumber)
+    {
+        stream.queuedMessages[stream.numberQueuedMessages++] = isMinFirst ? stream.bucketMaxMessage : stream.bucketMinMessage;
+    }
+    stream.isBucketEmpty = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the next message that is sent by the stream without removing it (see main_popGetDataMessage()).
+ * With downsampling, only the messages with the minimum and maximum battery voltage of each bucket and all pin state transitions are sent (in constant memory).
+ * @return False if all messages of the range were sent.
+ */
+bool main_peekGetDataMessage(get_data_stream_t& stream, message_sensor_timestamped_t& sensorMessage)
+{
+    while(stream.numberQueuedMessages == 0 && !stream.isEnd)
+    {
+        // The messages are saved in time order. So all following messages are also out of the requested range.
+        message_sensor_timestamped_t readMessage;
+        if(!memory_readHistoryMessage(stream.reader, readMessage) || readMessage.timestamp > stream.timeTo)
+        {
+            memory_closeHistoryReader(stream.reader);
+            stream.isEnd = true;
+            main_flushGetDataBucket(stream);
+            break;
+        }
+        // Skip the message if the timestamp is before the requested range
+        if(readMessage.timestamp < stream.timeFrom)
+        {
+            continue;
+        }
+        stream.numberReadMessages++;
+
+        // All messages are sent without downsampling. Pin state transitions (and the first message) are always sent, so that the pin state chart stays correct.
+        if(stream.bucketDuration == 0 || readMessage.msg.pinState != stream.lastPinState)
+        {
+            main_flushGetDataBucket(stream);
+            stream.queuedMessages[stream.numberQueuedMessages++] = readMessage;
+            stream.lastPinState = readMessage.msg.pinState;
+            continue;
+        }
+
+        if(readMessage.timestamp >= stream.bucketEnd)
+        {
+            main_flushGetDataBucket(stream);
+        }
+        if(stream.isBucketEmpty)
+        {
+            stream.bucketEnd = stream.timeFrom + ((readMessage.timestamp - stream.timeFrom) / stream.bucketDuration + 1) * stream.bucketDuration;
+            stream.bucketMinMessage = readMessage;
+            stream.bucketMaxMessage = readMessage;
+            stream.bucketMinNumber = stream.numberReadMessages;
+            stream.bucketMaxNumber = stream.numberReadMessages;
+            stream.isBucketEmpty = false;
+        }
+        else if(readMessage.msg.batteryVoltage_mV < stream.bucketMinMessage.msg.batteryVoltage_mV)
+        {
+            stream.bucketMinMessage = readMessage;
+            stream.bucketMinNumber = stream.numberReadMessages;
+        }
+        else if(readMessage.msg.batteryVoltage_mV > stream.bucketMaxMessage.msg.batteryVoltage_mV)
+        {
+            stream.bucketMaxMessage = readMessage;
+            stream.bucketMaxNumber = stream.numberReadMessages;
+        }
+    }
+    if(stream.numberQueuedMessages == 0)
+    {
+        return false;
+    }
+    sensorMessage = stream.queuedMessages[0];
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Remove the message that was returned by main_peekGetDataMessage() after it was sent.
+ */
+void main_popGetDataMessage(get_data_stream_t& stream)
+{
+    for(uint8_t i = 1; i < stream.numberQueuedMessages; i++)
+    {
+        stream.queuedMessages[i - 1] = stream.queuedMessages[i];
+    }
+    stream.numberQueuedMessages--;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the next chunk of a /get_data or /get_data_multi response.
+ * The messages of all sensors of the response are merged by their timestamps (each reader returns its messages in time order).
+ * @param stream First context of the response.
+ * @return Number of bytes written to the buffer (0 at the end of the response, RESPONSE_TRY_AGAIN if the buffer is too small for the next record).
+ */
+size_t main_readGetDataStream(get_data_stream_t& stream, uint8_t* buffer, size_t maxLen)
+{
+    // Continue with the rest of the record that didn't fit into the last chunk
+    size_t responseSize = jsonWriter_read(stream.writer, buffer, maxLen);
+    bool isEnd = false;
+    while(responseSize < maxLen && !jsonWriter_hasPendingData(stream.writer))
+    {
+        // Find the sensor with the oldest next message (the first one of the request on equal timestamps)
+        get_data_stream_t* oldestStream = NULL;
+        message_sensor_timestamped_t oldestMessage;
+        for(get_data_stream_t* sensorStream = &stream; sensorStream != NULL; sensorStream = sensorStream->nextMergedStream)
+        {
+            message_sensor_timestamped_t sensorMessage;
+            if(main_peekGetDataMessage(*sensorStream, sensorMessage) && (oldestStream == NULL || sensorMessage.timestamp < oldestMessage.timestamp))
+            {
+                oldestStream = sensorStream;
+                oldestMessage = sensorMessage;
+            }
+        }
+        if(oldestStream == NULL)
         {
-            // close the file handle as the upload is now done
-            request->_tempFile.close();
-            request->redirect("/system_management.html");     // Only redirect if the file was uploaded. If an invalid sensorIndex was given, the upload ends in the <IP>/upload_data page (white page)
-            updateLastSensorMessages();
+            if(!stream.isBinary)
+            {
+                responseSize += jsonWriter_end(stream.writer, buffer + responseSize, maxLen - responseSize);
+            }
+            isEnd = true;
+            break;
         }
-        else                      // return an error message only if file was NOT opened before
+
+        // Fixed-width records need no serialization. The record doesn't fit anymore -> the message stays queued for next chunk
+        if(stream.isBinary)
         {
-            request->send(200, "text/plain", "Upload failed: Invalid sensorIndex or file could not be written!");
+            size_t recordSize = stream.isMerged ? GET_DATA_MULTI_BINARY_RECORD_SIZE : GET_DATA_BINARY_RECORD_SIZE;
+            if(responseSize + recordSize > maxLen)
+            {
+                break;
+            }
+            main_writeBinaryDataRecord(buffer + responseSize, oldestMessage);
+            if(stream.isMerged)
+            {
+                buffer[responseSize + GET_DATA_BINARY_RECORD_SIZE] = oldestStream->sensorIndex;
+            }
+            responseSize += recordSize;
         }
+        else
+        {
+            // Format the record directly into the chunk. The part that doesn't fit anymore is sent with the next chunk.
+            jsonWriter_beginRecord(stream.writer, buffer + responseSize, maxLen - responseSize);
+            if(stream.isMerged)
+            {
+                jsonWriter_addUInt(stream.writer, "sensor", oldestStream->sensorIndex);
+            }
+            jsonWriter_addUInt(stream.writer, "time", oldestMessage.timestamp);
+            jsonWriter_addUInt(stream.writer, "pin", oldestMessage.msg.pinState);
+            jsonWriter_addFixed(stream.writer, "batP", battery_voltageToScaledPercent(oldestMessage.msg.batteryVoltage_mV, 2), 2);
+            responseSize += jsonWriter_endRecord(stream.writer);
+        }
+        main_popGetDataMessage(*oldestStream);
+    }
+
+    if(responseSize == 0 && !isEnd)
+    {
+        return RESPONSE_TRY_AGAIN;      // Not even one binary record fits into the chunk. 0 would end the response.
+    }
+
+    queryCache_appendCapture(stream.capture, buffer, responseSize);
+    if(isEnd && !jsonWriter_hasPendingData(stream.writer))
+    {
+        queryCache_endCapture(stream.capture);
+    }
+    return responseSize;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get an unused context for a /get_rollup response.
+ * @return NULL if all contexts are used.
+ */
+get_rollup_stream_t* main_allocGetRollupStream()
+{
+    for(uint8_t i = 0; i < GET_ROLLUP_MAX_STREAMS; i++)
+    {
+        if(!serverGetRollupStreams[i].isUsed)
+        {
+            serverGetRollupStreams[i].isUsed = true;
+            return &serverGetRollupStreams[i];
+        }
+    }
+    return NULL;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Release the context of a /get_rollup response when the client is disconnected (after the complete response or an aborted transfer).
+ */
+void main_freeGetRollupStream(get_rollup_stream_t* stream)
+{
+    memory_closeRollupReader(stream->reader);
+    queryCache_abortCapture(stream->capture);       // nothing is left if the result was added to the cache
+    stream->isUsed = false;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the next chunk of a /get_rollup response.
+ * @return Number of bytes written to the buffer (0 at the end of the response).
+ */
+size_t main_readGetRollupStream(get_rollup_stream_t& stream, uint8_t* buffer, size_t maxLen)
+{
+    // Continue with the rest of the bucket that didn't fit into the last chunk
+    size_t jsonSize = jsonWriter_read(stream.writer, buffer, maxLen);
+    bool isEnd = false;
+    while(jsonSize < maxLen && !jsonWriter_hasPendingData(stream.writer))
+    {
+        // Get bucket. The buckets are saved in time order. So all following buckets are also out of the requested range.
+        history_rollup_entry_t entry;
+        if(!memory_readRollupEntry(stream.reader, entry) || entry.bucketStart > stream.timeTo)
+        {
+            memory_closeRollupReader(stream.reader);
+            jsonSize += jsonWriter_end(stream.writer, buffer + jsonSize, maxLen - jsonSize);
+            isEnd = !jsonWriter_hasPendingData(stream.writer);
+            break;
+        }
+
+        // Format the bucket directly into the chunk. The part that doesn't fit anymore is sent with the next chunk.
+        jsonWriter_beginRecord(stream.writer, buffer + jsonSize, maxLen - jsonSize);
+        jsonWriter_addUInt(stream.writer, "time", entry.bucketStart);
+        jsonWriter_addUInt(stream.writer, "open", entry.numberOpen);
+        jsonWriter_addUInt(stream.writer, "closed", entry.numberClosed);
+        jsonWriter_addUInt(stream.writer, "minV", entry.minBatteryVoltage_mV);
+        jsonWriter_addUInt(stream.writer, "maxV", entry.maxBatteryVoltage_mV);
+        jsonWriter_addUInt(stream.writer, "lastV", entry.lastBatteryVoltage_mV);
+        jsonWriter_addUInt(stream.writer, "loops", entry.maxNumberSendLoops);
+        jsonSize += jsonWriter_endRecord(stream.writer);
+    }
+
+    queryCache_appendCapture(stream.capture, buffer, jsonSize);
+    if(isEnd)
+    {
+        queryCache_endCapture(stream.capture);
+    }
+    return jsonSize;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Parse the format parameter of /get_data and /get_data_multi (json, ndjson or bin; json if it isn't given).
+ * @return False if the format is unknown.
+ */
+bool main_parseGetDataFormat(AsyncWebServerRequest *request, bool& isBinary, JsonWriterFormats& jsonFormat)
+{
+    isBinary = false;
+    jsonFormat = JSON_WRITER_FORMAT_ARRAY;
+    if(!request->hasParam("format"))
+    {
+        return true;
+    }
+    String formatString = request->getParam("format")->value();
+    if(formatString == "bin")
+    {
+        isBinary = true;
+    }
+    else if(formatString == "ndjson")
+    {
+        jsonFormat = JSON_WRITER_FORMAT_NDJSON;
+    }
+    return formatString == "bin" || formatString == "ndjson" || formatString == "json";
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Parse the maxPoints parameter of /get_data and /get_data_multi (0 if it isn't given).
+ * @return False if the value is invalid.
+ */
+bool main_parseGetDataMaxPoints(AsyncWebServerRequest *request, uint16_t& maxPoints)
+{
+    maxPoints = 0;
+    if(!request->hasParam("maxPoints"))
+    {
+        return true;
+    }
+    long value = request->getParam("maxPoints")->value().toInt();
+    if(value < 2 || value > UINT16_MAX)
+    {
+        return false;
+    }
+    maxPoints = value;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Parse a comma separated list of sensor indices (e.g. "0,2").
+ * @param sensorIndices Array for NUM_SUPPORTED_SENSORS indices.
+ * @return False if an index is invalid, out of range or given twice.
+ */
+bool main_parseSensorList(const String& sensorsString, uint8_t* sensorIndices, uint8_t& numberSensors)
+{
+    numberSensors = 0;
+    int start = 0;
+    while(start <= (int)sensorsString.length())
+    {
+        int end = sensorsString.indexOf(',', start);
+        if(end < 0)
+        {
+            end = sensorsString.length();
+        }
+        String indexString = sensorsString.substring(start, end);
+        if(indexString.length() == 0 || indexString.length() > 3 || numberSensors >= NUM_SUPPORTED_SENSORS)
+        {
+            return false;
+        }
+        for(unsigned int i = 0; i < indexString.length(); i++)
+        {
+            if(indexString[i] < '0' || indexString[i] > '9')
+            {
+                return false;
+            }
+        }
+        int sensorIndex = indexString.toInt();
+        if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+        {
+            return false;
+        }
+        for(uint8_t i = 0; i < numberSensors; i++)
+        {
+            if(sensorIndices[i] == sensorIndex)
+            {
+                return false;
+            }
+        }
+        sensorIndices[numberSensors++] = sensorIndex;
+        start = end + 1;
+    }
+    return numberSensors > 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Answer a history request with 503, because all contexts for streamed histories are used.
+ */
+void main_sendGetDataBusy(AsyncWebServerRequest *request)
+{
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Too many history requests, please retry later");
+    response->addHeader("Retry-After", String(GET_DATA_RETRY_AFTER_S));
+    request->send(response);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the format field of the query cache key for the format of a response.
+ */
+QueryCacheFormats main_getQueryCacheFormat(bool isBinary, JsonWriterFormats jsonFormat)
+{
+    if(isBinary)
+    {
+        return QUERY_CACHE_FORMAT_BINARY;
     }
+    return (jsonFormat == JSON_WRITER_FORMAT_NDJSON) ? QUERY_CACHE_FORMAT_NDJSON : QUERY_CACHE_FORMAT_JSON;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Send a query result from the query cache. The result is kept until it is sent completely, even if it is evicted from the cache in the meantime.
+ */
+void main_sendQueryCacheResult(AsyncWebServerRequest *request, const char* contentType, std::shared_ptr<const uint8_t> result, size_t length)
+{
+    AsyncWebServerResponse *response = request->beginResponse(contentType, length, [result, length](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+    {
+        size_t numberBytes = min(maxLen, length - index);
+        memcpy(buffer, result.get() + index, numberBytes);
+        return numberBytes;
+    });
+    request->send(response);
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
@@ -376,7 +988,7 @@ void main_initWebserverEndpoints()
 
     server.on("/get_sensor_status", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        DynamicJsonDocument doc(1024);
+        DynamicJsonDocument doc(1536);
         JsonArray sensors = doc.createNestedArray("sensors");
         for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
         {
@@ -411,6 +1023,12 @@ void main_initWebserverEndpoints()
             sensor["isPaired"] = sysConfig.sensors[i].isPaired;
             sensor["useEncryption"] = sysConfig.sensors[i].useEncryption;
             sensor["numMessages"] = memory_getNumberSensorMessages(i);
+            sensor["historySize"] = memory_getStorageCatalog().historySize[i];
+            sensor["retentionMaxAge"] = sysConfig.retentionPolicies[i].maxAge_days;
+            sensor["retentionMaxSize"] = sysConfig.retentionPolicies[i].maxSize_kB;
+            sensor["samplingMode"] = sysConfig.samplingPolicies[i].mode;
+            sensor["samplingVoltageDelta"] = sysConfig.samplingPolicies[i].minVoltageDelta_mV;
+            sensor["samplingInterval"] = sysConfig.samplingPolicies[i].maxInterval_hours;
             
             if(sensor_messages_latest[i].timestamp == -1)
             {
@@ -432,11 +1050,20 @@ void main_initWebserverEndpoints()
 
     server.on("/get_indoor_station_info", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        DynamicJsonDocument doc(256);
+        query_cache_stats_t queryCacheStats;
+        queryCache_getStats(queryCacheStats);
+        DynamicJsonDocument doc(384);
         //doc["mac"] = WiFi.macAddress();
         doc["swVersion"] = GARAGE_DOOR_INDOOR_STATION_SW_VERSION;
         doc["memoryUsage"] = memory_getMemoryUsageString(true);
         doc["batteryEmptyThreshold"] = sysConfig.batteryEmptyThreshold_percent;
+        doc["retentionHighWatermark"] = sysConfig.retentionHighWatermark_percent;
+        doc["retentionLowWatermark"] = sysConfig.retentionLowWatermark_percent;
+        doc["retentionActive"] = memory_getStorageCatalog().isRetentionActive;
+        doc["queryCacheHits"] = queryCacheStats.hits;
+        doc["queryCacheMisses"] = queryCacheStats.misses;
+        doc["queryCacheEntries"] = queryCacheStats.numberEntries;
+        doc["queryCacheBytes"] = queryCacheStats.usedBytes;
         String response;
         serializeJson(doc, response);
         request->send(200, "application/json", response);
@@ -502,6 +1129,90 @@ void main_initWebserverEndpoints()
 
     // ----------------------------------
 
+    server.on("/set_retention_policy", HTTP_GET, [] (AsyncWebServerRequest *request)
+    {
+        int8_t sensorIndex = -1;
+        if(request->hasParam("sensorIndex"))
+        {
+            sensorIndex = request->getParam("sensorIndex")->value().toInt();
+        }
+
+        if(sensorIndex >= 0 && sensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            // Empty values or 0 disable the limit
+            if(request->hasParam("maxAge"))
+            {
+                long maxAge_days = request->getParam("maxAge")->value().toInt();
+                sysConfig.retentionPolicies[sensorIndex].maxAge_days = constrain(maxAge_days, 0L, 0xFFFFL);
+            }
+            if(request->hasParam("maxSize"))
+            {
+                long maxSize_kB = request->getParam("maxSize")->value().toInt();
+                sysConfig.retentionPolicies[sensorIndex].maxSize_kB = constrain(maxSize_kB, 0L, (long)(MEMORY_HISTORY_MAX_SIZE_PER_SENSOR / 1024));
+            }
+            memory_saveSystemConfig(sysConfig);
+        }
+        request->redirect("/system_management.html");
+    });
+
+    // ----------------------------------
+
+    server.on("/set_sampling_policy", HTTP_GET, [] (AsyncWebServerRequest *request)
+    {
+        int8_t sensorIndex = -1;
+        if(request->hasParam("sensorIndex"))
+        {
+            sensorIndex = request->getParam("sensorIndex")->value().toInt();
+        }
+
+        if(sensorIndex >= 0 && sensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            if(request->hasParam("mode"))
+            {
+                long mode = request->getParam("mode")->value().toInt();
+                sysConfig.samplingPolicies[sensorIndex].mode = constrain(mode, (long)HISTORY_SAMPLING_ALWAYS, (long)HISTORY_SAMPLING_SIGNIFICANT);
+            }
+            if(request->hasParam("voltageDelta"))
+            {
+                long voltageDelta_mV = request->getParam("voltageDelta")->value().toInt();
+                sysConfig.samplingPolicies[sensorIndex].minVoltageDelta_mV = constrain(voltageDelta_mV, 0L, 0xFFFFL);
+            }
+            if(request->hasParam("interval"))
+            {
+                long interval_hours = request->getParam("interval")->value().toInt();     // 0 disables the time limit
+                sysConfig.samplingPolicies[sensorIndex].maxInterval_hours = constrain(interval_hours, 0L, 0xFFFFL);
+            }
+            memory_saveSystemConfig(sysConfig);
+        }
+        request->redirect("/system_management.html");
+    });
+
+    // ----------------------------------
+
+    server.on("/set_retention_watermarks", HTTP_GET, [] (AsyncWebServerRequest *request)
+    {
+        int16_t highWatermark = -1;
+        int16_t lowWatermark = -1;
+        if(request->hasParam("high"))
+        {
+            highWatermark = request->getParam("high")->value().toInt();
+        }
+        if(request->hasParam("low"))
+        {
+            lowWatermark = request->getParam("low")->value().toInt();
+        }
+
+        if(highWatermark > 0 && highWatermark <= 100 && lowWatermark >= 0 && lowWatermark < highWatermark) // Ensure valid percentages with a hysteresis
+        {
+            sysConfig.retentionHighWatermark_percent = highWatermark;
+            sysConfig.retentionLowWatermark_percent = lowWatermark;
+            memory_saveSystemConfig(sysConfig);
+        }
+        request->send(200, "text/plain", "OK");
+    });
+
+    // ----------------------------------
+
     server.on("/download_data", HTTP_GET, [] (AsyncWebServerRequest *request)
     {
         int8_t sensorIndex = -1;
@@ -509,17 +1220,85 @@ void main_initWebserverEndpoints()
         {
             sensorIndex = request->getParam("sensorIndex")->value().toInt();
         }
-        //Download data of the requested sensor
-        char strBuf[32];
-        sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-        if(LittleFS.exists(strBuf))
+        if(sensorIndex < 0 || sensorIndex >= NUM_SUPPORTED_SENSORS || memory_getNumberSensorMessages(sensorIndex) == 0)
         {
-            request->send(LittleFS, strBuf, String(), true);
+            request->send(200, "text/plain", "No data found for sensorIndex: " + String(sensorIndex));
+            return;
         }
-        else
+
+        //Download data of the requested sensor. All history segments are sent as one file (v2 format; legacy format with the other history backends, see memory_readHistory()).
+        std::shared_ptr<memory_history_reader_t> reader = std::make_shared<memory_history_reader_t>();
+        memory_openHistoryReader(*reader, sensorIndex, 0);
+        AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+        {
+            return memory_readHistory(*reader, buffer, maxLen);
+        });
+        char strBuf[64];
+        sprintf(strBuf, "attachment; filename=\"dataSensor%d.bin\"", sensorIndex);
+        response->addHeader("Content-Disposition", strBuf);
+        request->send(response);
+    });
+
+    // ----------------------------------
+
+    server.on("/export", HTTP_GET, [] (AsyncWebServerRequest *request)
+    {
+        int8_t sensorIndex = -1;
+        time_t timeFrom = 0;
+        time_t timeTo = UINT32_MAX;
+        HistoryExportFormats format = HISTORY_EXPORT_FORMAT_CSV;
+        if(request->hasParam("sensorIndex"))
+        {
+            sensorIndex = request->getParam("sensorIndex")->value().toInt();
+        }
+        if(request->hasParam("from"))
+        {
+            timeFrom = request->getParam("from")->value().toInt();
+        }
+        if(request->hasParam("to"))
         {
-            request->send(200, "text/plain", "No file with this name found: " + String(strBuf));
+            timeTo = request->getParam("to")->value().toInt();
         }
+        if(request->hasParam("format"))
+        {
+            String formatString = request->getParam("format")->value();
+            if(formatString == "ndjson")
+            {
+                format = HISTORY_EXPORT_FORMAT_NDJSON;
+            }
+            else if(formatString != "csv")
+            {
+                request->send(400, "text/plain", "format parameter must be csv or ndjson");
+                return;
+            }
+        }
+        if(sensorIndex < 0 || sensorIndex >= NUM_SUPPORTED_SENSORS)
+        {
+            request->send(200, "text/plain", "sensorIndex parameter not set or out of range");
+            return;
+        }
+
+        // Compress the export if the client supports it (can be disabled with compress=0, e.g. for clients that don't decode it automatically)
+        bool isCompressed = request->hasHeader("Accept-Encoding") && request->getHeader("Accept-Encoding")->value().indexOf("deflate") >= 0;
+        if(request->hasParam("compress") && request->getParam("compress")->value() == "0")
+        {
+            isCompressed = false;
+        }
+
+        std::shared_ptr<history_export_t> exp = std::make_shared<history_export_t>();
+        historyExport_begin(*exp, sensorIndex, timeFrom, timeTo, format, isCompressed);
+        AsyncWebServerResponse *response = request->beginChunkedResponse((format == HISTORY_EXPORT_FORMAT_NDJSON) ? "application/x-ndjson" : "text/csv", [exp](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+        {
+            return historyExport_read(*exp, buffer, maxLen);
+        });
+        if(isCompressed)
+        {
+            response->addHeader("Content-Encoding", "deflate");
+        }
+        char strBuf[64];
+        sprintf(strBuf, "attachment; filename=\"dataSensor%d.%s\"", sensorIndex, (format == HISTORY_EXPORT_FORMAT_NDJSON) ? "ndjson" : "csv");
+        response->addHeader("Content-Disposition", strBuf);
+        request->send(response);
     });
 
     // ----------------------------------
@@ -545,94 +1324,262 @@ void main_initWebserverEndpoints()
 
     // ----------------------------------
 
+    server.on("/get_history_check", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        const memory_history_check_report_t& report = memory_getHistoryCheckReport();
+        DynamicJsonDocument doc(1024);
+        doc["running"] = report.isRunning;
+        doc["duration_ms"] = report.duration_ms;
+        JsonArray sensors = doc.createNestedArray("sensors");
+        for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+        {
+            JsonObject sensor = sensors.createNestedObject();
+            sensor["index"] = i;
+            sensor["checkedBlocks"] = report.sensors[i].checkedBlocks;
+            sensor["tornBytes"] = report.sensors[i].tornBytes;
+            sensor["invalidSegments"] = report.sensors[i].invalidSegments;
+            sensor["crcErrorBlocks"] = report.sensors[i].crcErrorBlocks;
+            sensor["invalidRecordBlocks"] = report.sensors[i].invalidRecordBlocks;
+            sensor["absurdTimestamps"] = report.sensors[i].absurdTimestamps;
+            sensor["outOfOrderTimestamps"] = report.sensors[i].outOfOrderTimestamps;
+            sensor["lostMessages"] = report.sensors[i].lostMessages;
+            sensor["repairedBlocks"] = report.sensors[i].repairedBlocks;
+        }
+        String response;
+        serializeJson(doc, response);
+        request->send(200, "application/json", response);
+    });
+
+    // ----------------------------------
+
+    server.on("/start_history_check", HTTP_POST, [](AsyncWebServerRequest *request)
+    {
+        memory_startHistoryCheck();
+        request->send(200, "text/plain", "OK");
+    });
+
+    // ----------------------------------
+
     server.on("/get_data", HTTP_GET, [] (AsyncWebServerRequest *request)
     {
-        serverGetDataSensorIndex = -1;
-        serverGetDataTimeFrom = 0;
-        serverGetDataTimeTo = UINT32_MAX;
+        int8_t sensorIndex = -1;
+        time_t timeFrom = 0;
+        time_t timeTo = UINT32_MAX;
+        uint16_t maxPoints;
+        bool isBinary;
+        JsonWriterFormats jsonFormat;
         if(request->hasParam("sensorIndex"))
         {
-            serverGetDataSensorIndex = request->getParam("sensorIndex")->value().toInt();
+            sensorIndex = request->getParam("sensorIndex")->value().toInt();
         }
         if(request->hasParam("from"))
         {
-            serverGetDataTimeFrom = request->getParam("from")->value().toInt();
+            timeFrom = request->getParam("from")->value().toInt();
         }
         if(request->hasParam("to"))
         {
-            serverGetDataTimeTo = request->getParam("to")->value().toInt();
+            timeTo = request->getParam("to")->value().toInt();
+        }
+        if(!main_parseGetDataFormat(request, isBinary, jsonFormat))
+        {
+            request->send(400, "text/plain", "format parameter must be json, ndjson or bin");
+            return;
+        }
+        if(!main_parseGetDataMaxPoints(request, maxPoints))
+        {
+            request->send(400, "text/plain", "maxPoints parameter must be between 2 and 65535");
+            return;
         }
 
-        if(serverGetDataSensorIndex < 0 || serverGetDataSensorIndex >= NUM_SUPPORTED_SENSORS)
+        if(sensorIndex < 0 || sensorIndex >= NUM_SUPPORTED_SENSORS)
         {
             request->send(200, "text/plain", "sensorIndex parameter not set or out of range");
             return;
         }
 
-        char strBuf[32];
-        sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, serverGetDataSensorIndex);
-        serverGetDataMemoryFile = LittleFS.open(strBuf, "r");
-        if(!serverGetDataMemoryFile)
+        // Repeated queries are answered from the query cache as long as the history of the sensor doesn't change
+        const char* contentType = isBinary ? "application/octet-stream" : ((jsonFormat == JSON_WRITER_FORMAT_NDJSON) ? "application/x-ndjson" : "application/json");
+        query_cache_key_t queryKey = { QUERY_CACHE_ENDPOINT_DATA, (uint8_t)sensorIndex, (uint8_t)main_getQueryCacheFormat(isBinary, jsonFormat), maxPoints, timeFrom, timeTo };
+        size_t resultLength;
+        std::shared_ptr<const uint8_t> result = queryCache_find(queryKey, resultLength);
+        if(result)
         {
-            request->send(200, "text/plain", "file open failed");
+            main_sendQueryCacheResult(request, contentType, result, resultLength);
             return;
         }
-        serverGetDataHasPendingMessage = false;
 
-        AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain", [](uint8_t *buffer, size_t maxLen, size_t index) -> size_t 
+        get_data_stream_t* stream = main_allocGetDataStreams(1);
+        if(stream == NULL)
+        {
+            main_sendGetDataBusy(request);
+            return;
+        }
+        request->onDisconnect([stream]()
+        {
+            main_freeGetDataStreams(stream);
+        });
+        main_beginGetDataStream(*stream, sensorIndex, timeFrom, timeTo, maxPoints, isBinary, false, jsonFormat);
+        queryCache_beginCapture(stream->capture, queryKey);
+
+        AsyncWebServerResponse *response = request->beginChunkedResponse(contentType, [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t 
         {
             //Write up to "maxLen" bytes into "buffer" and return the amount written.
             //Index equals the amount of bytes that have been already sent.
             //You will be asked for more data until 0 is returned.
             //Keep in mind that you can not delay or yield waiting for more data!
+            return main_readGetDataStream(*stream, buffer, maxLen);
+        });
+        request->send(response);
+    });
 
-            size_t jsonSize = 0;
-            StaticJsonDocument<75> json;
-            while(jsonSize < maxLen)
-            {
-                // Get message (pending or from file)
-                message_sensor_timestamped_t sensorMessage;
-                if(serverGetDataHasPendingMessage)
-                {
-                    sensorMessage = serverGetDataPendingMessage;
-                    serverGetDataHasPendingMessage = false;
-                }
-                else
-                {
-                    size_t numReadBytes = serverGetDataMemoryFile.read((uint8_t*)&sensorMessage, sizeof(message_sensor_timestamped_t));
-                    if(numReadBytes == 0)
-                    {
-                        serverGetDataMemoryFile.close();
-                        break;
-                    }
-                }
+    // ----------------------------------
 
-                // Skip the message if the timestamp is out of the requested range
-                if(sensorMessage.timestamp < serverGetDataTimeFrom || sensorMessage.timestamp > serverGetDataTimeTo)
-                {
-                    continue;
-                }
+    server.on("/get_data_multi", HTTP_GET, [] (AsyncWebServerRequest *request)
+    {
+        uint8_t sensorIndices[NUM_SUPPORTED_SENSORS];
+        uint8_t numberSensors = NUM_SUPPORTED_SENSORS;
+        time_t timeFrom = 0;
+        time_t timeTo = UINT32_MAX;
+        uint16_t maxPoints;
+        bool isBinary;
+        JsonWriterFormats jsonFormat;
+        for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+        {
+            sensorIndices[i] = i;       // all sensors if the sensors parameter isn't given
+        }
+        if(request->hasParam("sensors") && !main_parseSensorList(request->getParam("sensors")->value(), sensorIndices, numberSensors))
+        {
+            request->send(400, "text/plain", "sensors parameter must be a comma separated list of different sensor indices");
+            return;
+        }
+        if(request->hasParam("from"))
+        {
+            timeFrom = request->getParam("from")->value().toInt();
+        }
+        if(request->hasParam("to"))
+        {
+            timeTo = request->getParam("to")->value().toInt();
+        }
+        if(!main_parseGetDataFormat(request, isBinary, jsonFormat))
+        {
+            request->send(400, "text/plain", "format parameter must be json, ndjson or bin");
+            return;
+        }
+        if(!main_parseGetDataMaxPoints(request, maxPoints))
+        {
+            request->send(400, "text/plain", "maxPoints parameter must be between 2 and 65535");
+            return;
+        }
 
-                // create a JSON document with the data
-                json.clear();
-                json["time"] = sensorMessage.timestamp;
-                json["pin"]  = sensorMessage.msg.pinState;
-                json["batP"] = battery_voltageToPercent(sensorMessage.msg.batteryVoltage_mV);
+        // The histories of all requested sensors are sent in one response (merged by their timestamps). The response isn't cached, because it depends on several histories.
+        get_data_stream_t* stream = main_allocGetDataStreams(numberSensors);
+        if(stream == NULL)
+        {
+            main_sendGetDataBusy(request);
+            return;
+        }
+        request->onDisconnect([stream]()
+        {
+            main_freeGetDataStreams(stream);
+        });
+        uint8_t i = 0;
+        for(get_data_stream_t* sensorStream = stream; sensorStream != NULL; sensorStream = sensorStream->nextMergedStream)
+        {
+            main_beginGetDataStream(*sensorStream, sensorIndices[i++], timeFrom, timeTo, maxPoints, isBinary, true, jsonFormat);
+        }
 
-                size_t needed = measureJson(json);
+        const char* contentType = isBinary ? "application/octet-stream" : ((jsonFormat == JSON_WRITER_FORMAT_NDJSON) ? "application/x-ndjson" : "application/json");
+        AsyncWebServerResponse *response = request->beginChunkedResponse(contentType, [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t 
+        {
+            return main_readGetDataStream(*stream, buffer, maxLen);
+        });
+        request->send(response);
+    });
 
-                // Doesn't fit anymore -> remember for next chunk
-                if(jsonSize + needed >= maxLen)
-                {
-                    serverGetDataPendingMessage = sensorMessage;
-                    serverGetDataHasPendingMessage = true;
-                    break;
-                }
+    // ----------------------------------
 
-                // Write JSON to buffer
-                jsonSize += serializeJson(json, buffer + jsonSize, maxLen - jsonSize);
+    server.on("/get_rollup", HTTP_GET, [] (AsyncWebServerRequest *request)
+    {
+        int8_t sensorIndex = -1;
+        RollupResolutions resolution = ROLLUP_RESOLUTION_HOUR;
+        time_t timeFrom = 0;
+        time_t timeTo = UINT32_MAX;
+        JsonWriterFormats jsonFormat = JSON_WRITER_FORMAT_ARRAY;
+        if(request->hasParam("sensorIndex"))
+        {
+            sensorIndex = request->getParam("sensorIndex")->value().toInt();
+        }
+        if(request->hasParam("res"))
+        {
+            String resolutionString = request->getParam("res")->value();
+            if(resolutionString == "day")
+            {
+                resolution = ROLLUP_RESOLUTION_DAY;
+            }
+            else if(resolutionString != "hour")
+            {
+                request->send(400, "text/plain", "res parameter must be hour or day");
+                return;
+            }
+        }
+        if(request->hasParam("from"))
+        {
+            timeFrom = request->getParam("from")->value().toInt();
+        }
+        if(request->hasParam("to"))
+        {
+            timeTo = request->getParam("to")->value().toInt();
+        }
+        if(request->hasParam("format"))
+        {
+            String formatString = request->getParam("format")->value();
+            if(formatString == "ndjson")
+            {
+                jsonFormat = JSON_WRITER_FORMAT_NDJSON;
+            }
+            else if(formatString != "json")
+            {
+                request->send(400, "text/plain", "format parameter must be json or ndjson");
+                return;
             }
-            return jsonSize;
+        }
+
+        if(sensorIndex < 0 || sensorIndex >= NUM_SUPPORTED_SENSORS)
+        {
+            request->send(200, "text/plain", "sensorIndex parameter not set or out of range");
+            return;
+        }
+
+        const char* contentType = (jsonFormat == JSON_WRITER_FORMAT_NDJSON) ? "application/x-ndjson" : "application/json";
+        query_cache_key_t queryKey = { QUERY_CACHE_ENDPOINT_ROLLUP, (uint8_t)sensorIndex, (uint8_t)main_getQueryCacheFormat(false, jsonFormat), (uint32_t)resolution, timeFrom, timeTo };
+        size_t resultLength;
+        std::shared_ptr<const uint8_t> result = queryCache_find(queryKey, resultLength);
+        if(result)
+        {
+            main_sendQueryCacheResult(request, contentType, result, resultLength);
+            return;
+        }
+
+        get_rollup_stream_t* stream = main_allocGetRollupStream();
+        if(stream == NULL)
+        {
+            main_sendGetDataBusy(request);
+            return;
+        }
+        request->onDisconnect([stream]()
+        {
+            main_freeGetRollupStream(stream);
+        });
+        stream->timeTo = timeTo;
+        queryCache_beginCapture(stream->capture, queryKey);
+
+        // The rollup reader starts at the bucket that contains the from timestamp
+        memory_openRollupReader(stream->reader, sensorIndex, resolution, timeFrom);
+        jsonWriter_begin(stream->writer, jsonFormat);
+
+        AsyncWebServerResponse *response = request->beginChunkedResponse(contentType, [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t 
+        {
+            return main_readGetRollupStream(*stream, buffer, maxLen);
         });
         request->send(response);
     });
@@ -749,9 +1696,18 @@ void setup()
         main_setDefaultSystemConfig(sysConfig);
         memory_saveSystemConfig(sysConfig);
     }
-    main_makeSureEncryptionKeysAreSetInSystemConfig(sysConfig);
+
+    // Show the sensor states from the latest state snapshot, before the histories are restored
+    for(uint8_t i=0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        sensor_messages_latest[i].timestamp = -1;
+    }
+    memory_loadLatestStateSnapshot(sensor_messages_latest);
     main_updateLeds_sensorStatus();
 
+    memory_init();
+    main_makeSureEncryptionKeysAreSetInSystemConfig(sysConfig);
+
     updateLastSensorMessages();
 
     #ifdef DEBUG_OUTPUT
@@ -802,6 +1758,7 @@ void loop()
     btn_pairing.loop();
     leds.service();
     otaUpdate_loop();
+    memory_loop();
 
     if(pairing_handlePairingAPTimeout())
     {
@@ -840,7 +1797,8 @@ void loop()
               
                 main_updateLeds_sensorStatus();
 
-                if(sysConfig.sensors[i].mode == SENSOR_MODE_NORMAL)
+                // Messages that don't change anything relevant (e.g. retries or battery voltage noise) are only displayed, if the sampling policy of the sensor drops them
+                if(sysConfig.sensors[i].mode == SENSOR_MODE_NORMAL && memory_isSensorMessageSampled(i, sensor_messages_latest[i], sysConfig.samplingPolicies[i]))
                 {
                     memory_addSensorMessage(i, sensor_messages_latest[i]);
                 }
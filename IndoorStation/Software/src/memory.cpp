@@ -1,251 +1,3819 @@
 #include "memory.h"
 #include "utils.h"
+#include "historyCodec.h"
+#include "timeHandling.h"
+#include "historyLog.h"
+#include "historyRam.h"
+#include "historyBackend.h"
 #include <FS.h>
 #include <LittleFS.h>
 
 // https://github.com/esp8266/Arduino/blob/master/cores/esp8266/FS.h
 
+#define MEMORY_HISTORY_BLOCKS_PER_SEGMENT       (MEMORY_HISTORY_SEGMENT_SIZE / MEMORY_HISTORY_BLOCK_SIZE)
+#define MEMORY_HISTORY_MAX_APPEND_SIZE          (HISTORY_CODEC_MAX_RECORD_SIZE - 1 + sizeof(history_segment_header_t) + HISTORY_CODEC_MAX_RECORD_SIZE)   // Padding at the end of a block + header of a new segment + keyframe. Must be <= MEMORY_WRITE_BUFFER_SIZE.
+#define MEMORY_WRITE_BUFFER_MAX_INDEX_ENTRIES   (MEMORY_WRITE_BUFFER_SIZE / MEMORY_HISTORY_BLOCK_SIZE + 1)
+
+#define MEMORY_IMPORT_FORMAT_UNKNOWN            0       // Not enough data received to detect the format
+#define MEMORY_IMPORT_FORMAT_LEGACY             1       // Concatenated message_sensor_timestamped_t structs
+#define MEMORY_IMPORT_FORMAT_V2                 2       // Segments with header and encoded records (like the history segment files)
+
+typedef struct memory_history_import
+{
+    uint8_t sensorIndex;                        // Index of the sensor for which the import is active (NUM_SUPPORTED_SENSORS if no import is active)
+    uint8_t format;                             // Detected format of the imported file (MEMORY_IMPORT_FORMAT_...)
+    bool failed;                                // Set when a part of the file couldn't be imported
+    bool isEnded;                               // The whole file was received (memory_endSensorHistoryImport()). memory_loop() merges the rest of the existing history and replaces the history.
+    HistoryImportStates state;                  // State of the last started import (see memory_getSensorHistoryImportState())
+    unsigned long lastDataMillis;               // millis() when the import was started or data was imported the last time (see MEMORY_IMPORT_TIMEOUT_MS)
+    unsigned long lastStepMillis;               // millis() of the last step of memory_historyImportStep()
+    uint32_t blockPosition;                     // Position of the block buffer inside the imported file
+    uint8_t block[MEMORY_HISTORY_BLOCK_SIZE];   // Received data that isn't imported yet
+    uint16_t blockLength;                       // Number of bytes in the block buffer
+    message_sensor_timestamped_t message;       // Last decoded message (needed to decode the following delta record)
+    uint8_t segmentFlags;                       // Flags of the header of the current segment (HISTORY_SEGMENT_FLAG_...)
+    time_t lastImportedTimestamp;               // Timestamp of the last imported message (the imported messages must be in time order)
+    memory_history_reader_t existingReader;     // Reader of the existing history, whose messages are merged with the imported messages. After the replacement it reads the merged history to recalculate the rollups.
+    uint8_t replaySensorIndex;                  // Index of the sensor whose rollups are recalculated after its history was replaced (NUM_SUPPORTED_SENSORS if none)
+    File mergeFile;                             // Newest segment file of the merged history
+    File mergeIndexFile;                        // Sparse time index of the merged history (positions of the merged segment files). It replaces the index together with the history.
+    uint32_t mergeNumberMessages;               // Number of messages added to the merged history
+    uint16_t mergeFirstSegment;                 // Number of the oldest segment file of the merged history
+    uint16_t mergeNumberSegments;               // Number of segment files of the merged history
+    uint16_t mergeSegmentNumberBlocks;          // Number of completed blocks in the newest segment file of the merged history
+    uint8_t mergeBlock[MEMORY_HISTORY_BLOCK_SIZE];  // Block of the merged history that is filled
+    uint16_t mergeBlockLength;                  // Number of bytes in the merge block buffer
+    message_sensor_timestamped_t mergeLatestMessage;    // Last message added to the merged history (timestamp -1 if there is none)
+    uint8_t mergeLatestPinStates;               // Pin states of the merged messages with the timestamp of mergeLatestMessage (bit 0: pin state false, bit 1: pin state true). Used to drop duplicates.
+    bool mergeWriteFailed;                      // A part of the merged history couldn't be written. The existing history is kept.
+}memory_history_import_t;
+
+typedef struct memory_history_merge_commit     // Content of the merge commit file. When it exists, the merged segments replace the history of the sensor (also after a restart).
+{
+    uint16_t mergeFirstSegment;                 // Number of the oldest segment file of the merged history
+    uint16_t numberSegments;                    // Number of segment files of the merged history
+    uint16_t targetFirstSegment;                // New number of the oldest segment of the merged history. The merged segments are renamed to the following numbers.
+    uint16_t oldFirstSegment;                   // Number of the oldest segment of the replaced history
+    uint16_t oldNumberSegments;                 // Number of segments of the replaced history
+}memory_history_merge_commit_t;
+
+typedef struct memory_history_check
+{
+    uint8_t sensorIndex;                        // Index of the sensor whose history is checked
+    uint32_t blockPosition;                     // Position of the next block that is checked
+    time_t previousTimestamp;                   // Timestamp of the previous checked message (-1 if there is none)
+    bool isRepaired;                            // A block of the sensor was repaired. The sparse time index is rebuilt when all blocks of the sensor are checked.
+    unsigned long startMillis;                  // millis() when the check was started
+    unsigned long lastStepMillis;               // millis() of the last step of the check
+    memory_history_reader_t reader;             // Reader whose block buffer contains the checked block
+    uint8_t block[MEMORY_HISTORY_BLOCK_SIZE];   // Repaired block
+}memory_history_check_t;
+
+uint16_t memory_historyFirstSegment[NUM_SUPPORTED_SENSORS];     // Number of the oldest history segment of each sensor
+uint16_t memory_historyNumberSegments[NUM_SUPPORTED_SENSORS];   // Number of history segments of each sensor (0 = no history available)
+uint32_t memory_historyLastSegmentSize[NUM_SUPPORTED_SENSORS];  // Number of bytes written to the newest history segment of each sensor
+File memory_historyAppendFile[NUM_SUPPORTED_SENSORS];           // The newest history segment of each sensor is kept open between the writes
+uint32_t memory_historyFirstMessageNumber[NUM_SUPPORTED_SENSORS];   // Consecutive number of the oldest sensor message of each sensor
+uint32_t memory_historyNextMessageNumber[NUM_SUPPORTED_SENSORS];    // Consecutive number that is used for the next sensor message of each sensor
+message_sensor_timestamped_t memory_historyLatestMessage[NUM_SUPPORTED_SENSORS];    // Newest sensor message of each sensor (timestamp -1 if there is none). The next message is encoded relative to this one.
+uint32_t memory_historyLegacyFileSize[NUM_SUPPORTED_SENSORS];   // Size of the legacy history file of each sensor that isn't converted completely yet (0 = no legacy file)
+uint32_t memory_historyLegacyConvertedSize[NUM_SUPPORTED_SENSORS];  // Number of bytes at the start of the legacy history file of each sensor that are already converted to history segments
+message_sensor_timestamped_t memory_historyLegacyConvertedMessage[NUM_SUPPORTED_SENSORS];  // Last converted message of the legacy history file of each sensor (timestamp -1 if there is none). The next converted message is encoded relative to this one.
+unsigned long memory_legacyConversionLastStepMillis = 0;        // millis() of the last step of the conversion of the legacy history files
+
+uint8_t memory_writeBuffer[NUM_SUPPORTED_SENSORS][MEMORY_WRITE_BUFFER_SIZE];    // Encoded sensor messages that are not written to the history segments yet. They belong directly behind the newest segment.
+uint16_t memory_writeBufferLength[NUM_SUPPORTED_SENSORS];                       // Number of bytes in the write buffer of each sensor
+unsigned long memory_writeBufferFirstMillis[NUM_SUPPORTED_SENSORS];             // Time at which the oldest message in the write buffer of each sensor was added
+history_index_entry_t memory_writeBufferIndexEntries[NUM_SUPPORTED_SENSORS][MEMORY_WRITE_BUFFER_MAX_INDEX_ENTRIES];    // Index entries of the blocks that are started in the write buffer
+uint8_t memory_writeBufferNumberIndexEntries[NUM_SUPPORTED_SENSORS];
+uint32_t memory_writeBlockCRC[NUM_SUPPORTED_SENSORS];                           // CRC32 of the bytes of the newest (not completed) block of each sensor. It is written at the end of the block when the block is completed.
+
+memory_history_import_t memory_historyImport;
+memory_history_check_t memory_historyCheck;
+memory_history_check_report_t memory_historyCheckReport;
+
+File memory_rollupFile[NUM_SUPPORTED_SENSORS][NUM_ROLLUP_RESOLUTIONS];                         // The rollup files of each sensor are kept open between the writes
+history_rollup_entry_t memory_rollupCurrentEntry[NUM_SUPPORTED_SENSORS][NUM_ROLLUP_RESOLUTIONS];  // Bucket of each sensor that is still in progress (bucketStart -1 if there is none). It is written to the rollup file when the first message of the next bucket is added.
+const uint32_t memory_rollupBucketDuration[NUM_ROLLUP_RESOLUTIONS] = { 60 * 60UL, 24 * 60 * 60UL };
+const uint16_t memory_rollupMaxEntries[NUM_ROLLUP_RESOLUTIONS] = { MEMORY_ROLLUP_MAX_ENTRIES_HOUR, MEMORY_ROLLUP_MAX_ENTRIES_DAY };
+
+persisted_system_config_t memory_systemConfig;              // Newest system config (saved or waiting to be saved)
+uint8_t memory_systemConfigSlot = 1;                        // Slot that contains the newest saved system config. The next config is saved to the other slot.
+bool memory_systemConfigChanged = false;                    // The system config was changed and isn't saved yet
+unsigned long memory_systemConfigChangedMillis = 0;         // millis() of the last change of the system config
+const char* const memory_systemConfigSlotFileNames[2] = { FILENAME_PERSISTED_SYSTEM_CONFIG_SLOT_A, FILENAME_PERSISTED_SYSTEM_CONFIG_SLOT_B };
+
+bool memory_latestStateSnapshotChanged = false;            // The latest message of a sensor changed since the snapshot file was written
+
+memory_storage_catalog_t memory_storageCatalog;
+bool memory_storageCatalogUsageChanged = false;     // The file system usage is re-read by memory_loop() after files were written or deleted
+
+bool memory_suspended = false;                      // memory_end() was called (e.g. for an OTA update). The file system isn't accessed by memory_loop() and memory_addSensorMessage() until memory_init().
+
+unsigned long memory_retentionLastStepMillis = 0;                   // millis() of the last step of the retention engine
+uint16_t memory_retentionEndTimeSegment[NUM_SUPPORTED_SENSORS];     // Oldest segment of each sensor for which memory_retentionEndTime is valid
+time_t memory_retentionEndTime[NUM_SUPPORTED_SENSORS];              // First timestamp of the segment following the oldest segment of each sensor (-1 if unknown)
+
+#if defined(MEMORY_RAM_HISTORY_BACKEND)
+const history_backend_t* memory_historyBackend = &historyRam_backend;                   // Storage of the histories (see historyBackend.h)
+#elif defined(MEMORY_UNIFIED_HISTORY_LOG)
+const history_backend_t* memory_historyBackend = &historyLog_backend;
+#else
+const history_backend_t* memory_historyBackend = &memory_segmentsHistoryBackend;
+#endif
+history_backend_stats_t memory_segmentsStats;                       // Statistics of the history segments backend
+
+message_sensor_timestamped_t* memory_tailCache = NULL;              // RAM tail cache with the newest messages of each sensor. Message number n of a sensor is saved at index (sensorIndex * memory_tailCacheSize + n % memory_tailCacheSize).
+uint16_t memory_tailCacheSize = 0;                                  // Number of messages per sensor in the tail cache (0 = disabled)
+uint32_t memory_tailCacheFirstNumber[NUM_SUPPORTED_SENSORS];        // Number of the oldest message of each sensor in the tail cache
+uint32_t memory_tailCacheNextNumber[NUM_SUPPORTED_SENSORS];         // Number that is used for the next message of each sensor in the tail cache
+bool memory_tailCacheIsComplete[NUM_SUPPORTED_SENSORS];             // The tail cache contains the whole history of the sensor (no message was evicted)
+uint32_t memory_historyGeneration[NUM_SUPPORTED_SENSORS];           // Incremented on each change of the history or the rollups of each sensor (see memory_getHistoryGeneration())
+time_t memory_historyNewestTimestamp[NUM_SUPPORTED_SENSORS];        // Newest timestamp in the history of each sensor (-1 if it is empty). Unlike memory_historyLatestMessage, it isn't lowered by a message that is appended with an older timestamp.
+
+/**
+ * Get the number of the newest history segment of the requested sensor. Only valid if the sensor has at least one segment.
+ */
+uint16_t memory_getLastHistorySegment(uint8_t sensorIndex)
+{
+    return memory_historyFirstSegment[sensorIndex] + memory_historyNumberSegments[sensorIndex] - 1;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the position directly behind the last byte that was written to the history segments of the requested sensor.
+ * The write buffer will be written starting at this position.
+ */
+uint32_t memory_getPersistedHistoryEndPosition(uint8_t sensorIndex)
+{
+    if(memory_historyNumberSegments[sensorIndex] == 0)
+    {
+        return memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE;
+    }
+    return memory_getLastHistorySegment(sensorIndex) * MEMORY_HISTORY_SEGMENT_SIZE + memory_historyLastSegmentSize[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the position directly behind the last byte of the history of the requested sensor (including the write buffer). The next message is appended at this position.
+ */
+uint32_t memory_getHistoryEndPosition(uint8_t sensorIndex)
+{
+    return memory_getPersistedHistoryEndPosition(sensorIndex) + memory_writeBufferLength[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the number of index entries that are expected for the current history segments of the requested sensor (one entry per started block).
+ */
+uint32_t memory_getExpectedNumberIndexEntries(uint8_t sensorIndex)
+{
+    if(memory_historyNumberSegments[sensorIndex] == 0)
+    {
+        return 0;
+    }
+    return (memory_historyNumberSegments[sensorIndex] - 1) * MEMORY_HISTORY_BLOCKS_PER_SEGMENT + (memory_historyLastSegmentSize[sensorIndex] + MEMORY_HISTORY_BLOCK_SIZE - 1) / MEMORY_HISTORY_BLOCK_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check if the histories are saved in the history segments of each sensor. The history check, the import merge, the retention policies of each sensor and the conversion of legacy files need them.
+ */
+bool memory_isSegmentsHistoryBackend()
+{
+    return memory_historyBackend == &memory_segmentsHistoryBackend;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t memory_segmentsGetNumberMessages(uint8_t sensorIndex)
+{
+    return (memory_historyNextMessageNumber[sensorIndex] - memory_historyFirstMessageNumber[sensorIndex]) + (memory_historyLegacyFileSize[sensorIndex] - memory_historyLegacyConvertedSize[sensorIndex]) / sizeof(message_sensor_timestamped_t);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the number of bytes of the history of the requested sensor (segments, write buffer, sparse time index and legacy file).
+ */
+uint32_t memory_segmentsGetHistorySize(uint8_t sensorIndex)
+{
+    return (memory_getHistoryEndPosition(sensorIndex) - memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE) +
+           (memory_getExpectedNumberIndexEntries(sensorIndex) + memory_writeBufferNumberIndexEntries[sensorIndex]) * sizeof(history_index_entry_t) + memory_historyLegacyFileSize[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Update the storage catalog entry of the requested sensor from the state of the history in RAM (no file system access).
+ */
+void memory_updateStorageCatalog(uint8_t sensorIndex)
+{
+    memory_storageCatalog.numberMessages[sensorIndex] = memory_historyBackend->getNumberMessages(sensorIndex);
+    memory_storageCatalog.historySize[sensorIndex] = memory_historyBackend->getHistorySize(sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read the file system usage into the storage catalog. LittleFS.info() walks the whole file system, so this is only done when files were changed.
+ */
+void memory_updateStorageCatalogUsage()
+{
+    FSInfo info;
+    LittleFS.info(info);
+    memory_storageCatalog.usedBytes = info.usedBytes;
+    memory_storageCatalog.totalBytes = info.totalBytes;
+    memory_storageCatalogUsageChanged = false;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the latest message of each sensor to the snapshot in the RTC memory and optionally to the snapshot file.
+ * @param persist Also write the snapshot file (only done together with the history, so that it matches the history after a power loss).
+ */
+void memory_writeLatestStateSnapshot(bool persist)
+{
+    latest_state_snapshot_t snapshot;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        snapshot.latestMessages[i] = memory_historyLatestMessage[i];
+    }
+    snapshot.crc32 = utils_calculateCRC32((uint8_t*)&snapshot, sizeof(latest_state_snapshot_t) - sizeof(snapshot.crc32));
+    ESP.rtcUserMemoryWrite(MEMORY_LATEST_STATE_RTC_OFFSET, (uint32_t*)&snapshot, sizeof(latest_state_snapshot_t));
+
+    if(persist)
+    {
+        File snapshotFile = LittleFS.open(FILENAME_LATEST_STATE_SNAPSHOT, "w");
+        snapshotFile.write((uint8_t*)&snapshot, sizeof(latest_state_snapshot_t));
+        snapshotFile.close();
+        memory_latestStateSnapshotChanged = false;
+    }
+    else
+    {
+        memory_latestStateSnapshotChanged = true;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check the magic and CRC of the latest state snapshot.
+ */
+bool memory_isValidLatestStateSnapshot(latest_state_snapshot_t& snapshot)
+{
+    return (snapshot.magic == MEMORY_LATEST_STATE_SNAPSHOT_MAGIC && snapshot.crc32 == utils_calculateCRC32((uint8_t*)&snapshot, sizeof(latest_state_snapshot_t) - sizeof(snapshot.crc32)));
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Delete the oldest history segment of the requested sensor and remove its entries from the sparse time index.
+ */
+void memory_removeOldestHistorySegment(uint8_t sensorIndex)
+{
+    if(memory_historyNumberSegments[sensorIndex] == 0)
+    {
+        return;
+    }
+
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, memory_historyFirstSegment[sensorIndex]);
+    LittleFS.remove(strBuf);
+    memory_historyFirstSegment[sensorIndex]++;
+    memory_historyNumberSegments[sensorIndex]--;
+
+    // The oldest remaining message is the first one of the oldest remaining block
+    memory_historyFirstMessageNumber[sensorIndex] = (memory_writeBufferNumberIndexEntries[sensorIndex] > 0) ? memory_writeBufferIndexEntries[sensorIndex][0].messageNumber : memory_historyNextMessageNumber[sensorIndex];
+
+    // The index entries are sorted by position. So only the entries at the beginning of the index belong to the deleted segment.
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    if(!indexFile)
+    {
+        return;
+    }
+    char strBufTmp[32];
+    sprintf(strBufTmp, FILENAME_HISTORY_INDEX_SENSOR_FORMAT ".tmp", sensorIndex);
+    File indexFileTmp = LittleFS.open(strBufTmp, "w");
+    uint32_t firstPosition = memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE;
+    bool isFirstRemainingEntry = true;
+    history_index_entry_t indexEntry;
+    while(indexFile.read((uint8_t*)&indexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t))
+    {
+        if(indexEntry.position >= firstPosition)
+        {
+            if(isFirstRemainingEntry)
+            {
+                memory_historyFirstMessageNumber[sensorIndex] = indexEntry.messageNumber;
+                isFirstRemainingEntry = false;
+            }
+            indexFileTmp.write((uint8_t*)&indexEntry, sizeof(history_index_entry_t));
+        }
+    }
+    indexFile.close();
+    indexFileTmp.close();
+    LittleFS.remove(strBuf);
+    LittleFS.rename(strBufTmp, strBuf);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the newest history segment of the requested sensor opened for appending. The file stays open until memory_end() is called.
+ * If the newest segment is full, a new segment is started. If this exceeds the maximum number of segments, the oldest segment is deleted.
+ * @return The opened segment file. The file is invalid if it couldn't be opened.
+ */
+File& memory_openHistorySegmentForAppend(uint8_t sensorIndex)
+{
+    if(memory_historyNumberSegments[sensorIndex] == 0)
+    {
+        memory_historyAppendFile[sensorIndex].close();
+        memory_historyNumberSegments[sensorIndex] = 1;
+        memory_historyLastSegmentSize[sensorIndex] = 0;
+    }
+    else if(memory_historyLastSegmentSize[sensorIndex] >= MEMORY_HISTORY_SEGMENT_SIZE)
+    {
+        // Start a new segment. Rotation only costs the deletion of the oldest segment file.
+        memory_historyAppendFile[sensorIndex].close();
+        memory_historyNumberSegments[sensorIndex]++;
+        memory_historyLastSegmentSize[sensorIndex] = 0;
+        while(memory_historyNumberSegments[sensorIndex] > MEMORY_HISTORY_MAX_SEGMENTS_PER_SENSOR)
+        {
+            memory_removeOldestHistorySegment(sensorIndex);
+        }
+    }
+
+    if(!memory_historyAppendFile[sensorIndex])
+    {
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, memory_getLastHistorySegment(sensorIndex));
+        memory_historyAppendFile[sensorIndex] = LittleFS.open(strBuf, "a");
+    }
+    return memory_historyAppendFile[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the file name of the rollup file of the requested sensor and resolution.
+ */
+void memory_getRollupFileName(char* strBuf, uint8_t sensorIndex, uint8_t resolution)
+{
+    sprintf(strBuf, (resolution == ROLLUP_RESOLUTION_HOUR) ? FILENAME_ROLLUP_HOUR_SENSOR_FORMAT : FILENAME_ROLLUP_DAY_SENSOR_FORMAT, sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the start of the bucket (UTC hour or day) that contains the given timestamp.
+ */
+time_t memory_getRollupBucketStart(time_t timestamp, uint8_t resolution)
+{
+    time_t remainder = timestamp % (time_t)memory_rollupBucketDuration[resolution];
+    if(remainder < 0)
+    {
+        remainder += memory_rollupBucketDuration[resolution];
+    }
+    return timestamp - remainder;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Add the sensor message to the rollup bucket. If the bucket is empty (bucketStart -1), it is started with the given bucket start.
+ */
+void memory_addToRollupEntry(history_rollup_entry_t& entry, const message_sensor_timestamped_t& sensorMessage, time_t bucketStart)
+{
+    if(entry.bucketStart == -1)
+    {
+        entry.bucketStart = bucketStart;
+        entry.numberOpen = 0;
+        entry.numberClosed = 0;
+        entry.minBatteryVoltage_mV = sensorMessage.msg.batteryVoltage_mV;
+        entry.maxBatteryVoltage_mV = sensorMessage.msg.batteryVoltage_mV;
+        entry.maxNumberSendLoops = 0;
+    }
+
+    if(sensorMessage.msg.pinState == SENSOR_PIN_STATE_OPEN)
+    {
+        if(entry.numberOpen < UINT16_MAX) { entry.numberOpen++; }
+    }
+    else
+    {
+        if(entry.numberClosed < UINT16_MAX) { entry.numberClosed++; }
+    }
+    entry.minBatteryVoltage_mV = min(entry.minBatteryVoltage_mV, sensorMessage.msg.batteryVoltage_mV);
+    entry.maxBatteryVoltage_mV = max(entry.maxBatteryVoltage_mV, sensorMessage.msg.batteryVoltage_mV);
+    entry.lastBatteryVoltage_mV = sensorMessage.msg.batteryVoltage_mV;
+    entry.maxNumberSendLoops = max(entry.maxNumberSendLoops, sensorMessage.msg.numberSendLoops);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the finished bucket to the rollup file. If the file is full, the oldest quarter of the buckets is deleted first.
+ */
+void memory_appendRollupEntry(uint8_t sensorIndex, uint8_t resolution, const history_rollup_entry_t& entry)
+{
+    char strBuf[32];
+    memory_getRollupFileName(strBuf, sensorIndex, resolution);
+    File& rollupFile = memory_rollupFile[sensorIndex][resolution];
+    if(!rollupFile)
+    {
+        rollupFile = LittleFS.open(strBuf, "a");
+    }
+
+    uint32_t numberEntries = rollupFile.size() / sizeof(history_rollup_entry_t);
+    if(numberEntries >= memory_rollupMaxEntries[resolution])
+    {
+        rollupFile.close();
+        char strBufTmp[32];
+        sprintf(strBufTmp, FILENAME_ROLLUP_TMP_SENSOR_FORMAT, sensorIndex);
+        File rollupFileOld = LittleFS.open(strBuf, "r");
+        File rollupFileTmp = LittleFS.open(strBufTmp, "w");
+        rollupFileOld.seek((numberEntries - memory_rollupMaxEntries[resolution] * 3 / 4) * sizeof(history_rollup_entry_t), SeekSet);
+        history_rollup_entry_t oldEntry;
+        while(rollupFileOld.read((uint8_t*)&oldEntry, sizeof(history_rollup_entry_t)) == sizeof(history_rollup_entry_t))
+        {
+            rollupFileTmp.write((uint8_t*)&oldEntry, sizeof(history_rollup_entry_t));
+        }
+        rollupFileOld.close();
+        rollupFileTmp.close();
+        LittleFS.remove(strBuf);
+        LittleFS.rename(strBufTmp, strBuf);
+        rollupFile = LittleFS.open(strBuf, "a");
+    }
+
+    rollupFile.write((uint8_t*)&entry, sizeof(history_rollup_entry_t));
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Add the sensor message to the hourly and daily rollups of the requested sensor.
+ * Messages with a timestamp before the bucket in progress (e.g. after a time correction) are added to the bucket in progress to keep the buckets in time order.
+ */
+void memory_updateSensorRollups(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        history_rollup_entry_t& currentEntry = memory_rollupCurrentEntry[sensorIndex][resolution];
+        time_t bucketStart = memory_getRollupBucketStart(sensorMessage.timestamp, resolution);
+        if(currentEntry.bucketStart != -1 && bucketStart > currentEntry.bucketStart)
+        {
+            memory_appendRollupEntry(sensorIndex, resolution, currentEntry);
+            currentEntry.bucketStart = -1;
+        }
+        memory_addToRollupEntry(currentEntry, sensorMessage, bucketStart);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Commit the appended buckets of the rollup files of the requested sensor.
+ */
+void memory_flushSensorRollups(uint8_t sensorIndex)
+{
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        if(memory_rollupFile[sensorIndex][resolution])
+        {
+            memory_rollupFile[sensorIndex][resolution].flush();
+        }
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Delete the rollup files of the requested sensor and the buckets in progress.
+ */
+void memory_removeSensorRollups(uint8_t sensorIndex)
+{
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        char strBuf[32];
+        memory_getRollupFileName(strBuf, sensorIndex, resolution);
+        memory_rollupFile[sensorIndex][resolution].close();
+        LittleFS.remove(strBuf);
+        memory_rollupCurrentEntry[sensorIndex][resolution].bucketStart = -1;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the write buffer of the requested sensor to the history segments.
+ * All bytes that fit into the newest segment are written at once and committed with a single flush (group commit).
+ * @return True if the whole buffer was written; otherwise false (the bytes that couldn't be written are kept in the write buffer).
+ */
+bool memory_writeBufferedSensorMessages(uint8_t sensorIndex)
+{
+    uint16_t numberBytesWritten = 0;
+    while(numberBytesWritten < memory_writeBufferLength[sensorIndex])
+    {
+        File& segmentFile = memory_openHistorySegmentForAppend(sensorIndex);
+        if(!segmentFile)
+        {
+            break;
+        }
+
+        size_t numberBytesToWrite = min((uint32_t)(memory_writeBufferLength[sensorIndex] - numberBytesWritten), (uint32_t)(MEMORY_HISTORY_SEGMENT_SIZE - memory_historyLastSegmentSize[sensorIndex]));
+        size_t writtenSize = segmentFile.write(&memory_writeBuffer[sensorIndex][numberBytesWritten], numberBytesToWrite);
+        segmentFile.flush();
+        memory_segmentsStats.numberWrites++;
+        memory_segmentsStats.writtenBytes += writtenSize;
+        memory_historyLastSegmentSize[sensorIndex] += writtenSize;
+        numberBytesWritten += writtenSize;
+        if(writtenSize != numberBytesToWrite)
+        {
+            break;
+        }
+    }
+
+    // Keep the bytes that couldn't be written in the write buffer
+    memory_writeBufferLength[sensorIndex] -= numberBytesWritten;
+    memmove(&memory_writeBuffer[sensorIndex][0], &memory_writeBuffer[sensorIndex][numberBytesWritten], memory_writeBufferLength[sensorIndex]);
+
+    // Add the blocks that were started by the written bytes to the sparse time index
+    uint32_t persistedEndPosition = memory_getPersistedHistoryEndPosition(sensorIndex);
+    uint8_t numberNewIndexEntries = 0;
+    while(numberNewIndexEntries < memory_writeBufferNumberIndexEntries[sensorIndex] && memory_writeBufferIndexEntries[sensorIndex][numberNewIndexEntries].position < persistedEndPosition)
+    {
+        numberNewIndexEntries++;
+    }
+    if(numberNewIndexEntries > 0)
+    {
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+        File indexFile = LittleFS.open(strBuf, "a");
+        if(indexFile.size() != (memory_getExpectedNumberIndexEntries(sensorIndex) - numberNewIndexEntries) * sizeof(history_index_entry_t))
+        {
+            // The index doesn't match the history segments (e.g. after a power loss). Rebuild it completely (this also covers the new blocks).
+            indexFile.close();
+            memory_rebuildSensorHistoryIndex(sensorIndex);
+        }
+        else
+        {
+            indexFile.write((uint8_t*)&memory_writeBufferIndexEntries[sensorIndex][0], numberNewIndexEntries * sizeof(history_index_entry_t));
+            indexFile.close();
+        }
+        memory_writeBufferNumberIndexEntries[sensorIndex] -= numberNewIndexEntries;
+        memmove(&memory_writeBufferIndexEntries[sensorIndex][0], &memory_writeBufferIndexEntries[sensorIndex][numberNewIndexEntries], memory_writeBufferNumberIndexEntries[sensorIndex] * sizeof(history_index_entry_t));
+        memory_segmentsStats.writtenBytes += numberNewIndexEntries * sizeof(history_index_entry_t);
+    }
+
+    return memory_writeBufferLength[sensorIndex] == 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_segmentsWriteBuffer(int8_t sensorIndex)
+{
+    bool isWritten = true;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if((sensorIndex < 0 || sensorIndex == i) && memory_writeBufferLength[i] > 0)
+        {
+            isWritten &= memory_writeBufferedSensorMessages(i);
+            // Restart the time threshold for bytes that couldn't be written (retried with the next flush)
+            memory_writeBufferFirstMillis[i] = millis();
+        }
+    }
+    return isWritten;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint16_t memory_segmentsGetWriteBufferLength(uint8_t sensorIndex)
+{
+    return memory_writeBufferLength[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+unsigned long memory_segmentsGetWriteBufferFirstMillis(uint8_t sensorIndex)
+{
+    return memory_writeBufferFirstMillis[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the write buffer of the requested sensor (-1 = of all sensors) with the history backend. The rollups and the latest state snapshot are committed together with the history.
+ * @return True if the whole buffer was written; otherwise false (the bytes that couldn't be written are kept in the write buffer).
+ */
+bool memory_writeSensorHistory(int8_t sensorIndex)
+{
+    bool isWritten = memory_historyBackend->writeBuffer(sensorIndex);
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        memory_flushSensorRollups(i);
+        memory_updateStorageCatalog(i);     // backends with a shared storage delete the oldest data of all sensors when it is full
+    }
+    if(memory_latestStateSnapshotChanged)
+    {
+        memory_writeLatestStateSnapshot(true);
+    }
+    memory_storageCatalogUsageChanged = true;
+    return isWritten;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the message with the given number of the sensor from the tail cache. The number must be between the first and the next number of the sensor.
+ */
+message_sensor_timestamped_t& memory_getTailCacheMessage(uint8_t sensorIndex, uint32_t number)
+{
+    return memory_tailCache[sensorIndex * memory_tailCacheSize + number % memory_tailCacheSize];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the sensor message to the tail cache of the requested sensor. The oldest cached message is evicted if the cache is full.
+ */
+void memory_addToTailCache(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    if(memory_tailCacheSize == 0)
+    {
+        return;
+    }
+    if(memory_tailCacheNextNumber[sensorIndex] - memory_tailCacheFirstNumber[sensorIndex] >= memory_tailCacheSize)
+    {
+        memory_tailCacheFirstNumber[sensorIndex]++;
+        memory_tailCacheIsComplete[sensorIndex] = false;
+    }
+    memory_getTailCacheMessage(sensorIndex, memory_tailCacheNextNumber[sensorIndex]) = sensorMessage;
+    memory_tailCacheNextNumber[sensorIndex]++;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Fill the tail cache of the requested sensor with the newest messages of its history. This is needed whenever older messages of the history were changed or deleted.
+ * The message numbers are continued, so that readers of the old cache content notice that their next message was evicted.
+ */
+void memory_fillTailCache(uint8_t sensorIndex)
+{
+    if(memory_tailCacheSize == 0)
+    {
+        return;
+    }
+    uint32_t nextNumber = memory_tailCacheNextNumber[sensorIndex] + memory_tailCacheSize;
+    memory_tailCacheFirstNumber[sensorIndex] = nextNumber;
+    memory_tailCacheNextNumber[sensorIndex] = nextNumber;
+    memory_tailCacheIsComplete[sensorIndex] = true;
+    if(memory_historyLatestMessage[sensorIndex].timestamp == -1 || memory_historyLegacyFileSize[sensorIndex] > 0)
+    {
+        return;     // The messages of a legacy history file are added to the empty cache while the file is converted
+    }
+
+    // The history is read backwards, so the cache is filled from its end
+    memory_history_reader_t reader;
+    memory_openHistoryReaderReverse(reader, sensorIndex, memory_historyLatestMessage[sensorIndex].timestamp);
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readPreviousHistoryMessage(reader, sensorMessage))
+    {
+        if(memory_tailCacheNextNumber[sensorIndex] - memory_tailCacheFirstNumber[sensorIndex] >= memory_tailCacheSize)
+        {
+            memory_tailCacheIsComplete[sensorIndex] = false;
+            break;
+        }
+        memory_tailCacheFirstNumber[sensorIndex]--;
+        memory_getTailCacheMessage(sensorIndex, memory_tailCacheFirstNumber[sensorIndex]) = sensorMessage;
+    }
+    memory_closeHistoryReader(reader);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Invalidate everything derived from the history of the requested sensor after older messages were changed or deleted (e.g. by an import or the retention engine).
+ * The tail cache is refilled and the generation is incremented, so that cached query results aren't used anymore.
+ */
+void memory_invalidateSensorHistory(uint8_t sensorIndex)
+{
+    memory_historyGeneration[sensorIndex]++;
+    memory_fillTailCache(sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check if the tail cache of the requested sensor contains all messages of the history from timeFrom on.
+ */
+bool memory_isTailCacheCovering(uint8_t sensorIndex, time_t timeFrom)
+{
+    if(memory_tailCacheSize == 0 || memory_historyLegacyFileSize[sensorIndex] > 0)
+    {
+        return false;
+    }
+    if(memory_tailCacheIsComplete[sensorIndex])
+    {
+        return true;
+    }
+    // An older message in the cache proves that no message from timeFrom on was evicted
+    return memory_tailCacheNextNumber[sensorIndex] != memory_tailCacheFirstNumber[sensorIndex] && memory_getTailCacheMessage(sensorIndex, memory_tailCacheFirstNumber[sensorIndex]).timestamp < timeFrom;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the number of the first message of the sensor in the tail cache with a timestamp >= timeFrom (binary search).
+ */
+uint32_t memory_findTailCacheMessage(uint8_t sensorIndex, time_t timeFrom)
+{
+    uint32_t low = memory_tailCacheFirstNumber[sensorIndex];
+    uint32_t high = memory_tailCacheNextNumber[sensorIndex];
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if(memory_getTailCacheMessage(sensorIndex, middle).timestamp < timeFrom)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the sensor message with the history backend. The write buffer is written when it is full.
+ * @return True if the message was added; otherwise false.
+ */
+bool memory_appendSensorMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    if(!memory_historyBackend->appendMessage(sensorIndex, sensorMessage))
+    {
+        // Write the full buffer. If this fails, try again with the next message.
+        memory_writeSensorHistory(sensorIndex);
+        if(!memory_historyBackend->appendMessage(sensorIndex, sensorMessage))
+        {
+            return false;
+        }
+    }
+    memory_historyLatestMessage[sensorIndex] = sensorMessage;
+    memory_historyNewestTimestamp[sensorIndex] = max(memory_historyNewestTimestamp[sensorIndex], sensorMessage.timestamp);
+    if(memory_historyImport.replaySensorIndex != sensorIndex)
+    {
+        memory_updateSensorRollups(sensorIndex, sensorMessage);     // While the rollups are recalculated after an import, the message is added by the recalculation
+    }
+    memory_addToTailCache(sensorIndex, sensorMessage);
+    memory_historyGeneration[sensorIndex]++;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Encode the sensor message and append it to the write buffer of the requested sensor.
+ * Each block starts with a keyframe. All other messages are encoded relative to the previous message.
+ * @return True if the message was added; false if it doesn't fit into the write buffer anymore.
+ */
+bool memory_segmentsAppendMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    uint32_t position = memory_getHistoryEndPosition(sensorIndex);
+    uint32_t blockOffset = position % MEMORY_HISTORY_BLOCK_SIZE;
+    uint8_t record[HISTORY_CODEC_MAX_RECORD_SIZE];
+    size_t recordLength = 0;
+    size_t paddingLength = 0;
+    if(blockOffset != 0)
+    {
+        recordLength = historyCodec_encodeMessage(sensorMessage, (memory_historyLatestMessage[sensorIndex].timestamp != -1) ? &memory_historyLatestMessage[sensorIndex] : NULL, record);
+        if(blockOffset + recordLength >= MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE)
+        {
+            // The record doesn't fit into the block anymore. Complete the block with padding (at least one byte) and the CRC of the block and start a new block.
+            paddingLength = MEMORY_HISTORY_BLOCK_SIZE - blockOffset;
+            recordLength = 0;
+        }
+    }
+    uint32_t recordPosition = position + paddingLength;
+    bool startsSegment = (recordPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0;
+    bool startsBlock = (recordPosition % MEMORY_HISTORY_BLOCK_SIZE) == 0;
+    if(recordLength == 0)
+    {
+        recordLength = historyCodec_encodeMessage(sensorMessage, NULL, record);
+    }
+
+    size_t dataLength = paddingLength + (startsSegment ? sizeof(history_segment_header_t) : 0) + recordLength;
+    if(memory_writeBufferLength[sensorIndex] + dataLength > MEMORY_WRITE_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    if(memory_writeBufferLength[sensorIndex] == 0)
+    {
+        memory_writeBufferFirstMillis[sensorIndex] = millis();
+    }
+    uint8_t* bufferEnd = &memory_writeBuffer[sensorIndex][memory_writeBufferLength[sensorIndex]];
+    uint8_t* dataStart = bufferEnd;
+    if(paddingLength > 0)
+    {
+        memset(bufferEnd, HISTORY_CODEC_TAG_PADDING, paddingLength - HISTORY_CODEC_BLOCK_CRC_SIZE);
+        uint32_t blockCRC = utils_updateCRC32(memory_writeBlockCRC[sensorIndex], bufferEnd, paddingLength - HISTORY_CODEC_BLOCK_CRC_SIZE);
+        memcpy(bufferEnd + paddingLength - HISTORY_CODEC_BLOCK_CRC_SIZE, &blockCRC, HISTORY_CODEC_BLOCK_CRC_SIZE);
+        bufferEnd += paddingLength;
+        dataStart = bufferEnd;
+    }
+    if(startsBlock)
+    {
+        memory_writeBlockCRC[sensorIndex] = 0xFFFFFFFF;
+    }
+    if(startsSegment)
+    {
+        history_segment_header_t header;
+        header.magic = HISTORY_SEGMENT_MAGIC;
+        header.version = HISTORY_SEGMENT_FORMAT_VERSION;
+        header.flags = HISTORY_SEGMENT_FLAG_BLOCK_CRC;
+        header.blockSize = MEMORY_HISTORY_BLOCK_SIZE;
+        header.segmentSize = MEMORY_HISTORY_SEGMENT_SIZE;
+        header.baseTimestamp = sensorMessage.timestamp;
+        memcpy(bufferEnd, &header, sizeof(history_segment_header_t));
+        bufferEnd += sizeof(history_segment_header_t);
+    }
+    memcpy(bufferEnd, record, recordLength);
+    bufferEnd += recordLength;
+    memory_writeBufferLength[sensorIndex] += dataLength;
+    memory_writeBlockCRC[sensorIndex] = utils_updateCRC32(memory_writeBlockCRC[sensorIndex], dataStart, bufferEnd - dataStart);
+
+    if(startsBlock)
+    {
+        history_index_entry_t& indexEntry = memory_writeBufferIndexEntries[sensorIndex][memory_writeBufferNumberIndexEntries[sensorIndex]++];
+        indexEntry.timestamp = sensorMessage.timestamp;
+        indexEntry.position = recordPosition;
+        indexEntry.messageNumber = memory_historyNextMessageNumber[sensorIndex];
+    }
+    memory_historyNextMessageNumber[sensorIndex]++;
+    memory_segmentsStats.numberAppendedMessages++;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Append the sensor message to the legacy history file of the requested sensor, that isn't converted completely yet.
+ * The message is converted after the older messages of the file, so that the history stays in time order.
+ * @return True if the message was added; otherwise false.
+ */
+bool memory_appendLegacySensorMessage(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage)
+{
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
+    File legacyFile = LittleFS.open(strBuf, "r+");
+    legacyFile.seek(memory_historyLegacyFileSize[sensorIndex], SeekSet);     // A partially written message at the end of the file is overwritten
+    bool isWritten = legacyFile.write((uint8_t*)&sensorMessage, sizeof(message_sensor_timestamped_t)) == sizeof(message_sensor_timestamped_t);
+    legacyFile.close();
+    if(!isWritten)
+    {
+        return false;
+    }
+
+    memory_historyLegacyFileSize[sensorIndex] += sizeof(message_sensor_timestamped_t);
+    memory_historyLatestMessage[sensorIndex] = sensorMessage;
+    memory_historyNewestTimestamp[sensorIndex] = max(memory_historyNewestTimestamp[sensorIndex], sensorMessage.timestamp);
+    memory_historyGeneration[sensorIndex]++;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Convert the next messages (at most MEMORY_LEGACY_CONVERSION_STEP_MESSAGES) of the first legacy history file that isn't converted completely to history segments in the v2 format.
+ * The legacy file is deleted when all of its messages are converted. Until then, it is converted again from the start after a restart (see memory_segmentsInit()).
+ * Like all other messages, the converted messages are subject to MEMORY_HISTORY_MAX_SIZE_PER_SENSOR: if the legacy file doesn't fit, its oldest messages are dropped.
+ */
+void memory_legacyConversionStep()
+{
+    uint8_t sensorIndex = 0;
+    while(sensorIndex < NUM_SUPPORTED_SENSORS && memory_historyLegacyFileSize[sensorIndex] == 0)
+    {
+        sensorIndex++;
+    }
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        return;
+    }
+
+    // The converted messages are encoded relative to the last converted message. The latest message of the sensor is already in the legacy file.
+    message_sensor_timestamped_t latestMessage = memory_historyLatestMessage[sensorIndex];
+    bool isSnapshotChanged = memory_latestStateSnapshotChanged;
+    memory_historyLatestMessage[sensorIndex] = memory_historyLegacyConvertedMessage[sensorIndex];
+
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
+    File legacyFile = LittleFS.open(strBuf, "r");
+    legacyFile.seek(memory_historyLegacyConvertedSize[sensorIndex], SeekSet);
+    message_sensor_timestamped_t sensorMessage;
+    for(uint16_t i = 0; i < MEMORY_LEGACY_CONVERSION_STEP_MESSAGES && memory_historyLegacyConvertedSize[sensorIndex] < memory_historyLegacyFileSize[sensorIndex]; i++)
+    {
+        if(legacyFile.read((uint8_t*)&sensorMessage, sizeof(message_sensor_timestamped_t)) != sizeof(message_sensor_timestamped_t))
+        {
+            memory_historyLegacyConvertedSize[sensorIndex] = memory_historyLegacyFileSize[sensorIndex];     // The rest of the file can't be read
+            break;
+        }
+        memory_appendSensorMessage(sensorIndex, sensorMessage);
+        memory_historyLegacyConvertedSize[sensorIndex] += sizeof(message_sensor_timestamped_t);
+    }
+    legacyFile.close();
+
+    memory_historyLegacyConvertedMessage[sensorIndex] = memory_historyLatestMessage[sensorIndex];
+    memory_historyLatestMessage[sensorIndex] = latestMessage;
+    if(isSnapshotChanged && !memory_latestStateSnapshotChanged)
+    {
+        memory_writeLatestStateSnapshot(true);      // The snapshot file was written with the last converted message instead of the latest message
+    }
+    if(memory_historyLegacyConvertedSize[sensorIndex] < memory_historyLegacyFileSize[sensorIndex])
+    {
+        return;
+    }
+
+    memory_writeSensorHistory(sensorIndex);
+    LittleFS.remove(strBuf);
+    #ifdef DEBUG_OUTPUT
+        Serial.printf("Legacy history of sensor %d converted (%u messages, %u oldest messages dropped to stay below MEMORY_HISTORY_MAX_SIZE_PER_SENSOR)\n", sensorIndex,
+                      (unsigned int)(memory_historyLegacyFileSize[sensorIndex] / sizeof(message_sensor_timestamped_t)), (unsigned int)memory_historyFirstMessageNumber[sensorIndex]);
+    #endif
+    memory_historyLegacyFileSize[sensorIndex] = 0;
+    memory_historyLegacyConvertedSize[sensorIndex] = 0;
+    memory_updateStorageCatalog(sensorIndex);
+    memory_storageCatalogUsageChanged = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Open a reader for the history segments of the requested sensor without converting the legacy history file.
+ */
+void memory_segmentsOpenReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position)
+{
+    reader.sensorIndex = sensorIndex;
+    reader.position = position;
+    reader.segment = 0;
+    reader.file = File();
+    reader.blockPosition = position - (position % MEMORY_HISTORY_BLOCK_SIZE);
+    reader.blockLength = 0;
+    reader.blockOffset = 0;
+    reader.message.timestamp = -1;
+    reader.flagsSegment = UINT16_MAX;
+    reader.segmentFlags = 0;
+    reader.isMessagePending = false;
+    reader.numberRecordsLeft = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read history bytes of the reader's sensor from the given position. The requested range must be inside one segment.
+ * The bytes behind the newest segment are taken from the write buffer.
+ * @return Number of bytes read. This is less than length if the end of the history is reached or the segment file is missing or shorter than expected.
+ */
+size_t memory_readHistoryRange(memory_history_reader_t& reader, uint32_t position, uint8_t* buffer, size_t length)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    uint32_t persistedEndPosition = memory_getPersistedHistoryEndPosition(sensorIndex);
+    size_t numReadBytes = 0;
+    if(position < persistedEndPosition)
+    {
+        uint16_t segment = position / MEMORY_HISTORY_SEGMENT_SIZE;
+        uint32_t offset = position % MEMORY_HISTORY_SEGMENT_SIZE;
+        if(!reader.file || reader.segment != segment)
+        {
+            reader.file.close();
+            reader.segment = segment;
+            char strBuf[32];
+            sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, segment);
+            reader.file = LittleFS.open(strBuf, "r");
+        }
+        if(reader.file.position() != offset)
+        {
+            reader.file.seek(offset, SeekSet);
+        }
+
+        size_t numberBytesInFile = min((uint32_t)length, persistedEndPosition - position);
+        numReadBytes = reader.file.read(buffer, numberBytesInFile);
+        if(numReadBytes != numberBytesInFile)
+        {
+            return numReadBytes;
+        }
+    }
+
+    // The write buffer follows directly behind the persisted bytes
+    if(numReadBytes < length && position + numReadBytes >= persistedEndPosition)
+    {
+        uint32_t offsetInWriteBuffer = position + numReadBytes - persistedEndPosition;
+        if(offsetInWriteBuffer < memory_writeBufferLength[sensorIndex])
+        {
+            size_t numberBytesToCopy = min((uint32_t)(length - numReadBytes), (uint32_t)(memory_writeBufferLength[sensorIndex] - offsetInWriteBuffer));
+            memcpy(buffer + numReadBytes, &memory_writeBuffer[sensorIndex][offsetInWriteBuffer], numberBytesToCopy);
+            numReadBytes += numberBytesToCopy;
+        }
+    }
+    return numReadBytes;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check the CRC of the complete block in the block buffer of the reader. The header of the segment is read to check if the segment contains block CRCs.
+ * @return True if the CRC is valid or the segment has no block CRCs; otherwise false.
+ */
+bool memory_isValidHistoryBlock(memory_history_reader_t& reader)
+{
+    uint16_t segment = reader.blockPosition / MEMORY_HISTORY_SEGMENT_SIZE;
+    if(reader.flagsSegment != segment)
+    {
+        history_segment_header_t header;
+        if((reader.blockPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0)
+        {
+            memcpy(&header, reader.block, sizeof(history_segment_header_t));
+        }
+        else if(memory_readHistoryRange(reader, segment * MEMORY_HISTORY_SEGMENT_SIZE, (uint8_t*)&header, sizeof(history_segment_header_t)) != sizeof(history_segment_header_t))
+        {
+            header.magic = 0;
+        }
+        reader.segmentFlags = historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE) ? header.flags : 0;
+        reader.flagsSegment = segment;
+    }
+    return !(reader.segmentFlags & HISTORY_SEGMENT_FLAG_BLOCK_CRC) || historyCodec_isValidBlock(reader.block, MEMORY_HISTORY_BLOCK_SIZE);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Calculate the CRC of the newest (not completed) block of the requested sensor from the history segments after a restart.
+ */
+void memory_restoreWriteBlockCRC(uint8_t sensorIndex)
+{
+    memory_history_reader_t reader;
+    uint32_t endPosition = memory_getHistoryEndPosition(sensorIndex);
+    memory_segmentsOpenReader(reader, sensorIndex, endPosition);
+    memory_writeBlockCRC[sensorIndex] = 0xFFFFFFFF;
+    if(endPosition > reader.blockPosition)
+    {
+        size_t numReadBytes = memory_readHistoryRange(reader, reader.blockPosition, reader.block, endPosition - reader.blockPosition);
+        memory_writeBlockCRC[sensorIndex] = utils_updateCRC32(0xFFFFFFFF, reader.block, numReadBytes);
+    }
+    memory_closeHistoryReader(reader);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Decode the history of the requested sensor from the given position on (including the write buffer) and restore the latest message and the next message number.
+ * @param startPosition Position of a block from which on the history is decoded.
+ * @param startMessageNumber Consecutive number of the first message at startPosition.
+ * @param indexFile If not NULL, an index entry is written to this file for each block of the history segments.
+ * @return Position directly behind the last decoded message.
+ */
+uint32_t memory_scanSensorHistory(uint8_t sensorIndex, uint32_t startPosition, uint32_t startMessageNumber, File* indexFile)
+{
+    uint32_t persistedEndPosition = memory_getPersistedHistoryEndPosition(sensorIndex);
+    uint32_t messageNumber = startMessageNumber;
+    uint32_t endPosition = startPosition;
+    uint32_t lastBlockPosition = UINT32_MAX;
+    memory_historyLatestMessage[sensorIndex].timestamp = -1;
+
+    memory_history_reader_t reader;
+    memory_segmentsOpenReader(reader, sensorIndex, startPosition);
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readHistoryMessage(reader, sensorMessage))
+    {
+        if(reader.blockPosition != lastBlockPosition)
+        {
+            // First message of a block
+            lastBlockPosition = reader.blockPosition;
+            if(reader.blockPosition < persistedEndPosition)
+            {
+                if(indexFile != NULL)
+                {
+                    history_index_entry_t indexEntry;
+                    indexEntry.timestamp = sensorMessage.timestamp;
+                    indexEntry.position = reader.blockPosition;
+                    indexEntry.messageNumber = messageNumber;
+                    indexFile->write((uint8_t*)&indexEntry, sizeof(history_index_entry_t));
+                }
+            }
+            else
+            {
+                for(uint8_t i = 0; i < memory_writeBufferNumberIndexEntries[sensorIndex]; i++)
+                {
+                    if(memory_writeBufferIndexEntries[sensorIndex][i].position == reader.blockPosition)
+                    {
+                        memory_writeBufferIndexEntries[sensorIndex][i].messageNumber = messageNumber;
+                    }
+                }
+            }
+        }
+        memory_historyLatestMessage[sensorIndex] = sensorMessage;
+        messageNumber++;
+        endPosition = reader.blockPosition + reader.blockOffset;
+    }
+    memory_closeHistoryReader(reader);
+
+    memory_historyNextMessageNumber[sensorIndex] = messageNumber;
+    return endPosition;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Restore the state of the history of the requested sensor after a restart. The state is taken from the sparse time index and the last block of the history.
+ * Incompletely written data at the end of the history (e.g. after a power loss) is removed.
+ */
+void memory_restoreSensorHistory(uint8_t sensorIndex)
+{
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    uint32_t numberIndexEntries = memory_getExpectedNumberIndexEntries(sensorIndex);
+    history_index_entry_t firstIndexEntry, lastIndexEntry;
+    uint32_t endPosition;
+    if(indexFile && numberIndexEntries > 0 && indexFile.size() == numberIndexEntries * sizeof(history_index_entry_t) &&
+        indexFile.read((uint8_t*)&firstIndexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t) &&
+        indexFile.seek((numberIndexEntries - 1) * sizeof(history_index_entry_t), SeekSet) &&
+        indexFile.read((uint8_t*)&lastIndexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t))
+    {
+        // Only the last block has to be decoded
+        indexFile.close();
+        memory_historyFirstMessageNumber[sensorIndex] = firstIndexEntry.messageNumber;
+        endPosition = memory_scanSensorHistory(sensorIndex, lastIndexEntry.position, lastIndexEntry.messageNumber, NULL);
+    }
+    else
+    {
+        indexFile.close();
+        indexFile = LittleFS.open(strBuf, "w");
+        memory_historyFirstMessageNumber[sensorIndex] = 0;
+        endPosition = memory_scanSensorHistory(sensorIndex, memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE, 0, &indexFile);
+        indexFile.close();
+    }
+
+    uint32_t lastSegmentPosition = memory_getLastHistorySegment(sensorIndex) * MEMORY_HISTORY_SEGMENT_SIZE;
+    if(endPosition < memory_getPersistedHistoryEndPosition(sensorIndex))
+    {
+        memory_historyCheckReport.sensors[sensorIndex].tornBytes += memory_getPersistedHistoryEndPosition(sensorIndex) - endPosition;
+        // The end of the history wasn't written completely. Remove the incomplete data, so that new messages are appended to the last valid message.
+        sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, memory_getLastHistorySegment(sensorIndex));
+        if(endPosition > lastSegmentPosition)
+        {
+            File segmentFile = LittleFS.open(strBuf, "r+");
+            segmentFile.truncate(endPosition - lastSegmentPosition);
+            segmentFile.close();
+            memory_historyLastSegmentSize[sensorIndex] = endPosition - lastSegmentPosition;
+        }
+        else
+        {
+            LittleFS.remove(strBuf);
+            memory_historyNumberSegments[sensorIndex]--;
+            memory_historyLastSegmentSize[sensorIndex] = (memory_historyNumberSegments[sensorIndex] > 0) ? MEMORY_HISTORY_SEGMENT_SIZE : 0;
+        }
+        memory_rebuildSensorHistoryIndex(sensorIndex);
+    }
+    memory_restoreWriteBlockCRC(sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Restore the buckets in progress of the rollups of the requested sensor after a restart from the messages of the last bucket.
+ * The rollups are rebuilt completely if the rollup files are missing (e.g. for histories that were written before the rollups existed).
+ */
+void memory_restoreSensorRollups(uint8_t sensorIndex)
+{
+    char strBuf[32];
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        memory_getRollupFileName(strBuf, sensorIndex, resolution);
+        if(!LittleFS.exists(strBuf))
+        {
+            memory_rebuildSensorRollups(sensorIndex);
+            return;
+        }
+    }
+
+    message_sensor_timestamped_t latestMessage = memory_historyLatestMessage[sensorIndex];
+    if(latestMessage.timestamp == -1)
+    {
+        return;
+    }
+    time_t bucketStarts[NUM_ROLLUP_RESOLUTIONS];
+    time_t firstBucketStart = latestMessage.timestamp;
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        bucketStarts[resolution] = memory_getRollupBucketStart(latestMessage.timestamp, resolution);
+        firstBucketStart = min(firstBucketStart, bucketStarts[resolution]);
+    }
+
+    memory_history_reader_t reader;
+    memory_historyBackend->openReader(reader, sensorIndex, memory_findSensorMessagePosition(sensorIndex, firstBucketStart));
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readHistoryMessage(reader, sensorMessage))
+    {
+        for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+        {
+            if(memory_getRollupBucketStart(sensorMessage.timestamp, resolution) == bucketStarts[resolution])
+            {
+                memory_addToRollupEntry(memory_rollupCurrentEntry[sensorIndex][resolution], sensorMessage, bucketStarts[resolution]);
+            }
+        }
+    }
+    memory_closeHistoryReader(reader);
+
+    // Remove the buckets from the rollup files that are not older than the buckets in progress (e.g. written before a power loss, while their messages were still in the write buffer)
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        memory_getRollupFileName(strBuf, sensorIndex, resolution);
+        File rollupFile = LittleFS.open(strBuf, "r+");
+        uint32_t numberEntries = rollupFile.size() / sizeof(history_rollup_entry_t);
+        uint32_t numberValidEntries = numberEntries;
+        history_rollup_entry_t entry;
+        while(numberValidEntries > 0 && rollupFile.seek((numberValidEntries - 1) * sizeof(history_rollup_entry_t), SeekSet) &&
+            rollupFile.read((uint8_t*)&entry, sizeof(history_rollup_entry_t)) == sizeof(history_rollup_entry_t) && entry.bucketStart >= bucketStarts[resolution])
+        {
+            numberValidEntries--;
+        }
+        if(numberValidEntries != numberEntries || rollupFile.size() != numberEntries * sizeof(history_rollup_entry_t))
+        {
+            rollupFile.truncate(numberValidEntries * sizeof(history_rollup_entry_t));
+        }
+        rollupFile.close();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Start to recalculate the rollups of the requested sensor from the whole history. The buckets from the oldest message of the history on are removed, older buckets are kept.
+ * The reader is opened at the start of the history. All of its messages must be added with memory_updateSensorRollups() before memory_flushSensorRollups() is called.
+ */
+void memory_beginRollupReplay(memory_history_reader_t& reader, uint8_t sensorIndex)
+{
+    memory_openHistoryReader(reader, sensorIndex, 0);
+    message_sensor_timestamped_t sensorMessage;
+    bool isMessageAvailable = memory_readHistoryMessage(reader, sensorMessage);
+    if(isMessageAvailable)
+    {
+        memory_unreadHistoryMessage(reader);
+    }
+
+    char strBuf[32];
+    for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+    {
+        memory_rollupFile[sensorIndex][resolution].close();
+        memory_rollupCurrentEntry[sensorIndex][resolution].bucketStart = -1;
+        if(!isMessageAvailable)
+        {
+            continue;
+        }
+
+        // Remove the buckets that are recalculated
+        time_t firstBucketStart = memory_getRollupBucketStart(sensorMessage.timestamp, resolution);
+        memory_getRollupFileName(strBuf, sensorIndex, resolution);
+        File rollupFile = LittleFS.open(strBuf, "r+");
+        uint32_t numberEntries = rollupFile.size() / sizeof(history_rollup_entry_t);
+        uint32_t numberValidEntries = numberEntries;
+        history_rollup_entry_t entry;
+        while(numberValidEntries > 0 && rollupFile.seek((numberValidEntries - 1) * sizeof(history_rollup_entry_t), SeekSet) &&
+            rollupFile.read((uint8_t*)&entry, sizeof(history_rollup_entry_t)) == sizeof(history_rollup_entry_t) && entry.bucketStart >= firstBucketStart)
+        {
+            numberValidEntries--;
+        }
+        if(rollupFile && rollupFile.size() != numberValidEntries * sizeof(history_rollup_entry_t))
+        {
+            rollupFile.truncate(numberValidEntries * sizeof(history_rollup_entry_t));
+        }
+        rollupFile.close();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Recalculate the rollups of the requested sensor from the whole history at once (see memory_beginRollupReplay()).
+ * This is needed when older messages were added to the history (e.g. by an import).
+ */
+void memory_replaySensorRollups(uint8_t sensorIndex)
+{
+    memory_history_reader_t reader;
+    memory_beginRollupReplay(reader, sensorIndex);
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readHistoryMessage(reader, sensorMessage))
+    {
+        memory_updateSensorRollups(sensorIndex, sensorMessage);
+    }
+    memory_closeHistoryReader(reader);
+    memory_flushSensorRollups(sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Delete the given segment files of a merged history of the requested sensor (e.g. of an aborted import).
+ */
+void memory_removeMergeSegments(uint8_t sensorIndex, uint16_t firstSegment, uint16_t numberSegments)
+{
+    char strBuf[32];
+    for(uint32_t segment = firstSegment; segment < (uint32_t)firstSegment + numberSegments; segment++)
+    {
+        sprintf(strBuf, FILENAME_HISTORY_MERGE_SEGMENT_SENSOR_FORMAT, sensorIndex, (uint16_t)segment);
+        LittleFS.remove(strBuf);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Stop the active import without changing the history and delete the merged segment files, also if the whole file was already received.
+ */
+void memory_discardSensorHistoryImport()
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    if(historyImport.sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        return;
+    }
+    memory_closeHistoryReader(historyImport.existingReader);
+    historyImport.mergeFile.close();
+    historyImport.mergeIndexFile.close();
+    memory_removeMergeSegments(historyImport.sensorIndex, historyImport.mergeFirstSegment, historyImport.mergeNumberSegments);
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_MERGE_INDEX_SENSOR_FORMAT, historyImport.sensorIndex);
+    LittleFS.remove(strBuf);
+    historyImport.sensorIndex = NUM_SUPPORTED_SENSORS;
+    historyImport.isEnded = false;
+    historyImport.state = HISTORY_IMPORT_STATE_NONE;
+    memory_storageCatalogUsageChanged = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_abortSensorHistoryImport()
+{
+    if(memory_historyImport.isEnded)
+    {
+        return;         // The whole file was received, the import is finished by memory_loop()
+    }
+    memory_discardSensorHistoryImport();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Replace the history of the requested sensor by the merged history, if the merge commit file exists. Only the files are changed, not the state in RAM.
+ * Each step can be repeated, so an interrupted replacement (e.g. by a power loss) is completed by calling this again.
+ * The merge commit file is kept, it is deleted by the caller when the rollups are recalculated (see memory_removeSensorHistoryMergeCommit()).
+ * @return True if the merged history replaced the history; false if there is no (valid) merge commit file.
+ */
+bool memory_completeSensorHistoryMerge(uint8_t sensorIndex)
+{
+    char strBufCommit[32];
+    sprintf(strBufCommit, FILENAME_HISTORY_MERGE_COMMIT_SENSOR_FORMAT, sensorIndex);
+    File commitFile = LittleFS.open(strBufCommit, "r");
+    memory_history_merge_commit_t commit;
+    bool isCommitted = commitFile && commitFile.read((uint8_t*)&commit, sizeof(memory_history_merge_commit_t)) == sizeof(memory_history_merge_commit_t);
+    commitFile.close();
+    if(!isCommitted)
+    {
+        LittleFS.remove(strBufCommit);
+        return false;
+    }
+
+    // The index of the merged history gets the positions of the renamed segments. Without it, the index is rebuilt when the history is restored.
+    char strBuf[32], strBufMerge[32];
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    sprintf(strBufMerge, FILENAME_HISTORY_MERGE_INDEX_SENSOR_FORMAT, sensorIndex);
+    LittleFS.remove(strBuf);
+    File mergeIndexFile = LittleFS.open(strBufMerge, "r");
+    if(mergeIndexFile)
+    {
+        File indexFile = LittleFS.open(strBuf, "w");
+        history_index_entry_t indexEntry;
+        while(mergeIndexFile.read((uint8_t*)&indexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t))
+        {
+            // Entries of merged segments that were deleted because the merged history got too large are skipped
+            if(indexEntry.position >= commit.mergeFirstSegment * MEMORY_HISTORY_SEGMENT_SIZE)
+            {
+                indexEntry.position = indexEntry.position - commit.mergeFirstSegment * MEMORY_HISTORY_SEGMENT_SIZE + commit.targetFirstSegment * MEMORY_HISTORY_SEGMENT_SIZE;
+                indexFile.write((uint8_t*)&indexEntry, sizeof(history_index_entry_t));
+            }
+        }
+        indexFile.close();
+        mergeIndexFile.close();
+        LittleFS.remove(strBufMerge);
+    }
+    for(uint16_t i = 0; i < commit.numberSegments; i++)
+    {
+        sprintf(strBufMerge, FILENAME_HISTORY_MERGE_SEGMENT_SENSOR_FORMAT, sensorIndex, (uint16_t)(commit.mergeFirstSegment + i));
+        if(LittleFS.exists(strBufMerge))
+        {
+            sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, (uint16_t)(commit.targetFirstSegment + i));
+            LittleFS.remove(strBuf);
+            LittleFS.rename(strBufMerge, strBuf);
+        }
+    }
+    for(uint16_t i = 0; i < commit.oldNumberSegments; i++)
+    {
+        sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, (uint16_t)(commit.oldFirstSegment + i));
+        LittleFS.remove(strBuf);
+    }
+    sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
+    LittleFS.remove(strBuf);
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Delete the merge commit file of the requested sensor after its rollups were recalculated from the merged history.
+ */
+void memory_removeSensorHistoryMergeCommit(uint8_t sensorIndex)
+{
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_MERGE_COMMIT_SENSOR_FORMAT, sensorIndex);
+    LittleFS.remove(strBuf);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write the merge block buffer to the newest segment file of the merged history.
+ */
+void memory_writeMergeBlock()
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    if(historyImport.mergeFile.write(historyImport.mergeBlock, historyImport.mergeBlockLength) != historyImport.mergeBlockLength)
+    {
+        historyImport.mergeWriteFailed = true;
+    }
+    if(historyImport.mergeBlockLength == MEMORY_HISTORY_BLOCK_SIZE)
+    {
+        historyImport.mergeSegmentNumberBlocks++;
+    }
+    historyImport.mergeBlockLength = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Encode the sensor message and append it to the merged history (same format as the history segments). Full blocks are written directly to the merged segment files.
+ * A message with the same timestamp and pin state as an already added message is dropped as duplicate.
+ */
+void memory_addMergedMessage(const message_sensor_timestamped_t& sensorMessage)
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    uint8_t pinStateBit = sensorMessage.msg.pinState ? 0x02 : 0x01;
+    if(sensorMessage.timestamp == historyImport.mergeLatestMessage.timestamp)
+    {
+        if(historyImport.mergeLatestPinStates & pinStateBit)
+        {
+            return;         // duplicate
+        }
+        historyImport.mergeLatestPinStates |= pinStateBit;
+    }
+    else
+    {
+        historyImport.mergeLatestPinStates = pinStateBit;
+    }
+
+    uint8_t record[HISTORY_CODEC_MAX_RECORD_SIZE];
+    size_t recordLength = 0;
+    if(historyImport.mergeBlockLength > 0)
+    {
+        recordLength = historyCodec_encodeMessage(sensorMessage, &historyImport.mergeLatestMessage, record);
+        if(historyImport.mergeBlockLength + recordLength >= MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE)
+        {
+            // Complete the block with padding and the CRC of the block
+            memset(&historyImport.mergeBlock[historyImport.mergeBlockLength], HISTORY_CODEC_TAG_PADDING, MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE - historyImport.mergeBlockLength);
+            uint32_t blockCRC = utils_calculateCRC32(historyImport.mergeBlock, MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE);
+            memcpy(&historyImport.mergeBlock[MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE], &blockCRC, HISTORY_CODEC_BLOCK_CRC_SIZE);
+            historyImport.mergeBlockLength = MEMORY_HISTORY_BLOCK_SIZE;
+            memory_writeMergeBlock();
+            recordLength = 0;
+        }
+    }
+
+    if(historyImport.mergeBlockLength == 0)
+    {
+        if(historyImport.mergeNumberSegments == 0 || historyImport.mergeSegmentNumberBlocks >= MEMORY_HISTORY_BLOCKS_PER_SEGMENT)
+        {
+            // Start a new segment file. The merged history is limited to the same number of segments as the history.
+            historyImport.mergeFile.close();
+            historyImport.mergeNumberSegments++;
+            historyImport.mergeSegmentNumberBlocks = 0;
+            while(historyImport.mergeNumberSegments > MEMORY_HISTORY_MAX_SEGMENTS_PER_SENSOR)
+            {
+                memory_removeMergeSegments(historyImport.sensorIndex, historyImport.mergeFirstSegment, 1);
+                historyImport.mergeFirstSegment++;
+                historyImport.mergeNumberSegments--;
+            }
+            char strBuf[32];
+            sprintf(strBuf, FILENAME_HISTORY_MERGE_SEGMENT_SENSOR_FORMAT, historyImport.sensorIndex, (uint16_t)(historyImport.mergeFirstSegment + historyImport.mergeNumberSegments - 1));
+            historyImport.mergeFile = LittleFS.open(strBuf, "w");
+
+            history_segment_header_t header;
+            header.magic = HISTORY_SEGMENT_MAGIC;
+            header.version = HISTORY_SEGMENT_FORMAT_VERSION;
+            header.flags = HISTORY_SEGMENT_FLAG_BLOCK_CRC;
+            header.blockSize = MEMORY_HISTORY_BLOCK_SIZE;
+            header.segmentSize = MEMORY_HISTORY_SEGMENT_SIZE;
+            header.baseTimestamp = sensorMessage.timestamp;
+            memcpy(historyImport.mergeBlock, &header, sizeof(history_segment_header_t));
+            historyImport.mergeBlockLength = sizeof(history_segment_header_t);
+        }
+        recordLength = historyCodec_encodeMessage(sensorMessage, NULL, record);
+
+        history_index_entry_t indexEntry;
+        indexEntry.timestamp = sensorMessage.timestamp;
+        indexEntry.position = (historyImport.mergeFirstSegment + historyImport.mergeNumberSegments - 1) * MEMORY_HISTORY_SEGMENT_SIZE + historyImport.mergeSegmentNumberBlocks * MEMORY_HISTORY_BLOCK_SIZE;
+        indexEntry.messageNumber = historyImport.mergeNumberMessages;
+        historyImport.mergeIndexFile.write((uint8_t*)&indexEntry, sizeof(history_index_entry_t));
+    }
+
+    memcpy(&historyImport.mergeBlock[historyImport.mergeBlockLength], record, recordLength);
+    historyImport.mergeBlockLength += recordLength;
+    historyImport.mergeLatestMessage = sensorMessage;
+    historyImport.mergeNumberMessages++;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check the imported sensor message and merge it with the existing history. All existing messages up to the timestamp of the imported message are added to the merged history first.
+ * Messages with an implausible timestamp (before MEMORY_IMPORT_MIN_TIMESTAMP, in the future or older than the previous imported message) are dropped.
+ */
+void memory_mergeImportedMessage(const message_sensor_timestamped_t& sensorMessage)
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    if(sensorMessage.timestamp < MEMORY_IMPORT_MIN_TIMESTAMP || (isTimeValid && sensorMessage.timestamp > time(NULL) + MEMORY_IMPORT_MAX_FUTURE_S) || sensorMessage.timestamp < historyImport.lastImportedTimestamp)
+    {
+        historyImport.failed = true;
+        return;
+    }
+    historyImport.lastImportedTimestamp = sensorMessage.timestamp;
+
+    if(!memory_isSegmentsHistoryBackend())
+    {
+        // Messages can only be appended with the other backends (e.g. to the unified history log). Messages that are not newer than the latest message of the sensor are skipped.
+        if(sensorMessage.timestamp > memory_historyLatestMessage[historyImport.sensorIndex].timestamp)
+        {
+            memory_appendSensorMessage(historyImport.sensorIndex, sensorMessage);
+        }
+        return;
+    }
+
+    message_sensor_timestamped_t existingMessage;
+    while(memory_readHistoryMessage(historyImport.existingReader, existingMessage))
+    {
+        if(existingMessage.timestamp > sensorMessage.timestamp)
+        {
+            memory_unreadHistoryMessage(historyImport.existingReader);
+            break;
+        }
+        memory_addMergedMessage(existingMessage);
+    }
+    memory_addMergedMessage(sensorMessage);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Replace the history of the requested sensor by the completely written merged history of the import. Afterwards memory_historyImportStep() recalculates the rollups.
+ * The merge commit file is written first, so that an interrupted replacement (or recalculation of the rollups) is completed by memory_init().
+ * @return True if the history was replaced; otherwise false (the existing history is kept).
+ */
+bool memory_commitSensorHistoryMerge(uint8_t sensorIndex)
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    memory_history_merge_commit_t commit;
+    commit.mergeFirstSegment = historyImport.mergeFirstSegment;
+    commit.numberSegments = historyImport.mergeNumberSegments;
+    commit.oldFirstSegment = memory_historyFirstSegment[sensorIndex];
+    commit.oldNumberSegments = memory_historyNumberSegments[sensorIndex];
+    // The merged segments get numbers behind the replaced segments, so that the numbers of both don't overlap
+    commit.targetFirstSegment = (memory_historyNumberSegments[sensorIndex] > 0) ? memory_getLastHistorySegment(sensorIndex) + 1 : memory_historyFirstSegment[sensorIndex];
+    if((uint32_t)commit.targetFirstSegment + commit.numberSegments > UINT16_MAX || (commit.targetFirstSegment < commit.oldFirstSegment + commit.oldNumberSegments && commit.targetFirstSegment + commit.numberSegments > commit.oldFirstSegment))
+    {
+        commit.targetFirstSegment = 0;
+    }
+
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_MERGE_COMMIT_SENSOR_FORMAT, sensorIndex);
+    File commitFile = LittleFS.open(strBuf, "w");
+    size_t written = commitFile.write((uint8_t*)&commit, sizeof(memory_history_merge_commit_t));
+    commitFile.close();
+    if(written != sizeof(memory_history_merge_commit_t))
+    {
+        LittleFS.remove(strBuf);
+        return false;
+    }
+
+    // The buffered messages are part of the merged history
+    memory_historyAppendFile[sensorIndex].close();
+    memory_writeBufferLength[sensorIndex] = 0;
+    memory_writeBufferNumberIndexEntries[sensorIndex] = 0;
+    memory_completeSensorHistoryMerge(sensorIndex);
+
+    memory_historyFirstSegment[sensorIndex] = commit.targetFirstSegment;
+    memory_historyNumberSegments[sensorIndex] = commit.numberSegments;
+    memory_historyLegacyFileSize[sensorIndex] = 0;
+    memory_retentionEndTimeSegment[sensorIndex] = 0xFFFF;
+    sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, memory_getLastHistorySegment(sensorIndex));
+    File lastSegmentFile = LittleFS.open(strBuf, "r");
+    memory_historyLastSegmentSize[sensorIndex] = lastSegmentFile.size();
+    lastSegmentFile.close();
+
+    memory_restoreSensorHistory(sensorIndex);      // Only the last block is decoded, the sparse time index of the merged history was written during the merge
+    memory_writeLatestStateSnapshot(true);
+
+    // The merged history can contain older messages, so the rollups are recalculated by memory_loop()
+    historyImport.replaySensorIndex = sensorIndex;
+    memory_beginRollupReplay(historyImport.existingReader, sensorIndex);
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_beginSensorHistoryImport(uint8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    memory_history_import_t& historyImport = memory_historyImport;
+    if(memory_historyLegacyFileSize[sensorIndex] > 0 || historyImport.isEnded || historyImport.replaySensorIndex < NUM_SUPPORTED_SENSORS)
+    {
+        return false;       // The existing history isn't complete until the legacy file is converted. The previous import isn't finished until its history is merged and its rollups are recalculated.
+    }
+    memory_abortSensorHistoryImport();      // Only one import can be active
+
+    historyImport.sensorIndex = sensorIndex;
+    historyImport.format = MEMORY_IMPORT_FORMAT_UNKNOWN;
+    historyImport.failed = false;
+    historyImport.isEnded = false;
+    historyImport.state = HISTORY_IMPORT_STATE_RUNNING;
+    historyImport.lastDataMillis = millis();
+    historyImport.blockPosition = 0;
+    historyImport.segmentFlags = 0;
+    historyImport.blockLength = 0;
+    historyImport.lastImportedTimestamp = MEMORY_IMPORT_MIN_TIMESTAMP;
+    memory_openHistoryReader(historyImport.existingReader, sensorIndex, 0);
+    historyImport.mergeFile = File();
+    historyImport.mergeIndexFile = File();
+    if(memory_isSegmentsHistoryBackend())
+    {
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_MERGE_INDEX_SENSOR_FORMAT, sensorIndex);
+        historyImport.mergeIndexFile = LittleFS.open(strBuf, "w");
+    }
+    historyImport.mergeNumberMessages = 0;
+    historyImport.mergeFirstSegment = 0;
+    historyImport.mergeNumberSegments = 0;
+    historyImport.mergeSegmentNumberBlocks = 0;
+    historyImport.mergeBlockLength = 0;
+    historyImport.mergeLatestMessage.timestamp = -1;
+    historyImport.mergeLatestPinStates = 0;
+    historyImport.mergeWriteFailed = false;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Decode all records of the import block buffer (v2 format) and merge them with the history.
+ */
+void memory_importHistoryBlock()
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    uint16_t offset = 0;
+    if((historyImport.blockPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0)
+    {
+        // Each segment starts with a header
+        history_segment_header_t header;
+        if(historyImport.blockLength < sizeof(history_segment_header_t))
+        {
+            historyImport.failed = true;
+            return;
+        }
+        memcpy(&header, historyImport.block, sizeof(history_segment_header_t));
+        if(!historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE) || (header.flags & HISTORY_SEGMENT_FLAG_SENSOR_ID))
+        {
+            historyImport.failed = true;        // unknown format or segment of the unified history log (records of several sensors)
+            return;
+        }
+        historyImport.segmentFlags = header.flags;
+        offset = sizeof(history_segment_header_t);
+    }
+
+    if(historyImport.blockLength == MEMORY_HISTORY_BLOCK_SIZE && (historyImport.segmentFlags & HISTORY_SEGMENT_FLAG_BLOCK_CRC) && !historyCodec_isValidBlock(historyImport.block, MEMORY_HISTORY_BLOCK_SIZE))
+    {
+        historyImport.failed = true;        // corrupted block. The following blocks are still imported.
+        return;
+    }
+
+    while(offset < historyImport.blockLength && historyImport.block[offset] != HISTORY_CODEC_TAG_PADDING)
+    {
+        size_t recordLength = historyCodec_decodeMessage(&historyImport.block[offset], historyImport.blockLength - offset, historyImport.message);
+        if(recordLength == 0)
+        {
+            historyImport.failed = true;
+            break;
+        }
+        memory_mergeImportedMessage(historyImport.message);
+        offset += recordLength;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_importSensorHistory(uint8_t sensorIndex, const uint8_t* data, size_t length)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    memory_history_import_t& historyImport = memory_historyImport;
+    if(historyImport.sensorIndex != sensorIndex || historyImport.isEnded)
+    {
+        return false;       // no import started for this sensor or the file was already received completely
+    }
+
+    historyImport.lastDataMillis = millis();
+    while(length > 0)
+    {
+        size_t numberBytesToCopy = min(length, (size_t)(MEMORY_HISTORY_BLOCK_SIZE - historyImport.blockLength));
+        memcpy(&historyImport.block[historyImport.blockLength], data, numberBytesToCopy);
+        historyImport.blockLength += numberBytesToCopy;
+        data += numberBytesToCopy;
+        length -= numberBytesToCopy;
+
+        // Files in the v2 format start with the magic number of the segment header
+        if(historyImport.format == MEMORY_IMPORT_FORMAT_UNKNOWN && historyImport.blockLength >= sizeof(uint32_t))
+        {
+            uint32_t magic;
+            memcpy(&magic, historyImport.block, sizeof(uint32_t));
+            historyImport.format = (magic == HISTORY_SEGMENT_MAGIC) ? MEMORY_IMPORT_FORMAT_V2 : MEMORY_IMPORT_FORMAT_LEGACY;
+        }
+
+        if(historyImport.format == MEMORY_IMPORT_FORMAT_LEGACY)
+        {
+            // Import all complete messages and keep the rest for the next data (messages can be split between the chunks of an upload)
+            uint16_t offset = 0;
+            message_sensor_timestamped_t sensorMessage;
+            while(offset + sizeof(message_sensor_timestamped_t) <= historyImport.blockLength)
+            {
+                memcpy(&sensorMessage, &historyImport.block[offset], sizeof(message_sensor_timestamped_t));
+                memory_mergeImportedMessage(sensorMessage);
+                offset += sizeof(message_sensor_timestamped_t);
+            }
+            historyImport.blockLength -= offset;
+            memmove(historyImport.block, &historyImport.block[offset], historyImport.blockLength);
+        }
+        else if(historyImport.format == MEMORY_IMPORT_FORMAT_V2 && historyImport.blockLength == MEMORY_HISTORY_BLOCK_SIZE)
+        {
+            memory_importHistoryBlock();
+            historyImport.blockPosition += MEMORY_HISTORY_BLOCK_SIZE;
+            historyImport.blockLength = 0;
+        }
+    }
+    return !historyImport.failed && !historyImport.mergeWriteFailed;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_endSensorHistoryImport(uint8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    memory_history_import_t& historyImport = memory_historyImport;
+    if(historyImport.sensorIndex != sensorIndex || historyImport.isEnded)
+    {
+        return false;       // no import started for this sensor or it was already ended
+    }
+
+    // The last block of a file in the v2 format is usually incomplete. Remaining bytes of the legacy format belong to an incomplete message.
+    if(historyImport.format == MEMORY_IMPORT_FORMAT_V2 && historyImport.blockLength > 0)
+    {
+        memory_importHistoryBlock();
+    }
+    else if(historyImport.blockLength > 0)
+    {
+        historyImport.failed = true;
+    }
+
+    if(memory_isSegmentsHistoryBackend())
+    {
+        // The remaining existing messages (including the messages received until then) follow the imported messages. They are merged by memory_loop().
+        historyImport.isEnded = true;
+        return true;
+    }
+
+    // The imported messages were appended to the history
+    memory_writeLatestStateSnapshot(false);
+    memory_writeSensorHistory(-1);
+    memory_closeHistoryReader(historyImport.existingReader);
+    historyImport.sensorIndex = NUM_SUPPORTED_SENSORS;
+    historyImport.state = historyImport.failed ? HISTORY_IMPORT_STATE_FAILED : HISTORY_IMPORT_STATE_SUCCEEDED;
+    memory_historyNewestTimestamp[sensorIndex] = max(memory_historyNewestTimestamp[sensorIndex], memory_historyLatestMessage[sensorIndex].timestamp);
+    memory_updateStorageCatalog(sensorIndex);
+    memory_invalidateSensorHistory(sensorIndex);
+    memory_storageCatalogUsageChanged = true;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Replace the history of the sensor of the ended import by the merged history, after all existing messages were merged.
+ * If the merged history couldn't be written completely, the existing history is kept and the import is finished.
+ */
+void memory_replaceSensorHistoryByMerge()
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    uint8_t sensorIndex = historyImport.sensorIndex;
+    memory_closeHistoryReader(historyImport.existingReader);
+    if(historyImport.mergeBlockLength > 0)
+    {
+        memory_writeMergeBlock();
+    }
+    historyImport.mergeFile.close();
+    historyImport.mergeIndexFile.close();
+
+    bool isReplaced = false;
+    if(!historyImport.mergeWriteFailed && historyImport.mergeNumberSegments > 0)
+    {
+        isReplaced = memory_commitSensorHistoryMerge(sensorIndex);
+    }
+    if(!isReplaced)
+    {
+        memory_removeMergeSegments(sensorIndex, historyImport.mergeFirstSegment, historyImport.mergeNumberSegments);
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_MERGE_INDEX_SENSOR_FORMAT, sensorIndex);
+        LittleFS.remove(strBuf);
+        historyImport.state = (historyImport.mergeNumberSegments == 0 && !historyImport.failed) ? HISTORY_IMPORT_STATE_SUCCEEDED : HISTORY_IMPORT_STATE_FAILED;
+    }
+    historyImport.sensorIndex = NUM_SUPPORTED_SENSORS;
+    historyImport.isEnded = false;
+
+    // The merged history is sorted by time, so its latest message is the newest one
+    memory_historyNewestTimestamp[sensorIndex] = max(memory_historyNewestTimestamp[sensorIndex], memory_historyLatestMessage[sensorIndex].timestamp);
+    memory_updateStorageCatalog(sensorIndex);
+    memory_invalidateSensorHistory(sensorIndex);
+    memory_storageCatalogUsageChanged = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Stop the recalculation of the rollups after the history was replaced by an import and finish the import.
+ * @param isComplete True if all messages of the merged history were added to the rollups or the rollups are recalculated otherwise. If false, the merge commit file is kept, so that the next memory_init() recalculates the rollups.
+ */
+void memory_endRollupReplay(bool isComplete)
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    uint8_t sensorIndex = historyImport.replaySensorIndex;
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        return;
+    }
+    memory_closeHistoryReader(historyImport.existingReader);
+    historyImport.replaySensorIndex = NUM_SUPPORTED_SENSORS;
+    historyImport.state = historyImport.failed ? HISTORY_IMPORT_STATE_FAILED : HISTORY_IMPORT_STATE_SUCCEEDED;
+    if(isComplete)
+    {
+        memory_flushSensorRollups(sensorIndex);
+        memory_removeSensorHistoryMergeCommit(sensorIndex);
+    }
+    memory_historyGeneration[sensorIndex]++;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Execute one step of an import whose file was received completely (see memory_endSensorHistoryImport()):
+ * - The next existing messages (at most MEMORY_IMPORT_STEP_MESSAGES) are merged behind the imported messages. After the last one, the merged history replaces the history.
+ * - Afterwards the next messages of the merged history (at most MEMORY_IMPORT_STEP_MESSAGES) are added to the recalculated rollups.
+ */
+void memory_historyImportStep()
+{
+    memory_history_import_t& historyImport = memory_historyImport;
+    message_sensor_timestamped_t sensorMessage;
+    for(uint16_t i = 0; i < MEMORY_IMPORT_STEP_MESSAGES; i++)
+    {
+        if(!memory_readHistoryMessage(historyImport.existingReader, sensorMessage))
+        {
+            if(historyImport.replaySensorIndex < NUM_SUPPORTED_SENSORS)
+            {
+                memory_endRollupReplay(true);
+            }
+            else
+            {
+                memory_replaceSensorHistoryByMerge();
+            }
+            return;
+        }
+
+        if(historyImport.replaySensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            memory_updateSensorRollups(historyImport.replaySensorIndex, sensorMessage);
+        }
+        else
+        {
+            memory_addMergedMessage(sensorMessage);
+        }
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+HistoryImportStates memory_getSensorHistoryImportState()
+{
+    return memory_historyImport.state;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Get the timestamp up to which the oldest history segment of the requested sensor contains messages. This is the first timestamp of the next segment (from its header).
+ * The value is cached until the oldest segment changes.
+ * @return Timestamp or -1 if the sensor has less than two segments or the header of the next segment isn't valid.
+ */
+time_t memory_getOldestHistorySegmentEndTime(uint8_t sensorIndex)
+{
+    if(memory_historyNumberSegments[sensorIndex] < 2)
+    {
+        return -1;
+    }
+    if(memory_retentionEndTimeSegment[sensorIndex] != memory_historyFirstSegment[sensorIndex])
+    {
+        memory_retentionEndTimeSegment[sensorIndex] = memory_historyFirstSegment[sensorIndex];
+        memory_retentionEndTime[sensorIndex] = -1;
+
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, memory_historyFirstSegment[sensorIndex] + 1);
+        File segmentFile = LittleFS.open(strBuf, "r");
+        history_segment_header_t header;
+        if(segmentFile && segmentFile.read((uint8_t*)&header, sizeof(history_segment_header_t)) == sizeof(history_segment_header_t) && historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE))
+        {
+            memory_retentionEndTime[sensorIndex] = header.baseTimestamp;
+        }
+        segmentFile.close();
+    }
+    return memory_retentionEndTime[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Execute one step of the retention engine. The oldest history segment of one sensor is deleted, if
+ * - the retention policy of the sensor is violated (history larger than maxSize_kB or the whole oldest segment older than maxAge_days) or
+ * - the file system usage exceeded the high watermark and isn't below the low watermark yet (the sensor with the largest history is trimmed).
+ * Only one segment (about 1000 messages) is deleted per step, so the loop() isn't blocked for long. The newest segment of a sensor is never deleted.
+ * The rollups are not changed, so the long-term statistics stay available.
+ * @return True if a segment was deleted; otherwise false.
+ */
+bool memory_retentionStep()
+{
+    const system_config_t& sysConfig = memory_systemConfig.system_config;
+
+    if(memory_storageCatalog.totalBytes > 0)
+    {
+        uint32_t usage_percent = (uint64_t)memory_storageCatalog.usedBytes * 100 / memory_storageCatalog.totalBytes;
+        if(usage_percent >= sysConfig.retentionHighWatermark_percent)
+        {
+            memory_storageCatalog.isRetentionActive = true;
+        }
+        else if(usage_percent < sysConfig.retentionLowWatermark_percent)
+        {
+            memory_storageCatalog.isRetentionActive = false;
+        }
+    }
+
+    if(!memory_isSegmentsHistoryBackend())
+    {
+        // The other backends can only delete the oldest data of all sensors (e.g. a segment of the unified log), so only the watermarks are applied
+        if(!memory_storageCatalog.isRetentionActive || memory_historyImport.sensorIndex < NUM_SUPPORTED_SENSORS || memory_historyBackend->removeOldestData == NULL || !memory_historyBackend->removeOldestData())
+        {
+            return false;
+        }
+        #ifdef DEBUG_OUTPUT
+            Serial.printf("Retention: Deleting oldest history data (%s)\n", memory_historyBackend->name);
+        #endif
+        for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+        {
+            memory_updateStorageCatalog(i);
+            memory_invalidateSensorHistory(i);
+        }
+        memory_storageCatalogUsageChanged = true;
+        return true;
+    }
+
+    int8_t selectedSensorIndex = -1;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if(memory_historyNumberSegments[i] < 2 || memory_historyImport.sensorIndex == i || memory_historyImport.replaySensorIndex == i)
+        {
+            continue;
+        }
+
+        const retention_policy_t& policy = sysConfig.retentionPolicies[i];
+        bool isPolicyViolated = (policy.maxSize_kB > 0 && memory_storageCatalog.historySize[i] > policy.maxSize_kB * 1024UL);
+        if(!isPolicyViolated && policy.maxAge_days > 0 && isTimeValid)
+        {
+            time_t endTime = memory_getOldestHistorySegmentEndTime(i);
+            isPolicyViolated = (endTime != -1 && endTime < time(NULL) - (time_t)policy.maxAge_days * 24 * 60 * 60);
+        }
+
+        if(isPolicyViolated)
+        {
+            selectedSensorIndex = i;
+            break;
+        }
+        if(memory_storageCatalog.isRetentionActive && (selectedSensorIndex < 0 || memory_storageCatalog.historySize[i] > memory_storageCatalog.historySize[selectedSensorIndex]))
+        {
+            selectedSensorIndex = i;
+        }
+    }
+
+    if(selectedSensorIndex < 0)
+    {
+        return false;
+    }
+
+    #ifdef DEBUG_OUTPUT
+        Serial.printf("Retention: Deleting oldest history segment of sensor #%d\n", selectedSensorIndex);
+    #endif
+    memory_removeOldestHistorySegment(selectedSensorIndex);
+    memory_updateStorageCatalog(selectedSensorIndex);
+    memory_invalidateSensorHistory(selectedSensorIndex);
+    memory_storageCatalogUsageChanged = true;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Rebuild the sparse time index of the sensor of the history check, if one of its blocks was repaired.
+ * The message numbers and the timestamps of the index entries change when messages are removed.
+ */
+void memory_finishHistoryCheckSensor()
+{
+    memory_history_check_t& check = memory_historyCheck;
+    if(check.isRepaired)
+    {
+        memory_rebuildSensorHistoryIndex(check.sensorIndex);
+        memory_updateStorageCatalog(check.sensorIndex);
+        memory_invalidateSensorHistory(check.sensorIndex);
+        memory_storageCatalogUsageChanged = true;
+        check.isRepaired = false;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Execute one step of the history check. One completed block of the history of the current sensor is checked and rewritten if it must be repaired.
+ * The messages of the block are decoded and encoded again, so that removed messages don't break the delta encoding of the following messages.
+ */
+void memory_historyCheckStep()
+{
+    memory_history_check_t& check = memory_historyCheck;
+    memory_history_reader_t& reader = check.reader;
+    if(memory_historyImport.sensorIndex != NUM_SUPPORTED_SENSORS || memory_historyImport.replaySensorIndex != NUM_SUPPORTED_SENSORS)
+    {
+        // The merged history replaces the segments at the end of the import. The cached segment flags may be outdated then.
+        reader.flagsSegment = UINT16_MAX;
+        return;
+    }
+
+    uint8_t sensorIndex = check.sensorIndex;
+    memory_history_check_sensor_report_t& report = memory_historyCheckReport.sensors[sensorIndex];
+    // Blocks in segments that were deleted in the meantime are skipped
+    if(check.blockPosition < memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE)
+    {
+        check.blockPosition = memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE;
+    }
+
+    // Only completed blocks are checked. The newest block was already decoded by memory_init().
+    if(memory_historyNumberSegments[sensorIndex] == 0 || check.blockPosition + MEMORY_HISTORY_BLOCK_SIZE > memory_getPersistedHistoryEndPosition(sensorIndex))
+    {
+        memory_finishHistoryCheckSensor();
+        check.sensorIndex++;
+        check.blockPosition = 0;
+        check.previousTimestamp = -1;
+        if(check.sensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            memory_segmentsOpenReader(reader, check.sensorIndex, 0);
+        }
+        else
+        {
+            memory_historyCheckReport.isRunning = false;
+            memory_historyCheckReport.duration_ms = millis() - check.startMillis;
+            #ifdef DEBUG_OUTPUT
+                Serial.printf("History check finished after %u ms\n", memory_historyCheckReport.duration_ms);
+            #endif
+        }
+        return;
+    }
+
+    uint16_t segment = check.blockPosition / MEMORY_HISTORY_SEGMENT_SIZE;
+    uint32_t offsetInSegment = check.blockPosition % MEMORY_HISTORY_SEGMENT_SIZE;
+    reader.blockPosition = check.blockPosition;
+    size_t numReadBytes = memory_readHistoryRange(reader, check.blockPosition, reader.block, MEMORY_HISTORY_BLOCK_SIZE);
+    reader.file.close();        // The segment could be deleted by the retention engine until the next step
+    history_segment_header_t header;
+    memcpy(&header, reader.block, sizeof(history_segment_header_t));
+    if(numReadBytes != MEMORY_HISTORY_BLOCK_SIZE || (offsetInSegment == 0 && !historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE)))
+    {
+        // The segment can't be read. Continue with the next segment.
+        report.invalidSegments++;
+        check.blockPosition = (segment + 1) * MEMORY_HISTORY_SEGMENT_SIZE;
+        return;
+    }
+    report.checkedBlocks++;
+
+    uint16_t offset = (offsetInSegment == 0) ? sizeof(history_segment_header_t) : 0;
+    uint16_t repairedLength = offset;
+    uint16_t numberLostMessages = 0;
+    bool isRepairNeeded = false;
+    time_t firstTimestamp = -1;
+    memcpy(check.block, reader.block, offset);
+    if(!memory_isValidHistoryBlock(reader))
+    {
+        // The block is cleared. The readers skip blocks with a wrong CRC anyway.
+        report.crcErrorBlocks++;
+        isRepairNeeded = true;
+    }
+    else
+    {
+        message_sensor_timestamped_t sensorMessage;
+        message_sensor_timestamped_t previousKeptMessage;
+        previousKeptMessage.timestamp = -1;
+        bool isFirstRecord = true;
+        while(offset < MEMORY_HISTORY_BLOCK_SIZE && reader.block[offset] != HISTORY_CODEC_TAG_PADDING)
+        {
+            // Each block must start with a keyframe
+            size_t recordLength = 0;
+            if(!isFirstRecord || (reader.block[offset] & HISTORY_CODEC_TAG_KEYFRAME))
+            {
+                recordLength = historyCodec_decodeMessage(&reader.block[offset], MEMORY_HISTORY_BLOCK_SIZE - offset, sensorMessage);
+            }
+            if(recordLength == 0)
+            {
+                report.invalidRecordBlocks++;
+                isRepairNeeded = true;
+                break;
+            }
+            offset += recordLength;
+            isFirstRecord = false;
+
+            if(sensorMessage.timestamp < MEMORY_IMPORT_MIN_TIMESTAMP || (isTimeValid && sensorMessage.timestamp > time(NULL) + MEMORY_IMPORT_MAX_FUTURE_S))
+            {
+                report.absurdTimestamps++;
+                isRepairNeeded = true;
+                continue;
+            }
+            if(check.previousTimestamp != -1 && sensorMessage.timestamp < check.previousTimestamp)
+            {
+                report.outOfOrderTimestamps++;
+            }
+            check.previousTimestamp = sensorMessage.timestamp;
+
+            // Encode the kept message for the repaired block (the first kept message becomes the keyframe)
+            uint8_t record[HISTORY_CODEC_MAX_RECORD_SIZE];
+            size_t newRecordLength = historyCodec_encodeMessage(sensorMessage, (previousKeptMessage.timestamp != -1) ? &previousKeptMessage : NULL, record);
+            if(repairedLength + newRecordLength >= MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE)
+            {
+                numberLostMessages++;
+                continue;
+            }
+            memcpy(&check.block[repairedLength], record, newRecordLength);
+            repairedLength += newRecordLength;
+            if(firstTimestamp == -1)
+            {
+                firstTimestamp = sensorMessage.timestamp;
+            }
+            previousKeptMessage = sensorMessage;
+        }
+    }
+
+    if(isRepairNeeded)
+    {
+        if(offsetInSegment == 0 && firstTimestamp != -1)
+        {
+            header.baseTimestamp = firstTimestamp;
+            memcpy(check.block, &header, sizeof(history_segment_header_t));
+        }
+        memset(&check.block[repairedLength], HISTORY_CODEC_TAG_PADDING, MEMORY_HISTORY_BLOCK_SIZE - repairedLength);
+        if(reader.segmentFlags & HISTORY_SEGMENT_FLAG_BLOCK_CRC)
+        {
+            uint32_t blockCRC = utils_calculateCRC32(check.block, MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE);
+            memcpy(&check.block[MEMORY_HISTORY_BLOCK_SIZE - HISTORY_CODEC_BLOCK_CRC_SIZE], &blockCRC, HISTORY_CODEC_BLOCK_CRC_SIZE);
+        }
+
+        if(segment == memory_getLastHistorySegment(sensorIndex))
+        {
+            memory_historyAppendFile[sensorIndex].close();     // reopened by the next append
+        }
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, segment);
+        File segmentFile = LittleFS.open(strBuf, "r+");
+        if(segmentFile && segmentFile.seek(offsetInSegment, SeekSet) && segmentFile.write(check.block, MEMORY_HISTORY_BLOCK_SIZE) == MEMORY_HISTORY_BLOCK_SIZE)
+        {
+            report.repairedBlocks++;
+            report.lostMessages += numberLostMessages;
+            check.isRepaired = true;
+        }
+        segmentFile.close();
+        memory_retentionEndTimeSegment[sensorIndex] = 0xFFFF;     // The base timestamp of the segment may have changed
+        #ifdef DEBUG_OUTPUT
+            Serial.printf("History check: Repaired block (sensor %d, position %u)\n", sensorIndex, check.blockPosition);
+        #endif
+    }
+    check.blockPosition += MEMORY_HISTORY_BLOCK_SIZE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Find the history segment files of all sensors and restore the state of the histories. The rollups of the sensors with history segments are restored.
+ * Afterwards the history check is started.
+ */
+void memory_segmentsInit()
+{
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        memory_historyFirstSegment[i] = 0;
+        memory_historyNumberSegments[i] = 0;
+        memory_historyLastSegmentSize[i] = 0;
+        memory_historyFirstMessageNumber[i] = 0;
+        memory_historyNextMessageNumber[i] = 0;
+        memory_historyLatestMessage[i].timestamp = -1;
+        memory_historyLegacyFileSize[i] = 0;
+        memory_historyLegacyConvertedSize[i] = 0;
+        memory_historyLegacyConvertedMessage[i].timestamp = -1;
+        memory_writeBufferLength[i] = 0;
+        memory_writeBufferNumberIndexEntries[i] = 0;
+        memory_writeBlockCRC[i] = 0xFFFFFFFF;
+        memory_retentionEndTimeSegment[i] = 0xFFFF;
+    }
+    memset(&memory_segmentsStats, 0, sizeof(memory_segmentsStats));
+
+    // Complete the replacement of histories by merged histories that was interrupted by a restart
+    bool isMergeCompleted[NUM_SUPPORTED_SENSORS];
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        isMergeCompleted[i] = memory_completeSensorHistoryMerge(i);
+    }
+
+    // Find the oldest and newest segment and the legacy history file of each sensor
+    uint16_t lastSegment[NUM_SUPPORTED_SENSORS];
+    uint16_t firstMergeSegment[NUM_SUPPORTED_SENSORS];
+    uint16_t lastMergeSegment[NUM_SUPPORTED_SENSORS];
+    bool isMergeSegmentFound[NUM_SUPPORTED_SENSORS] = { false };
+    Dir dir = LittleFS.openDir("/");
+    while(dir.next())
+    {
+        unsigned int sensorIndex, segment;
+        int numberCharsParsed = 0;
+        String fileName = dir.fileName();
+        if(sscanf(fileName.c_str(), "dataSensor%u.m%u%n", &sensorIndex, &segment, &numberCharsParsed) == 2 && numberCharsParsed == (int)fileName.length() && sensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            // Segment of an import that wasn't finished. It is deleted below.
+            if(!isMergeSegmentFound[sensorIndex] || segment < firstMergeSegment[sensorIndex])
+            {
+                firstMergeSegment[sensorIndex] = segment;
+            }
+            if(!isMergeSegmentFound[sensorIndex] || segment > lastMergeSegment[sensorIndex])
+            {
+                lastMergeSegment[sensorIndex] = segment;
+            }
+            isMergeSegmentFound[sensorIndex] = true;
+        }
+        else if(sscanf(fileName.c_str(), "dataSensor%u.%u%n", &sensorIndex, &segment, &numberCharsParsed) == 2 && numberCharsParsed == (int)fileName.length() && sensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            if(memory_historyNumberSegments[sensorIndex] == 0 || segment < memory_historyFirstSegment[sensorIndex])
+            {
+                memory_historyFirstSegment[sensorIndex] = segment;
+            }
+            if(memory_historyNumberSegments[sensorIndex] == 0 || segment > lastSegment[sensorIndex])
+            {
+                lastSegment[sensorIndex] = segment;
+                memory_historyLastSegmentSize[sensorIndex] = dir.fileSize();
+            }
+            memory_historyNumberSegments[sensorIndex] = lastSegment[sensorIndex] - memory_historyFirstSegment[sensorIndex] + 1;
+        }
+        else if(sscanf(fileName.c_str(), "dataSensor%u.bin%n", &sensorIndex, &numberCharsParsed) == 1 && numberCharsParsed == (int)fileName.length() && sensorIndex < NUM_SUPPORTED_SENSORS)
+        {
+            // A partially written message at the end of the legacy file is ignored (it isn't converted)
+            memory_historyLegacyFileSize[sensorIndex] = dir.fileSize() - (dir.fileSize() % sizeof(message_sensor_timestamped_t));
+            memory_historyCheckReport.sensors[sensorIndex].tornBytes = dir.fileSize() % sizeof(message_sensor_timestamped_t);
+        }
+    }
+
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if(isMergeSegmentFound[i])
+        {
+            memory_removeMergeSegments(i, firstMergeSegment[i], lastMergeSegment[i] - firstMergeSegment[i] + 1);
+        }
+        char strBuf[32];
+        sprintf(strBuf, FILENAME_HISTORY_MERGE_INDEX_SENSOR_FORMAT, i);
+        LittleFS.remove(strBuf);        // Index of an import that wasn't finished
+
+        if(memory_historyLegacyFileSize[i] > 0)
+        {
+            // The legacy file is converted in the background by memory_loop() and only deleted when the conversion is complete.
+            // Segments next to it are left from a conversion that was interrupted by a restart, so the conversion is started again.
+            for(uint16_t segment = memory_historyFirstSegment[i]; segment < memory_historyFirstSegment[i] + memory_historyNumberSegments[i]; segment++)
+            {
+                sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, i, segment);
+                LittleFS.remove(strBuf);
+            }
+            memory_historyFirstSegment[i] = 0;
+            memory_historyNumberSegments[i] = 0;
+            memory_historyLastSegmentSize[i] = 0;
+            sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, i);
+            LittleFS.remove(strBuf);
+            memory_removeSensorRollups(i);
+
+            // Until then only the latest message is needed
+            sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, i);
+            File legacyFile = LittleFS.open(strBuf, "r");
+            legacyFile.seek(memory_historyLegacyFileSize[i] - sizeof(message_sensor_timestamped_t), SeekSet);
+            legacyFile.read((uint8_t*)&memory_historyLatestMessage[i], sizeof(message_sensor_timestamped_t));
+            legacyFile.close();
+            #ifdef DEBUG_OUTPUT
+                Serial.printf("Legacy history of sensor %d (%u messages) is converted in the background\n", i, (unsigned int)(memory_historyLegacyFileSize[i] / sizeof(message_sensor_timestamped_t)));
+            #endif
+        }
+        else if(memory_historyNumberSegments[i] > 0)
+        {
+            memory_restoreSensorHistory(i);
+            if(isMergeCompleted[i])
+            {
+                memory_replaySensorRollups(i);      // The merged history can contain older messages
+            }
+            else
+            {
+                memory_restoreSensorRollups(i);
+            }
+        }
+        if(isMergeCompleted[i])
+        {
+            memory_removeSensorHistoryMergeCommit(i);
+        }
+    }
+
+    // The rest of the histories is checked in the background, so that the start isn't delayed
+    memory_startHistoryCheck();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_segmentsEnd()
+{
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        memory_historyAppendFile[i].close();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Delete the history segments, the sparse time index and the legacy history file of the requested sensor.
+ */
+void memory_segmentsRemoveSensor(uint8_t sensorIndex)
+{
+    memory_writeBufferLength[sensorIndex] = 0;
+    memory_writeBufferNumberIndexEntries[sensorIndex] = 0;
+    memory_writeBlockCRC[sensorIndex] = 0xFFFFFFFF;
+    memory_retentionEndTimeSegment[sensorIndex] = 0xFFFF;
+    memory_historyAppendFile[sensorIndex].close();
+
+    char strBuf[32];
+    for(uint16_t segment = memory_historyFirstSegment[sensorIndex]; segment < memory_historyFirstSegment[sensorIndex] + memory_historyNumberSegments[sensorIndex]; segment++)
+    {
+        sprintf(strBuf, FILENAME_HISTORY_SEGMENT_SENSOR_FORMAT, sensorIndex, segment);
+        LittleFS.remove(strBuf);
+    }
+    memory_historyFirstSegment[sensorIndex] = 0;
+    memory_historyNumberSegments[sensorIndex] = 0;
+    memory_historyLastSegmentSize[sensorIndex] = 0;
+    memory_historyFirstMessageNumber[sensorIndex] = 0;
+    memory_historyNextMessageNumber[sensorIndex] = 0;
+    memory_historyLatestMessage[sensorIndex].timestamp = -1;
+    memory_historyLegacyFileSize[sensorIndex] = 0;
+    memory_historyLegacyConvertedSize[sensorIndex] = 0;
+    memory_historyLegacyConvertedMessage[sensorIndex].timestamp = -1;
+
+    sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
+    LittleFS.remove(strBuf);
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    LittleFS.remove(strBuf);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_init()
+{
+    memory_suspended = false;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+        {
+            memory_rollupCurrentEntry[i][resolution].bucketStart = -1;
+        }
+        memset(&memory_historyCheckReport.sensors[i], 0, sizeof(memory_history_check_sensor_report_t));
+    }
+    memory_historyImport.sensorIndex = NUM_SUPPORTED_SENSORS;
+    memory_historyImport.replaySensorIndex = NUM_SUPPORTED_SENSORS;
+    memory_historyImport.isEnded = false;
+    memory_historyImport.state = HISTORY_IMPORT_STATE_NONE;
+    memory_historyCheckReport.isRunning = false;
+
+    if(memory_tailCache == NULL)
+    {
+        // The tail cache is allocated only once and never resized, so that the heap doesn't get fragmented
+        uint32_t cacheBytes = min((uint32_t)ESP.getFreeHeap() * MEMORY_TAIL_CACHE_HEAP_SHARE_PERCENT / 100, (uint32_t)ESP.getMaxFreeBlockSize() / 2);
+        uint32_t cacheSize = min((uint32_t)(cacheBytes / (NUM_SUPPORTED_SENSORS * sizeof(message_sensor_timestamped_t))), (uint32_t)MEMORY_TAIL_CACHE_MAX_MESSAGES);
+        if(cacheSize >= MEMORY_TAIL_CACHE_MIN_MESSAGES)
+        {
+            memory_tailCache = (message_sensor_timestamped_t*)malloc(cacheSize * NUM_SUPPORTED_SENSORS * sizeof(message_sensor_timestamped_t));
+        }
+        memory_tailCacheSize = (memory_tailCache != NULL) ? cacheSize : 0;
+        memory_storageCatalog.tailCacheMessages = memory_tailCacheSize;
+        #ifdef DEBUG_OUTPUT
+            Serial.printf("Tail cache: %d messages per sensor\n", memory_tailCacheSize);
+        #endif
+    }
+
+    memory_historyBackend->init();
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        memory_historyLatestMessage[i] = memory_historyBackend->getLatestMessage(i);
+        memory_historyNewestTimestamp[i] = memory_historyLatestMessage[i].timestamp;
+        // The segments backend restores the rollups itself, because merged histories must be replayed and the rollups of legacy files are built by their conversion
+        if(!memory_isSegmentsHistoryBackend() && memory_historyLatestMessage[i].timestamp != -1)
+        {
+            memory_restoreSensorRollups(i);
+        }
+        memory_updateStorageCatalog(i);
+        memory_invalidateSensorHistory(i);
+    }
+    memory_updateStorageCatalogUsage();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_loadLatestStateSnapshot(message_sensor_timestamped_t* latestMessages)
+{
+    latest_state_snapshot_t snapshot;
+    bool isValid = ESP.rtcUserMemoryRead(MEMORY_LATEST_STATE_RTC_OFFSET, (uint32_t*)&snapshot, sizeof(latest_state_snapshot_t)) && memory_isValidLatestStateSnapshot(snapshot);
+    if(!isValid)
+    {
+        // The RTC memory is lost on a power loss
+        File snapshotFile = LittleFS.open(FILENAME_LATEST_STATE_SNAPSHOT, "r");
+        isValid = snapshotFile && snapshotFile.read((uint8_t*)&snapshot, sizeof(latest_state_snapshot_t)) == sizeof(latest_state_snapshot_t) && memory_isValidLatestStateSnapshot(snapshot);
+        snapshotFile.close();
+    }
+    if(!isValid)
+    {
+        return false;
+    }
+
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        latestMessages[i] = snapshot.latestMessages[i];
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_loop()
+{
+    if(memory_suspended)
+    {
+        return;
+    }
+
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if(memory_historyBackend->getWriteBufferLength(i) > 0 && (millis() - memory_historyBackend->getWriteBufferFirstMillis(i)) >= MEMORY_WRITE_BUFFER_MAX_AGE_MS)
+        {
+            memory_flushSensorHistory(i);
+        }
+    }
+
+    if(memory_systemConfigChanged && (millis() - memory_systemConfigChangedMillis) >= MEMORY_SYSTEM_CONFIG_SAVE_DELAY_MS)
+    {
+        memory_flushSystemConfig();
+    }
+
+    if((millis() - memory_retentionLastStepMillis) >= MEMORY_RETENTION_STEP_INTERVAL_MS)
+    {
+        memory_retentionLastStepMillis = millis();
+        memory_retentionStep();
+    }
+
+    if(memory_historyCheckReport.isRunning && (millis() - memory_historyCheck.lastStepMillis) >= MEMORY_HISTORY_CHECK_STEP_INTERVAL_MS)
+    {
+        memory_historyCheck.lastStepMillis = millis();
+        memory_historyCheckStep();
+    }
+
+    if((memory_historyImport.isEnded || memory_historyImport.replaySensorIndex < NUM_SUPPORTED_SENSORS) && (millis() - memory_historyImport.lastStepMillis) >= MEMORY_IMPORT_STEP_INTERVAL_MS)
+    {
+        memory_historyImport.lastStepMillis = millis();
+        memory_historyImportStep();
+    }
+
+    // An upload that stopped without a disconnect of the client mustn't keep the import active
+    if(memory_historyImport.sensorIndex < NUM_SUPPORTED_SENSORS && !memory_historyImport.isEnded && (millis() - memory_historyImport.lastDataMillis) >= MEMORY_IMPORT_TIMEOUT_MS)
+    {
+        #ifdef DEBUG_OUTPUT
+            Serial.printf("Import of sensor %d aborted, no data received for %lu ms\n", memory_historyImport.sensorIndex, MEMORY_IMPORT_TIMEOUT_MS);
+        #endif
+        memory_abortSensorHistoryImport();
+    }
+
+    if((millis() - memory_legacyConversionLastStepMillis) >= MEMORY_LEGACY_CONVERSION_STEP_INTERVAL_MS)
+    {
+        memory_legacyConversionLastStepMillis = millis();
+        memory_legacyConversionStep();
+    }
+
+    if(memory_storageCatalogUsageChanged)
+    {
+        memory_updateStorageCatalogUsage();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_flushSensorHistory(int8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        return;
+    }
+
+    bool isBufferEmpty = true;
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        if((sensorIndex < 0 || sensorIndex == i) && memory_historyBackend->getWriteBufferLength(i) > 0)
+        {
+            isBufferEmpty = false;
+        }
+    }
+    if(!isBufferEmpty)
+    {
+        memory_writeSensorHistory(sensorIndex);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_end()
+{
+    // An interrupted recalculation of the rollups is repeated by the next memory_init() (the merge commit file is kept)
+    memory_discardSensorHistoryImport();
+    memory_endRollupReplay(false);
+    memory_flushSensorHistory(-1);
+    memory_historyBackend->end();
+    memory_flushSystemConfig();
+    if(memory_latestStateSnapshotChanged)
+    {
+        memory_writeLatestStateSnapshot(true);
+    }
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        for(uint8_t resolution = 0; resolution < NUM_ROLLUP_RESOLUTIONS; resolution++)
+        {
+            memory_rollupFile[i][resolution].close();
+        }
+    }
+    memory_suspended = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_isSuspended()
+{
+    return memory_suspended;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
 void memory_removeAllData()
 {
-    memory_removeSensorHistory(-1);
+    memory_removeSensorHistory(-1);
+
+    LittleFS.remove(FILENAME_PERSISTED_SYSTEM_CONFIG);
+    LittleFS.remove(FILENAME_PERSISTED_SYSTEM_CONFIG_SLOT_A);
+    LittleFS.remove(FILENAME_PERSISTED_SYSTEM_CONFIG_SLOT_B);
+    LittleFS.remove(FILENAME_LATEST_STATE_SNAPSHOT);
+    memory_systemConfigChanged = false;
+    memory_storageCatalogUsageChanged = true;
+    // The system config file will be automatically recreated with default values when the device is restarted.
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_removeSensorHistory(int8_t sensorIndex)
+{
+    if(sensorIndex < 0)
+    {
+        for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+        {
+            memory_removeSensorHistory(i);
+        }
+    }
+    else if(sensorIndex < NUM_SUPPORTED_SENSORS)
+    {
+        if(memory_historyImport.sensorIndex == sensorIndex)
+        {
+            memory_discardSensorHistoryImport();
+        }
+        if(memory_historyImport.replaySensorIndex == sensorIndex)
+        {
+            memory_endRollupReplay(true);       // The merge commit file mustn't be completed again after the history is removed
+        }
+        memory_historyBackend->removeSensor(sensorIndex);
+        memory_historyLatestMessage[sensorIndex].timestamp = -1;
+        memory_historyNewestTimestamp[sensorIndex] = -1;
+        memory_invalidateSensorHistory(sensorIndex);
+        memory_removeSensorRollups(sensorIndex);
+        memory_updateStorageCatalog(sensorIndex);
+        memory_writeLatestStateSnapshot(true);
+        memory_storageCatalogUsageChanged = true;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const memory_storage_catalog_t& memory_getStorageCatalog()
+{
+    return memory_storageCatalog;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_startHistoryCheck()
+{
+    if(!memory_isSegmentsHistoryBackend())
+    {
+        return;     // Only the history segments are checked (e.g. the unified history log is checked by historyLog_init() and CRC errors are skipped while reading)
+    }
+    memory_history_check_t& check = memory_historyCheck;
+    if(memory_historyCheckReport.isRunning)
+    {
+        memory_finishHistoryCheckSensor();
+    }
+
+    // The torn bytes are found by memory_init() and are kept until the next start
+    for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        uint32_t tornBytes = memory_historyCheckReport.sensors[i].tornBytes;
+        memset(&memory_historyCheckReport.sensors[i], 0, sizeof(memory_history_check_sensor_report_t));
+        memory_historyCheckReport.sensors[i].tornBytes = tornBytes;
+    }
+    memory_historyCheckReport.isRunning = true;
+    memory_historyCheckReport.duration_ms = 0;
+
+    check.sensorIndex = 0;
+    check.blockPosition = 0;
+    check.previousTimestamp = -1;
+    check.isRepaired = false;
+    check.startMillis = millis();
+    check.lastStepMillis = millis();
+    memory_segmentsOpenReader(check.reader, 0, 0);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const memory_history_check_report_t& memory_getHistoryCheckReport()
+{
+    return memory_historyCheckReport;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const char* memory_getMemoryUsageString(bool shortFormat)
+{
+    const memory_storage_catalog_t& info = memory_storageCatalog;
+
+    float percentage = (info.usedBytes * 100.0f) / info.totalBytes;
+    static char buffer[100];
+    if(shortFormat)
+    {
+        snprintf(buffer, sizeof(buffer), "%.2f %%", percentage);
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), "%u von %u Bytes belegt (%.2f %%)", (unsigned int)info.usedBytes, (unsigned int)info.totalBytes, percentage); 
+    }
+    return buffer;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_showMemoryContent()
+{
+    #ifdef DEBUG_OUTPUT
+        Serial.println("--- File System usage");
+        Serial.println(memory_getMemoryUsageString());
+        
+        Serial.println("--- MACs");
+        MacArrayStruct_t macStruct = memory_getSensorMacs();
+        for(int sensorIdx = 0; sensorIdx < NUM_SUPPORTED_SENSORS; sensorIdx++)
+        {
+            Serial.printf("MAC Sensor #%d: %02X:%02X:%02X:%02X:%02X:%02X \n", sensorIdx + 1, macStruct.macs[sensorIdx][0], macStruct.macs[sensorIdx][1], macStruct.macs[sensorIdx][2], macStruct.macs[sensorIdx][3], macStruct.macs[sensorIdx][4], macStruct.macs[sensorIdx][5]);    
+        }
+
+        for(int sensorIdx = 0; sensorIdx < NUM_SUPPORTED_SENSORS; sensorIdx++)
+        {
+            uint16_t numberMessages = memory_getNumberSensorMessages(sensorIdx);
+            Serial.printf("--- Data for sensor %d (%d messages)\n", sensorIdx, numberMessages);
+            memory_history_reader_t reader;
+            memory_openHistoryReader(reader, sensorIdx, 0);
+            message_sensor_timestamped_t sensorMessage;
+            while(memory_readHistoryMessage(reader, sensorMessage))
+            {
+                Serial.printf("time=%lld, pinState=%d, voltage_mV=%d\n", sensorMessage.timestamp, sensorMessage.msg.pinState, sensorMessage.msg.batteryVoltage_mV);
+            }
+            memory_closeHistoryReader(reader);
+        }
+    #endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint16_t memory_getNumberSensorMessages(uint8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    return memory_storageCatalog.numberMessages[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+message_sensor_timestamped_t memory_getLatestSensorMessagesForSensor(uint8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    // The latest message is kept in RAM (timestamp -1 if no message exists for the requested sensor)
+    return memory_historyLatestMessage[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_getSensorHistoryTimeRange(uint8_t sensorIndex, time_t& timeOldest, time_t& timeNewest)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    timeNewest = memory_historyNewestTimestamp[sensorIndex];
+    if(timeNewest == -1)
+    {
+        timeOldest = -1;
+        return false;
+    }
+    timeOldest = memory_historyBackend->getFirstTimestamp(sensorIndex);
+    if(timeOldest == -1 || timeOldest > timeNewest)
+    {
+        timeOldest = 0;         // the index isn't available
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_isSensorMessageSampled(uint8_t sensorIndex, const message_sensor_timestamped_t& sensorMessage, const history_sampling_policy_t& policy)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    // Compare with the newest saved message in RAM. Door state and software version changes are always saved.
+    const message_sensor_timestamped_t& latestMessage = memory_historyLatestMessage[sensorIndex];
+    if(policy.mode == HISTORY_SAMPLING_ALWAYS || latestMessage.timestamp == -1 ||
+       sensorMessage.msg.pinState != latestMessage.msg.pinState || sensorMessage.msg.sensor_sw_version != latestMessage.msg.sensor_sw_version)
+    {
+        return true;
+    }
+    if(policy.mode == HISTORY_SAMPLING_SIGNIFICANT)
+    {
+        if(abs((int32_t)sensorMessage.msg.batteryVoltage_mV - (int32_t)latestMessage.msg.batteryVoltage_mV) > policy.minVoltageDelta_mV)
+        {
+            return true;
+        }
+        if(policy.maxInterval_hours > 0 && (sensorMessage.timestamp - latestMessage.timestamp) >= (time_t)policy.maxInterval_hours * 3600)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t memory_getHistoryGeneration(uint8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+    return memory_historyGeneration[sensorIndex];
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_addSensorMessage(uint8_t sensorIndex, message_sensor_timestamped_t sensorMessage)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+    if(memory_suspended)
+    {
+        #ifdef DEBUG_OUTPUT
+            Serial.printf("Message of sensor %d not saved, the memory module is suspended\n", sensorIndex);
+        #endif
+        return false;
+    }
+
+    // The messages are written when the buffer is full. Otherwise they are written by memory_loop() when the oldest one gets too old.
+    bool appended = (memory_historyLegacyFileSize[sensorIndex] > 0) ? memory_appendLegacySensorMessage(sensorIndex, sensorMessage) : memory_appendSensorMessage(sensorIndex, sensorMessage);
+    memory_updateStorageCatalog(sensorIndex);
+    memory_writeLatestStateSnapshot(false);     // The snapshot file is written together with the buffered message
+    return appended;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Binary search in the sparse time index of the requested sensor. The index is rebuilt first if it is missing or stale.
+ */
+uint32_t memory_segmentsFindMessagePosition(uint8_t sensorIndex, time_t timeFrom)
+{
+    uint32_t position = memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE;
+    uint32_t expectedNumberIndexEntries = memory_getExpectedNumberIndexEntries(sensorIndex);
+    if(expectedNumberIndexEntries == 0)
+    {
+        return position;
+    }
+
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    if(!indexFile || indexFile.size() != expectedNumberIndexEntries * sizeof(history_index_entry_t))
+    {
+        // The index is missing or stale. Rebuild it and try again.
+        indexFile.close();
+        if(!memory_rebuildSensorHistoryIndex(sensorIndex))
+        {
+            return position;
+        }
+        indexFile = LittleFS.open(strBuf, "r");
+        if(!indexFile)
+        {
+            return position;
+        }
+    }
+
+    // Binary search for the last index entry with a timestamp < timeFrom. All messages before this entry are older than timeFrom.
+    uint32_t low = 0;
+    uint32_t high = indexFile.size() / sizeof(history_index_entry_t);
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        history_index_entry_t indexEntry;
+        indexFile.seek(middle * sizeof(history_index_entry_t), SeekSet);
+        if(indexFile.read((uint8_t*)&indexEntry, sizeof(history_index_entry_t)) != sizeof(history_index_entry_t))
+        {
+            break;
+        }
+
+        if(indexEntry.timestamp < timeFrom)
+        {
+            position = indexEntry.position;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    indexFile.close();
+
+    return position;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t memory_findSensorMessagePosition(uint8_t sensorIndex, time_t timeFrom)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    return memory_historyBackend->findMessagePosition(sensorIndex, timeFrom);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_segmentsRebuildIndex(uint8_t sensorIndex)
+{
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    if(memory_historyNumberSegments[sensorIndex] == 0)
+    {
+        LittleFS.remove(strBuf);
+        return true;        // no history segments means no index is needed
+    }
+
+    File indexFile = LittleFS.open(strBuf, "w");
+    if(!indexFile)
+    {
+        return false;
+    }
+
+    // The messages are numbered again starting from the oldest one
+    memory_historyFirstMessageNumber[sensorIndex] = 0;
+    memory_scanSensorHistory(sensorIndex, memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE, 0, &indexFile);
+    indexFile.close();
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_rebuildSensorHistoryIndex(uint8_t sensorIndex)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    if(memory_historyBackend->rebuildIndex == NULL)
+    {
+        return true;        // the backend has no index
+    }
+    return memory_historyBackend->rebuildIndex(sensorIndex);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_openHistoryReader(memory_history_reader_t& reader, uint8_t sensorIndex, uint32_t position)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    memory_historyBackend->openReader(reader, sensorIndex, position);
+    reader.tailCacheNumber = MEMORY_TAIL_CACHE_NO_MESSAGE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_segmentsReadMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    while(true)
+    {
+        // Blocks in segments that were already deleted are moved to the start of the oldest segment
+        if(reader.blockPosition < memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE)
+        {
+            reader.blockPosition = memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE;
+            reader.blockLength = 0;
+            reader.blockOffset = 0;
+        }
+
+        bool needMoreData = false;
+        if(reader.blockOffset == 0 && (reader.blockPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0)
+        {
+            // Each segment starts with a header
+            history_segment_header_t header;
+            if(reader.blockLength < sizeof(history_segment_header_t))
+            {
+                needMoreData = true;
+            }
+            else
+            {
+                memcpy(&header, reader.block, sizeof(history_segment_header_t));
+                if(!historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE))
+                {
+                    // Unknown segment format. Continue with the next segment.
+                    reader.blockPosition += MEMORY_HISTORY_SEGMENT_SIZE;
+                    reader.blockLength = 0;
+                    continue;
+                }
+                reader.blockOffset = sizeof(history_segment_header_t);
+            }
+        }
+
+        if(!needMoreData)
+        {
+            if(reader.blockOffset < reader.blockLength)
+            {
+                if(reader.block[reader.blockOffset] == HISTORY_CODEC_TAG_PADDING)
+                {
+                    // The rest of the block is unused
+                    reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+                    reader.blockLength = MEMORY_HISTORY_BLOCK_SIZE;
+                }
+                else
+                {
+                    size_t recordLength = historyCodec_decodeMessage(&reader.block[reader.blockOffset], reader.blockLength - reader.blockOffset, reader.message);
+                    if(recordLength > 0)
+                    {
+                        reader.blockOffset += recordLength;
+                        sensorMessage = reader.message;
+                        return true;
+                    }
+                    if(reader.blockLength == MEMORY_HISTORY_BLOCK_SIZE)
+                    {
+                        // Invalid record. Continue with the keyframe of the next block.
+                        reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+                    }
+                    else
+                    {
+                        needMoreData = true;    // incomplete record at the end of the loaded data
+                    }
+                }
+            }
+            else if(reader.blockLength < MEMORY_HISTORY_BLOCK_SIZE)
+            {
+                needMoreData = true;
+            }
+        }
+
+        if(needMoreData)
+        {
+            // Load the rest of the block (this also gets the messages that were added since the block was loaded)
+            size_t numReadBytes = memory_readHistoryRange(reader, reader.blockPosition + reader.blockLength, &reader.block[reader.blockLength], MEMORY_HISTORY_BLOCK_SIZE - reader.blockLength);
+            if(numReadBytes > 0)
+            {
+                // Completed blocks are loaded at once. Their CRC is checked before the first record is decoded.
+                if(reader.blockLength == 0 && numReadBytes == MEMORY_HISTORY_BLOCK_SIZE && !memory_isValidHistoryBlock(reader))
+                {
+                    #ifdef DEBUG_OUTPUT
+                        Serial.printf("History block CRC mismatch (sensor %d, position %u). The block is skipped.\n", sensorIndex, reader.blockPosition);
+                    #endif
+                    reader.blockOffset = MEMORY_HISTORY_BLOCK_SIZE;
+                }
+                reader.blockLength += numReadBytes;
+                continue;
+            }
+            if(reader.blockPosition + reader.blockLength < memory_getPersistedHistoryEndPosition(sensorIndex))
+            {
+                // The segment file is missing or shorter than expected. Continue with the next segment.
+                reader.blockPosition = (reader.blockPosition / MEMORY_HISTORY_SEGMENT_SIZE + 1) * MEMORY_HISTORY_SEGMENT_SIZE;
+                reader.blockLength = 0;
+                reader.blockOffset = 0;
+                continue;
+            }
+            return false;       // end of the history reached
+        }
+
+        // The block is completely decoded. Continue with the next block.
+        reader.blockPosition += MEMORY_HISTORY_BLOCK_SIZE;
+        reader.blockLength = 0;
+        reader.blockOffset = 0;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read the next message of a reader that was moved into the tail cache by memory_seekHistoryReader().
+ * If the next message was evicted in the meantime (e.g. by new messages while a long response is sent), the reader continues in the history behind the timestamp of the last returned message.
+ */
+bool memory_readTailCacheMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    // The number of an evicted message is outside of the cached numbers (the distances are used, because the numbers can wrap around)
+    if(reader.tailCacheNumber - memory_tailCacheFirstNumber[sensorIndex] > memory_tailCacheNextNumber[sensorIndex] - memory_tailCacheFirstNumber[sensorIndex])
+    {
+        time_t lastTimestamp = reader.message.timestamp;
+        reader.tailCacheNumber = MEMORY_TAIL_CACHE_NO_MESSAGE;
+        memory_historyBackend->openReader(reader, sensorIndex, memory_findSensorMessagePosition(sensorIndex, lastTimestamp + 1));
+        while(memory_historyBackend->readMessage(reader, sensorMessage))
+        {
+            if(sensorMessage.timestamp > lastTimestamp)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    if(reader.tailCacheNumber == memory_tailCacheNextNumber[sensorIndex])
+    {
+        return false;       // end of the history reached
+    }
+    reader.message = memory_getTailCacheMessage(sensorIndex, reader.tailCacheNumber);
+    reader.tailCacheNumber++;
+    sensorMessage = reader.message;
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_readHistoryMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    if(reader.isMessagePending)
+    {
+        reader.isMessagePending = false;
+        sensorMessage = reader.message;
+        return true;
+    }
+    if(reader.tailCacheNumber != MEMORY_TAIL_CACHE_NO_MESSAGE)
+    {
+        return memory_readTailCacheMessage(reader, sensorMessage);
+    }
+    return memory_historyBackend->readMessage(reader, sensorMessage);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_seekHistoryReader(memory_history_reader_t& reader, time_t timeFrom)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    if(memory_isTailCacheCovering(sensorIndex, timeFrom))
+    {
+        memory_historyBackend->closeReader(reader);
+        reader.isMessagePending = false;
+        reader.message.timestamp = timeFrom - 1;        // Older messages are skipped if the reader has to continue in the history
+        reader.tailCacheNumber = memory_findTailCacheMessage(sensorIndex, timeFrom);
+        return;
+    }
 
-    LittleFS.remove(FILENAME_PERSISTED_SYSTEM_CONFIG);
-    // The system config file will be automatically recreated with default values when the device is restarted.
+    reader.tailCacheNumber = MEMORY_TAIL_CACHE_NO_MESSAGE;
+    memory_historyBackend->openReader(reader, reader.sensorIndex, memory_findSensorMessagePosition(reader.sensorIndex, timeFrom));
+
+    // Skip the older messages at the start of the block. The first message of interest is returned by the next read.
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readHistoryMessage(reader, sensorMessage))
+    {
+        if(sensorMessage.timestamp >= timeFrom)
+        {
+            memory_unreadHistoryMessage(reader);
+            break;
+        }
+    }
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-void memory_removeSensorHistory(int8_t sensorIndex)
+void memory_segmentsOpenReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo)
 {
-    if(sensorIndex < 0)
+    // Messages that are not newer than timeTo are only located before the position found for timeTo + 1 or in the block at this position
+    uint32_t position = memory_getHistoryEndPosition(sensorIndex);
+    if(timeTo < memory_historyLatestMessage[sensorIndex].timestamp)
     {
-        for(int i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+        uint32_t blockPosition = memory_segmentsFindMessagePosition(sensorIndex, timeTo + 1);
+        blockPosition -= blockPosition % MEMORY_HISTORY_BLOCK_SIZE;
+        position = min(position, blockPosition + MEMORY_HISTORY_BLOCK_SIZE);
+    }
+    memory_segmentsOpenReader(reader, sensorIndex, position);
+    reader.position = position;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_openHistoryReaderReverse(memory_history_reader_t& reader, uint8_t sensorIndex, time_t timeTo)
+{
+    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    {
+        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+    }
+
+    memory_historyBackend->openReaderReverse(reader, sensorIndex, timeTo);
+    reader.tailCacheNumber = MEMORY_TAIL_CACHE_NO_MESSAGE;
+
+    // Skip the newer messages at the end of the block. The first message of interest is returned by the next read.
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readPreviousHistoryMessage(reader, sensorMessage))
+    {
+        if(sensorMessage.timestamp <= timeTo)
         {
-            char strBuf[32];
-            sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, i);
-            LittleFS.remove(strBuf);
+            memory_unreadHistoryMessage(reader);
+            break;
         }
     }
-    else
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Decode the records of the block in the block buffer of the reader from the start of the block on (behind the segment header).
+ * @param maxNumberRecords Decoding stops after this number of records.
+ * @return Number of decoded records. The last decoded message is in reader.message.
+ */
+uint16_t memory_decodeHistoryBlock(memory_history_reader_t& reader, uint16_t maxNumberRecords)
+{
+    uint16_t offset = 0;
+    if((reader.blockPosition % MEMORY_HISTORY_SEGMENT_SIZE) == 0)
     {
-        char strBuf[32];
-        sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-        LittleFS.remove(strBuf);
+        // Each segment starts with a header
+        history_segment_header_t header;
+        if(reader.blockLength < sizeof(history_segment_header_t))
+        {
+            return 0;
+        }
+        memcpy(&header, reader.block, sizeof(history_segment_header_t));
+        if(!historyCodec_isValidSegmentHeader(header, MEMORY_HISTORY_BLOCK_SIZE, MEMORY_HISTORY_SEGMENT_SIZE))
+        {
+            return 0;
+        }
+        offset = sizeof(history_segment_header_t);
+    }
+
+    uint16_t numberRecords = 0;
+    while(numberRecords < maxNumberRecords && offset < reader.blockLength && reader.block[offset] != HISTORY_CODEC_TAG_PADDING)
+    {
+        size_t recordLength = historyCodec_decodeMessage(&reader.block[offset], reader.blockLength - offset, reader.message);
+        if(recordLength == 0)
+        {
+            break;      // invalid or incomplete record. The rest of the block is ignored.
+        }
+        offset += recordLength;
+        numberRecords++;
     }
+    return numberRecords;
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-const char* memory_getMemoryUsageString(bool shortFormat)
+bool memory_segmentsReadPreviousMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
 {
-    FSInfo info;
-    LittleFS.info(info);
+    uint8_t sensorIndex = reader.sensorIndex;
+    if(reader.numberRecordsLeft > 0)
+    {
+        // Decode the block again up to the record before the last returned one
+        memory_decodeHistoryBlock(reader, reader.numberRecordsLeft);
+        reader.numberRecordsLeft--;
+        sensorMessage = reader.message;
+        return true;
+    }
 
-    float percentage = (info.usedBytes * 100.0f) / info.totalBytes;
-    static char buffer[100];
-    if(shortFormat)
+    // Load the previous block. reader.position is the end of the part of the history that wasn't read yet.
+    while(reader.position > memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE)
     {
-        snprintf(buffer, sizeof(buffer), "%.2f %%", percentage);
+        reader.blockPosition = (reader.position - 1) - ((reader.position - 1) % MEMORY_HISTORY_BLOCK_SIZE);
+        reader.blockLength = memory_readHistoryRange(reader, reader.blockPosition, reader.block, reader.position - reader.blockPosition);
+        reader.blockOffset = 0;
+        reader.position = reader.blockPosition;
+        if(reader.blockLength == MEMORY_HISTORY_BLOCK_SIZE && !memory_isValidHistoryBlock(reader))
+        {
+            continue;       // corrupted block
+        }
+
+        uint16_t numberRecords = memory_decodeHistoryBlock(reader, UINT16_MAX);
+        if(numberRecords > 0)
+        {
+            reader.numberRecordsLeft = numberRecords - 1;
+            sensorMessage = reader.message;
+            return true;
+        }
+        // Empty block, missing segment file or unknown segment format. Continue with the previous block.
     }
-    else
+    return false;       // start of the history reached
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_readPreviousHistoryMessage(memory_history_reader_t& reader, message_sensor_timestamped_t& sensorMessage)
+{
+    if(reader.isMessagePending)
     {
-        snprintf(buffer, sizeof(buffer), "%d von %d Bytes belegt (%.2f %%)", info.usedBytes, info.totalBytes, percentage); 
+        reader.isMessagePending = false;
+        sensorMessage = reader.message;
+        return true;
     }
-    return buffer;
+    return memory_historyBackend->readPreviousMessage(reader, sensorMessage);
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-void memory_showMemoryContent()
+void memory_unreadHistoryMessage(memory_history_reader_t& reader)
 {
-    #ifdef DEBUG_OUTPUT
-        FSInfo info;
-        LittleFS.info(info);
-        Serial.println("--- File System usage");
-        Serial.println(memory_getMemoryUsageString());
-        
-        Serial.println("--- MACs");
-        MacArrayStruct_t macStruct = memory_getSensorMacs();
-        for(int sensorIdx = 0; sensorIdx < NUM_SUPPORTED_SENSORS; sensorIdx++)
+    reader.isMessagePending = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read the raw bytes of the history segments (v2 format with segment headers).
+ */
+size_t memory_segmentsReadHistory(memory_history_reader_t& reader, uint8_t* buffer, size_t length)
+{
+    uint8_t sensorIndex = reader.sensorIndex;
+    size_t numReadBytesTotal = 0;
+    while(numReadBytesTotal < length)
+    {
+        // Positions in segments that were already deleted are moved to the start of the oldest segment
+        if(reader.position < memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE)
         {
-            Serial.printf("MAC Sensor #%d: %02X:%02X:%02X:%02X:%02X:%02X \n", sensorIdx + 1, macStruct.macs[sensorIdx][0], macStruct.macs[sensorIdx][1], macStruct.macs[sensorIdx][2], macStruct.macs[sensorIdx][3], macStruct.macs[sensorIdx][4], macStruct.macs[sensorIdx][5]);    
+            reader.position = memory_historyFirstSegment[sensorIndex] * MEMORY_HISTORY_SEGMENT_SIZE;
+        }
+        if(reader.position >= memory_getHistoryEndPosition(sensorIndex))
+        {
+            break;      // end of the history reached
         }
 
-        for(int sensorIdx = 0; sensorIdx < NUM_SUPPORTED_SENSORS; sensorIdx++)
+        uint32_t segmentEndPosition = (reader.position / MEMORY_HISTORY_SEGMENT_SIZE + 1) * MEMORY_HISTORY_SEGMENT_SIZE;
+        size_t numReadBytes = memory_readHistoryRange(reader, reader.position, buffer + numReadBytesTotal, min((uint32_t)(length - numReadBytesTotal), segmentEndPosition - reader.position));
+        if(numReadBytes == 0)
         {
-            uint16_t numberMessages = memory_getNumberSensorMessages(sensorIdx);
-            Serial.printf("--- Data for sensor %d (%d messages)\n", sensorIdx, numberMessages);
-            message_sensor_timestamped_t sensorMessages[numberMessages];
-            memory_getSensorMessagesForSensor(sensorIdx, sensorMessages);
-            for(int msgIdx = 0; msgIdx < numberMessages; msgIdx++)
-            {
-                Serial.printf("time=%lld, pinState=%d, voltage_mV=%d\n", sensorMessages[msgIdx].timestamp, sensorMessages[msgIdx].msg.pinState, sensorMessages[msgIdx].msg.batteryVoltage_mV);
-            }
+            // The segment file is missing or shorter than expected. Continue with the next one.
+            reader.position = segmentEndPosition;
+            continue;
         }
-    #endif
+        numReadBytesTotal += numReadBytes;
+        reader.position += numReadBytes;
+    }
+    return numReadBytesTotal;
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-uint16_t memory_getNumberSensorMessages(uint8_t sensorIndex)
+size_t memory_readHistory(memory_history_reader_t& reader, uint8_t* buffer, size_t length)
 {
-    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+    if(memory_historyBackend->readHistory != NULL)
     {
-        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+        return memory_historyBackend->readHistory(reader, buffer, length);
     }
-	
-	char strBuf[32];
-	sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-    if(LittleFS.exists(strBuf))
+
+    // reader.position counts the bytes that were returned. A message that doesn't fit into the buffer is continued with the next call.
+    size_t numReadBytes = 0;
+    while(numReadBytes < length)
     {
-        File memoryFile = LittleFS.open(strBuf, "r");
-        size_t fileSize = memoryFile.size();
-        memoryFile.close();
-        
-        return fileSize / sizeof(message_sensor_timestamped_t);
+        uint32_t offset = reader.position % sizeof(message_sensor_timestamped_t);
+        message_sensor_timestamped_t sensorMessage;
+        if(offset == 0 && !memory_historyBackend->readMessage(reader, sensorMessage))
+        {
+            break;      // end of the history reached
+        }
+        size_t numberBytesToCopy = min(length - numReadBytes, sizeof(message_sensor_timestamped_t) - offset);
+        memcpy(&buffer[numReadBytes], (uint8_t*)&reader.message + offset, numberBytesToCopy);
+        numReadBytes += numberBytesToCopy;
+        reader.position += numberBytesToCopy;
     }
-    else
+    return numReadBytes;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_segmentsCloseReader(memory_history_reader_t& reader)
+{
+    reader.file.close();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_closeHistoryReader(memory_history_reader_t& reader)
+{
+    memory_historyBackend->closeReader(reader);
+    reader.tailCacheNumber = MEMORY_TAIL_CACHE_NO_MESSAGE;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+message_sensor_timestamped_t memory_segmentsGetLatestMessage(uint8_t sensorIndex)
+{
+    return memory_historyLatestMessage[sensorIndex];       // restored by memory_segmentsInit()
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+time_t memory_segmentsGetFirstTimestamp(uint8_t sensorIndex)
+{
+    // The first index entry contains the timestamp of the first message of the oldest block. Blocks that are only started in the write buffer have their entries in RAM.
+    uint32_t expectedNumberIndexEntries = memory_getExpectedNumberIndexEntries(sensorIndex);
+    if(expectedNumberIndexEntries == 0)
     {
-        return 0;
+        return (memory_writeBufferNumberIndexEntries[sensorIndex] > 0) ? memory_writeBufferIndexEntries[sensorIndex][0].timestamp : -1;
+    }
+
+    char strBuf[32];
+    sprintf(strBuf, FILENAME_HISTORY_INDEX_SENSOR_FORMAT, sensorIndex);
+    File indexFile = LittleFS.open(strBuf, "r");
+    history_index_entry_t indexEntry;
+    bool isRead = indexFile && indexFile.size() == expectedNumberIndexEntries * sizeof(history_index_entry_t) && indexFile.read((uint8_t*)&indexEntry, sizeof(history_index_entry_t)) == sizeof(history_index_entry_t);
+    indexFile.close();
+    return isRead ? indexEntry.timestamp : -1;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_segmentsGetStats(history_backend_stats_t& stats)
+{
+    stats = memory_segmentsStats;
+    stats.usedBytes = 0;
+    for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        stats.usedBytes += memory_segmentsGetHistorySize(i);
     }
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-void memory_getSensorMessagesForSensor(uint8_t sensorIndex, message_sensor_timestamped_t* sensorMessagesBuffer)
+const history_backend_t memory_segmentsHistoryBackend =
 {
-    if(sensorMessagesBuffer == NULL) { return; }
+    "segments",
+    memory_segmentsInit,
+    memory_segmentsEnd,
+    memory_segmentsAppendMessage,
+    memory_segmentsWriteBuffer,
+    memory_segmentsGetWriteBufferLength,
+    memory_segmentsGetWriteBufferFirstMillis,
+    memory_segmentsRemoveSensor,
+    NULL,                                       // the retention engine deletes the oldest segments of each sensor itself
+    memory_segmentsGetLatestMessage,
+    memory_segmentsGetFirstTimestamp,
+    memory_segmentsGetNumberMessages,
+    memory_segmentsGetHistorySize,
+    memory_segmentsGetStats,
+    memory_segmentsFindMessagePosition,
+    memory_segmentsRebuildIndex,
+    memory_segmentsOpenReader,
+    memory_segmentsReadMessage,
+    memory_segmentsOpenReaderReverse,
+    memory_segmentsReadPreviousMessage,
+    memory_segmentsReadHistory,
+    memory_segmentsCloseReader
+};
 
-    if(sensorIndex >= NUM_SUPPORTED_SENSORS)
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_setHistoryBackend(const history_backend_t* backend)
+{
+    if(backend != NULL)
     {
-        sensorIndex = NUM_SUPPORTED_SENSORS - 1;
+        memory_historyBackend = backend;
     }
-	
-	uint16_t numberSensorMessages = memory_getNumberSensorMessages(sensorIndex);
-	
-    if(numberSensorMessages > 0)
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+const history_backend_t* memory_getHistoryBackend()
+{
+    return memory_historyBackend;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#ifdef MEMORY_UNIFIED_HISTORY_LOG
+void memory_openAllSensorsHistoryReader(memory_history_reader_t& reader, time_t timeFrom)
+{
+    historyLog_openAllSensorsReader(reader, timeFrom);
+    if(memory_historyBackend != &historyLog_backend)
     {
-        char strBuf[32];
-        sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-        File memoryFile = LittleFS.open(strBuf, "r");
+        return;     // The log isn't used (memory_readAllSensorsHistoryMessage() returns no messages)
+    }
 
-        for(int i = 0; i < numberSensorMessages; i++)
+    // Skip the older messages at the start of the segment. The first message of interest is returned by the next read.
+    uint8_t sensorIndex;
+    message_sensor_timestamped_t sensorMessage;
+    while(historyLog_readAllSensorsMessage(reader, sensorIndex, sensorMessage))
+    {
+        if(sensorMessage.timestamp >= timeFrom)
         {
-            message_sensor_timestamped_t sensorMessage;
-            memoryFile.read((uint8_t*)&sensorMessage, sizeof(message_sensor_timestamped_t));
-            sensorMessagesBuffer[i] = sensorMessage;
+            memory_unreadHistoryMessage(reader);
+            break;
         }
-        memoryFile.close();
     }
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-message_sensor_timestamped_t memory_getLatestSensorMessagesForSensor(uint8_t sensorIndex)
+bool memory_readAllSensorsHistoryMessage(memory_history_reader_t& reader, uint8_t& sensorIndex, message_sensor_timestamped_t& sensorMessage)
+{
+    if(memory_historyBackend != &historyLog_backend)
+    {
+        return false;
+    }
+    return historyLog_readAllSensorsMessage(reader, sensorIndex, sensorMessage);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+#endif
+
+bool memory_rebuildSensorRollups(uint8_t sensorIndex)
 {
     if(sensorIndex >= NUM_SUPPORTED_SENSORS)
     {
         sensorIndex = NUM_SUPPORTED_SENSORS - 1;
     }
-	
-	char strBuf[32];
-	sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-    if(LittleFS.exists(strBuf))
-    {
-        File memoryFile = LittleFS.open(strBuf, "r");
-        memoryFile.seek(sizeof(message_sensor_timestamped_t), SeekEnd);		// move file pointer to beginning of last entry
 
-        message_sensor_timestamped_t sensorMessage;
-        memoryFile.read((uint8_t*)&sensorMessage, sizeof(message_sensor_timestamped_t));
-        memoryFile.close();
-        return sensorMessage;
+    if(memory_historyImport.replaySensorIndex == sensorIndex)
+    {
+        memory_endRollupReplay(true);       // The rollups are recalculated completely below
     }
-    else
+    memory_removeSensorRollups(sensorIndex);
+
+    memory_history_reader_t reader;
+    memory_historyBackend->openReader(reader, sensorIndex, 0);
+    message_sensor_timestamped_t sensorMessage;
+    while(memory_readHistoryMessage(reader, sensorMessage))
     {
-        // return an invalid message if no message exists for the requested sensor
-        message_sensor_timestamped_t invalidMessage;
-        invalidMessage.timestamp = -1;
-        return invalidMessage;
+        memory_updateSensorRollups(sensorIndex, sensorMessage);
     }
+    memory_closeHistoryReader(reader);
 
+    memory_flushSensorRollups(sensorIndex);
+    memory_historyGeneration[sensorIndex]++;
+    return true;
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-bool memory_addSensorMessage(uint8_t sensorIndex, message_sensor_timestamped_t sensorMessage)
+void memory_openRollupReader(memory_rollup_reader_t& reader, uint8_t sensorIndex, RollupResolutions resolution, time_t timeFrom)
 {
     if(sensorIndex >= NUM_SUPPORTED_SENSORS)
     {
         sensorIndex = NUM_SUPPORTED_SENSORS - 1;
     }
-	
-	char strBuf[32];
-	sprintf(strBuf, FILENAME_HISTORY_SENSOR_FORMAT, sensorIndex);
-	File memoryFile = LittleFS.open(strBuf, "a");
-	size_t writtenSize = memoryFile.write((uint8_t*)&sensorMessage, sizeof(message_sensor_timestamped_t));
-	memoryFile.close();
 
-    return writtenSize == sizeof(message_sensor_timestamped_t);
+    memory_flushSensorRollups(sensorIndex);
+
+    reader.sensorIndex = sensorIndex;
+    reader.resolution = resolution;
+    reader.timeFrom = memory_getRollupBucketStart(timeFrom, resolution);
+    reader.lastBucketStart = reader.timeFrom - 1;
+
+    char strBuf[32];
+    memory_getRollupFileName(strBuf, sensorIndex, resolution);
+    reader.file = LittleFS.open(strBuf, "r");
+    if(!reader.file)
+    {
+        return;
+    }
+
+    // Binary search for the first bucket that isn't older than timeFrom
+    uint32_t low = 0;
+    uint32_t high = reader.file.size() / sizeof(history_rollup_entry_t);
+    while(low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        history_rollup_entry_t entry;
+        reader.file.seek(middle * sizeof(history_rollup_entry_t), SeekSet);
+        if(reader.file.read((uint8_t*)&entry, sizeof(history_rollup_entry_t)) != sizeof(history_rollup_entry_t))
+        {
+            break;
+        }
+
+        if(entry.bucketStart < reader.timeFrom)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    reader.file.seek(low * sizeof(history_rollup_entry_t), SeekSet);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_readRollupEntry(memory_rollup_reader_t& reader, history_rollup_entry_t& entry)
+{
+    if(reader.file && reader.file.read((uint8_t*)&entry, sizeof(history_rollup_entry_t)) == sizeof(history_rollup_entry_t))
+    {
+        reader.lastBucketStart = entry.bucketStart;
+        return true;
+    }
+
+    // The bucket in progress is kept in RAM
+    history_rollup_entry_t& currentEntry = memory_rollupCurrentEntry[reader.sensorIndex][reader.resolution];
+    if(currentEntry.bucketStart != -1 && currentEntry.bucketStart > reader.lastBucketStart)
+    {
+        entry = currentEntry;
+        reader.lastBucketStart = entry.bucketStart;
+        return true;
+    }
+    return false;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void memory_closeRollupReader(memory_rollup_reader_t& reader)
+{
+    reader.file.close();
 }
 
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 bool memory_saveSystemConfig(system_config_t& sysConfig)
 {
-    persisted_system_config_t persistedConfig;
+    if(!memory_systemConfigChanged && memory_systemConfig.magic == MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC && memcmp(&memory_systemConfig.system_config, &sysConfig, sizeof(system_config_t)) == 0)
+    {
+        return true;        // unchanged config isn't written again
+    }
+
+    memory_systemConfig.system_config = sysConfig;
+    memory_systemConfigChanged = true;
+    memory_systemConfigChangedMillis = millis();
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool memory_flushSystemConfig()
+{
+    if(!memory_systemConfigChanged)
+    {
+        return true;
+    }
+
+    persisted_system_config_t& persistedConfig = memory_systemConfig;
     persistedConfig.magic = MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC;
-    persistedConfig.system_config = sysConfig;
+    persistedConfig.generation++;
     persistedConfig.crc32 = utils_calculateCRC32((uint8_t*)&persistedConfig, sizeof(persisted_system_config_t) - sizeof(persistedConfig.crc32));
 
-    File memoryFile = LittleFS.open(FILENAME_PERSISTED_SYSTEM_CONFIG, "w");
+    // Write to the other slot. The slot with the previous config stays untouched until this write is complete.
+    uint8_t slot = 1 - memory_systemConfigSlot;
+    File memoryFile = LittleFS.open(memory_systemConfigSlotFileNames[slot], "w");
     if(!memoryFile)
     {
+        persistedConfig.generation--;
         return false;
     }
 
     size_t written = memoryFile.write((uint8_t*)&persistedConfig, sizeof(persisted_system_config_t));
 
     memoryFile.close();
-    return (written == sizeof(persisted_system_config_t));
+    memory_storageCatalogUsageChanged = true;
+    if(written != sizeof(persisted_system_config_t))
+    {
+        persistedConfig.generation--;
+        return false;
+    }
+
+    memory_systemConfigSlot = slot;
+    memory_systemConfigChanged = false;
+    LittleFS.remove(FILENAME_PERSISTED_SYSTEM_CONFIG);     // The legacy file is replaced by the slot files
+    return true;
 }
 
 /*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-bool memory_loadSystemConfig(system_config_t& sysConfig)
+/**
+ * Read a system config file (slot or legacy format) and check it (size, magic and CRC).
+ * Files written by older versions are shorter, because fields were appended to system_config_t since then. Only the fields contained in the file are loaded, the others keep their default values.
+ * @param fileName Name of the system config file.
+ * @param header Buffer for the bytes in front of the system config (magic and, for slot files, the generation).
+ * @param headerSize Number of bytes in front of the system config.
+ * @param sysConfig The loaded system config.
+ * @return True if the file contains a valid system config; otherwise false.
+ */
+bool memory_readSystemConfigFile(const char* fileName, uint8_t* header, size_t headerSize, system_config_t& sysConfig)
 {
-    File memoryFile = LittleFS.open(FILENAME_PERSISTED_SYSTEM_CONFIG, "r");
+    File memoryFile = LittleFS.open(fileName, "r");
     if(!memoryFile)
     {
         return false;
     }
-    
-    if(memoryFile.size() != sizeof(persisted_system_config_t))
+
+    size_t configSize = memoryFile.size() - headerSize - sizeof(uint32_t);
+    if(memoryFile.size() < headerSize + SYSTEM_CONFIG_V1_DATA_SIZE + sizeof(uint32_t) || configSize > sizeof(system_config_t))
     {
         memoryFile.close();
         return false;
     }
 
-    persisted_system_config_t persistedConfig;
-    size_t bytesRead = memoryFile.read((uint8_t*)&persistedConfig, sizeof(persisted_system_config_t));
+    uint8_t configData[sizeof(system_config_t)];
+    uint32_t crc32;
+    bool isComplete = memoryFile.read(header, headerSize) == headerSize &&
+                      memoryFile.read(configData, configSize) == configSize &&
+                      memoryFile.read((uint8_t*)&crc32, sizeof(crc32)) == sizeof(crc32);
 
     memoryFile.close();
 
-    if(bytesRead != sizeof(persisted_system_config_t))
+    uint32_t magic;
+    memcpy(&magic, header, sizeof(magic));
+    if(!isComplete || magic != MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC)
     {
         return false;
     }
-    
-    if(persistedConfig.magic != MEMORY_PERSISTED_SYSTEM_CONFIG_MAGIC)
+
+    uint32_t expectedCRC = utils_updateCRC32(utils_updateCRC32(0xFFFFFFFF, header, headerSize), configData, configSize);
+    if(crc32 != expectedCRC)
     {
         return false;
     }
-    
-    uint32_t expectedCRC = utils_calculateCRC32((uint8_t*)&persistedConfig, sizeof(persisted_system_config_t) - sizeof(persistedConfig.crc32));
-    if(persistedConfig.crc32 != expectedCRC)
+
+    // The padding behind the last field of an older version isn't taken over
+    sysConfig = system_config_t();
+    size_t dataSize = SYSTEM_CONFIG_V1_DATA_SIZE;
+    if(configSize == sizeof(system_config_t))
     {
-        return false;
+        dataSize = configSize;
     }
+    else if(configSize >= SYSTEM_CONFIG_V2_DATA_SIZE)
+    {
+        dataSize = SYSTEM_CONFIG_V2_DATA_SIZE;
+    }
+    memcpy((uint8_t*)&sysConfig, configData, dataSize);
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read a system config slot file and check it (size, magic and CRC).
+ * @return True if the file contains a valid system config; otherwise false.
+ */
+bool memory_readSystemConfigSlot(const char* fileName, persisted_system_config_t& persistedConfig)
+{
+    return memory_readSystemConfigFile(fileName, (uint8_t*)&persistedConfig, offsetof(persisted_system_config_t, system_config), persistedConfig.system_config);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read the legacy system config file (used before the slot files) and check it (size, magic and CRC).
+ * @return True if the file contains a valid system config; otherwise false.
+ */
+bool memory_readLegacySystemConfig(system_config_t& sysConfig)
+{
+    persisted_system_config_legacy_t persistedConfig;
+    return memory_readSystemConfigFile(FILENAME_PERSISTED_SYSTEM_CONFIG, (uint8_t*)&persistedConfig, offsetof(persisted_system_config_legacy_t, system_config), sysConfig);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
-    sysConfig = persistedConfig.system_config;
+bool memory_loadSystemConfig(system_config_t& sysConfig)
+{
+    persisted_system_config_t slotConfigs[2];
+    bool slotValid[2];
+    for(uint8_t slot = 0; slot < 2; slot++)
+    {
+        slotValid[slot] = memory_readSystemConfigSlot(memory_systemConfigSlotFileNames[slot], slotConfigs[slot]);
+    }
+
+    uint8_t newestSlot;
+    if(slotValid[0] && slotValid[1])
+    {
+        // The generation difference is evaluated signed, so that the order is still correct after an overflow of the generation counter
+        newestSlot = ((int32_t)(slotConfigs[1].generation - slotConfigs[0].generation) > 0) ? 1 : 0;
+    }
+    else if(slotValid[0] || slotValid[1])
+    {
+        newestSlot = slotValid[0] ? 0 : 1;
+    }
+    else
+    {
+        // No slot is written yet. The next save writes slot A.
+        memory_systemConfigSlot = 1;
+        memory_systemConfig.generation = 0;
+        if(!memory_readLegacySystemConfig(sysConfig))
+        {
+            memory_systemConfig.magic = 0;      // Nothing loaded. The next save is written even if the config equals the (empty) RAM copy.
+            return false;
+        }
+        memory_systemConfig.system_config = sysConfig;
+        memory_systemConfigChanged = false;
+        return true;
+    }
+
+    memory_systemConfig = slotConfigs[newestSlot];
+    memory_systemConfigSlot = newestSlot;
+    memory_systemConfigChanged = false;
+    sysConfig = memory_systemConfig.system_config;
     return true;
-}
\ No newline at end of file
+}
@@ -4,6 +4,8 @@
 #include "main.h"
 
 unsigned long ota_progress_millis = 0;
+bool ota_isRunning = false;                 // onOTAStart() was called and onOTAEnd() wasn't called yet. The memory module is suspended meanwhile.
+unsigned long ota_lastDataMillis = 0;       // millis() of the last received data of the running OTA update
 
 system_config_t sysConfig_backup;
 
@@ -12,7 +14,11 @@ void onOTAStart()
     // Backup the current system config before OTA update.
     memcpy(&sysConfig_backup, &sysConfig, sizeof(system_config_t));
 
+    // Write the buffered sensor messages before the file system is unmounted
+    memory_end();
     LittleFS.end();
+    ota_isRunning = true;
+    ota_lastDataMillis = millis();
 
     leds_otaStart();
     #ifdef DEBUG_OUTPUT
@@ -22,6 +28,7 @@ void onOTAStart()
 
 void onOTAProgress(size_t current, size_t final)
 {
+    ota_lastDataMillis = millis();
     // Log every 1 second
     if (millis() - ota_progress_millis > 1000)
     {
@@ -34,6 +41,7 @@ void onOTAProgress(size_t current, size_t final)
 
 void onOTAEnd(bool success)
 {
+    ota_isRunning = false;
     leds_otaEnd(success);
 
     if (LittleFS.begin())
@@ -42,6 +50,8 @@ void onOTAEnd(bool success)
         // By restoring the system config, the sensor MACs and modes are preserved during OTA update.
         memcpy(&sysConfig, &sysConfig_backup, sizeof(system_config_t));
         memory_saveSystemConfig(sysConfig);
+        memory_flushSystemConfig();
+        memory_init();      // The file system might be replaced by the OTA update
     }
     
     if (success)
@@ -69,4 +79,10 @@ void otaUpdate_init(AsyncWebServer* server)
 void otaUpdate_loop()
 {
     ElegantOTA.loop();
+
+    // ElegantOTA doesn't report an upload that is aborted (e.g. the browser was closed). The file system is mounted again as after a failed update.
+    if(ota_isRunning && (millis() - ota_lastDataMillis) >= OTA_UPDATE_TIMEOUT_MS)
+    {
+        onOTAEnd(false);
+    }
 }
\ No newline at end of file
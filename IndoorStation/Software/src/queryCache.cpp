@@ -0,0 +1,211 @@
+#include "queryCache.h"
+
+/**
+ * Cached result of a query.
+ */
+typedef struct query_cache_entry
+{
+    query_cache_key_t key;
+    uint32_t generation;                    // History generation of the sensor for which the result is valid
+    std::shared_ptr<const uint8_t> data;    // Serialized result (NULL if the entry is unused)
+    size_t length;                          // Number of bytes of the result
+    uint32_t lastUsed;                      // Value of queryCache_useCounter at the last use. The entry with the smallest value is evicted first.
+} query_cache_entry_t;
+
+query_cache_entry_t queryCache_entries[QUERY_CACHE_MAX_ENTRIES];
+uint32_t queryCache_useCounter = 0;         // Incremented on each use of an entry
+size_t queryCache_allocatedBytes = 0;       // Heap bytes of all buffers of the cache (including evicted results that are still sent and the captured result)
+uint32_t queryCache_hits = 0;
+uint32_t queryCache_misses = 0;
+
+/**
+ * Check if both keys belong to the same query.
+ */
+bool queryCache_isSameKey(const query_cache_key_t& key1, const query_cache_key_t& key2)
+{
+    return key1.endpoint == key2.endpoint && key1.sensorIndex == key2.sensorIndex && key1.format == key2.format && key1.params == key2.params && key1.timeFrom == key2.timeFrom && key1.timeTo == key2.timeTo;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Remove the results whose history changed in the meantime and the least recently used result.
+ * @return True if a result was removed; false if the cache is empty.
+ */
+bool queryCache_evict()
+{
+    int8_t leastRecentlyUsedIndex = -1;
+    bool isEvicted = false;
+    for(int i = 0; i < QUERY_CACHE_MAX_ENTRIES; i++)
+    {
+        query_cache_entry_t& entry = queryCache_entries[i];
+        if(!entry.data)
+        {
+            continue;
+        }
+        if(entry.generation != memory_getHistoryGeneration(entry.key.sensorIndex))
+        {
+            entry.data.reset();
+            isEvicted = true;
+        }
+        else if(leastRecentlyUsedIndex < 0 || (int32_t)(entry.lastUsed - queryCache_entries[leastRecentlyUsedIndex].lastUsed) < 0)
+        {
+            leastRecentlyUsedIndex = i;
+        }
+    }
+    if(!isEvicted && leastRecentlyUsedIndex >= 0)
+    {
+        queryCache_entries[leastRecentlyUsedIndex].data.reset();
+        isEvicted = true;
+    }
+    return isEvicted;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+std::shared_ptr<const uint8_t> queryCache_find(const query_cache_key_t& key, size_t& length)
+{
+    for(int i = 0; i < QUERY_CACHE_MAX_ENTRIES; i++)
+    {
+        query_cache_entry_t& entry = queryCache_entries[i];
+        if(entry.data && queryCache_isSameKey(entry.key, key))
+        {
+            if(entry.generation != memory_getHistoryGeneration(key.sensorIndex))
+            {
+                entry.data.reset();     // outdated
+                break;
+            }
+            entry.lastUsed = ++queryCache_useCounter;
+            queryCache_hits++;
+            length = entry.length;
+            return entry.data;
+        }
+    }
+    queryCache_misses++;
+    length = 0;
+    return std::shared_ptr<const uint8_t>();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void queryCache_beginCapture(query_cache_capture_t& capture, const query_cache_key_t& key)
+{
+    queryCache_abortCapture(capture);
+    capture.key = key;
+    capture.generation = memory_getHistoryGeneration(key.sensorIndex);
+
+    // The buffer is allocated for the largest result that is cached and shrunk to the real size at the end
+    while(queryCache_allocatedBytes + QUERY_CACHE_MAX_RESULT_BYTES > QUERY_CACHE_BUDGET_BYTES && queryCache_evict());
+    if(queryCache_allocatedBytes + QUERY_CACHE_MAX_RESULT_BYTES > QUERY_CACHE_BUDGET_BYTES || ESP.getFreeHeap() < QUERY_CACHE_MAX_RESULT_BYTES + QUERY_CACHE_MIN_FREE_HEAP)
+    {
+        return;     // the evicted results are still sent by other responses or the heap is low
+    }
+    capture.data = (uint8_t*)malloc(QUERY_CACHE_MAX_RESULT_BYTES);
+    if(capture.data != NULL)
+    {
+        queryCache_allocatedBytes += QUERY_CACHE_MAX_RESULT_BYTES;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void queryCache_appendCapture(query_cache_capture_t& capture, const uint8_t* data, size_t length)
+{
+    if(capture.data == NULL)
+    {
+        return;
+    }
+    if(capture.length + length > QUERY_CACHE_MAX_RESULT_BYTES)
+    {
+        queryCache_abortCapture(capture);
+        return;
+    }
+    memcpy(capture.data + capture.length, data, length);
+    capture.length += length;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void queryCache_endCapture(query_cache_capture_t& capture)
+{
+    if(capture.data == NULL)
+    {
+        return;
+    }
+    if(capture.generation != memory_getHistoryGeneration(capture.key.sensorIndex))
+    {
+        queryCache_abortCapture(capture);       // the result may be incomplete
+        return;
+    }
+
+    // Shrinking the buffer doesn't move it, so the heap isn't fragmented (an empty result keeps one byte)
+    size_t size = max(capture.length, (size_t)1);
+    uint8_t* data = (uint8_t*)realloc(capture.data, size);
+    if(data == NULL)
+    {
+        data = capture.data;
+        size = QUERY_CACHE_MAX_RESULT_BYTES;
+    }
+    queryCache_allocatedBytes -= QUERY_CACHE_MAX_RESULT_BYTES - size;
+
+    // Replace the result of the same query or use a free or the least recently used entry
+    int8_t entryIndex = -1;
+    for(int i = 0; i < QUERY_CACHE_MAX_ENTRIES; i++)
+    {
+        query_cache_entry_t& entry = queryCache_entries[i];
+        if(entry.data && queryCache_isSameKey(entry.key, capture.key))
+        {
+            entryIndex = i;
+            break;
+        }
+        if(entryIndex < 0 || (queryCache_entries[entryIndex].data && (!entry.data || (int32_t)(entry.lastUsed - queryCache_entries[entryIndex].lastUsed) < 0)))
+        {
+            entryIndex = i;
+        }
+    }
+
+    // The buffer is freed when the entry is evicted and the result isn't sent anymore
+    query_cache_entry_t& entry = queryCache_entries[entryIndex];
+    entry.key = capture.key;
+    entry.generation = capture.generation;
+    entry.data = std::shared_ptr<const uint8_t>(data, [size](const uint8_t* data)
+    {
+        free((void*)data);
+        queryCache_allocatedBytes -= size;
+    });
+    entry.length = capture.length;
+    entry.lastUsed = ++queryCache_useCounter;
+
+    capture.data = NULL;
+    capture.length = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void queryCache_abortCapture(query_cache_capture_t& capture)
+{
+    if(capture.data != NULL)
+    {
+        free(capture.data);
+        queryCache_allocatedBytes -= QUERY_CACHE_MAX_RESULT_BYTES;
+    }
+    capture.data = NULL;
+    capture.length = 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void queryCache_getStats(query_cache_stats_t& stats)
+{
+    stats.hits = queryCache_hits;
+    stats.misses = queryCache_misses;
+    stats.numberEntries = 0;
+    for(int i = 0; i < QUERY_CACHE_MAX_ENTRIES; i++)
+    {
+        if(queryCache_entries[i].data)
+        {
+            stats.numberEntries++;
+        }
+    }
+    stats.usedBytes = queryCache_allocatedBytes;
+}
@@ -0,0 +1,193 @@
+#include "rawFlash.h"
+
+#ifdef MEMORY_RAW_FLASH_HISTORY_LOG
+
+#ifndef RAW_FLASH_SIMULATOR
+#include <flash_hal.h>
+extern "C"
+{
+    #include <spi_flash.h>
+}
+#endif
+
+#define RAW_FLASH_BUFFER_SIZE           256     // Number of bytes that are read or written at once (aligned buffer on the stack)
+
+bool rawFlash_isAvailable = false;              // The region doesn't overlap the sketch, the OTA update area or the file system
+
+#ifdef RAW_FLASH_SIMULATOR
+uint8_t rawFlash_simulatorMemory[RAW_FLASH_SIZE];                       // Content of the simulated region
+uint32_t rawFlash_simulatorEraseCount[RAW_FLASH_NUMBER_SECTORS];        // Number of erase cycles of each simulated sector
+int32_t rawFlash_simulatorWriteLimit = -1;                              // Number of bytes that are still written before the simulated power loss (-1 = no limit)
+bool rawFlash_simulatorIsErased = false;                                // The simulated region was erased once (like a new flash chip)
+#endif
+
+/**
+ * Read words from the region. The address and the length must be multiples of 4.
+ */
+bool rawFlash_readWords(uint32_t address, uint32_t* buffer, size_t length)
+{
+#ifdef RAW_FLASH_SIMULATOR
+    memcpy(buffer, &rawFlash_simulatorMemory[address], length);
+    return true;
+#else
+    return spi_flash_read(RAW_FLASH_START_ADDRESS + address, buffer, length) == SPI_FLASH_RESULT_OK;
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Write words to the region. The address and the length must be multiples of 4.
+ */
+bool rawFlash_writeWords(uint32_t address, const uint32_t* data, size_t length)
+{
+#ifdef RAW_FLASH_SIMULATOR
+    const uint8_t* bytes = (const uint8_t*)data;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(rawFlash_simulatorWriteLimit == 0)
+        {
+            return false;       // power loss
+        }
+        if(rawFlash_simulatorWriteLimit > 0)
+        {
+            rawFlash_simulatorWriteLimit--;
+        }
+        rawFlash_simulatorMemory[address + i] &= bytes[i];      // bits can only be cleared
+    }
+    return true;
+#else
+    return spi_flash_write(RAW_FLASH_START_ADDRESS + address, (uint32_t*)data, length) == SPI_FLASH_RESULT_OK;
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool rawFlash_begin()
+{
+#ifdef RAW_FLASH_SIMULATOR
+    if(!rawFlash_simulatorIsErased)
+    {
+        rawFlash_simulatorReset();
+    }
+    rawFlash_isAvailable = true;
+#else
+    // OTA updates are staged directly in front of the file system, so a sketch size must be left free between the region and the file system
+    uint32_t sketchEnd = (ESP.getSketchSize() + RAW_FLASH_SECTOR_SIZE - 1) & ~(uint32_t)(RAW_FLASH_SECTOR_SIZE - 1);
+    rawFlash_isAvailable = (RAW_FLASH_START_ADDRESS >= sketchEnd) && (RAW_FLASH_START_ADDRESS + RAW_FLASH_SIZE + sketchEnd <= FS_PHYS_ADDR);
+    #ifdef DEBUG_OUTPUT
+        if(!rawFlash_isAvailable)
+        {
+            Serial.printf("Raw flash region 0x%06X..0x%06X overlaps the sketch, the OTA update area or the file system. The history can't be saved.\n", RAW_FLASH_START_ADDRESS, (uint32_t)(RAW_FLASH_START_ADDRESS + RAW_FLASH_SIZE));
+        }
+    #endif
+#endif
+    return rawFlash_isAvailable;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool rawFlash_read(uint32_t address, uint8_t* buffer, size_t length)
+{
+    if(!rawFlash_isAvailable || address + length > RAW_FLASH_SIZE)
+    {
+        return false;
+    }
+
+    uint32_t words[RAW_FLASH_BUFFER_SIZE / sizeof(uint32_t)];
+    while(length > 0)
+    {
+        uint32_t alignedAddress = address & ~(uint32_t)3;
+        uint32_t offset = address - alignedAddress;
+        size_t chunkLength = min(length, (size_t)(RAW_FLASH_BUFFER_SIZE - offset));
+        size_t alignedLength = (offset + chunkLength + 3) & ~(size_t)3;
+        if(!rawFlash_readWords(alignedAddress, words, alignedLength))
+        {
+            return false;
+        }
+        memcpy(buffer, (uint8_t*)words + offset, chunkLength);
+        buffer += chunkLength;
+        address += chunkLength;
+        length -= chunkLength;
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool rawFlash_write(uint32_t address, const uint8_t* data, size_t length)
+{
+    if(!rawFlash_isAvailable || address + length > RAW_FLASH_SIZE)
+    {
+        return false;
+    }
+
+    // The bytes in front of and behind the data inside the aligned words are written as 0xFF, so they aren't changed
+    uint32_t words[RAW_FLASH_BUFFER_SIZE / sizeof(uint32_t)];
+    while(length > 0)
+    {
+        uint32_t alignedAddress = address & ~(uint32_t)3;
+        uint32_t offset = address - alignedAddress;
+        size_t chunkLength = min(length, (size_t)(RAW_FLASH_BUFFER_SIZE - offset));
+        size_t alignedLength = (offset + chunkLength + 3) & ~(size_t)3;
+        memset(words, 0xFF, alignedLength);
+        memcpy((uint8_t*)words + offset, data, chunkLength);
+        if(!rawFlash_writeWords(alignedAddress, words, alignedLength))
+        {
+            return false;
+        }
+        data += chunkLength;
+        address += chunkLength;
+        length -= chunkLength;
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool rawFlash_eraseSector(uint16_t sector)
+{
+    if(!rawFlash_isAvailable || sector >= RAW_FLASH_NUMBER_SECTORS)
+    {
+        return false;
+    }
+#ifdef RAW_FLASH_SIMULATOR
+    if(rawFlash_simulatorWriteLimit == 0)
+    {
+        return false;       // power loss
+    }
+    memset(&rawFlash_simulatorMemory[sector * RAW_FLASH_SECTOR_SIZE], 0xFF, RAW_FLASH_SECTOR_SIZE);
+    rawFlash_simulatorEraseCount[sector]++;
+    return true;
+#else
+    return spi_flash_erase_sector(RAW_FLASH_START_ADDRESS / RAW_FLASH_SECTOR_SIZE + sector) == SPI_FLASH_RESULT_OK;
+#endif
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#ifdef RAW_FLASH_SIMULATOR
+void rawFlash_simulatorReset()
+{
+    memset(rawFlash_simulatorMemory, 0xFF, RAW_FLASH_SIZE);
+    memset(rawFlash_simulatorEraseCount, 0, sizeof(rawFlash_simulatorEraseCount));
+    rawFlash_simulatorWriteLimit = -1;
+    rawFlash_simulatorIsErased = true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint32_t rawFlash_simulatorGetEraseCount(uint16_t sector)
+{
+    return (sector < RAW_FLASH_NUMBER_SECTORS) ? rawFlash_simulatorEraseCount[sector] : 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void rawFlash_simulatorSetWriteLimit(int32_t numberBytes)
+{
+    rawFlash_simulatorWriteLimit = numberBytes;
+}
+#endif
+
+#endif
@@ -6,6 +6,7 @@ bool isTimeValid = false;
 // https://www.weigu.lu/microcontroller/tips_tricks/esp_NTP_tips_tricks/index.html
 void time_is_set(bool from_sntp) 
 {  
+    (void)from_sntp;        // the time is also valid if it was set otherwise
     isTimeValid = true;
 }
 
@@ -23,6 +24,7 @@ void timeHandling_init()
 
 void timeHandling_printSerial(time_t time)
 {
+    (void)time;             // only used with DEBUG_OUTPUT
     #ifdef DEBUG_OUTPUT
         tm tm;                            // the structure tm holds time information in a more convenient way
         localtime_r(&time, &tm);          // update the structure tm with the current time
@@ -0,0 +1,81 @@
+#include "nativeTest.h"
+#include "utils.h"
+
+/*
+ * Compares the nibble table CRC32 (utils_calculateCRC32()) with the former bitwise calculation.
+ * Both must return the same checksums, because the CRCs of the existing files (system config, history segments) are checked with it.
+ */
+
+#define BENCHMARK_CRC32_BUFFER_SIZE     (1024 * 1024)
+#define BENCHMARK_CRC32_NUMBER_ROUNDS   20
+
+uint8_t benchmarkCrc32_buffer[BENCHMARK_CRC32_BUFFER_SIZE];
+
+/**
+ * Former bitwise CRC32 calculation (MSB first, polynomial 0x04C11DB7, no final XOR).
+ */
+uint32_t benchmarkCrc32_calculateBitwise(const uint8_t* data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while(length--)
+    {
+        uint8_t c = *data++;
+        for(uint8_t i = 0; i < 8; i++)
+        {
+            bool bit = crc & 0x80000000;
+            if(c & 0x80)
+            {
+                bit = !bit;
+            }
+            crc <<= 1;
+            c <<= 1;
+            if(bit)
+            {
+                crc ^= 0x04C11DB7;
+            }
+        }
+    }
+    return crc;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Measure the throughput of a CRC32 calculation over the whole buffer.
+ */
+void benchmarkCrc32_measure(const char* name, uint32_t (*calculateCRC32)(const uint8_t*, size_t))
+{
+    volatile uint32_t crc = 0;
+    uint64_t startMicros = nativeTest_getHostMicros();
+    for(uint8_t i = 0; i < BENCHMARK_CRC32_NUMBER_ROUNDS; i++)
+    {
+        crc = crc ^ calculateCRC32(benchmarkCrc32_buffer, sizeof(benchmarkCrc32_buffer));
+    }
+    uint64_t durationMicros = max(nativeTest_getHostMicros() - startMicros, (uint64_t)1);
+    printf("%-10s %8.1f MB/s\n", name, (double)BENCHMARK_CRC32_NUMBER_ROUNDS * sizeof(benchmarkCrc32_buffer) / durationMicros);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void benchmarkCrc32_run()
+{
+    srand(1);
+    for(size_t i = 0; i < sizeof(benchmarkCrc32_buffer); i++)
+    {
+        benchmarkCrc32_buffer[i] = rand();
+    }
+
+    // Same checksums for random ranges, also if the calculation is continued with utils_updateCRC32()
+    for(uint16_t i = 0; i < 10000; i++)
+    {
+        const uint8_t* data = benchmarkCrc32_buffer + rand() % 1000;
+        size_t length = rand() % 3000;
+        size_t splitLength = rand() % (length + 1);
+        uint32_t expectedCrc = benchmarkCrc32_calculateBitwise(data, length);
+        CHECK(utils_calculateCRC32(data, length) == expectedCrc);
+        CHECK(utils_updateCRC32(utils_calculateCRC32(data, splitLength), data + splitLength, length - splitLength) == expectedCrc);
+    }
+
+    benchmarkCrc32_measure("bitwise", benchmarkCrc32_calculateBitwise);
+    benchmarkCrc32_measure("nibble", utils_calculateCRC32);
+}
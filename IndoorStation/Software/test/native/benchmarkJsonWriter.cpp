@@ -0,0 +1,136 @@
+#include "nativeTest.h"
+#include "jsonWriter.h"
+#include "battery.h"
+#include <string>
+#include <vector>
+
+/*
+ * Compares the JSON writer with the former way to stream /get_data: each record was measured and then serialized with a float battery level,
+ * and a record that didn't fit into the rest of the buffer was serialized again in the next buffer (here with snprintf() instead of ArduinoJson).
+ * The records are streamed into buffers of the size of a TCP segment like by a chunked response.
+ */
+
+#define BENCHMARK_JSON_WRITER_NUMBER_RECORDS    200000
+#define BENCHMARK_JSON_WRITER_BUFFER_SIZE       1460
+#define BENCHMARK_JSON_WRITER_NUMBER_ROUNDS     3
+
+typedef struct benchmark_json_writer_record
+{
+    uint32_t timestamp;
+    uint8_t pinState;
+    uint16_t batteryVoltage_mV;
+} benchmark_json_writer_record_t;
+
+std::vector<benchmark_json_writer_record_t> benchmarkJsonWriter_records;
+volatile size_t benchmarkJsonWriter_sink;           // Keeps the compiler from removing the formatting
+
+/**
+ * Stream all records with snprintf() (former way). Only complete records are written into a buffer.
+ * @return Total number of bytes.
+ */
+size_t benchmarkJsonWriter_streamBaseline()
+{
+    uint8_t buffer[BENCHMARK_JSON_WRITER_BUFFER_SIZE];
+    size_t totalLength = 0;
+    size_t recordNumber = 0;
+    while(recordNumber < benchmarkJsonWriter_records.size())
+    {
+        size_t length = 0;
+        while(recordNumber < benchmarkJsonWriter_records.size())
+        {
+            const benchmark_json_writer_record_t& record = benchmarkJsonWriter_records[recordNumber];
+            float batteryPercent = battery_voltageToPercent(record.batteryVoltage_mV);
+            int recordLength = snprintf(NULL, 0, "{\"time\":%u,\"pin\":%u,\"batP\":%g}", record.timestamp, record.pinState, batteryPercent);
+            if(length + recordLength >= sizeof(buffer))
+            {
+                break;
+            }
+            length += snprintf((char*)buffer + length, sizeof(buffer) - length, "{\"time\":%u,\"pin\":%u,\"batP\":%g}", record.timestamp, record.pinState, batteryPercent);
+            recordNumber++;
+        }
+        totalLength += length;
+    }
+    return totalLength;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Stream all records with the JSON writer like main_readGetDataStream().
+ * @param bufferSize Size of the buffers (<= BENCHMARK_JSON_WRITER_BUFFER_SIZE).
+ * @param output If not NULL, all streamed bytes are appended.
+ * @return Total number of bytes.
+ */
+size_t benchmarkJsonWriter_streamWriter(size_t bufferSize, std::string* output)
+{
+    uint8_t buffer[BENCHMARK_JSON_WRITER_BUFFER_SIZE];
+    size_t totalLength = 0;
+    size_t recordNumber = 0;
+    bool isEnd = false;
+    json_writer_t writer;
+    jsonWriter_begin(writer, JSON_WRITER_FORMAT_ARRAY);
+    while(!isEnd)
+    {
+        size_t length = jsonWriter_read(writer, buffer, bufferSize);
+        while(length < bufferSize && !jsonWriter_hasPendingData(writer))
+        {
+            if(recordNumber >= benchmarkJsonWriter_records.size())
+            {
+                length += jsonWriter_end(writer, buffer + length, bufferSize - length);
+                isEnd = !jsonWriter_hasPendingData(writer);
+                break;
+            }
+            const benchmark_json_writer_record_t& record = benchmarkJsonWriter_records[recordNumber++];
+            jsonWriter_beginRecord(writer, buffer + length, bufferSize - length);
+            jsonWriter_addUInt(writer, "time", record.timestamp);
+            jsonWriter_addUInt(writer, "pin", record.pinState);
+            jsonWriter_addFixed(writer, "batP", battery_voltageToScaledPercent(record.batteryVoltage_mV, 2), 2);
+            length += jsonWriter_endRecord(writer);
+        }
+        if(output != NULL)
+        {
+            output->append((const char*)buffer, length);
+        }
+        totalLength += length;
+    }
+    return totalLength;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void benchmarkJsonWriter_run()
+{
+    benchmarkJsonWriter_records.clear();
+    for(uint32_t i = 0; i < BENCHMARK_JSON_WRITER_NUMBER_RECORDS; i++)
+    {
+        benchmark_json_writer_record_t record = { 1700000000 + i * 30, (uint8_t)(i % 2), (uint16_t)(2900 + (i * 7) % 1400) };
+        benchmarkJsonWriter_records.push_back(record);
+    }
+
+    // Records that are continued in the next buffer give the same response as records formatted directly into the buffer
+    std::string output;
+    std::string outputSmallBuffers;
+    benchmarkJsonWriter_streamWriter(BENCHMARK_JSON_WRITER_BUFFER_SIZE, &output);
+    benchmarkJsonWriter_streamWriter(37, &outputSmallBuffers);
+    CHECK(output == outputSmallBuffers);
+    CHECK(output.size() > 2 && output.front() == '[' && output.back() == ']');
+    char expectedStart[64];
+    uint32_t scaledPercent = battery_voltageToScaledPercent(benchmarkJsonWriter_records[0].batteryVoltage_mV, 2);
+    snprintf(expectedStart, sizeof(expectedStart), "[{\"time\":1700000000,\"pin\":0,\"batP\":%u.%02u},", scaledPercent / 100, scaledPercent % 100);
+    CHECK(output.compare(0, strlen(expectedStart), expectedStart) == 0);
+
+    for(uint8_t round = 0; round < BENCHMARK_JSON_WRITER_NUMBER_ROUNDS; round++)
+    {
+        uint64_t startMicros = nativeTest_getHostMicros();
+        size_t baselineLength = benchmarkJsonWriter_streamBaseline();
+        uint64_t baselineMicros = max(nativeTest_getHostMicros() - startMicros, (uint64_t)1);
+        startMicros = nativeTest_getHostMicros();
+        size_t writerLength = benchmarkJsonWriter_streamWriter(BENCHMARK_JSON_WRITER_BUFFER_SIZE, NULL);
+        uint64_t writerMicros = max(nativeTest_getHostMicros() - startMicros, (uint64_t)1);
+        benchmarkJsonWriter_sink = baselineLength + writerLength;
+        printf("snprintf %.0f records/s (%zu bytes), writer %.0f records/s (%zu bytes), x%.1f\n",
+               BENCHMARK_JSON_WRITER_NUMBER_RECORDS * 1e6 / baselineMicros, baselineLength,
+               BENCHMARK_JSON_WRITER_NUMBER_RECORDS * 1e6 / writerMicros, writerLength,
+               (double)baselineMicros / writerMicros);
+    }
+}
@@ -0,0 +1,82 @@
+#include "nativeTest.h"
+#include <FS.h>
+#include <LittleFS.h>
+#include <sys/time.h>
+
+/*
+ * Entry point of the native builds (see Info.txt). It runs all tests that are built into the configuration and the benchmarks if NATIVE_BENCHMARK is set.
+ */
+
+uint32_t nativeTest_numberFailedChecks = 0;
+
+message_sensor_timestamped_t nativeTest_createMessage(time_t timestamp, uint32_t number)
+{
+    message_sensor_timestamped_t message;
+    memset(&message, 0, sizeof(message));
+    message.timestamp = timestamp;
+    message.msg.pinState = (number % 2) == 1;
+    message.msg.batteryVoltage_mV = 4000 - (number % 50);
+    message.msg.numberSendLoops = ((number % 3) == 0) ? 2 : 1;
+    message.msg.sensor_sw_version = 0x11;
+    return message;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool nativeTest_isMessageEqual(const message_sensor_timestamped_t& message1, const message_sensor_timestamped_t& message2)
+{
+    return message1.timestamp == message2.timestamp &&
+           message1.msg.pinState == message2.msg.pinState &&
+           message1.msg.batteryVoltage_mV == message2.msg.batteryVoltage_mV &&
+           message1.msg.numberSendLoops == message2.msg.numberSendLoops &&
+           message1.msg.sensor_sw_version == message2.msg.sensor_sw_version;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void nativeTest_formatFs()
+{
+    LittleFS.begin();
+    LittleFS.format();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+uint64_t nativeTest_getHostMicros()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+int main()
+{
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    #ifdef RAW_FLASH_SIMULATOR
+        printf("== testRawFlash\n");
+        testRawFlash_run();
+    #else
+        printf("== testHistoryPosix\n");
+        testHistoryPosix_run();
+    #endif
+
+    // The benchmarks take longer, they are only run on request
+    if(getenv("NATIVE_BENCHMARK") != NULL)
+    {
+        printf("== benchmarkCrc32\n");
+        benchmarkCrc32_run();
+        printf("== benchmarkJsonWriter\n");
+        benchmarkJsonWriter_run();
+    }
+
+    if(nativeTest_numberFailedChecks > 0)
+    {
+        printf("FAILED (%u failed checks)\n", nativeTest_numberFailedChecks);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NATIVE_FS_DEFAULT_DIR       ".pio/native_fs"    // Directory of the simulated file system if NATIVE_FS_DIR isn't set
+#define NATIVE_FS_TOTAL_BYTES       (1024 * 1024)       // Size of the simulated file system (like the LittleFS partition of the ESP12E)
+#define NATIVE_FS_BLOCK_SIZE        4096
+#define NATIVE_RTC_USER_MEMORY_SIZE 512
+
+unsigned long nativeShims_millis = 0;
+NativeSerial Serial;
+NativeESP ESP;
+FS LittleFS;
+
+uint8_t nativeShims_rtcUserMemory[NATIVE_RTC_USER_MEMORY_SIZE];
+
+/**
+ * Directory of the host that contains the files of the simulated file system.
+ */
+std::string nativeShims_getFsDirectory()
+{
+    const char* directory = getenv("NATIVE_FS_DIR");
+    return (directory != NULL) ? directory : NATIVE_FS_DEFAULT_DIR;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+std::string nativeShims_getHostPath(const char* path)
+{
+    return nativeShims_getFsDirectory() + "/" + ((path[0] == '/') ? (path + 1) : path);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool NativeESP::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+{
+    if(offset * 4 + size > NATIVE_RTC_USER_MEMORY_SIZE)
+    {
+        return false;
+    }
+    memcpy(data, nativeShims_rtcUserMemory + offset * 4, size);
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool NativeESP::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+{
+    if(offset * 4 + size > NATIVE_RTC_USER_MEMORY_SIZE)
+    {
+        return false;
+    }
+    memcpy(nativeShims_rtcUserMemory + offset * 4, data, size);
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+// C stdio needs a seek between reading and writing the same stream. LittleFS allows to mix them freely, so each access starts with a seek to the current position.
+size_t File::read(uint8_t* buffer, size_t length)
+{
+    if(!_file)
+    {
+        return 0;
+    }
+    fseek(_file.get(), 0, SEEK_CUR);
+    return fread(buffer, 1, length, _file.get());
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+int File::read()
+{
+    uint8_t data;
+    return (read(&data, 1) == 1) ? data : -1;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t File::write(const uint8_t* data, size_t length)
+{
+    if(!_file)
+    {
+        return 0;
+    }
+    fseek(_file.get(), 0, SEEK_CUR);
+    return fwrite(data, 1, length, _file.get());
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool File::seek(uint32_t position, SeekMode mode)
+{
+    if(!_file)
+    {
+        return false;
+    }
+    switch(mode)
+    {
+        case SeekCur: return fseek(_file.get(), (long)position, SEEK_CUR) == 0;
+        case SeekEnd: return fseek(_file.get(), -(long)position, SEEK_END) == 0;
+        default: return fseek(_file.get(), (long)position, SEEK_SET) == 0;
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t File::position() const
+{
+    return _file ? (size_t)ftell(_file.get()) : 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+size_t File::size() const
+{
+    if(!_file)
+    {
+        return 0;
+    }
+    fflush(_file.get());
+    struct stat fileStat;
+    return (fstat(fileno(_file.get()), &fileStat) == 0) ? (size_t)fileStat.st_size : 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool File::truncate(uint32_t size)
+{
+    if(!_file)
+    {
+        return false;
+    }
+    fflush(_file.get());
+    return ftruncate(fileno(_file.get()), size) == 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void File::flush()
+{
+    if(_file)
+    {
+        fflush(_file.get());
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool FS::begin()
+{
+    // Create the directory and all missing parents
+    std::string directory = nativeShims_getFsDirectory();
+    for(size_t i = 1; i <= directory.size(); i++)
+    {
+        if(i == directory.size() || directory[i] == '/')
+        {
+            ::mkdir(directory.substr(0, i).c_str(), 0755);
+        }
+    }
+    struct stat directoryStat;
+    return stat(directory.c_str(), &directoryStat) == 0 && S_ISDIR(directoryStat.st_mode);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool FS::format()
+{
+    Dir dir = openDir("/");
+    while(dir.next())
+    {
+        remove(dir.fileName().c_str());
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+File FS::open(const char* path, const char* mode)
+{
+    std::string hostMode = std::string(mode) + "b";
+    FILE* file = fopen(nativeShims_getHostPath(path).c_str(), hostMode.c_str());
+    if(file == NULL)
+    {
+        return File();
+    }
+    return File(file, path);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool FS::exists(const char* path)
+{
+    struct stat fileStat;
+    return stat(nativeShims_getHostPath(path).c_str(), &fileStat) == 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool FS::remove(const char* path)
+{
+    return ::remove(nativeShims_getHostPath(path).c_str()) == 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool FS::rename(const char* pathFrom, const char* pathTo)
+{
+    return ::rename(nativeShims_getHostPath(pathFrom).c_str(), nativeShims_getHostPath(pathTo).c_str()) == 0;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+bool FS::info(FSInfo& info)
+{
+    // Each file occupies whole blocks, 2 blocks are used by the file system itself (like LittleFS)
+    info.totalBytes = NATIVE_FS_TOTAL_BYTES;
+    info.usedBytes = 2 * NATIVE_FS_BLOCK_SIZE;
+    info.blockSize = NATIVE_FS_BLOCK_SIZE;
+    info.pageSize = 256;
+    info.maxOpenFiles = 5;
+    info.maxPathLength = 32;
+    Dir dir = openDir("/");
+    while(dir.next())
+    {
+        info.usedBytes += ((dir.fileSize() + NATIVE_FS_BLOCK_SIZE - 1) / NATIVE_FS_BLOCK_SIZE) * NATIVE_FS_BLOCK_SIZE;
+    }
+    return true;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+Dir FS::openDir(const char* path)
+{
+    (void)path;             // all files are in the root directory
+    Dir dir;
+    std::string directory = nativeShims_getFsDirectory();
+    DIR* hostDir = opendir(directory.c_str());
+    if(hostDir == NULL)
+    {
+        return dir;
+    }
+    struct dirent* entry;
+    while((entry = readdir(hostDir)) != NULL)
+    {
+        struct stat fileStat;
+        if(stat((directory + "/" + entry->d_name).c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+        {
+            dir._entries.push_back(std::make_pair(std::string(entry->d_name), (size_t)fileStat.st_size));
+        }
+    }
+    closedir(hostDir);
+    std::sort(dir._entries.begin(), dir._entries.end());
+    return dir;
+}
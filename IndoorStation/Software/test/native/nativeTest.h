@@ -0,0 +1,53 @@
+#ifndef NATIVE_TEST_H
+#define NATIVE_TEST_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "structures.h"
+
+/*
+ * Helpers for the tests and benchmarks of the native builds (see Info.txt).
+ */
+
+extern uint32_t nativeTest_numberFailedChecks;     // Number of failed CHECK()s of all tests
+
+/**
+ * Check a condition of a test. A failed check is printed and counted, the test continues.
+ */
+#define CHECK(condition) \
+    do \
+    { \
+        if(!(condition)) \
+        { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            nativeTest_numberFailedChecks++; \
+        } \
+    } while(0)
+
+/**
+ * Create a sensor message with values that depend on the message number (to detect mixed up messages).
+ */
+message_sensor_timestamped_t nativeTest_createMessage(time_t timestamp, uint32_t number);
+
+/**
+ * Compare all fields of two sensor messages.
+ */
+bool nativeTest_isMessageEqual(const message_sensor_timestamped_t& message1, const message_sensor_timestamped_t& message2);
+
+/**
+ * Delete all files of the simulated file system and mount it.
+ */
+void nativeTest_formatFs();
+
+/**
+ * Current time of the host in microseconds (for the benchmarks; millis() and micros() are simulated).
+ */
+uint64_t nativeTest_getHostMicros();
+
+// Tests and benchmarks (called by nativeMain.cpp)
+void testHistoryPosix_run();
+void testRawFlash_run();
+void benchmarkCrc32_run();
+void benchmarkJsonWriter_run();
+
+#endif
@@ -0,0 +1,12 @@
+#!/bin/bash
+# Build the backend independent history code with the native shims and run the tests (see Info.txt).
+# Usage: test/native/runNative.sh [additional compiler flags]
+set -e
+cd "$(dirname "$0")/../.."
+
+BUILD_DIR=.pio/native_build
+SOURCES="src/memory.cpp src/utils.cpp src/battery.cpp src/historyCodec.cpp src/historyRam.cpp src/historyPosix.cpp src/historyLog.cpp src/rawFlash.cpp src/jsonWriter.cpp src/timeHandling.cpp test/native/*.cpp"
+
+mkdir -p $BUILD_DIR
+g++ -std=gnu++17 -O1 -g -fsanitize=address,undefined -Wall -Wextra -I test/native/shims -I test/native -I include "$@" $SOURCES -o $BUILD_DIR/nativeMain
+NATIVE_FS_DIR=${NATIVE_FS_DIR:-.pio/native_fs} $BUILD_DIR/nativeMain
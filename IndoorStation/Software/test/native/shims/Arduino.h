@@ -0,0 +1,105 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+/*
+ * Minimal replacement of the ESP8266 Arduino core for the native (Linux) builds of the history code (see test/native/Info.txt).
+ * Only the functions used by the backend independent modules are provided. millis() is simulated, so that the tests control the write buffer timeouts.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+typedef uint8_t uint8;
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW     0
+#define HIGH    1
+#define HEX     16
+#define PROGMEM
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define ICACHE_FLASH_ATTR
+#define F(x)    x
+#define PSTR(x) x
+
+using std::min;
+using std::max;
+
+extern unsigned long nativeShims_millis;        // Value returned by millis(). It is only advanced by the tests (nativeShims_advanceMillis()).
+
+inline unsigned long millis() { return nativeShims_millis; }
+inline unsigned long micros() { return nativeShims_millis * 1000; }
+inline void delay(unsigned long ms) { nativeShims_millis += ms; }
+inline void yield() {}
+
+/**
+ * Advance the simulated millis().
+ */
+inline void nativeShims_advanceMillis(unsigned long ms) { nativeShims_millis += ms; }
+
+inline long random(long howBig) { return (howBig > 0) ? (rand() % howBig) : 0; }
+inline long random(long howSmall, long howBig) { return (howBig > howSmall) ? (howSmall + rand() % (howBig - howSmall)) : howSmall; }
+inline void randomSeed(unsigned long seed) { srand(seed); }
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) { return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin; }
+
+// NTP functions of the ESP8266 core (used by timeHandling.cpp)
+inline void configTime(const char*, const char*) {}
+inline void settimeofday_cb(void (*)(bool)) {}
+
+/**
+ * Arduino String (only what the history code needs).
+ */
+class String : public std::string
+{
+public:
+    String() {}
+    String(const char* str) : std::string(str != NULL ? str : "") {}
+    String(const std::string& str) : std::string(str) {}
+    unsigned int length() const { return (unsigned int)size(); }
+};
+
+/**
+ * Serial output. Everything is written to stdout.
+ */
+class NativeSerial
+{
+public:
+    void begin(unsigned long) {}
+    void print(const char* str) { fputs(str, stdout); }
+    void print(const String& str) { fputs(str.c_str(), stdout); }
+    void print(long value) { printf("%ld", value); }
+    void print(unsigned long value) { printf("%lu", value); }
+    void print(int value) { printf("%d", value); }
+    void print(unsigned int value) { printf("%u", value); }
+    void print(double value) { printf("%.2f", value); }
+    template<typename T> void println(T value) { print(value); putchar('\n'); }
+    void println() { putchar('\n'); }
+    template<typename... Args> void printf(const char* format, Args... args) { ::printf(format, args...); }
+};
+extern NativeSerial Serial;
+
+/**
+ * ESP class of the ESP8266 core. The RTC user memory is simulated in RAM (it survives memory_end() / memory_init() like a reset).
+ */
+class NativeESP
+{
+public:
+    uint32_t getFreeHeap() { return 40 * 1024; }
+    uint32_t getMaxFreeBlockSize() { return 20 * 1024; }
+    uint32_t getCycleCount() { return (uint32_t)clock(); }
+    uint32_t getSketchSize() { return 512 * 1024; }
+    uint32_t getChipId() { return 0x00C0FFEE; }
+    void restart() {}
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+};
+extern NativeESP ESP;
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+/*
+ * File system of the ESP8266 core for the native builds. The files are saved in a directory of the host (NATIVE_FS_DIR environment variable, default .pio/native_fs).
+ * Like with LittleFS, copies of a File share the same open file.
+ */
+#include "Arduino.h"
+#include <memory>
+#include <vector>
+
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+struct FSInfo
+{
+    size_t totalBytes;
+    size_t usedBytes;
+    size_t blockSize;
+    size_t pageSize;
+    size_t maxOpenFiles;
+    size_t maxPathLength;
+};
+
+class File
+{
+public:
+    File() {}
+    File(FILE* file, const char* path) : _file(file, fclose), _path(path) {}
+
+    operator bool() const { return (bool)_file; }
+    size_t read(uint8_t* buffer, size_t length);
+    int read();
+    size_t write(const uint8_t* data, size_t length);
+    size_t write(uint8_t data) { return write(&data, 1); }
+    bool seek(uint32_t position, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    int available() { return (int)(size() - position()); }
+    bool truncate(uint32_t size);
+    void flush();
+    void close() { _file.reset(); }
+    const char* name() const { return _path.c_str(); }
+
+private:
+    std::shared_ptr<FILE> _file;
+    std::string _path;
+};
+
+class Dir
+{
+public:
+    bool next() { return ++_index < (int)_entries.size(); }
+    String fileName() const { return String(_entries[_index].first); }
+    size_t fileSize() const { return _entries[_index].second; }
+    bool isFile() const { return true; }
+
+private:
+    friend class FS;
+    std::vector<std::pair<std::string, size_t>> _entries;     // Name and size of the files (sorted by name)
+    int _index = -1;
+};
+
+class FS
+{
+public:
+    bool begin();
+    void end() {}
+    bool format();
+    File open(const char* path, const char* mode);
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* pathFrom, const char* pathTo);
+    bool info(FSInfo& info);
+    Dir openDir(const char* path);
+};
+
+/**
+ * Path on the host for a path of the simulated file system (e.g. "/dataSensor0.idx").
+ */
+std::string nativeShims_getHostPath(const char* path);
+
+#endif
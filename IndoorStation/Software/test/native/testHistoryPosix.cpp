@@ -0,0 +1,384 @@
+#include "nativeTest.h"
+#include "memory.h"
+#include "historyBackend.h"
+#include "historyRam.h"
+#include "historyPosix.h"
+#include <FS.h>
+#include <LittleFS.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+/*
+ * Runs the backend independent history code (memory.cpp) with the POSIX backend and compares all reads with the appended messages.
+ * The RAM backend and the segments backend are checked with the same sequence, so that a difference between the backends shows up here.
+ */
+
+#define TEST_HISTORY_POSIX_NUMBER_SENSORS   3
+
+std::vector<message_sensor_timestamped_t> testHistoryPosix_expected[NUM_SUPPORTED_SENSORS];    // All messages that were appended to each sensor (oldest first)
+time_t testHistoryPosix_time = 1700000000;                                                      // Timestamp of the last created message
+
+/**
+ * Append a new message to the history of the sensor and to the expected messages.
+ */
+void testHistoryPosix_add(uint8_t sensorIndex, uint32_t number)
+{
+    testHistoryPosix_time += 30;
+    message_sensor_timestamped_t message = nativeTest_createMessage(testHistoryPosix_time, number);
+    CHECK(memory_addSensorMessage(sensorIndex, message));
+    testHistoryPosix_expected[sensorIndex].push_back(message);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Clear the expected messages of all sensors (after the history was removed).
+ */
+void testHistoryPosix_clearExpected()
+{
+    for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        testHistoryPosix_expected[i].clear();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check all read paths of the history of the sensor against the expected messages.
+ * @param numberDropped Number of the oldest expected messages that the backend doesn't keep (RAM backend).
+ */
+void testHistoryPosix_check(uint8_t sensorIndex, size_t numberDropped)
+{
+    std::vector<message_sensor_timestamped_t>& expected = testHistoryPosix_expected[sensorIndex];
+    size_t numberKept = expected.size() - numberDropped;
+    memory_history_reader_t reader;
+    message_sensor_timestamped_t message;
+
+    // Forward
+    size_t number = 0;
+    memory_openHistoryReader(reader, sensorIndex, 0);
+    while(memory_readHistoryMessage(reader, message))
+    {
+        CHECK(number < numberKept && nativeTest_isMessageEqual(message, expected[numberDropped + number]));
+        number++;
+    }
+    memory_closeHistoryReader(reader);
+    CHECK(number == numberKept);
+
+    // Backward
+    number = 0;
+    memory_openHistoryReaderReverse(reader, sensorIndex, INT32_MAX);
+    while(memory_readPreviousHistoryMessage(reader, message))
+    {
+        CHECK(number < numberKept && nativeTest_isMessageEqual(message, expected[expected.size() - 1 - number]));
+        number++;
+    }
+    memory_closeHistoryReader(reader);
+    CHECK(number == numberKept);
+
+    // Seek to a message in the middle (forward and backward)
+    if(numberKept > 10)
+    {
+        size_t middle = numberDropped + numberKept / 2;
+        time_t timeFrom = expected[middle].timestamp;
+        memory_openHistoryReader(reader, sensorIndex, memory_findSensorMessagePosition(sensorIndex, timeFrom));
+        memory_seekHistoryReader(reader, timeFrom);
+        CHECK(memory_readHistoryMessage(reader, message) && nativeTest_isMessageEqual(message, expected[middle]));
+        memory_closeHistoryReader(reader);
+
+        memory_openHistoryReaderReverse(reader, sensorIndex, timeFrom);
+        CHECK(memory_readPreviousHistoryMessage(reader, message) && nativeTest_isMessageEqual(message, expected[middle]));
+        CHECK(memory_readPreviousHistoryMessage(reader, message) && nativeTest_isMessageEqual(message, expected[middle - 1]));
+        memory_closeHistoryReader(reader);
+    }
+
+    // Download in the legacy file format (only backends without an own download)
+    if(memory_getHistoryBackend()->readHistory == NULL)
+    {
+        std::vector<uint8_t> download;
+        uint8_t buffer[100];
+        size_t length;
+        memory_openHistoryReader(reader, sensorIndex, 0);
+        while((length = memory_readHistory(reader, buffer, sizeof(buffer))) > 0)
+        {
+            download.insert(download.end(), buffer, buffer + length);
+        }
+        memory_closeHistoryReader(reader);
+        CHECK(download.size() == numberKept * sizeof(message_sensor_timestamped_t));
+        for(size_t i = 0; i < numberKept && (i + 1) * sizeof(message) <= download.size(); i++)
+        {
+            memcpy(&message, &download[i * sizeof(message)], sizeof(message));
+            CHECK(nativeTest_isMessageEqual(message, expected[numberDropped + i]));
+        }
+    }
+
+    CHECK(memory_getNumberSensorMessages(sensorIndex) == numberKept);
+    if(numberKept > 0)
+    {
+        CHECK(nativeTest_isMessageEqual(memory_getLatestSensorMessagesForSensor(sensorIndex), expected.back()));
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check the histories of all sensors (nothing dropped).
+ */
+void testHistoryPosix_checkAll()
+{
+    for(uint8_t i = 0; i < TEST_HISTORY_POSIX_NUMBER_SENSORS; i++)
+    {
+        testHistoryPosix_check(i, 0);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Print the statistics of the active backend.
+ */
+void testHistoryPosix_printStats()
+{
+    history_backend_stats_t stats;
+    memory_getHistoryBackend()->getStats(stats);
+    printf("%s: appended %u, writes %u, written %u bytes, used %u bytes\n", memory_getHistoryBackend()->name, stats.numberAppendedMessages, stats.numberWrites, stats.writtenBytes, stats.usedBytes);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testHistoryPosix_testRam()
+{
+    nativeTest_formatFs();
+    memory_setHistoryBackend(&historyRam_backend);
+    memory_init();
+    testHistoryPosix_clearExpected();
+
+    for(uint32_t i = 0; i < 100; i++)
+    {
+        testHistoryPosix_add(i % TEST_HISTORY_POSIX_NUMBER_SENSORS, i);
+    }
+    testHistoryPosix_checkAll();
+
+    // Only the newest messages are kept
+    for(uint32_t i = 0; i < 1000; i++)
+    {
+        testHistoryPosix_add(i % TEST_HISTORY_POSIX_NUMBER_SENSORS, i);
+    }
+    for(uint8_t i = 0; i < TEST_HISTORY_POSIX_NUMBER_SENSORS; i++)
+    {
+        testHistoryPosix_check(i, testHistoryPosix_expected[i].size() - HISTORY_RAM_MAX_MESSAGES_PER_SENSOR);
+    }
+    testHistoryPosix_printStats();
+    CHECK(!LittleFS.exists("/dataSensor0.000") && !LittleFS.exists("/dataSensor0.idx"));
+
+    memory_removeSensorHistory(1);
+    testHistoryPosix_expected[1].clear();
+    testHistoryPosix_check(1, 0);
+    testHistoryPosix_add(1, 1);
+    testHistoryPosix_check(1, 0);
+
+    // Nothing survives a restart
+    memory_end();
+    memory_init();
+    testHistoryPosix_clearExpected();
+    testHistoryPosix_checkAll();
+    memory_end();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testHistoryPosix_testPosix()
+{
+    // The history files are saved in a subdirectory of the simulated file system, because they have the names of the legacy history files
+    std::string directory = nativeShims_getHostPath("posix");
+    char fileName[300];
+    nativeTest_formatFs();
+    mkdir(directory.c_str(), 0755);
+    for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        snprintf(fileName, sizeof(fileName), FILENAME_HISTORY_POSIX_SENSOR_FORMAT, directory.c_str(), i);
+        remove(fileName);
+    }
+    historyPosix_configure(directory.c_str(), false);
+    memory_setHistoryBackend(&historyPosix_backend);
+    memory_init();
+    testHistoryPosix_clearExpected();
+
+    for(uint32_t i = 0; i < 5000; i++)
+    {
+        testHistoryPosix_add(i % TEST_HISTORY_POSIX_NUMBER_SENSORS, i);
+        if(i % 700 == 0)
+        {
+            nativeShims_advanceMillis(MEMORY_WRITE_BUFFER_MAX_AGE_MS);
+            memory_loop();
+        }
+    }
+    testHistoryPosix_checkAll();
+
+    // An open reader continues with the appended messages
+    memory_history_reader_t reader;
+    message_sensor_timestamped_t message;
+    memory_openHistoryReader(reader, 0, memory_findSensorMessagePosition(0, testHistoryPosix_expected[0].back().timestamp));
+    while(memory_readHistoryMessage(reader, message));
+    for(uint32_t i = 0; i < 300; i++)
+    {
+        testHistoryPosix_add(i % TEST_HISTORY_POSIX_NUMBER_SENSORS, i);
+        if(i % TEST_HISTORY_POSIX_NUMBER_SENSORS == 0)
+        {
+            CHECK(memory_readHistoryMessage(reader, message) && nativeTest_isMessageEqual(message, testHistoryPosix_expected[0].back()));
+        }
+    }
+    memory_closeHistoryReader(reader);
+    testHistoryPosix_printStats();
+
+    memory_end();
+    memory_init();
+    testHistoryPosix_checkAll();
+
+    // An incomplete message at the end of a file (e.g. after a crash) is removed
+    snprintf(fileName, sizeof(fileName), FILENAME_HISTORY_POSIX_SENSOR_FORMAT, directory.c_str(), 2);
+    FILE* file = fopen(fileName, "ab");
+    fwrite("abc", 1, 3, file);
+    fclose(file);
+    memory_end();
+    memory_init();
+    testHistoryPosix_checkAll();
+
+    memory_removeSensorHistory(2);
+    testHistoryPosix_expected[2].clear();
+    testHistoryPosix_check(2, 0);
+    testHistoryPosix_add(2, 1);
+    testHistoryPosix_check(2, 0);
+    memory_end();
+    memory_init();
+    testHistoryPosix_checkAll();
+    memory_end();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testHistoryPosix_testSegments()
+{
+    // The default backend still works after switching back
+    nativeTest_formatFs();
+    memory_setHistoryBackend(&memory_segmentsHistoryBackend);
+    memory_init();
+    testHistoryPosix_clearExpected();
+    for(uint32_t i = 0; i < 3000; i++)
+    {
+        testHistoryPosix_add(i % TEST_HISTORY_POSIX_NUMBER_SENSORS, i);
+    }
+    testHistoryPosix_checkAll();
+    testHistoryPosix_printStats();
+    memory_end();
+
+    // A legacy history file is converted in the background. An incomplete message at its end is dropped.
+    nativeTest_formatFs();
+    testHistoryPosix_clearExpected();
+    char fileName[32];
+    sprintf(fileName, FILENAME_HISTORY_SENSOR_FORMAT, 1);
+    File legacyFile = LittleFS.open(fileName, "w");
+    for(uint32_t i = 0; i < 2000; i++)
+    {
+        testHistoryPosix_time += 30;
+        message_sensor_timestamped_t message = nativeTest_createMessage(testHistoryPosix_time, i);
+        legacyFile.write((uint8_t*)&message, sizeof(message_sensor_timestamped_t));
+        testHistoryPosix_expected[1].push_back(message);
+    }
+    legacyFile.write((uint8_t*)"abc", 3);
+    legacyFile.close();
+    memory_init();
+    CHECK(nativeTest_isMessageEqual(memory_getLatestSensorMessagesForSensor(1), testHistoryPosix_expected[1].back()));
+
+    // A conversion that is interrupted by a restart is started again
+    for(uint8_t i = 0; i < 5; i++)
+    {
+        nativeShims_advanceMillis(MEMORY_LEGACY_CONVERSION_STEP_INTERVAL_MS);
+        memory_loop();
+    }
+    memory_end();
+    memory_init();
+
+    // Messages received during the conversion follow the messages of the legacy file
+    for(uint32_t i = 0; i < 100 && LittleFS.exists(fileName); i++)
+    {
+        testHistoryPosix_add(1, i);
+        CHECK(nativeTest_isMessageEqual(memory_getLatestSensorMessagesForSensor(1), testHistoryPosix_expected[1].back()));
+        nativeShims_advanceMillis(MEMORY_LEGACY_CONVERSION_STEP_INTERVAL_MS);
+        memory_loop();
+    }
+    for(uint32_t i = 0; i < 1000 && LittleFS.exists(fileName); i++)
+    {
+        nativeShims_advanceMillis(MEMORY_LEGACY_CONVERSION_STEP_INTERVAL_MS);
+        memory_loop();
+    }
+    CHECK(!LittleFS.exists(fileName));
+    testHistoryPosix_checkAll();
+    memory_end();
+    memory_init();
+    testHistoryPosix_checkAll();
+
+    // An imported file is merged with the history by memory_loop() after its end. Duplicates of existing messages are dropped.
+    std::vector<message_sensor_timestamped_t>& expected = testHistoryPosix_expected[1];
+    std::vector<message_sensor_timestamped_t> imported;
+    for(size_t i = 0; i < 500; i++)
+    {
+        imported.push_back(expected[i]);
+        if(i % 10 != 0)
+        {
+            imported.back().timestamp += 15;
+        }
+    }
+    CHECK(memory_beginSensorHistoryImport(1));
+    CHECK(memory_importSensorHistory(1, (uint8_t*)imported.data(), imported.size() * sizeof(message_sensor_timestamped_t)));
+    CHECK(memory_endSensorHistoryImport(1));
+    CHECK(memory_getSensorHistoryImportState() == HISTORY_IMPORT_STATE_RUNNING);
+    CHECK(!memory_beginSensorHistoryImport(0));
+    for(size_t i = 0; i < imported.size(); i += 10)
+    {
+        imported[i].timestamp = 0;
+    }
+    for(size_t i = 0; i < imported.size(); i++)
+    {
+        if(imported[i].timestamp != 0)
+        {
+            expected.push_back(imported[i]);
+        }
+    }
+    std::stable_sort(expected.begin(), expected.end(), [](const message_sensor_timestamped_t& a, const message_sensor_timestamped_t& b) { return a.timestamp < b.timestamp; });
+    testHistoryPosix_add(1, 0);      // Received during the merge
+    for(uint32_t i = 0; i < 1000 && memory_getSensorHistoryImportState() == HISTORY_IMPORT_STATE_RUNNING; i++)
+    {
+        nativeShims_advanceMillis(MEMORY_IMPORT_STEP_INTERVAL_MS);
+        memory_loop();
+    }
+    CHECK(memory_getSensorHistoryImportState() == HISTORY_IMPORT_STATE_SUCCEEDED);
+    testHistoryPosix_checkAll();
+
+    // The rollups are recalculated from the merged history
+    memory_rollup_reader_t rollupReader;
+    history_rollup_entry_t entry;
+    size_t numberRollupMessages = 0;
+    memory_openRollupReader(rollupReader, 1, ROLLUP_RESOLUTION_HOUR, 0);
+    while(memory_readRollupEntry(rollupReader, entry))
+    {
+        numberRollupMessages += entry.numberOpen + entry.numberClosed;
+    }
+    memory_closeRollupReader(rollupReader);
+    CHECK(numberRollupMessages == expected.size());
+    memory_end();
+    memory_init();
+    testHistoryPosix_checkAll();
+    memory_end();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testHistoryPosix_run()
+{
+    testHistoryPosix_testRam();
+    testHistoryPosix_testPosix();
+    testHistoryPosix_testSegments();
+}
@@ -0,0 +1,306 @@
+#include "nativeTest.h"
+#include "memory.h"
+#include "historyLog.h"
+#include "rawFlash.h"
+#include <FS.h>
+#include <LittleFS.h>
+#include <vector>
+
+#ifdef RAW_FLASH_SIMULATOR
+
+/*
+ * Runs the unified history log on the simulated raw flash region (MEMORY_RAW_FLASH_HISTORY_LOG and RAW_FLASH_SIMULATOR).
+ * The power loss is simulated with rawFlash_simulatorSetWriteLimit(): the write limit is hit in the middle of a record, then the memory module is initialized again without memory_end() (like after a reset).
+ * The surviving history must be a prefix of the appended messages.
+ */
+
+#define TEST_RAW_FLASH_NUMBER_SENSORS   3
+
+std::vector<message_sensor_timestamped_t> testRawFlash_expected[NUM_SUPPORTED_SENSORS];    // All messages that were appended to each sensor (oldest first). Messages that are lost or deleted are removed.
+time_t testRawFlash_time = 1700000000;                                                      // Timestamp of the last created message
+
+/**
+ * Append a new message to the history of the sensor and to the expected messages.
+ */
+void testRawFlash_add(uint8_t sensorIndex, uint32_t number)
+{
+    testRawFlash_time += 30;
+    message_sensor_timestamped_t message = nativeTest_createMessage(testRawFlash_time, number);
+    CHECK(memory_addSensorMessage(sensorIndex, message));
+    testRawFlash_expected[sensorIndex].push_back(message);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Read all messages of the sensor from the oldest to the newest one.
+ */
+std::vector<message_sensor_timestamped_t> testRawFlash_readAll(uint8_t sensorIndex)
+{
+    std::vector<message_sensor_timestamped_t> messages;
+    memory_history_reader_t reader;
+    message_sensor_timestamped_t message;
+    memory_openHistoryReader(reader, sensorIndex, 0);
+    while(memory_readHistoryMessage(reader, message))
+    {
+        messages.push_back(message);
+    }
+    memory_closeHistoryReader(reader);
+    return messages;
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Check the history of the sensor against the expected messages (forward and backward). The oldest messages may be missing (deleted log segments).
+ * The expected messages that were deleted are removed.
+ */
+void testRawFlash_check(uint8_t sensorIndex)
+{
+    std::vector<message_sensor_timestamped_t>& expected = testRawFlash_expected[sensorIndex];
+    std::vector<message_sensor_timestamped_t> messages = testRawFlash_readAll(sensorIndex);
+    size_t numberDeleted = 0;
+    if(!messages.empty())
+    {
+        numberDeleted = expected.size() - min(expected.size(), messages.size());
+        while(numberDeleted < expected.size() && !nativeTest_isMessageEqual(expected[numberDeleted], messages[0]))
+        {
+            numberDeleted++;
+        }
+    }
+    expected.erase(expected.begin(), expected.begin() + numberDeleted);
+    CHECK(messages.size() == expected.size());
+    for(size_t i = 0; i < messages.size() && i < expected.size(); i++)
+    {
+        CHECK(nativeTest_isMessageEqual(messages[i], expected[i]));
+    }
+    CHECK(memory_getNumberSensorMessages(sensorIndex) == messages.size());
+
+    size_t number = 0;
+    memory_history_reader_t reader;
+    message_sensor_timestamped_t message;
+    memory_openHistoryReaderReverse(reader, sensorIndex, INT32_MAX);
+    while(memory_readPreviousHistoryMessage(reader, message))
+    {
+        CHECK(number < expected.size() && nativeTest_isMessageEqual(message, expected[expected.size() - 1 - number]));
+        number++;
+    }
+    memory_closeHistoryReader(reader);
+    CHECK(number == expected.size());
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_checkAll()
+{
+    for(uint8_t i = 0; i < TEST_RAW_FLASH_NUMBER_SENSORS; i++)
+    {
+        testRawFlash_check(i);
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+/**
+ * Initialize the memory module after a simulated power loss (without memory_end()).
+ */
+void testRawFlash_powerLossRestart()
+{
+    rawFlash_simulatorSetWriteLimit(-1);
+    memory_init();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_testAppendAndRemount()
+{
+    for(uint32_t i = 0; i < 3000; i++)
+    {
+        testRawFlash_add((i % 7 == 0) ? 2 : ((i % 3 == 0) ? 1 : 0), i);
+        if(i % 500 == 0)
+        {
+            nativeShims_advanceMillis(MEMORY_WRITE_BUFFER_MAX_AGE_MS);
+            memory_loop();
+        }
+    }
+    testRawFlash_checkAll();
+    CHECK(!LittleFS.exists("/dataLog.000") && LittleFS.exists("/dataLogSensor0.idx"));
+
+    memory_end();
+    memory_init();
+    testRawFlash_checkAll();
+
+    // The reader of all sensors returns the messages in the order in which they were appended
+    size_t number[NUM_SUPPORTED_SENSORS] = { 0 };
+    memory_history_reader_t reader;
+    message_sensor_timestamped_t message;
+    uint8_t sensorIndex;
+    memory_openAllSensorsHistoryReader(reader, 0);
+    while(memory_readAllSensorsHistoryMessage(reader, sensorIndex, message))
+    {
+        CHECK(sensorIndex < TEST_RAW_FLASH_NUMBER_SENSORS && number[sensorIndex] < testRawFlash_expected[sensorIndex].size());
+        if(sensorIndex < TEST_RAW_FLASH_NUMBER_SENSORS && number[sensorIndex] < testRawFlash_expected[sensorIndex].size())
+        {
+            CHECK(nativeTest_isMessageEqual(message, testRawFlash_expected[sensorIndex][number[sensorIndex]++]));
+        }
+    }
+    memory_closeHistoryReader(reader);
+    for(uint8_t i = 0; i < TEST_RAW_FLASH_NUMBER_SENSORS; i++)
+    {
+        CHECK(number[i] == testRawFlash_expected[i].size());
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_testPowerLossInRecord()
+{
+    // The write limit hits a different byte of the written records in each round
+    for(uint32_t round = 0; round < 60; round++)
+    {
+        size_t numberBefore[NUM_SUPPORTED_SENSORS];
+        for(uint8_t i = 0; i < TEST_RAW_FLASH_NUMBER_SENSORS; i++)
+        {
+            numberBefore[i] = testRawFlash_expected[i].size();
+        }
+        for(uint32_t i = 0; i < 25; i++)
+        {
+            testRawFlash_add(i % TEST_RAW_FLASH_NUMBER_SENSORS, i + round);
+        }
+        rawFlash_simulatorSetWriteLimit(round * 7 + 1);
+        memory_flushSensorHistory(-1);
+        testRawFlash_powerLossRestart();
+
+        // Only the messages that weren't written completely are lost. The messages written before the power loss survive.
+        for(uint8_t i = 0; i < TEST_RAW_FLASH_NUMBER_SENSORS; i++)
+        {
+            std::vector<message_sensor_timestamped_t> messages = testRawFlash_readAll(i);
+            CHECK(messages.size() >= numberBefore[i] && messages.size() <= testRawFlash_expected[i].size());
+            for(size_t j = 0; j < messages.size() && j < testRawFlash_expected[i].size(); j++)
+            {
+                CHECK(nativeTest_isMessageEqual(messages[j], testRawFlash_expected[i][j]));
+            }
+            testRawFlash_expected[i].resize(min(messages.size(), testRawFlash_expected[i].size()));
+        }
+        testRawFlash_checkAll();
+
+        // The log continues behind the damaged record (also after a remount)
+        testRawFlash_add(0, 1);
+        testRawFlash_add(1, 2);
+        testRawFlash_add(2, 3);
+        memory_flushSensorHistory(-1);
+        testRawFlash_checkAll();
+        memory_end();
+        memory_init();
+        testRawFlash_checkAll();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_testWrapAround()
+{
+    // The region is written several times: the oldest segments are deleted and the wear is spread evenly over the sectors
+    for(uint32_t i = 0; i < 400000; i++)
+    {
+        testRawFlash_add(i % TEST_RAW_FLASH_NUMBER_SENSORS, i);
+    }
+    memory_flushSensorHistory(-1);
+    testRawFlash_checkAll();
+    memory_end();
+    memory_init();
+    testRawFlash_checkAll();
+
+    uint32_t minEraseCount = UINT32_MAX;
+    uint32_t maxEraseCount = 0;
+    for(uint16_t i = 0; i < RAW_FLASH_NUMBER_SECTORS; i++)
+    {
+        minEraseCount = min(minEraseCount, rawFlash_simulatorGetEraseCount(i));
+        maxEraseCount = max(maxEraseCount, rawFlash_simulatorGetEraseCount(i));
+    }
+    printf("erase counts: %u..%u\n", minEraseCount, maxEraseCount);
+    CHECK(minEraseCount >= 2 && maxEraseCount - minEraseCount <= 1);
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_testPowerLossInSegmentStart()
+{
+    // Power loss while the next sector is erased and the new segment is started
+    for(uint32_t round = 0; round < 30; round++)
+    {
+        rawFlash_simulatorSetWriteLimit(round * 150);
+        for(uint32_t i = 0; i < 400; i++)
+        {
+            testRawFlash_time += 30;
+            message_sensor_timestamped_t message = nativeTest_createMessage(testRawFlash_time, i);
+            if(!memory_addSensorMessage(i % TEST_RAW_FLASH_NUMBER_SENSORS, message))
+            {
+                break;
+            }
+            testRawFlash_expected[i % TEST_RAW_FLASH_NUMBER_SENSORS].push_back(message);
+        }
+        memory_flushSensorHistory(-1);
+        testRawFlash_powerLossRestart();
+
+        // The lost messages are the newest ones: remove them from the expected messages
+        for(uint8_t i = 0; i < TEST_RAW_FLASH_NUMBER_SENSORS; i++)
+        {
+            memory_history_reader_t reader;
+            message_sensor_timestamped_t newestMessage;
+            memory_openHistoryReaderReverse(reader, i, INT32_MAX);
+            bool isMessageFound = memory_readPreviousHistoryMessage(reader, newestMessage);
+            memory_closeHistoryReader(reader);
+            while(isMessageFound && !testRawFlash_expected[i].empty() && !nativeTest_isMessageEqual(testRawFlash_expected[i].back(), newestMessage))
+            {
+                testRawFlash_expected[i].pop_back();
+            }
+        }
+        testRawFlash_checkAll();
+    }
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_testRemove()
+{
+    memory_removeSensorHistory(1);
+    testRawFlash_expected[1].clear();
+    testRawFlash_checkAll();
+    testRawFlash_add(1, 5);
+    memory_end();
+    memory_init();
+    testRawFlash_checkAll();
+
+    memory_removeSensorHistory(-1);
+    for(uint8_t i = 0; i < NUM_SUPPORTED_SENSORS; i++)
+    {
+        testRawFlash_expected[i].clear();
+    }
+    testRawFlash_checkAll();
+    memory_end();
+    memory_init();
+    testRawFlash_checkAll();
+    testRawFlash_add(2, 1);
+    memory_end();
+    memory_init();
+    testRawFlash_checkAll();
+    memory_end();
+}
+
+/*++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+void testRawFlash_run()
+{
+    nativeTest_formatFs();
+    rawFlash_simulatorReset();
+    memory_init();
+
+    testRawFlash_testAppendAndRemount();
+    testRawFlash_testPowerLossInRecord();
+    testRawFlash_testWrapAround();
+    testRawFlash_testPowerLossInSegmentStart();
+    testRawFlash_testRemove();
+}
+
+#endif
@@ -33,6 +33,13 @@ void utils_printMac(const uint8_t* mac)
 
 /**********************************************************************/
 
+// CRC32 (polynomial 0x04C11DB7, MSB first) of all 16 values of the upper 4 bits. The data is processed one nibble at a time, which needs only 64 bytes of RAM for the table.
+static const uint32_t utils_crc32NibbleTable[16] =
+{
+    0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+    0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD
+};
+
 uint32_t utils_calculateCRC32(const uint8_t* data, size_t length)
 {
     uint32_t crc = 0xFFFFFFFF;
@@ -40,18 +47,8 @@ uint32_t utils_calculateCRC32(const uint8_t* data, size_t length)
     while (length--)
     {
         uint8_t c = *data++;
-        for (uint8_t i = 0; i < 8; i++)
-        {
-            bool bit = crc & 0x80000000;
-            if (c & 0x80)
-                bit = !bit;
-
-            crc <<= 1;
-            c <<= 1;
-
-            if (bit)
-                crc ^= 0x04C11DB7;
-        }
+        crc = (crc << 4) ^ utils_crc32NibbleTable[(crc >> 28) ^ (c >> 4)];
+        crc = (crc << 4) ^ utils_crc32NibbleTable[(crc >> 28) ^ (c & 0x0F)];
     }
 
     return crc;